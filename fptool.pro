@@ -7,6 +7,8 @@ INCLUDEPATH += include
 INCLUDEPATH += externals/fplib/src
 
 HEADERS += include/cmdline.h \
+           include/addergraph.h \
+           include/addergraphcache.h \
            include/utils.h \
            include/cppcodegen.h \
            include/csd.h \
@@ -17,6 +19,29 @@ HEADERS += include/cmdline.h \
            include/pass_clean.h \
            include/pass_removeoperands.h \
            include/pass_csdmul.h \
+           include/pass_constfold.h \
+           include/pass_cse.h \
+           include/pass_dce.h \
+           include/pass_range.h \
+           include/pass_precision.h \
+           include/delaymodel.h \
+           include/pass_pipeline.h \
+           include/pass_retime.h \
+           include/pass_carrysave.h \
+           include/pass_reassociate.h \
+           include/pass_negate.h \
+           include/knownbits.h \
+           include/scheduler.h \
+           include/pass_dsp.h \
+           include/costmodel.h \
+           include/pass_wordlength.h \
+           include/pass_peephole.h \
+           include/ssaverifier.h \
+           include/pass_partition.h \
+           include/csdoptimizer.h \
+           include/parallel.h \
+           include/csdexplorer.h \
+           include/ssabatchevaluator.h \
            include/astgraphviz.h \
            include/reader.h \
            include/ssa.h \
@@ -32,6 +57,8 @@ HEADERS += include/cmdline.h \
            externals/fplib/src/fplib.h
 
 SOURCES += src/cmdline.cpp \
+           src/addergraph.cpp \
+           src/addergraphcache.cpp \
            src/utils.cpp \
            src/cppcodegen.cpp \
            src/csd.cpp \
@@ -43,6 +70,29 @@ SOURCES += src/cmdline.cpp \
            src/pass_clean.cpp \
            src/pass_removeoperands.cpp \
            src/pass_csdmul.cpp \
+           src/pass_constfold.cpp \
+           src/pass_cse.cpp \
+           src/pass_dce.cpp \
+           src/pass_range.cpp \
+           src/pass_precision.cpp \
+           src/delaymodel.cpp \
+           src/pass_pipeline.cpp \
+           src/pass_retime.cpp \
+           src/pass_carrysave.cpp \
+           src/pass_reassociate.cpp \
+           src/pass_negate.cpp \
+           src/knownbits.cpp \
+           src/scheduler.cpp \
+           src/pass_dsp.cpp \
+           src/costmodel.cpp \
+           src/pass_wordlength.cpp \
+           src/pass_peephole.cpp \
+           src/ssaverifier.cpp \
+           src/pass_partition.cpp \
+           src/csdoptimizer.cpp \
+           src/parallel.cpp \
+           src/csdexplorer.cpp \
+           src/ssabatchevaluator.cpp \
            src/astgraphviz.cpp \
            src/reader.cpp \
            src/ssa.cpp \
@@ -54,3 +104,5 @@ SOURCES += src/cmdline.cpp \
            src/ssaprint.cpp \
            src/ssaevaluator.cpp \
            externals/fplib/src/fplib.cpp
+
+unix: LIBS += -lpthread
@@ -2,6 +2,7 @@
 # Run FPTool tests
 #
 
+import sys
 from subprocess import call
 
 # create the VHDL file
@@ -18,3 +19,29 @@ with open('csd_test_final.vhdl', 'w') as outfile:
 # ghdl -c csd_test_final.vhdl -r tb --wave=csd_test_final.ghw
 call(["ghdl", "-c", "csd_test_final.vhdl", "-r", "tb", "--wave=csd_test_final.ghw"])
 
+# the options that change the generated VHDL. with "-o", fptool
+# writes a test bench "tb" that applies random inputs and asserts
+# the expected outputs, so a failing assertion fails the run.
+tests = [
+    ("fold",      ["-f", "4"]),
+    ("pipeline",  ["-p", "2"]),
+    ("retime",    ["-p", "2", "-R"]),
+    ("knownbits", []),
+    ("dsp",       ["-D", "25x18:2"]),
+    ("hierarchy", ["-j", "2", "-H", "top"]),
+]
+
+failed = []
+for name, options in tests:
+    vhdl = name + ".vhdl"
+    if call(["../build/debug/fptool", "../tests/" + name + ".fp", "-o", vhdl] + options) != 0:
+        failed.append(name)
+        continue
+
+    # the test bench uses to_string, which needs VHDL-2008
+    if call(["ghdl", "-c", "--std=08", vhdl, "-r", "tb", "--assert-level=error"]) != 0:
+        failed.append(name)
+
+for name in failed:
+    print("FAILED: " + name)
+sys.exit(1 if failed else 0)
@@ -0,0 +1,98 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Shift-and-add graph that multiplies a single
+                input by one or more constants (MCM).
+
+*/
+
+#ifndef addergraph_h
+#define addergraph_h
+
+#include <stdint.h>
+#include <vector>
+#include <string>
+#include <iostream>
+#include "csd.h"
+
+/** A shift-and-add graph that multiplies one input by a set
+    of constants (multiple constant multiplication, MCM).
+
+    Node 0 is the input x. Every other node k is the sum of
+    two signed, shifted terms that refer to earlier nodes:
+
+      node[k] = a.sign * node[a.node] * 2^a.shift
+              + b.sign * node[b.node] * 2^b.shift
+
+    Each output is a single signed, shifted term. Shifts are
+    re-interpretations and cost nothing in hardware, so the
+    number of adders equals the number of nodes, excluding
+    the input.
+*/
+class AdderGraph
+{
+public:
+    struct term_t
+    {
+        int32_t node;   ///< index of the referenced node, 0 is the input
+        int32_t shift;  ///< power-of-two weight of the node
+        int32_t sign;   ///< -1 or +1
+    };
+
+    struct node_t
+    {
+        term_t a;       ///< first term, always positive
+        term_t b;       ///< second term
+    };
+
+    /** find an adder graph that produces all the constants.
+        Digit patterns that occur in more than one constant are
+        computed only once. The remaining terms of each constant
+        are summed by a balanced adder tree. */
+    static AdderGraph create(const std::vector<csd_t> &constants);
+
+    /** build a string that uniquely identifies a set of constants.
+        the graph does not depend on the format of the input,
+        so the format is not part of the key. */
+    static std::string makeKey(const std::vector<csd_t> &constants);
+
+    /** return the order in which a set of constants is passed
+        to create(), so the graph does not depend on the order
+        in which the constants appear in a program. */
+    static std::vector<size_t> canonicalOrder(const std::vector<csd_t> &constants);
+
+    /** return the number of adders/subtractors in the graph */
+    uint32_t adderCount() const
+    {
+        return static_cast<uint32_t>(m_nodes.size());
+    }
+
+    /** return the number of adders on the longest path */
+    uint32_t depth() const;
+
+    /** return the constants the nodes multiply the input by.
+        entry 0 is the input. */
+    std::vector<double> nodeValues() const;
+
+    /** return the adder depths of the nodes.
+        entry 0 is the input. */
+    std::vector<uint32_t> nodeDepths() const;
+
+    /** check that the outputs multiply the input by the
+        constants. returns false if they do not, or if a
+        value has too many bits to be checked exactly. */
+    bool produces(const std::vector<csd_t> &constants) const;
+
+    /** write the graph in a line-based text format */
+    void write(std::ostream &os) const;
+
+    /** read a graph written by write().
+        returns false if the data is malformed. */
+    bool read(std::istream &is);
+
+    std::vector<node_t> m_nodes;    ///< adder nodes, m_nodes[k-1] defines node k
+    std::vector<term_t> m_outputs;  ///< one output term per constant
+};
+
+#endif
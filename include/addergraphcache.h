@@ -0,0 +1,75 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Persistent, content-addressed cache of
+                solved constant multiplier adder graphs.
+
+  Each graph is stored in its own file in the cache
+  directory. The file name is a hash of the key, which
+  describes the quantized constants. The graph does not
+  depend on the format of the input, so graphs are shared
+  between inputs of different formats. The key is also
+  stored inside the file to detect hash collisions.
+
+  A graph read from a file is only used if its outputs
+  are the requested constants, so a stale or corrupted
+  file is replaced instead of producing wrong products.
+  A file is written under a temporary name and renamed,
+  so another process never reads a partly written file.
+
+  The cache may be shared between threads and processes.
+
+*/
+
+#ifndef addergraphcache_h
+#define addergraphcache_h
+
+#include <map>
+#include <mutex>
+#include <string>
+#include "addergraph.h"
+
+class AdderGraphCache
+{
+public:
+    /** create a cache that keeps its files in 'directory'.
+        the directory is created if it does not exist. */
+    explicit AdderGraphCache(const std::string &directory);
+
+    /** get the adder graph for a set of constants. The graph
+        is read from the cache or, on a miss, created and stored. */
+    AdderGraph getGraph(const std::vector<csd_t> &constants);
+
+    /** look up the graph of a set of constants by key.
+        returns false on a cache miss, or if the graph read
+        from the file does not produce the constants. */
+    bool lookup(const std::string &key, const std::vector<csd_t> &constants, AdderGraph &graph);
+
+    /** add a graph to the cache and write it to disk */
+    void store(const std::string &key, const AdderGraph &graph);
+
+    /** return the number of cache hits */
+    uint32_t getHits() const
+    {
+        return m_hits;
+    }
+
+    /** return the number of cache misses */
+    uint32_t getMisses() const
+    {
+        return m_misses;
+    }
+
+protected:
+    /** get the file name of the graph with a certain key */
+    std::string getFilename(const std::string &key) const;
+
+    std::string m_directory;
+    std::map<std::string, AdderGraph> m_graphs;     ///< graphs that have been loaded or stored
+    std::mutex  m_mutex;                            ///< protects the graphs, files and counters
+    uint32_t    m_hits;
+    uint32_t    m_misses;
+};
+
+#endif
@@ -124,7 +124,7 @@ public:
 class CSDDeclaration : public Declaration
 {
 public:
-    CSDDeclaration() {}
+    CSDDeclaration() : m_value(0.0), m_terms(0) {}
 
     /** Accept a visitor by calling visitor->visit(this) */
     virtual void accept(AST::VisitorBase *visitor) override
@@ -132,7 +132,9 @@ public:
         visitor->visit(this);
     }
 
-    csd_t m_csd;
+    csd_t    m_csd;     ///< quantized constant
+    double   m_value;   ///< value before quantization
+    uint32_t m_terms;   ///< number of terms requested by the declaration
 };
 
 
@@ -0,0 +1,132 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Area and timing cost model
+
+  Estimates the resources of each SSA instruction from
+  the widths of its operands:
+
+    LUTs: adders, subtractors and negations use a number
+    of LUTs per bit of the result. A 3:2 compressor uses
+    a number of LUTs per bit for its sum or its carry.
+    A multiplication that is too small for a DSP block,
+    or on a family without them, uses a number of LUTs
+    per partial product bit.
+
+    DSP blocks: a multiplication is split into tiles of
+    the A x B multiplier of the DSP block.
+
+    Flip-flops: a register uses a number of flip-flops
+    per bit. The registers inside a DSP slice are free.
+
+  The critical path is estimated by the MODEL_WIDTH
+  delay model, using the logic and carry chain delays
+  of the family.
+
+  The parameters of an FPGA family are read from a data
+  file with one "name value" pair per line; '%' starts
+  a comment. Parameters that are not in the file keep
+  their default, which resembles a family with 6-input
+  LUTs and 25x18 DSP blocks:
+
+    family                   name used in the report
+    adder_luts_per_bit       1.0
+    compressor_luts_per_bit  1.0
+    mul_luts_per_bit         0.5
+    dsp_a_bits               25     (0: no DSP blocks)
+    dsp_b_bits               18
+    dsp_min_bits             10     smallest input width for a DSP block
+    ffs_per_bit              1.0
+    logic_delay              0.5    ns
+    carry_delay              0.05   ns per bit
+
+*/
+
+#ifndef costmodel_h
+#define costmodel_h
+
+#include <iostream>
+#include <string>
+#include "ssa.h"
+#include "delaymodel.h"
+
+namespace SSA {
+
+class CostModel : public OperationVisitorBase
+{
+public:
+    /** the resources of an instruction or a program */
+    struct cost_t
+    {
+        double luts;
+        double ffs;
+        double dsps;
+    };
+
+    CostModel();
+
+    /** read the parameters of an FPGA family.
+        returns false if the file is invalid. */
+    bool readFamily(std::istream &is);
+
+    /** get the resources of an instruction */
+    cost_t getCost(OperationBase *node);
+
+    /** log the resources and the delay of every
+        instruction that uses resources, followed
+        by the totals and the critical path. */
+    void report(const Program &ssa);
+
+    // supported nodes!
+    virtual bool visit(const OpAssign *node) override { (void)node; return true; }
+    virtual bool visit(const OpMul *node) override;
+    virtual bool visit(const OpCSDMul *node) override;
+    virtual bool visit(const OpAdd *node) override { return setAdderCost(node->m_lhs); }
+    virtual bool visit(const OpSub *node) override { return setAdderCost(node->m_lhs); }
+    virtual bool visit(const OpTruncate *node) override { (void)node; return true; }
+    virtual bool visit(const OpNegate *node) override { return setAdderCost(node->m_lhs); }
+    virtual bool visit(const OpReinterpret *node) override { (void)node; return true; }
+    virtual bool visit(const OpPatchBlock *node) override { (void)node; return false; }
+    virtual bool visit(const OpNull *node) override { (void)node; return true; }
+
+    virtual bool visit(const OpExtendLSBs *node) override { (void)node; return true; }
+    virtual bool visit(const OpExtendMSBs *node) override { (void)node; return true; }
+    virtual bool visit(const OpRemoveLSBs *node) override { (void)node; return true; }
+    virtual bool visit(const OpRemoveMSBs *node) override { (void)node; return true; }
+    virtual bool visit(const OpRegister *node) override;
+    virtual bool visit(const OpCSASum *node) override { return setCompressorCost(node->m_lhs); }
+    virtual bool visit(const OpCSACarry *node) override { return setCompressorCost(node->m_lhs); }
+    virtual bool visit(const OpMulAdd *node) override;
+
+    // unsupported nodes!
+    virtual bool visit(const OperationSingle *node) override { (void)node; return false; }
+    virtual bool visit(const OperationDual *node) override { (void)node; return false; }
+
+protected:
+    /** set the cost of an adder producing 'lhs' */
+    bool setAdderCost(const SharedOpPtr &lhs);
+
+    /** set the cost of one output of a 3:2 compressor */
+    bool setCompressorCost(const SharedOpPtr &lhs);
+
+    /** set the cost of a multiplier of two widths */
+    void setMultiplierCost(int32_t bits1, int32_t bits2);
+
+    std::string m_family;
+    double   m_adderLUTs;       ///< LUTs per bit of an adder
+    double   m_compressorLUTs;  ///< LUTs per bit of a compressor output
+    double   m_mulLUTs;         ///< LUTs per partial product bit
+    int32_t  m_dspABits;        ///< width of the first DSP multiplier input, 0 for none
+    int32_t  m_dspBBits;        ///< width of the second DSP multiplier input
+    int32_t  m_dspMinBits;      ///< narrower multiplications use LUTs
+    double   m_ffs;             ///< flip-flops per register bit
+    double   m_logicDelay;      ///< delay of a logic level, in ns
+    double   m_carryDelay;      ///< delay per bit of a carry chain, in ns
+    DelayModel m_delays;
+    cost_t   m_cost;            ///< cost of the last visited instruction
+};
+
+} // namespace
+
+#endif
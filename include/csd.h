@@ -36,6 +36,18 @@ struct csd_t
     with a determined number of terms */
 bool convertToCSD(const double v, uint32_t terms, csd_t &result);
 
+/** convert an integer into an exact CSD representation.
+    returns false if the value is zero. */
+bool convertIntegerToCSD(const int32_t v, csd_t &result);
+
+/** multiply two CSD constants and store the exact product
+    in canonical form. returns false if the product cannot
+    be represented. */
+bool multiplyCSD(const csd_t &a, const csd_t &b, csd_t &result);
+
+/** negate a CSD constant */
+csd_t negateCSD(const csd_t &csd);
+
 /** convert a CSD representation into a fixed-point data type */
 fplib::SFix convertCSDToSFix(const csd_t &csd);
 
@@ -0,0 +1,87 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Design space explorer for CSD term counts
+
+  Every combination of term counts for the CSD
+  declarations of a design is compiled with the
+  CSD expansion pass and run on a common set of
+  random inputs. The output error is measured
+  against a reference that uses (nearly) exact
+  constants and cannot overflow.
+
+  The combinations that are not dominated in
+  adder count, logic depth and maximum output error
+  form the Pareto front, which is written as CSV
+  or JSON.
+
+*/
+
+#ifndef csdexplorer_h
+#define csdexplorer_h
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <iostream>
+#include "astnode.h"
+#include "ssa.h"
+#include "addergraphcache.h"
+
+class CSDExplorer
+{
+public:
+    /** create an explorer for a parsed design. if 'cache'
+        is not NULL, it is used by the CSD expansion pass. */
+    CSDExplorer(AST::Statements &statements, AdderGraphCache *cache = NULL);
+
+    /** evaluate all combinations of 1 .. maxTerms terms.
+        returns false if the design cannot be compiled. */
+    bool explore(uint32_t maxTerms, uint32_t samples = 1000);
+
+    /** write the Pareto front as comma separated values */
+    void writeCSV(std::ostream &os) const;
+
+    /** write the Pareto front as JSON */
+    void writeJSON(std::ostream &os) const;
+
+protected:
+    struct point_t
+    {
+        point_t() : adders(0), depth(0), maxError(0.0), rmsError(0.0), valid(false) {}
+
+        std::vector<uint32_t> terms;    ///< number of terms of each CSD
+        uint32_t adders;                ///< adders, subtractors and negations
+        uint32_t depth;                 ///< adders on the longest path
+        double   maxError;              ///< largest absolute output error
+        double   rmsError;              ///< RMS output error
+        bool     valid;
+    };
+
+    /** create the SSA program with a number of terms per CSD */
+    bool createProgram(const std::vector<uint32_t> &terms, SSA::Program &ssa) const;
+
+    /** compile and evaluate a design point */
+    void evaluatePoint(point_t &point) const;
+
+    /** count the adders, subtractors and negations */
+    static uint32_t countAdders(const SSA::Program &ssa);
+
+    /** calculate the number of adders on the longest path */
+    static uint32_t calcLogicDepth(const SSA::Program &ssa);
+
+    /** keep only the points that are not dominated */
+    void findParetoFront();
+
+    AST::Statements         *m_statements;
+    AdderGraphCache         *m_cache;
+    std::vector<const AST::CSDDeclaration*> m_csdNodes;
+
+    std::vector< std::vector<double> > m_inputs;        ///< input vectors
+    std::vector< std::vector<double> > m_reference;     ///< reference output vectors
+    std::vector<point_t>    m_points;
+    std::vector<point_t>    m_front;
+};
+
+#endif
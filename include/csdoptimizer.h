@@ -0,0 +1,109 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Coefficient set quantization optimizer
+
+  Finds the number of CSD digits for each coefficient
+  of a set, such as the taps of a filter, so the adder
+  graph that multiplies an input by all coefficients
+  is as small as possible while the quantization error
+  of the whole set stays within a bound.
+
+  Supported error metrics:
+
+    max : the largest absolute coefficient error.
+    l2  : the L2 norm of the coefficient error vector.
+          For an FIR filter this equals the RMS error
+          of the frequency response (Parseval).
+
+*/
+
+#ifndef csdoptimizer_h
+#define csdoptimizer_h
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <iostream>
+#include "csd.h"
+#include "addergraphcache.h"
+
+class CSDOptimizer
+{
+public:
+    enum metric_t
+    {
+        METRIC_MAX,
+        METRIC_L2
+    };
+
+    /** create an optimizer. if 'cache' is not NULL, the
+        adder graphs are looked up in and added to the cache. */
+    explicit CSDOptimizer(AdderGraphCache *cache = NULL);
+
+    /** add a coefficient to the set */
+    void addCoefficient(const std::string &name, double value);
+
+    /** read coefficients from a stream.
+        each line holds a value or a name followed by a value.
+        text after '%' is a comment.
+        returns false if a line cannot be parsed. */
+    bool readCoefficients(std::istream &is);
+
+    /** parse a metric specification such as 'l2:1e-3'.
+        returns false if the specification is invalid. */
+    static bool parseMetric(const std::string &spec, metric_t &metric, double &bound);
+
+    /** search the digit allocation with the lowest adder count
+        that meets the error bound.
+        returns false if the bound cannot be met. */
+    bool optimize(metric_t metric, double bound);
+
+    /** write the optimized coefficients as csd declarations */
+    void writeDeclarations(std::ostream &os) const;
+
+    /** return the number of adders of the optimized set */
+    uint32_t getAdderCount() const
+    {
+        return m_adders;
+    }
+
+    /** return the quantization error of the optimized set */
+    double getError() const
+    {
+        return m_error;
+    }
+
+protected:
+    typedef std::vector<uint32_t> allocation_t;     ///< number of digits per coefficient
+
+    struct coefficient_t
+    {
+        std::string         name;
+        double              value;
+        std::vector<csd_t>  options;    ///< options[k] has k+1 digits at most
+    };
+
+    /** calculate the error of an allocation */
+    double calcError(const allocation_t &alloc) const;
+
+    /** calculate the number of adders needed by an allocation */
+    uint32_t calcAdders(const allocation_t &alloc) const;
+
+    /** get the CSD of coefficient 'idx' for an allocation */
+    const csd_t& getCSD(const allocation_t &alloc, size_t idx) const
+    {
+        return m_coefficients[idx].options[alloc[idx]-1];
+    }
+
+    std::vector<coefficient_t> m_coefficients;
+    AdderGraphCache *m_cache;
+    metric_t        m_metric;
+    double          m_bound;
+    allocation_t    m_best;
+    uint32_t        m_adders;
+    double          m_error;
+};
+
+#endif
@@ -0,0 +1,114 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Combinational delay model
+
+  Estimates the delay of each SSA instruction. Two
+  models are available:
+
+    MODEL_DEPTH counts the operators; each adder,
+    subtractor, negation or multiplier counts as one.
+
+    MODEL_WIDTH estimates the delay in nanoseconds of
+    a ripple-carry implementation from the width of
+    the result, as found in FPGA carry chains.
+
+  A 3:2 compressor has no carry chain; it is a single
+  logic level in MODEL_WIDTH and does not count as an
+  operator in MODEL_DEPTH.
+
+  Wiring-only instructions, such as bit extensions,
+  bit removals, reinterpretations and registers, have
+  no delay in either model.
+
+*/
+
+#ifndef delaymodel_h
+#define delaymodel_h
+
+#include "ssa.h"
+
+namespace SSA {
+
+class DelayModel : public OperationVisitorBase
+{
+public:
+    enum model_t
+    {
+        MODEL_DEPTH,
+        MODEL_WIDTH
+    };
+
+    explicit DelayModel(model_t model = MODEL_DEPTH);
+
+    /** set the delay of a logic level and the delay per
+        bit of a carry chain of MODEL_WIDTH, in ns. */
+    void setTiming(double logicDelay, double carryDelay)
+    {
+        m_logicDelay = logicDelay;
+        m_carryDelay = carryDelay;
+    }
+
+    /** get the delay of an instruction */
+    double getDelay(OperationBase *node);
+
+    /** get the longest combinational path between the
+        inputs, registers and outputs of a program. */
+    double calcCriticalPath(const Program &ssa);
+
+    /** unit of the delays, for reporting */
+    const char* getUnit() const
+    {
+        return (m_model == MODEL_DEPTH) ? "operators" : "ns";
+    }
+
+    model_t getModel() const
+    {
+        return m_model;
+    }
+
+    // supported nodes!
+    virtual bool visit(const OpAssign *node) override { (void)node; m_delay = 0.0; return true; }
+    virtual bool visit(const OpMul *node) override;
+    virtual bool visit(const OpCSDMul *node) override;
+    virtual bool visit(const OpAdd *node) override { return setAdderDelay(node->m_lhs); }
+    virtual bool visit(const OpSub *node) override { return setAdderDelay(node->m_lhs); }
+    virtual bool visit(const OpTruncate *node) override { (void)node; m_delay = 0.0; return true; }
+    virtual bool visit(const OpNegate *node) override { return setAdderDelay(node->m_lhs); }
+    virtual bool visit(const OpReinterpret *node) override { (void)node; m_delay = 0.0; return true; }
+    virtual bool visit(const OpPatchBlock *node) override { (void)node; return false; }
+    virtual bool visit(const OpNull *node) override { (void)node; m_delay = 0.0; return true; }
+
+    virtual bool visit(const OpExtendLSBs *node) override { (void)node; m_delay = 0.0; return true; }
+    virtual bool visit(const OpExtendMSBs *node) override { (void)node; m_delay = 0.0; return true; }
+    virtual bool visit(const OpRemoveLSBs *node) override { (void)node; m_delay = 0.0; return true; }
+    virtual bool visit(const OpRemoveMSBs *node) override { (void)node; m_delay = 0.0; return true; }
+    virtual bool visit(const OpRegister *node) override { (void)node; m_delay = 0.0; return true; }
+    virtual bool visit(const OpCSASum *node) override { (void)node; return setCompressorDelay(); }
+    virtual bool visit(const OpCSACarry *node) override { (void)node; return setCompressorDelay(); }
+    virtual bool visit(const OpMulAdd *node) override;
+
+    // unsupported nodes!
+    virtual bool visit(const OperationSingle *node) override { (void)node; return false; }
+    virtual bool visit(const OperationDual *node) override { (void)node; return false; }
+
+protected:
+    /** set the delay of an adder producing 'lhs' */
+    bool setAdderDelay(const SharedOpPtr &lhs);
+
+    /** set the delay of a 3:2 compressor */
+    bool setCompressorDelay();
+
+    /** delay of a carry chain of a number of bits */
+    double adderDelay(int32_t bits) const;
+
+    model_t m_model;
+    double  m_delay;        ///< delay of the last visited instruction
+    double  m_logicDelay;   ///< delay of a logic level, including routing
+    double  m_carryDelay;   ///< delay per bit of a carry chain
+};
+
+} // namespace
+
+#endif
@@ -0,0 +1,109 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Known-bits analysis
+
+  Determines which bits of each operand are known
+  without evaluating the program:
+
+    Zero LSBs: the LSBs appended by an LSB extension,
+    or created by the reinterpretation of a shifted
+    CSD partial product, are always zero.
+
+    Sign bits: the MSBs appended by an MSB extension
+    are copies of the sign bit. An addition of two
+    operands with redundant sign bits has one less.
+
+  The value of each operand is tracked as the Q(n,m)
+  format it is known to fit in, which can be narrower
+  than the format of the operand. The code generator
+  uses this to pass known-zero LSBs straight through
+  an adder and to build the carry chain over the
+  overlapping bit range only.
+
+*/
+
+#ifndef knownbits_h
+#define knownbits_h
+
+#include <map>
+#include "ssa.h"
+
+namespace SSA {
+
+class KnownBits : public OperationVisitorBase
+{
+public:
+    KnownBits()
+    {
+    }
+
+    /** analyse all instructions of a program */
+    void analyse(const Program &ssa);
+
+    /** get the number of LSBs of an operand that are known to be zero */
+    int32_t getZeroLSBs(const SharedOpPtr &op) const;
+
+    /** get the number of MSBs of an operand that are known to be
+        copies of the sign bit, not counting the sign bit itself. */
+    int32_t getSignBits(const SharedOpPtr &op) const;
+
+    // supported nodes!
+    virtual bool visit(const OpAssign *node) override { return copyBits(node); }
+    virtual bool visit(const OpMul *node) override;
+    virtual bool visit(const OpCSDMul *node) override { return setUnknown(node->m_lhs); }
+    virtual bool visit(const OpAdd *node) override { return setAddSubBits(node); }
+    virtual bool visit(const OpSub *node) override { return setAddSubBits(node); }
+    virtual bool visit(const OpTruncate *node) override { return copyBits(node); }
+    virtual bool visit(const OpNegate *node) override;
+    virtual bool visit(const OpReinterpret *node) override;
+    virtual bool visit(const OpPatchBlock *node) override { (void)node; return false; }
+    virtual bool visit(const OpNull *node) override { (void)node; return true; }
+
+    virtual bool visit(const OpExtendLSBs *node) override { return copyBits(node); }
+    virtual bool visit(const OpExtendMSBs *node) override { return copyBits(node); }
+    virtual bool visit(const OpRemoveLSBs *node) override { return copyBits(node); }
+    virtual bool visit(const OpRemoveMSBs *node) override { return copyBits(node); }
+    virtual bool visit(const OpRegister *node) override { return copyBits(node); }
+    virtual bool visit(const OpCSASum *node) override { return setUnknown(node->m_lhs); }
+    virtual bool visit(const OpCSACarry *node) override { return setUnknown(node->m_lhs); }
+    virtual bool visit(const OpMulAdd *node) override { return setUnknown(node->m_lhs); }
+
+    // unsupported nodes!
+    virtual bool visit(const OperationSingle *node) override { (void)node; return false; }
+    virtual bool visit(const OperationDual *node) override { (void)node; return false; }
+
+protected:
+    /** the Q(n,m) format that the value of an operand fits in */
+    struct bits_t
+    {
+        int32_t intBits;
+        int32_t fracBits;
+    };
+
+    /** get the format the value of an operand fits in;
+        inputs can take any value of their format. */
+    bits_t getBits(const SharedOpPtr &op) const;
+
+    /** set the format the value of an instruction result fits
+        in. values that do not fit the format of the result
+        wrap around, so they can take any value. */
+    bool setBits(const SharedOpPtr &lhs, int32_t intBits, int32_t fracBits);
+
+    /** the result has the same value as the input, reduced
+        to the format of the result. */
+    bool copyBits(const OperationSingle *node);
+
+    /** the result can take any value of its format */
+    bool setUnknown(const SharedOpPtr &lhs);
+
+    /** set the bits of an addition or subtraction */
+    bool setAddSubBits(const OperationDual *node);
+
+    std::map<const OperandBase*, bits_t> m_bits;
+};
+
+} // namespace
+
+#endif
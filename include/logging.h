@@ -18,6 +18,10 @@ typedef enum {LOG_INFO = 1, LOG_DEBUG = 2, LOG_WARN = 4, LOG_ERROR = 8} logtype_
 /** enable the debug output */
 void setDebugging(bool enabled = true);
 
+/** suppress info, debug and warning messages,
+    for instance while exploring many design variants */
+void setQuiet(bool quiet = true);
+
 /** set log filename to log to a file.
     returns true if successful. */
 bool setLogFile(const char *filename);
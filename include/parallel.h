@@ -0,0 +1,27 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Simple parallel loop helper
+
+*/
+
+#ifndef parallel_h
+#define parallel_h
+
+#include <stdint.h>
+#include <functional>
+
+/** return the number of worker threads used by parallelFor */
+uint32_t getWorkerCount();
+
+/** set the number of worker threads used by parallelFor.
+    zero selects the number of hardware threads. */
+void setWorkerCount(uint32_t workers);
+
+/** call func(i) for i = 0 .. count-1 using several threads.
+    the calls are independent and may run in any order, so
+    func must only write to data owned by index i. */
+void parallelFor(size_t count, const std::function<void(size_t)> &func);
+
+#endif
@@ -44,10 +44,14 @@ public:
     virtual bool visit(const OpExtendMSBs *node) override { (void)node; return true; }
     virtual bool visit(const OpRemoveLSBs *node) override { (void)node; return true; }
     virtual bool visit(const OpRemoveMSBs *node) override { (void)node; return true; }
+    virtual bool visit(const OpRegister *node) override { (void)node; return true; }
 
     // unsupported nodes!
     virtual bool visit(const OperationSingle *node) override { (void)node; return false; }
     virtual bool visit(const OperationDual *node) override { (void)node; return false; }
+    virtual bool visit(const OpCSASum *node) override { (void)node; return false; }
+    virtual bool visit(const OpCSACarry *node) override { (void)node; return false; }
+    virtual bool visit(const OpMulAdd *node) override { (void)node; return false; }
 
 protected:
     explicit PassAddSub(Program &ssa) : m_ssa(&ssa)
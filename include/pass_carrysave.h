@@ -0,0 +1,95 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Carry-save lowering SSA pass
+
+  Trees of additions and subtractions, such as the ones
+  created by CSD expansion, are collected into a list
+  of terms. The terms are reduced to two by a tree of
+  3:2 compressors (carry-save adders), which have no
+  carry chain, followed by a single carry-propagate
+  adder.
+
+  A subtracted term is inverted and a one is added to
+  the LSB of a compressor carry output, as -x = ~x + 1.
+  Each compressor has one free carry input and the
+  final adder adds one more by subtracting an inverted
+  sum, so all terms but one can be subtracted. Trees
+  that subtract all terms are not lowered.
+
+  All terms are converted to the format of the result
+  of the tree. This is exact because two's complement
+  addition is modular. An intermediate result that has
+  fewer integer bits than the result of the tree is only
+  merged into the tree when it cannot wrap around.
+
+  Run this pass after the AddSub and RemoveOperands
+  passes, followed by the RemoveOperands pass.
+
+*/
+
+#ifndef pass_carrysave_h
+#define pass_carrysave_h
+
+#include <map>
+#include <set>
+#include <vector>
+#include "ssa.h"
+
+namespace SSA {
+
+class PassCarrySave
+{
+public:
+    /** Replace trees of three or more additions and
+        subtractions by compressor trees.
+    */
+    static bool execute(Program &ssa);
+
+protected:
+    /* hide constructor so use can't call it directly */
+    explicit PassCarrySave(Program &ssa) : m_ssa(&ssa), m_adders(0), m_compressors(0)
+    {
+    }
+
+    /** a term of a sum */
+    struct term_t
+    {
+        SharedOpPtr op;
+        bool        negative;
+    };
+
+    /** closed interval of values */
+    struct range_t
+    {
+        double minValue;
+        double maxValue;
+    };
+
+    /** collect the terms of a tree of additions and
+        subtractions that produces 'op'. the instructions
+        that are merged into the tree are added to 'merged'.
+        returns the range of the sum of the terms, which
+        is the range of -op if 'negative' is set. */
+    range_t collectTerms(const SharedOpPtr &op, bool negative, const SharedOpPtr &root,
+                         std::vector<term_t> &terms, std::vector<OperationBase*> &merged);
+
+    /** convert a term to the format of the result of a tree */
+    SharedOpPtr alignTerm(const SharedOpPtr &op, const SharedOpPtr &root, OpPatchBlock *patch);
+
+    /** build the compressor tree for the terms of the
+        instruction 'node'. returns NULL if the tree
+        cannot be lowered. */
+    OpPatchBlock* lowerTree(const OperationDual *node, const std::vector<term_t> &terms);
+
+    Program *m_ssa;
+    std::map<const OperandBase*, OperationBase*> m_definitions;    ///< instruction that produces each operand
+    std::map<const OperandBase*, uint32_t>       m_uses;           ///< number of uses of each operand
+    uint32_t m_adders;          ///< number of removed carry-propagate adders
+    uint32_t m_compressors;     ///< number of inserted 3:2 compressors
+};
+
+} // namespace
+
+#endif
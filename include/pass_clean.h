@@ -4,8 +4,12 @@
 
   Description:  Clean the SSA list
 
-  1) remove re-interpret nodes
-  2) remove superluous assignment nodes
+  1) remove superluous assignment nodes
+  2) optionally, replace re-interpret nodes by views
+     of their operand, which need no instruction or
+     variable. Only the evaluator and the code
+     generators know views, so this is done just
+     before them.
 
   Author: Niels A. Moseley
 
@@ -15,6 +19,7 @@
 #ifndef clean_h
 #define clean_h
 
+#include <set>
 #include "ssa.h"
 
 namespace SSA {
@@ -22,9 +27,10 @@ namespace SSA {
 class PassClean : public OperationVisitorBase
 {
 public:
-    /** Remove superfluous assignment nodes.
+    /** Remove superfluous assignment nodes, and replace
+        re-interpret nodes by views if createViews is set.
     */
-    static bool execute(Program &ssa);
+    static bool execute(Program &ssa, bool createViews = false);
 
     // supported nodes!
     virtual bool visit(const OpAssign *node) override;
@@ -42,6 +48,10 @@ public:
     virtual bool visit(const OpExtendMSBs *node) override { (void)node; return true; }
     virtual bool visit(const OpRemoveLSBs *node) override { (void)node; return true; }
     virtual bool visit(const OpRemoveMSBs *node) override { (void)node; return true; }
+    virtual bool visit(const OpRegister *node) override { (void)node; return true; }
+    virtual bool visit(const OpCSASum *node) override { (void)node; return true; }
+    virtual bool visit(const OpCSACarry *node) override { (void)node; return true; }
+    virtual bool visit(const OpMulAdd *node) override { (void)node; return true; }
 
     // unsupported nodes!
     virtual bool visit(const OperationSingle *node) override { (void)node; return false; }
@@ -49,11 +59,13 @@ public:
 
 protected:
     /* hide constructor so use can't call it directly */
-    explicit PassClean(Program &ssa) : m_ssa(&ssa)
+    PassClean(Program &ssa, bool createViews)
+        : m_ssa(&ssa), m_createViews(createViews), m_views(0)
     {
     }
 
-    /** substitute op1 with op2 in SSA list
+    /** substitute op1 with op2 in SSA list,
+        and remember the instructions that use it.
     */
     void substituteOperands(const SharedOpPtr &op1, SharedOpPtr op2);
 
@@ -61,6 +73,9 @@ protected:
     void replaceWithNull(const OperationBase *node);
 
     Program *m_ssa;
+    bool     m_createViews;     ///< replace re-interpret nodes by views
+    uint32_t m_views;           ///< number of re-interpret nodes replaced
+    std::set<const OperationBase*> m_modified;  ///< instructions with substituted operands
 };
 
 } // namespace
@@ -0,0 +1,128 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Constant folding SSA pass
+
+  Products that only involve constants are computed
+  at compile time:
+
+  1) CSD * CSD and CSD * integer become a new CSD.
+  2) -CSD becomes a new CSD with inverted digits.
+  3) c2 * (c1 * x) becomes (c2*c1) * x when the
+     intermediate c1 * x is not used elsewhere.
+  4) a generic multiplication with a constant that
+     appeared by folding becomes a CSD multiplication.
+
+  A product of constants that does not fit the CSD
+  mantissa is kept as a list of factors, which are
+  applied as a chain of CSD multiplications.
+
+  A product that reduces to a single positive digit
+  is later expanded into a reinterpret, so no adders
+  are generated for it.
+
+*/
+
+#ifndef constfold_h
+#define constfold_h
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "ssa.h"
+
+namespace SSA {
+
+class PassConstFold : public OperationVisitorBase
+{
+public:
+    /** Fold constant products.
+    */
+    static bool execute(Program &ssa);
+
+    // supported nodes!
+    virtual bool visit(const OpMul *node) override;
+    virtual bool visit(const OpCSDMul *node) override;
+    virtual bool visit(const OpNegate *node) override;
+    virtual bool visit(const OpAssign *node) override { return checkNotConstant(node->m_op); }
+    virtual bool visit(const OpAdd *node) override { return checkNotConstant(node->m_op1) && checkNotConstant(node->m_op2); }
+    virtual bool visit(const OpSub *node) override { return checkNotConstant(node->m_op1) && checkNotConstant(node->m_op2); }
+    virtual bool visit(const OpTruncate *node) override { return checkNotConstant(node->m_op); }
+    virtual bool visit(const OpReinterpret *node) override { return checkNotConstant(node->m_op); }
+    virtual bool visit(const OpPatchBlock *node) override { (void)node; return true; }
+    virtual bool visit(const OpNull *node) override { (void)node; return true; }
+
+    virtual bool visit(const OpExtendLSBs *node) override { return checkNotConstant(node->m_op); }
+    virtual bool visit(const OpExtendMSBs *node) override { return checkNotConstant(node->m_op); }
+    virtual bool visit(const OpRemoveLSBs *node) override { return checkNotConstant(node->m_op); }
+    virtual bool visit(const OpRemoveMSBs *node) override { return checkNotConstant(node->m_op); }
+    virtual bool visit(const OpRegister *node) override { return checkNotConstant(node->m_op); }
+
+    // unsupported nodes!
+    virtual bool visit(const OperationSingle *node) override { (void)node; return false; }
+    virtual bool visit(const OperationDual *node) override { (void)node; return false; }
+    virtual bool visit(const OpCSASum *node) override { (void)node; return false; }
+    virtual bool visit(const OpCSACarry *node) override { (void)node; return false; }
+    virtual bool visit(const OpMulAdd *node) override { (void)node; return false; }
+
+protected:
+    /* hide constructor so use can't call it directly */
+    explicit PassConstFold(Program &ssa) : m_ssa(&ssa)
+    {
+    }
+
+    /** count how often each operand is used as an input */
+    void countUses();
+
+    /** a constant factor of a product that cannot be folded */
+    struct factor_t
+    {
+        csd_t       csd;
+        std::string name;
+    };
+
+    typedef std::vector<factor_t> factors_t;
+
+    /** emit an error if a constant is used by an operation
+        that cannot be folded */
+    bool checkNotConstant(const SharedOpPtr &op) const;
+
+    /** get the constant factors of an operand.
+        returns false if the operand is not a constant */
+    bool getFactors(const SharedOpPtr &op, factors_t &factors) const;
+
+    /** replace the product of two constants by a new
+        constant, or by a list of factors if the product
+        does not fit into a CSD */
+    void foldFactors(const OperationBase *node, const SharedOpPtr &result,
+                     const factors_t &factors1, const factors_t &factors2);
+
+    /** replace a node by a chain of CSD multiplications
+        of the variable with the factors */
+    void expandFactors(const OperationBase *node, const SharedOpPtr &variable,
+                       const factors_t &factors, const SharedOpPtr &result);
+
+    /** replace all uses of 'result' by a new constant */
+    void replaceWithConstant(const OperationBase *node, const SharedOpPtr &result,
+                             const csd_t &csd, const std::string &name);
+
+    /** substitute op1 with op2 in SSA list
+    */
+    void substituteOperands(const SharedOpPtr &op1, SharedOpPtr op2);
+
+    /** replace a node in the program by another one
+        and delete the original node */
+    void replaceNode(const OperationBase *node, OperationBase *newNode);
+
+    Program *m_ssa;
+    std::map<const OperandBase*, uint32_t>          m_uses;     ///< number of uses of each operand
+    std::map<const OperandBase*, const OpCSDMul*>   m_csdMuls;  ///< CSD multiplications by result operand
+    std::set<const OperationBase*>                  m_modified; ///< new instructions and instructions with substituted operands
+    std::map<const OperandBase*, factors_t>         m_factors;  ///< constant products that do not fit into a CSD
+};
+
+} // namespace
+
+#endif
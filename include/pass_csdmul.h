@@ -8,6 +8,10 @@
   expanded by introducting an addition or
   subtraction of shifted inputs for each digit.
 
+  All constants that multiply the same input are
+  expanded together as one adder graph, so digit
+  patterns they have in common are computed once.
+
   Author: Niels A. Moseley
 
 */
@@ -15,16 +19,20 @@
 #ifndef csdmul_h
 #define csdmul_h
 
+#include <map>
 #include <vector>
 #include "ssa.h"
+#include "addergraphcache.h"
 
 namespace SSA {
 
 class PassCSDMul : public OperationVisitorBase
 {
 public:
-    /** replace all CSD multiplications by shift-and-add instructions */
-    static bool execute(Program &ssa);
+    /** replace all CSD multiplications by shift-and-add instructions.
+        when a cache is supplied, the adder graphs are taken from
+        the cache instead of being searched for. */
+    static bool execute(Program &ssa, AdderGraphCache *cache = NULL);
 
     // supported nodes!
     virtual bool visit(const OpAssign *node) override { (void)node; return true; }
@@ -42,33 +50,50 @@ public:
     virtual bool visit(const OpExtendMSBs *node) override { (void)node; return true; }
     virtual bool visit(const OpRemoveLSBs *node) override { (void)node; return true; }
     virtual bool visit(const OpRemoveMSBs *node) override { (void)node; return true; }
+    virtual bool visit(const OpRegister *node) override { (void)node; return true; }
 
     // unsupported nodes!
     virtual bool visit(const OperationSingle *node) override { (void)node; return false; }
     virtual bool visit(const OperationDual *node) override { (void)node; return false; }
+    virtual bool visit(const OpCSASum *node) override { (void)node; return false; }
+    virtual bool visit(const OpCSACarry *node) override { (void)node; return false; }
+    virtual bool visit(const OpMulAdd *node) override { (void)node; return false; }
 
 protected:
-    explicit PassCSDMul(Program &ssa) : m_ssa(&ssa)
+    PassCSDMul(Program &ssa, AdderGraphCache *cache) : m_ssa(&ssa), m_cache(cache)
     {
     }
 
-    /** expand CSD multiplication: produce instructions and operands
-        that replace the original y := c*x instruction.
+    /** expand CSD multiplications: produce instructions and operands
+        that replace the original y_i := c_i*x instructions, which
+        all share the same input operand x.
 
-        @param[in] csd the constant expressed in canonical signed digit representation.
-        @param[in] input pointer to the input operand.
-        @param[in] output pointer to the output operand.
+        @param[in] nodes the CSD multiplication instructions.
         @param[out] patch a patch block that will receive the replacement instructions.
         @param[out] operands a list of additional operands used by the new instructions.
     */
-    void expandCSD(const csd_t &csd, const SharedOpPtr &input, const SharedOpPtr &output,
+    void expandCSD(const std::vector<const OpCSDMul*> &nodes,
                    SSA::OpPatchBlock *patch,
                    std::list<SharedOpPtr> &operands);
 
+    /** return a re-interpreted version of an operand that is multiplied
+        by 2^shift. Re-interpretations are shared within a patch. */
+    SharedOpPtr shiftOperand(const SharedOpPtr &op, int32_t shift,
+                             SSA::OpPatchBlock *patch,
+                             std::list<SharedOpPtr> &operands);
+
     /** replace the node in the program with a patch block */
     void patchNode(const OperationBase *node, SSA::OpPatchBlock *patch);
 
     Program *m_ssa;
+    AdderGraphCache *m_cache;
+
+    /** CSD multiplications grouped by input operand, in program order */
+    std::vector< std::vector<const OpCSDMul*> > m_groups;
+    std::map<const OperandBase*, size_t>        m_groupIndex;
+
+    /** shared re-interpretations of the current patch */
+    std::map<std::pair<const OperandBase*, int32_t>, SharedOpPtr> m_shifted;
 };
 
 } // namespace
@@ -0,0 +1,89 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Common subexpression elimination SSA pass
+
+  Every instruction is hash-consed by its opcode,
+  operands and width parameters. When an identical
+  instruction was seen before, the users of the new
+  result are rewired to the earlier result and the
+  instruction is removed.
+
+  Assignments are never merged as they define
+  outputs or are removed by the clean pass.
+
+*/
+
+#ifndef cse_h
+#define cse_h
+
+#include <map>
+#include <string>
+#include "ssa.h"
+
+namespace SSA {
+
+class PassCSE : public OperationVisitorBase
+{
+public:
+    /** Remove duplicate instructions.
+    */
+    static bool execute(Program &ssa);
+
+    // supported nodes!
+    virtual bool visit(const OpAssign *node) override { (void)node; return true; }
+    virtual bool visit(const OpMul *node) override;
+    virtual bool visit(const OpCSDMul *node) override;
+    virtual bool visit(const OpAdd *node) override;
+    virtual bool visit(const OpSub *node) override;
+    virtual bool visit(const OpTruncate *node) override;
+    virtual bool visit(const OpNegate *node) override;
+    virtual bool visit(const OpReinterpret *node) override;
+    virtual bool visit(const OpPatchBlock *node) override { (void)node; return true; }
+    virtual bool visit(const OpNull *node) override { (void)node; return true; }
+
+    virtual bool visit(const OpExtendLSBs *node) override;
+    virtual bool visit(const OpExtendMSBs *node) override;
+    virtual bool visit(const OpRemoveLSBs *node) override;
+    virtual bool visit(const OpRemoveMSBs *node) override;
+    virtual bool visit(const OpRegister *node) override;
+
+    // unsupported nodes!
+    virtual bool visit(const OperationSingle *node) override { (void)node; return false; }
+    virtual bool visit(const OperationDual *node) override { (void)node; return false; }
+    virtual bool visit(const OpCSASum *node) override { (void)node; return false; }
+    virtual bool visit(const OpCSACarry *node) override { (void)node; return false; }
+    virtual bool visit(const OpMulAdd *node) override { (void)node; return false; }
+
+protected:
+    /* hide constructor so use can't call it directly */
+    explicit PassCSE(Program &ssa) : m_ssa(&ssa), m_removed(0)
+    {
+    }
+
+    /** look up the instruction by its key. if an identical
+        one exists, rewire the users and remove the node. */
+    void hashCons(const OperationBase *node, const SharedOpPtr &lhs, const std::string &key);
+
+    /** make a key for a single operand instruction */
+    std::string makeKey(const char *opcode, const OperationSingle *node,
+                        int32_t param1 = 0, int32_t param2 = 0) const;
+
+    /** make a key for a dual operand instruction.
+        the operands of a commutative instruction are ordered. */
+    std::string makeKey(const char *opcode, const OperationDual *node,
+                        bool commutative, int32_t param = 0) const;
+
+    /** substitute op1 with op2 in SSA list
+    */
+    void substituteOperands(const SharedOpPtr &op1, SharedOpPtr op2);
+
+    Program *m_ssa;
+    std::map<std::string, SharedOpPtr> m_results;   ///< result operand of each unique instruction
+    uint32_t m_removed;
+};
+
+} // namespace
+
+#endif
@@ -0,0 +1,77 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Dead instruction elimination SSA pass
+
+  The statements are visited from the last to the
+  first. An instruction is live when its result is
+  an output or is used by a live instruction. All
+  other instructions are removed. Run the
+  RemoveOperands pass afterwards to remove the
+  operands that are no longer referenced.
+
+*/
+
+#ifndef dce_h
+#define dce_h
+
+#include <set>
+#include "ssa.h"
+
+namespace SSA {
+
+class PassDCE : public OperationVisitorBase
+{
+public:
+    /** Remove instructions whose results do not reach an output.
+    */
+    static bool execute(Program &ssa);
+
+    // supported nodes!
+    virtual bool visit(const OpAssign *node) override { return markLive(node); }
+    virtual bool visit(const OpMul *node) override { return markLive(node); }
+    virtual bool visit(const OpCSDMul *node) override { return markLive(node); }
+    virtual bool visit(const OpAdd *node) override { return markLive(node); }
+    virtual bool visit(const OpSub *node) override { return markLive(node); }
+    virtual bool visit(const OpTruncate *node) override { return markLive(node); }
+    virtual bool visit(const OpNegate *node) override { return markLive(node); }
+    virtual bool visit(const OpReinterpret *node) override { return markLive(node); }
+    virtual bool visit(const OpPatchBlock *node) override { (void)node; return false; }
+    virtual bool visit(const OpNull *node) override { (void)node; return true; }
+
+    virtual bool visit(const OpExtendLSBs *node) override { return markLive(node); }
+    virtual bool visit(const OpExtendMSBs *node) override { return markLive(node); }
+    virtual bool visit(const OpRemoveLSBs *node) override { return markLive(node); }
+    virtual bool visit(const OpRemoveMSBs *node) override { return markLive(node); }
+    virtual bool visit(const OpRegister *node) override { return markLive(node); }
+
+    // unsupported nodes!
+    virtual bool visit(const OperationSingle *node) override { (void)node; return false; }
+    virtual bool visit(const OperationDual *node) override { (void)node; return false; }
+    virtual bool visit(const OpCSASum *node) override { (void)node; return false; }
+    virtual bool visit(const OpCSACarry *node) override { (void)node; return false; }
+    virtual bool visit(const OpMulAdd *node) override { (void)node; return false; }
+
+protected:
+    /* hide constructor so use can't call it directly */
+    explicit PassDCE(Program &ssa) : m_ssa(&ssa), m_dead(NULL)
+    {
+    }
+
+    /** check if an operand is needed by a live instruction or is an output */
+    bool isLive(const SharedOpPtr &op) const;
+
+    /** mark the operands of a live instruction as live,
+        or flag the instruction as dead */
+    bool markLive(const OperationSingle *node);
+    bool markLive(const OperationDual *node);
+
+    Program *m_ssa;
+    std::set<const OperandBase*> m_live;    ///< operands needed by live instructions
+    const OperationBase *m_dead;            ///< set when the visited instruction is dead
+};
+
+} // namespace
+
+#endif
@@ -0,0 +1,119 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  DSP slice mapping SSA pass
+
+  The DSP slices of FPGAs have a pre-adder in front of
+  the multiplier and a post-adder behind it. This pass
+  fuses the additions around a multiplication into an
+  OpMulAdd, so they map onto one slice:
+
+    (a+d)*b, (a-d)*b        pre-adder
+    x*b+c, x*b-c, c-x*b     post-adder
+
+  An addition or subtraction is only fused when its
+  result has no other use. The product may be extended
+  to the format of the post-adder first.
+
+  The widths of the multiplier inputs and the post-
+  adder are checked against the slice, for instance
+  25x18 and 48 bits. Multiplications that do not fit
+  are left alone, as are multiplications without an
+  adder to fuse.
+
+  The slice has up to three internal pipeline registers:
+  after the post-adder, the multiplier and the pre-adder,
+  which are used in that order. The operands that are
+  needed later, such as c, and the operands on paths
+  without slices are delayed with registers, so that
+  all paths and outputs have the same latency.
+
+  Run this pass after all other passes, as they do
+  not know how to handle these instructions.
+
+*/
+
+#ifndef pass_dsp_h
+#define pass_dsp_h
+
+#include <map>
+#include <vector>
+#include "ssa.h"
+
+namespace SSA {
+
+class PassDSP
+{
+public:
+    /** the widths and pipeline registers of a DSP slice */
+    struct dsp_t
+    {
+        uint32_t aBits;     ///< width of the first multiplier input
+        uint32_t bBits;     ///< width of the second multiplier input
+        uint32_t pBits;     ///< width of the post-adder
+        uint32_t stages;    ///< number of pipeline registers to use
+    };
+
+    /** parse a slice description AxB[xP][:stages],
+        for instance 25x18x48:2. returns false if the
+        description is invalid. */
+    static bool parse(const std::string &str, dsp_t &dsp);
+
+    /** Map multiplications and the additions around them
+        onto DSP slices.
+    */
+    static bool execute(Program &ssa, const dsp_t &dsp);
+
+protected:
+    /* hide constructor so use can't call it directly */
+    PassDSP(Program &ssa, const dsp_t &dsp) : m_ssa(&ssa), m_dsp(dsp), m_mapped(0), m_registers(0)
+    {
+    }
+
+    /** determine the definition and users of every operand */
+    void analyse();
+
+    /** check if an intermediate result has a single user.
+        returns the user or NULL. */
+    OperationBase* getSingleUser(const SharedOpPtr &op) const;
+
+    /** get the addition or subtraction that produces an
+        intermediate result used only by 'user', or NULL. */
+    OperationDual* getAdder(const SharedOpPtr &op, const OperationBase *user) const;
+
+    /** try to fuse a multiplication with its adders.
+        returns true if the program was changed. */
+    bool map(OpMul *mul);
+
+    /** set the number of pipeline registers of the
+        slices and delay the other operands. */
+    void balance();
+
+    /** get the clock cycle in which an operand is available */
+    uint32_t getCycle(const SharedOpPtr &op) const;
+
+    /** get an operand delayed to a later clock cycle, adding
+        the registers to 'statements' when needed. */
+    SharedOpPtr getDelayed(const SharedOpPtr &op, uint32_t cycle,
+                           std::list<OperationBase*> &statements);
+
+    static uint32_t getWidth(const SharedOpPtr &op)
+    {
+        return static_cast<uint32_t>(op->m_intBits + op->m_fracBits);
+    }
+
+    Program *m_ssa;
+    dsp_t    m_dsp;
+    std::map<const OperandBase*, OperationBase*> m_definitions;    ///< instruction that produces each operand
+    std::map<const OperandBase*, std::vector<OperationBase*> > m_users;     ///< instructions that use each operand
+    std::map<OperationBase*, OperationBase*> m_replacements;
+    std::map<const OperandBase*, uint32_t> m_cycles;
+    std::map<std::pair<const OperandBase*, uint32_t>, SharedOpPtr> m_delayed;
+    uint32_t m_mapped;      ///< number of mapped multiplications
+    uint32_t m_registers;   ///< number of inserted registers
+};
+
+} // namespace
+
+#endif
@@ -0,0 +1,100 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Negation absorption SSA pass
+
+  A negation costs a full-width adder. This peephole
+  pass removes negations that are only used once:
+
+  1) -(-x) becomes x.
+  2) -(c*x) becomes (-c)*x and c*(-x) becomes (-c)*x.
+  3) y+(-x) and (-x)+y become y-x, y-(-x) becomes y+x
+     and (-x)-(-z) becomes z-x.
+  4) a negation is moved past a format change, such as
+     the assignment or MSB removal that follows the
+     negated output of a CSD multiplication, so that
+     it reaches the addition that uses it.
+
+  A negation of the most negative value wraps around.
+  Rewrites 2) to 4) are only done when this cannot
+  happen, which is checked with the value range of
+  the negated operand, or when the result wraps around
+  at the same bit position anyway. The program stays
+  bit-exact.
+
+  The pass repeats until no more negations are removed.
+
+*/
+
+#ifndef pass_negate_h
+#define pass_negate_h
+
+#include <map>
+#include <set>
+#include "ssa.h"
+
+namespace SSA {
+
+class PassNegate
+{
+public:
+    /** Absorb negations into adders, subtractors and
+        constant products.
+    */
+    static bool execute(Program &ssa);
+
+protected:
+    /* hide constructor so use can't call it directly */
+    explicit PassNegate(Program &ssa) : m_ssa(&ssa), m_removed(0)
+    {
+    }
+
+    /** closed interval of values an operand can take */
+    struct range_t
+    {
+        double minValue;
+        double maxValue;
+    };
+
+    /** determine the definition, users and value range
+        of every operand. */
+    void analyse();
+
+    /** get the range of an operand */
+    range_t getRange(const SharedOpPtr &op) const;
+
+    /** check if an operand can hold the most negative
+        value of its format, i.e. negating it can wrap. */
+    bool canWrap(const SharedOpPtr &op) const;
+
+    /** check if an intermediate result has a single user.
+        returns the user or NULL. */
+    OperationBase* getSingleUser(const SharedOpPtr &op) const;
+
+    /** try to remove a negation. returns true if the
+        program was changed. */
+    bool absorb(OpNegate *negate);
+
+    /** replace 'node' by the statements in 'patch' */
+    void replace(OperationBase *node, OpPatchBlock *patch);
+
+    /** replace 'node' by a null operation */
+    void remove(OperationBase *node);
+
+    /** add a constant product of 'op' and 'csd' that writes
+        to 'lhs', keeping the Q(n,m) format of 'lhs'. */
+    void addCSDMul(OpPatchBlock *patch, const SharedOpPtr &op, const csd_t &csd,
+                   const std::string &csdName, const SharedOpPtr &lhs);
+
+    Program *m_ssa;
+    std::map<const OperandBase*, OperationBase*> m_definitions;    ///< instruction that produces each operand
+    std::map<const OperandBase*, std::vector<OperationBase*> > m_users;     ///< instructions that use each operand
+    std::map<const OperandBase*, range_t> m_ranges;     ///< value ranges that are tighter than the format
+    std::map<OperationBase*, OperationBase*> m_replacements;
+    uint32_t m_removed;     ///< number of removed negations
+};
+
+} // namespace
+
+#endif
@@ -0,0 +1,88 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Partition the program into output cones
+                and optimize them concurrently
+
+  The cone of an output holds the instructions its value
+  depends on. Cones that share an instruction are put in
+  the same cluster, so the clusters only have the inputs
+  in common and can be optimized independently, each as
+  a program of its own, by the worker threads. Cones
+  that multiply the same operand by a constant are put
+  in the same cluster too, so the CSD pass can share the
+  partial products.
+
+  The clusters are ordered by their first instruction,
+  and merged back in that order. The intermediate
+  operands are then renamed in program order, so the
+  result does not depend on the order in which the
+  threads created them.
+
+  Instructions that do not reach an output are removed.
+
+*/
+
+#ifndef pass_partition_h
+#define pass_partition_h
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include "ssa.h"
+
+namespace SSA {
+
+class PassPartition
+{
+public:
+    /** Split the program into clusters of output cones,
+        run the passes on each cluster concurrently and
+        merge the results. returns false if the passes
+        fail on any cluster.
+    */
+    static bool execute(Program &ssa, const std::function<bool(Program &)> &passes);
+
+    /** Split the program into clusters of output cones,
+        call a function on each cluster in turn with its
+        number and merge them again. a cluster only holds
+        the inputs, outputs and constants it uses, and the
+        operands keep their names. returns false if the
+        function fails on any cluster.
+    */
+    static bool forEachCluster(Program &ssa, const std::function<bool(uint32_t, Program &)> &func);
+
+protected:
+    /* hide constructor so use can't call it directly */
+    explicit PassPartition(Program &ssa) : m_ssa(&ssa), m_removed(0)
+    {
+    }
+
+    /** assign each instruction to a cluster */
+    void findClusters();
+
+    /** move the instructions and operands into
+        a program per cluster. if usedOnly is set, the
+        inputs, outputs and constants are only added to
+        the clusters that use them. */
+    void split(bool usedOnly);
+
+    /** move the instructions and operands of
+        the clusters back into the program */
+    void merge();
+
+    /** give the intermediate operands new names
+        in program order */
+    void rename();
+
+    Program *m_ssa;
+    std::vector<OperationBase*>  m_statements;  ///< the instructions in program order
+    std::vector<int32_t>         m_cluster;     ///< cluster of each instruction, -1 if none
+    std::vector<std::unique_ptr<Program> > m_clusters;
+    uint32_t m_removed;                         ///< instructions that do not reach an output
+};
+
+} // namespace
+
+#endif
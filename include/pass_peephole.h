@@ -0,0 +1,119 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Peephole SSA pass for width adjustments
+
+  The Truncate and AddSub passes lower the formats of
+  the operands into chains of assignments, reinterprets
+  and ExtendLSBs, RemoveLSBs, ExtendMSBs and RemoveMSBs
+  instructions, which often undo each other.
+
+  Each rule of the table in pass_peephole.cpp matches an
+  instruction and, optionally, the instruction that
+  produces its input, by opcode. A rewrite function checks
+  the width parameters and returns the instruction that
+  replaces the first one, for instance:
+
+    EXTENDLSBS(EXTENDLSBS(x,a),b)   -> EXTENDLSBS(x,a+b)
+    REMOVELSBS(EXTENDLSBS(x,a),b)   -> EXTENDLSBS(x,a-b)  a > b
+                                    -> x                  a = b
+                                    -> REMOVELSBS(x,b-a)  a < b
+    REINTERPRET(REINTERPRET(x))     -> REINTERPRET(x)
+
+  Extending the MSBs and then removing them does not
+  change the value, but the reverse does, so there are
+  no rules for that. Instructions on the LSBs are moved
+  in front of instructions on the MSBs, so that they
+  meet the other LSB instructions of a chain, except
+  where removing the LSBs first would leave no bits.
+
+  The rules are applied until none matches. The
+  instructions that are no longer used are left for
+  the DCE pass.
+
+  The result of an instruction keeps its format, and
+  outputs are only written by assignments.
+
+*/
+
+#ifndef pass_peephole_h
+#define pass_peephole_h
+
+#include <map>
+#include <vector>
+#include "ssa.h"
+
+namespace SSA {
+
+class PassPeephole
+{
+public:
+    /** the instructions the rules can match */
+    enum opcode_t
+    {
+        OPC_NONE = 0,       ///< no instruction: the rule matches a single instruction
+        OPC_ASSIGN,
+        OPC_REINTERPRET,
+        OPC_EXTENDLSBS,
+        OPC_REMOVELSBS,
+        OPC_EXTENDMSBS,
+        OPC_REMOVEMSBS,
+        OPC_ANY             ///< any of the above
+    };
+
+    /** a decoded width-adjusting instruction */
+    struct instr_t
+    {
+        opcode_t    opcode;
+        SharedOpPtr op;         ///< input operand
+        int32_t     bits;       ///< bits to extend or remove
+        int32_t     intBits;    ///< format of a reinterpret
+        int32_t     fracBits;
+    };
+
+    /** a rewrite rule. 'rewrite' returns false if the widths
+        do not allow it. Otherwise, it returns one or two
+        instructions; the second one uses the result of the
+        first. A single OPC_ASSIGN is a copy of its operand. */
+    struct rule_t
+    {
+        const char *name;
+        opcode_t    outer;      ///< the instruction that is rewritten
+        opcode_t    inner;      ///< the instruction producing its input
+        bool        singleUse;  ///< the inner instruction may have no other users
+        bool (*rewrite)(const instr_t &outer, const instr_t &inner, std::vector<instr_t> &result);
+    };
+
+    /** Remove redundant width adjustments.
+    */
+    static bool execute(Program &ssa);
+
+protected:
+    /* hide constructor so use can't call it directly */
+    explicit PassPeephole(Program &ssa) : m_ssa(&ssa)
+    {
+    }
+
+    /** decode an instruction. returns false if it is
+        not a width-adjusting instruction. */
+    static bool decode(const OperationBase *node, instr_t &instr);
+
+    /** create the instruction for a decoded instruction */
+    static OperationBase* create(const instr_t &instr, const SharedOpPtr &lhs);
+
+    /** apply the first matching rule to each instruction.
+        returns the number of rewrites. */
+    uint32_t rewrite();
+
+    /** replace a statement, the old one is deleted */
+    void replace(std::list<OperationBase*>::iterator iter, OperationBase *node);
+
+    Program *m_ssa;
+    std::map<const OperandBase*, OperationBase*> m_definitions;    ///< instruction that produces each operand
+    std::map<const OperandBase*, uint32_t> m_uses;                 ///< number of instructions using each operand
+};
+
+} // namespace
+
+#endif
@@ -0,0 +1,69 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Pipeline register insertion SSA pass
+
+  Each instruction is assigned to a pipeline stage as
+  soon as its inputs are available (ASAP). When the
+  delay within a stage would exceed the target, the
+  instruction is moved to the next stage. Registers
+  are inserted on every operand that crosses a stage
+  boundary; an operand that is used in several later
+  stages shares one chain of registers.
+
+  All outputs are delayed to the last stage, so they
+  have the same latency.
+
+  Run this pass after all other passes, as they do
+  not know how to handle registers.
+
+*/
+
+#ifndef pass_pipeline_h
+#define pass_pipeline_h
+
+#include <map>
+#include "ssa.h"
+#include "delaymodel.h"
+
+namespace SSA {
+
+class PassPipeline
+{
+public:
+    /** Insert pipeline registers so the delay between
+        registers does not exceed targetDelay, as
+        estimated by the delay model.
+    */
+    static bool execute(Program &ssa, DelayModel::model_t model, double targetDelay);
+
+    /** get the number of clock cycles between the inputs
+        and the outputs of a program. */
+    static uint32_t calcLatency(const Program &ssa);
+
+protected:
+    /* hide constructor so use can't call it directly */
+    explicit PassPipeline(Program &ssa) : m_ssa(&ssa), m_registers(0), m_registerBits(0)
+    {
+    }
+
+    /** get the stage in which an operand is available.
+        inputs are available in stage 0. */
+    uint32_t getStage(const SharedOpPtr &op) const;
+
+    /** get an operand delayed to a later stage, adding
+        the registers to 'statements' when needed. */
+    SharedOpPtr getDelayed(const SharedOpPtr &op, uint32_t stage,
+                           std::list<OperationBase*> &statements);
+
+    Program  *m_ssa;
+    std::map<const OperandBase*, uint32_t> m_stages;
+    std::map<std::pair<const OperandBase*, uint32_t>, SharedOpPtr> m_delayed;
+    uint32_t m_registers;       ///< number of inserted registers
+    uint32_t m_registerBits;    ///< number of inserted flip-flops
+};
+
+} // namespace
+
+#endif
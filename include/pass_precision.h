@@ -0,0 +1,135 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Backward required-precision SSA pass
+
+  The number of fractional bits that is actually needed
+  is propagated from the outputs to the inputs. When
+  an output is truncated, the LSBs below the truncation
+  point are often not needed upstream. Such LSBs are
+  removed as early as possible so the intermediate
+  operands, and the adders that produce them, shrink.
+
+  Without an error bound only identities of the floor
+  function are used, so the outputs are bit-exact:
+
+    floor(a + b) = a + floor(b)   when a has no bits below the floor
+    floor(a - b) = floor(a) - b   when b has no bits below the floor
+    floor(2^k * x) = 2^k * floor(x), with k more fractional bits
+
+  With an error bound, a number of guard bits below
+  each requirement is kept instead, and the smallest
+  number of guard bits whose worst-case output error
+  is within the bound is selected.
+
+*/
+
+#ifndef pass_precision_h
+#define pass_precision_h
+
+#include <map>
+#include <set>
+#include <vector>
+#include "ssa.h"
+
+namespace SSA {
+
+class PassPrecision : public OperationVisitorBase
+{
+public:
+    /** Remove LSBs that do not contribute to the outputs.
+        When errorBound is zero, the outputs do not change.
+        Otherwise, the absolute error of each output is
+        at most errorBound.
+    */
+    static bool execute(Program &ssa, double errorBound = 0.0);
+
+    // supported nodes!
+    virtual bool visit(const OpAssign *node) override;
+    virtual bool visit(const OpMul *node) override;
+    virtual bool visit(const OpCSDMul *node) override;
+    virtual bool visit(const OpAdd *node) override;
+    virtual bool visit(const OpSub *node) override;
+    virtual bool visit(const OpTruncate *node) override;
+    virtual bool visit(const OpNegate *node) override;
+    virtual bool visit(const OpReinterpret *node) override;
+    virtual bool visit(const OpPatchBlock *node) override { (void)node; return false; }
+    virtual bool visit(const OpNull *node) override { (void)node; return true; }
+
+    virtual bool visit(const OpExtendLSBs *node) override;
+    virtual bool visit(const OpExtendMSBs *node) override;
+    virtual bool visit(const OpRemoveLSBs *node) override;
+    virtual bool visit(const OpRemoveMSBs *node) override;
+    virtual bool visit(const OpRegister *node) override;
+
+    // unsupported nodes!
+    virtual bool visit(const OperationSingle *node) override { (void)node; return false; }
+    virtual bool visit(const OperationDual *node) override { (void)node; return false; }
+    virtual bool visit(const OpCSASum *node) override { (void)node; return false; }
+    virtual bool visit(const OpCSACarry *node) override { (void)node; return false; }
+    virtual bool visit(const OpMulAdd *node) override { (void)node; return false; }
+
+protected:
+    /* hide constructor so use can't call it directly */
+    PassPrecision(Program &ssa, int32_t guardBits,
+                  const std::set<const OperandBase*> &exactOutputs)
+        : m_ssa(&ssa), m_guardBits(guardBits), m_exactOutputs(exactOutputs)
+    {
+    }
+
+    /** precision that the users of an operand need */
+    struct required_t
+    {
+        int32_t fracBits;   ///< number of fractional bits needed
+        bool    exact;      ///< set when no error is allowed
+    };
+
+    /** requirements of an instruction on its inputs */
+    struct nodeinfo_t
+    {
+        nodeinfo_t() : approximate(false), extraGuardBits(0), rounds(false), roundFracBits(0) {}
+
+        SharedOpPtr              lhs;
+        std::vector<SharedOpPtr> inputs;
+        std::vector<int32_t>     fracBits;      ///< fractional bits needed of each input
+        std::vector<int32_t>     exactFracBits; ///< fractional bits needed for an exact result
+        std::vector<double>      gains;         ///< error gain from each input to the result
+        bool                     approximate;   ///< set when input LSBs may be removed with an error
+        int32_t                  extraGuardBits;///< guard bits to compensate for a gain > 1
+        bool                     rounds;        ///< set when the instruction removes LSBs itself
+        int32_t                  roundFracBits; ///< fractional bits of the result when rounding
+    };
+
+    /** run the backward sweep that determines the
+        requirements of all instructions */
+    bool collect();
+
+    /** calculate the worst-case error of each output */
+    std::map<const OperandBase*, double> calcErrors() const;
+
+    /** insert the LSB removals. returns the number of
+        bits that were removed. */
+    int32_t apply();
+
+    /** get the precision required of an instruction result.
+        returns false if the result is not used. */
+    bool getRequired(const SharedOpPtr &lhs, required_t &req) const;
+
+    /** store the requirements of an instruction and merge
+        them into the requirements of its inputs. 'info'
+        holds the precision needed for an exact result,
+        which is reduced when errors are allowed. */
+    void require(const OperationBase *node, const SharedOpPtr &lhs,
+                 const required_t &req, nodeinfo_t &info);
+
+    Program *m_ssa;
+    int32_t  m_guardBits;   ///< guard bits to keep, or -1 for bit-exact results
+    std::set<const OperandBase*> m_exactOutputs;    ///< outputs that must not have errors
+    std::map<const OperandBase*, required_t> m_required;
+    std::map<const OperationBase*, nodeinfo_t> m_nodes;
+};
+
+} // namespace
+
+#endif
@@ -0,0 +1,113 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Interval (value range) analysis SSA pass
+
+  The minimum and maximum value of every operand is
+  propagated from the inputs to the outputs. Additions
+  and subtractions whose result range fits in fewer
+  integer bits than the width rules allocate are
+  rewritten so they produce the narrower result:
+  the extension MSB is dropped and, if needed, the
+  MSBs of the wider inputs are removed. This is exact
+  because two's complement addition is modular.
+
+  All other width rules are left alone; the narrower
+  add/sub results propagate through them when the
+  output precisions are recalculated. The instructions
+  whose parameters depend on the width of their input,
+  reinterpretations and removals of MSBs or LSBs, are
+  not recalculated: an input that became narrower is
+  extended back to its former width before them.
+
+*/
+
+#ifndef pass_range_h
+#define pass_range_h
+
+#include <list>
+#include <map>
+#include "ssa.h"
+
+namespace SSA {
+
+class PassRange : public OperationVisitorBase
+{
+public:
+    /** Reduce the integer bits of add/sub results to
+        the minimum that holds their value range.
+    */
+    static bool execute(Program &ssa);
+
+    // supported nodes!
+    virtual bool visit(const OpAssign *node) override;
+    virtual bool visit(const OpMul *node) override;
+    virtual bool visit(const OpCSDMul *node) override;
+    virtual bool visit(const OpAdd *node) override;
+    virtual bool visit(const OpSub *node) override;
+    virtual bool visit(const OpTruncate *node) override;
+    virtual bool visit(const OpNegate *node) override;
+    virtual bool visit(const OpReinterpret *node) override;
+    virtual bool visit(const OpPatchBlock *node) override { (void)node; return false; }
+    virtual bool visit(const OpNull *node) override { (void)node; return true; }
+
+    virtual bool visit(const OpExtendLSBs *node) override;
+    virtual bool visit(const OpExtendMSBs *node) override;
+    virtual bool visit(const OpRemoveLSBs *node) override;
+    virtual bool visit(const OpRemoveMSBs *node) override;
+    virtual bool visit(const OpRegister *node) override;
+
+    // unsupported nodes!
+    virtual bool visit(const OperationSingle *node) override { (void)node; return false; }
+    virtual bool visit(const OperationDual *node) override { (void)node; return false; }
+    virtual bool visit(const OpCSASum *node) override { (void)node; return false; }
+    virtual bool visit(const OpCSACarry *node) override { (void)node; return false; }
+    virtual bool visit(const OpMulAdd *node) override { (void)node; return false; }
+
+protected:
+    /* hide constructor so use can't call it directly */
+    explicit PassRange(Program &ssa) : m_ssa(&ssa), m_narrowed(0)
+    {
+    }
+
+    /** closed interval of values an operand can take */
+    struct range_t
+    {
+        double minValue;
+        double maxValue;
+    };
+
+    /** get the range of an operand; operands that have
+        not been assigned a range, such as inputs, can
+        take any value of their Q(n,m) format. */
+    range_t getRange(const SharedOpPtr &op) const;
+
+    /** set the range of an instruction result. A range
+        that does not fit the Q(n,m) format of the result
+        wraps around, so any value is possible. */
+    void setRange(const SharedOpPtr &op, double minValue, double maxValue);
+
+    /** round a range down to a number of fractional bits */
+    static range_t floorRange(const range_t &range, int32_t fracBits);
+
+    /** extend the input of an instruction whose parameters
+        depend on the width of its input back to its format
+        before the pass. the extension is inserted into the
+        program before the instruction. */
+    void keepInputFormat(std::list<OperationBase*>::iterator position);
+
+    /** narrow an add or subtract instruction to the width
+        of its result range, if possible. */
+    bool narrowAddSub(const OperationDual *node, bool noExtension,
+                      double minValue, double maxValue, bool isAdd);
+
+    Program *m_ssa;
+    std::map<const OperandBase*, range_t> m_ranges;
+    std::map<const OperandBase*, int32_t> m_intBits;   ///< integer bits of the results before the pass
+    uint32_t m_narrowed;    ///< number of narrowed add/sub instructions
+};
+
+} // namespace
+
+#endif
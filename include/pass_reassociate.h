@@ -0,0 +1,83 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Reassociation SSA pass
+
+  The parser builds left-associative trees, so a sum
+  such as a+b+c+d+e becomes a chain of n-1 adders in
+  series. This pass flattens chains of additions and
+  subtractions into a list of signed terms and rebuilds
+  them as a balanced tree of depth ceil(log2(n)).
+
+  The terms are sorted by their number of integer bits
+  and the smallest terms are combined first, which keeps
+  the carry growth of the intermediate results small. A negative term is
+  subtracted from a positive one where possible; two
+  negative terms are added and the sum is subtracted
+  later.
+
+  The additions and subtractions before the AddSub pass
+  produce exact results, so the rebuilt tree gives the
+  same value bit for bit. Instructions that can wrap
+  around, such as additions without an extension bit,
+  end a chain. A negation ends a chain too, unless its
+  result has an extra integer bit so -MIN cannot wrap.
+  The result of a rebuilt tree is truncated to the
+  absolute format of the original chain, so it stays
+  correct when the Range pass narrows the tree.
+
+  Run this pass before the AddSub pass.
+
+*/
+
+#ifndef pass_reassociate_h
+#define pass_reassociate_h
+
+#include <map>
+#include <vector>
+#include "ssa.h"
+
+namespace SSA {
+
+class PassReassociate
+{
+public:
+    /** Rebuild chains of additions and subtractions
+        as balanced trees.
+    */
+    static bool execute(Program &ssa);
+
+protected:
+    /* hide constructor so use can't call it directly */
+    explicit PassReassociate(Program &ssa) : m_ssa(&ssa), m_chains(0)
+    {
+    }
+
+    /** a term of a sum */
+    struct term_t
+    {
+        SharedOpPtr op;
+        bool        negative;
+    };
+
+    /** collect the terms of a chain of additions and
+        subtractions that produces 'op'. the instructions
+        that are merged into the chain are added to 'merged'. */
+    void collectTerms(const SharedOpPtr &op, bool negative, const SharedOpPtr &root,
+                      std::vector<term_t> &terms, std::vector<OperationBase*> &merged);
+
+    /** build a balanced tree for the terms of the
+        instruction 'node'. returns NULL if the tree
+        cannot be rebuilt. */
+    OpPatchBlock* buildTree(const OperationDual *node, std::vector<term_t> terms);
+
+    Program *m_ssa;
+    std::map<const OperandBase*, OperationBase*> m_definitions;    ///< instruction that produces each operand
+    std::map<const OperandBase*, uint32_t>       m_uses;           ///< number of uses of each operand
+    uint32_t m_chains;      ///< number of rebuilt chains
+};
+
+} // namespace
+
+#endif
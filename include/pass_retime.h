@@ -0,0 +1,97 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Register retiming SSA pass
+
+  The registers are moved through the dataflow graph to
+  minimize the clock period, following Leiserson and
+  Saxe. Each instruction is a vertex and each operand
+  that is used by an instruction is an edge, weighted
+  by the number of registers in between. A retiming
+  assigns a lag r(v) to each vertex, which moves r(v)
+  registers from its outputs to its inputs:
+
+    w'(u->v) = w(u->v) + r(v) - r(u)
+
+  The inputs and outputs have a lag of zero, so the
+  latency of each output stays the same.
+
+  The smallest clock period is found by a binary
+  search, where each period is tested with the FEAS
+  algorithm using the width-based delay model.
+
+*/
+
+#ifndef pass_retime_h
+#define pass_retime_h
+
+#include <map>
+#include <vector>
+#include "ssa.h"
+#include "delaymodel.h"
+
+namespace SSA {
+
+class PassRetime
+{
+public:
+    /** Move the registers to minimize the critical path.
+    */
+    static bool execute(Program &ssa);
+
+protected:
+    /* hide constructor so use can't call it directly */
+    explicit PassRetime(Program &ssa) : m_ssa(&ssa), m_delays(DelayModel::MODEL_WIDTH)
+    {
+    }
+
+    /** a use of an operand, with the number of registers between
+        the instruction that produces the operand and its user. */
+    struct edge_t
+    {
+        uint32_t    from;       ///< producing vertex
+        uint32_t    to;         ///< using vertex
+        int32_t     weight;     ///< number of registers
+        SharedOpPtr operand;    ///< operand before the registers
+    };
+
+    /** build the graph from the program */
+    bool buildGraph();
+
+    /** calculate the arrival time at each vertex for a retiming.
+        returns the clock period. */
+    double calcArrival(const std::vector<int32_t> &lags, std::vector<double> &arrival) const;
+
+    /** check that a retiming has no negative edge weights */
+    bool isLegal(const std::vector<int32_t> &lags) const;
+
+    /** find a retiming for a clock period with the FEAS
+        algorithm. returns false when none was found. */
+    bool findRetiming(double period, std::vector<int32_t> &lags) const;
+
+    /** rebuild the program with the registers of a retiming */
+    void rebuild(const std::vector<int32_t> &lags);
+
+    /** get an operand delayed by a number of registers,
+        adding the registers to 'statements' when needed. */
+    SharedOpPtr getDelayed(const SharedOpPtr &op, int32_t registers,
+                           std::list<OperationBase*> &statements);
+
+    Program     *m_ssa;
+    DelayModel  m_delays;
+
+    // vertex 0 is the source of the inputs, the last
+    // vertex is the sink of the outputs; the others are
+    // the instructions except for the registers.
+    std::vector<OperationBase*> m_vertices;
+    std::vector<double>         m_vertexDelays;
+    std::vector<edge_t>         m_edges;
+    std::vector<std::vector<uint32_t> > m_inputEdges;   ///< edges into each vertex, in input order
+
+    std::map<std::pair<const OperandBase*, int32_t>, SharedOpPtr> m_delayed;
+};
+
+} // namespace
+
+#endif
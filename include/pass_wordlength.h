@@ -0,0 +1,143 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Word-length optimization SSA pass
+
+  Removes fractional bits from intermediate results
+  until an output error target is reached, either the
+  largest absolute error of any output or the lowest
+  signal-to-noise ratio of any output, in dB.
+
+  A truncation is inserted behind an addition,
+  subtraction, multiplication or negation, or an
+  existing truncation is made narrower. The operands
+  behind it shrink accordingly, which is what saves
+  area.
+
+  A max target is checked with a worst-case bound of
+  the output error, so it holds for all inputs. A
+  truncation that can make a product, negation or
+  removal of MSBs wrap around has no bound and is not
+  applied for either metric. The SNR
+  of each candidate truncation is measured with the
+  batch evaluator on random input vectors, relative to
+  the program before this pass. The area
+  is estimated with the LUT figures of the default
+  cost model: a LUT per adder bit and half a LUT per
+  partial product bit of a multiplier.
+
+  Each round, the largest number of bits that can be
+  removed at every candidate without missing the target
+  is determined, in parallel, and the candidate that
+  saves the most area is applied. This repeats until
+  no candidate saves area.
+
+  For an SNR target, the result is checked on other
+  input vectors, and the last truncations are undone
+  until it meets the target there too. As the SNR is
+  measured on samples, it is an estimate rather than
+  a guarantee.
+
+*/
+
+#ifndef pass_wordlength_h
+#define pass_wordlength_h
+
+#include <map>
+#include <vector>
+#include "ssa.h"
+#include "ssabatchevaluator.h"
+
+namespace SSA {
+
+class PassWordLength
+{
+public:
+    enum metric_t
+    {
+        METRIC_MAXERROR,    ///< largest absolute error of an output
+        METRIC_SNR          ///< lowest signal-to-noise ratio of an output, in dB
+    };
+
+    /** parse a target max:<error> or snr:<dB>.
+        returns false if the target is invalid. */
+    static bool parse(const std::string &str, metric_t &metric, double &target);
+
+    /** Truncate intermediate results to reduce the area
+        while meeting the error target. errorBound is set
+        to an upper bound of the absolute output error,
+        which holds for all inputs. returns false if the
+        target cannot be met.
+    */
+    static bool execute(Program &ssa, metric_t metric, double target, double &errorBound);
+
+protected:
+    /* hide constructor so use can't call it directly */
+    PassWordLength(Program &ssa, metric_t metric, double target)
+        : m_ssa(&ssa), m_metric(metric), m_target(target)
+    {
+    }
+
+    /** an intermediate result that can be truncated */
+    struct candidate_t
+    {
+        OperationBase *statement;   ///< the instruction producing the result
+        int32_t  valueIndex;        ///< index of the result in the evaluator
+        int32_t  fracBits;          ///< fractional bits before this pass
+    };
+
+    /** the error of a number of samples */
+    struct error_t
+    {
+        double maxError;    ///< largest absolute error of an output
+        double minSNR;      ///< lowest signal-to-noise ratio of an output, in dB
+    };
+
+    /** replace the LSB extensions and removals by
+        truncations, which keep the format of their
+        result when the input gets fewer bits. */
+    void normalise();
+
+    /** find the candidates and the reference outputs */
+    bool analyse(const BatchEvaluator &eval);
+
+    /** measure the error when each candidate i is
+        truncated to fracBits[i] fractional bits */
+    error_t measure(const BatchEvaluator &eval, const std::vector<int32_t> &fracBits,
+                    const std::vector<std::vector<double> > &inputs,
+                    const std::vector<std::vector<double> > &reference) const;
+
+    /** check if the program meets the target when each
+        candidate i is truncated to fracBits[i] fractional
+        bits. a max target is checked with the error bound,
+        an SNR target on the samples, provided that the
+        error is bounded. */
+    bool meetsTarget(const BatchEvaluator &eval, const std::vector<int32_t> &fracBits,
+                     const std::vector<std::vector<double> > &inputs,
+                     const std::vector<std::vector<double> > &reference) const;
+
+    /** estimate the area, in LUTs, when each candidate
+        i is truncated to fracBits[i] fractional bits */
+    double calcArea(const std::vector<int32_t> &fracBits) const;
+
+    /** calculate an upper bound of the absolute output
+        error when each candidate i is truncated to
+        fracBits[i] fractional bits */
+    double calcErrorBound(const std::vector<int32_t> &fracBits) const;
+
+    /** truncate the candidates in the program */
+    void apply(const std::vector<int32_t> &fracBits);
+
+    Program     *m_ssa;
+    metric_t    m_metric;
+    double      m_target;
+    std::vector<candidate_t> m_candidates;
+    std::map<const OperationBase*, size_t> m_candidateIndex;
+    std::vector<std::vector<double> > m_inputs;
+    std::vector<std::vector<double> > m_reference;
+};
+
+} // namespace
+
+#endif
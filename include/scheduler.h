@@ -0,0 +1,113 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Resource-constrained list scheduler
+
+  When the sample rate is a fraction of the clock
+  frequency, one multiplier can compute several
+  products of a sample in successive clock cycles.
+  The scheduler folds a program onto a limited number
+  of shared operators:
+
+    Each sample period has a fixed number of control
+    steps (clock cycles). Every multiplication, and
+    every addition and subtraction if the adders are
+    shared too, is assigned a step and an operator.
+
+    An operation can use the results of operations in
+    earlier steps only; these are held in registers.
+    Wiring and unshared operators between them are
+    combinational.
+
+  The operations are placed by list scheduling: in
+  each step, the operations whose inputs are ready are
+  placed on the free operators, longest remaining path
+  first. Without a given number of operators, the
+  fewest that fit the steps are used.
+
+  The program is not changed; the VHDL generator uses
+  the schedule to build a sequencer and the input
+  multiplexers of the shared operators.
+
+*/
+
+#ifndef scheduler_h
+#define scheduler_h
+
+#include <map>
+#include <vector>
+#include "ssa.h"
+
+namespace SSA {
+
+class Scheduler
+{
+public:
+    enum resource_t
+    {
+        RES_MULTIPLIER = 0,
+        RES_ADDER,
+        RES_COUNT
+    };
+
+    /** the operator and control step of an operation */
+    struct slot_t
+    {
+        resource_t  resource;
+        uint32_t    unit;       ///< index of the shared operator
+        uint32_t    step;       ///< control step
+    };
+
+    /** create a scheduler for the given number of
+        clock cycles per sample. */
+    explicit Scheduler(uint32_t steps);
+
+    /** share the operators of a kind. with 0 units,
+        the fewest that fit the steps are used. */
+    void share(resource_t resource, uint32_t units = 0);
+
+    /** schedule a program. returns false if it
+        does not fit the steps. */
+    bool execute(const Program &ssa);
+
+    /** get the slot of an operation, or NULL if it
+        does not use a shared operator. */
+    const slot_t* getSlot(const OperationBase *node) const;
+
+    /** get the number of clock cycles per sample */
+    uint32_t getSteps() const
+    {
+        return m_steps;
+    }
+
+    /** get the number of shared operators of a kind */
+    uint32_t getUnits(resource_t resource) const
+    {
+        return m_units[resource];
+    }
+
+    /** get the name of a kind of operator, for reporting */
+    static const char* getName(resource_t resource);
+
+protected:
+    /** get the kind of operator an operation needs.
+        returns RES_COUNT if it is not shared. */
+    resource_t getResource(const OperationBase *node) const;
+
+    /** place the operations on the current number of
+        operators. returns the number of steps used. */
+    uint32_t listSchedule(const Program &ssa);
+
+    uint32_t m_steps;
+    bool     m_shared[RES_COUNT];
+    bool     m_auto[RES_COUNT];     ///< find the fewest operators
+    uint32_t m_units[RES_COUNT];
+    uint32_t m_ops[RES_COUNT];      ///< number of operations of each kind
+    std::map<const OperationBase*, uint32_t> m_priority;   ///< shared operations on the longest path to an output
+    std::map<const OperationBase*, slot_t>   m_slots;
+};
+
+} // namespace
+
+#endif
@@ -13,9 +13,12 @@
 #define ssa_h
 
 #include <list>
+#include <vector>
 #include <string>
 #include <memory>   // shared_ptr
 #include <iostream>
+#include <cmath>
+#include <algorithm>
 
 #include "utils.h"
 #include "csd.h"
@@ -28,6 +31,11 @@ namespace SSA
 class OperationBase;            // forward declaration
 class OperationVisitorBase;     // forward declaration
 
+/** return the smallest number of integer bits of a signed
+    Q(n,fracBits) number that can hold all values in the
+    interval [minValue, maxValue]. */
+int32_t calcIntBits(double minValue, double maxValue, int32_t fracBits);
+
 // *****************************************
 // **********   OPERAND CLASSES   **********
 // *****************************************
@@ -73,8 +81,6 @@ class OutputOperand : public OperandBase
 {
 };
 
-static uint32_t gs_tempIdx = 0;
-
 /** SSA operand that represents an intermediate variable */
 class IntermediateOperand : public OperandBase
 {
@@ -83,9 +89,20 @@ public:
     static std::shared_ptr<IntermediateOperand> createNewIntermediate()
     {
         std::shared_ptr<IntermediateOperand> obj = std::make_shared<IntermediateOperand>();
-        obj->m_identName = stringf("TMP%d", gs_tempIdx++);
+        obj->m_identName = stringf("TMP%d", getNextIndex());
         return obj;
     }
+
+    /** give the operand a new unique name */
+    void rename()
+    {
+        m_identName = stringf("TMP%d", getNextIndex());
+    }
+
+protected:
+    /** return a unique index for a new intermediate.
+        the counter is shared by all passes and threads. */
+    static uint32_t getNextIndex();
 };
 
 
@@ -103,6 +120,34 @@ public:
 };
 
 
+/** SSA operand that reads the bits of another operand
+    in a different Q(n,m) format, like a reinterpret
+    without an instruction. It has the name of the
+    source operand, so the code generators use the
+    source variable directly. Views are not part of
+    the operand list of a program. */
+class ViewOperand : public OperandBase
+{
+public:
+    /** create a view of an operand. a view of a view
+        reads the original operand. */
+    static std::shared_ptr<ViewOperand> create(const SharedOpPtr &op,
+        int32_t intBits, int32_t fracBits)
+    {
+        const ViewOperand *view = dynamic_cast<const ViewOperand*>(op.get());
+        std::shared_ptr<ViewOperand> obj = std::make_shared<ViewOperand>();
+        obj->m_source    = (view != NULL) ? view->m_source : op;
+        obj->m_usedFlag  = true;
+        obj->m_intBits   = intBits;
+        obj->m_fracBits  = fracBits;
+        obj->m_identName = obj->m_source->m_identName;
+        return obj;
+    }
+
+    SharedOpPtr m_source;   ///< the operand holding the bits, never a view
+};
+
+
 
 
 // *****************************************
@@ -136,6 +181,19 @@ public:
     {
         throw std::runtime_error("OperationBase::clone() called on abstract base class!");
     }
+
+    /** return the input operands of the instruction */
+    virtual std::vector<SharedOpPtr> getInputs() const
+    {
+        return std::vector<SharedOpPtr>();
+    }
+
+    /** return the LHS / output operand, or an empty
+        pointer if the instruction has none */
+    virtual SharedOpPtr getLHS() const
+    {
+        return SharedOpPtr();
+    }
 };
 
 
@@ -157,6 +215,16 @@ public:
         throw std::runtime_error("OperationDual::clone() called on abstract base class!");
     }
 
+    virtual std::vector<SharedOpPtr> getInputs() const override
+    {
+        return {m_op1, m_op2};
+    }
+
+    virtual SharedOpPtr getLHS() const override
+    {
+        return m_lhs;
+    }
+
     SharedOpPtr m_lhs;
     SharedOpPtr m_op1;
     SharedOpPtr m_op2;
@@ -181,11 +249,69 @@ public:
         throw std::runtime_error("OperationSingle::clone() called on abstract base class!");
     }
 
+    virtual std::vector<SharedOpPtr> getInputs() const override
+    {
+        return {m_op};
+    }
+
+    virtual SharedOpPtr getLHS() const override
+    {
+        return m_lhs;
+    }
+
     SharedOpPtr m_lhs;
     SharedOpPtr m_op;
 };
 
 
+/** 3:2 compressor (carry-save adder) with three arguments.
+    The arguments and the result all have the same Q(n,m)
+    format. Each argument can be inverted, which, with a
+    carry in of one, subtracts it. */
+class OperationCompressor : public OperationBase
+{
+public:
+    OperationCompressor(const SharedOpPtr &op1, const SharedOpPtr &op2, const SharedOpPtr &op3,
+                        const SharedOpPtr &lhs, uint32_t invertMask)
+        : m_lhs(lhs), m_op1(op1), m_op2(op2), m_op3(op3), m_invertMask(invertMask)
+    {
+    }
+
+    /** replace operand op1 with op2 if op1 is present */
+    virtual void replaceOperand(const SharedOpPtr &op1, SharedOpPtr op2) override;
+
+    /** calculate and set the Q(n,m) precision of the
+        LHS / output operand */
+    virtual void updateOutputPrecision() const override
+    {
+        m_lhs->m_intBits  = m_op1->m_intBits;
+        m_lhs->m_fracBits = m_op1->m_fracBits;
+    }
+
+    virtual std::vector<SharedOpPtr> getInputs() const override
+    {
+        return {m_op1, m_op2, m_op3};
+    }
+
+    virtual SharedOpPtr getLHS() const override
+    {
+        return m_lhs;
+    }
+
+    /** returns true if argument 0, 1 or 2 is inverted */
+    bool isInverted(uint32_t index) const
+    {
+        return ((m_invertMask >> index) & 1) != 0;
+    }
+
+    SharedOpPtr m_lhs;
+    SharedOpPtr m_op1;
+    SharedOpPtr m_op2;
+    SharedOpPtr m_op3;
+    uint32_t    m_invertMask;   ///< bit i set: argument i is inverted
+};
+
+
 class OpAdd : public OperationDual
 {
 public:
@@ -314,44 +440,23 @@ public:
         LHS / output operand */
     virtual void updateOutputPrecision() const override
     {
-        //FIXME: this is true for signed*signed multiplications
-        //  however, CSDs are sign-magnitude and will have
-        //  even fewer bits to output
-        //
-        //  example (2^1 + 2^-3) * x
-        //  where x is Q(n,m)
-        //
-        //  2^1  * x -> Q(n+1,m-1)
-        //  2^-3 * x -> Q(n-3,m+3)
-        //  after addition:
-        //  Q(n+1,m-1) + Q(n-3,m+3) -> Q(n+2,m+3)
-        //
-        //  however: (2^1 - 2^-3) * x
-        //  where x is Q(n,m)
-        //
-        //  2^1  * x -> Q(n+1,m-1)
-        //  2^-3 * x -> Q(n-3,m+3)
-        //  after addition:
-        //  Q(n,m) - Q(n-3,m+3) -> Q(n,m+3)
-        //  because (2^0 - 2^-3) < 2^0
-        //
-        //  if the first digit is positive and
-        //  the second is negative or non-existent,
-        //  the CSD coefficient is smaller or equal
-        //  to the first digit and we don't need
-        //  an additional expansion MSB.
+        // the CSD is a known constant so the exact output
+        // range follows from the range of the input format.
+        // A negative coefficient maps the most negative
+        // input onto a positive value, which needs an
+        // additional MSB when the coefficient is -2^k.
         //
+        // the product of Q(n,m) and a digit 2^Pmin
+        // has m-Pmin fractional bits.
 
-        int32_t Pmax = m_csd.digits.front().power;
         int32_t Pmin = m_csd.digits.back().power;
-
-        m_lhs->m_intBits = Pmax + m_op->m_intBits;
-        if ((m_csd.digits.size() > 1) && (m_csd.digits[0].sign != m_csd.digits[1].sign))
-        {
-            m_lhs->m_intBits++;
-        }
+        double inMin = -ldexp(1.0, m_op->m_intBits-1);
+        double inMax = ldexp(1.0, m_op->m_intBits-1) - ldexp(1.0, -m_op->m_fracBits);
+        double p1 = m_csd.value * inMin;
+        double p2 = m_csd.value * inMax;
 
         m_lhs->m_fracBits = -Pmin + m_op->m_fracBits;
+        m_lhs->m_intBits  = calcIntBits(std::min(p1,p2), std::max(p1,p2), m_lhs->m_fracBits);
     }
 
     /** clone the object */
@@ -625,6 +730,222 @@ public:
     int32_t m_bits;     ///< number of bits to remove
 };
 
+/** A register: the output is the input delayed by one clock cycle.
+    Programs without registers are purely combinational. */
+class OpRegister : public OperationSingle
+{
+public:
+    OpRegister(const SharedOpPtr &op, const SharedOpPtr &output)
+        : OperationSingle(op, output)
+    {
+        updateOutputPrecision();
+    }
+
+    /** accept a visitor */
+    virtual bool accept(OperationVisitorBase *visitor) override;
+
+    /** calculate and set the Q(n,m) precision of the
+        LHS / output operand */
+    virtual void updateOutputPrecision() const override
+    {
+        m_lhs->m_intBits  = m_op->m_intBits;
+        m_lhs->m_fracBits = m_op->m_fracBits;
+    }
+
+    /** clone the object */
+    virtual OperationBase* clone() const override
+    {
+        return new OpRegister(*this);
+    }
+};
+
+/** The sum output of a 3:2 compressor: the bitwise
+    exclusive OR of the arguments. */
+class OpCSASum : public OperationCompressor
+{
+public:
+    OpCSASum(const SharedOpPtr &op1, const SharedOpPtr &op2, const SharedOpPtr &op3,
+             const SharedOpPtr &lhs, uint32_t invertMask = 0)
+        : OperationCompressor(op1, op2, op3, lhs, invertMask)
+    {
+        updateOutputPrecision();
+    }
+
+    /** accept a visitor */
+    virtual bool accept(OperationVisitorBase *visitor) override;
+
+    /** clone the object */
+    virtual OperationBase* clone() const override
+    {
+        return new OpCSASum(*this);
+    }
+};
+
+/** The carry output of a 3:2 compressor: the bitwise
+    majority of the arguments, shifted one bit to the left.
+    The MSB is dropped and the LSB is the carry in, so the
+    sum and carry outputs add up to the sum of the arguments,
+    modulo the word size. */
+class OpCSACarry : public OperationCompressor
+{
+public:
+    OpCSACarry(const SharedOpPtr &op1, const SharedOpPtr &op2, const SharedOpPtr &op3,
+               const SharedOpPtr &lhs, uint32_t invertMask = 0, bool carryIn = false)
+        : OperationCompressor(op1, op2, op3, lhs, invertMask), m_carryIn(carryIn)
+    {
+        updateOutputPrecision();
+    }
+
+    /** accept a visitor */
+    virtual bool accept(OperationVisitorBase *visitor) override;
+
+    /** clone the object */
+    virtual OperationBase* clone() const override
+    {
+        return new OpCSACarry(*this);
+    }
+
+    bool m_carryIn;
+};
+
+/** A multiplication with an optional pre-adder and post-adder,
+    as found in the DSP slices of FPGAs:
+
+      pre  := a + d, a - d  or a
+      prod := pre * b
+      lhs  := prod + c, prod - c, c - prod or prod
+
+    The pre-adder and the post-adder do not extend the result,
+    like OpAdd and OpSub with m_noExtension set. The product is
+    aligned to the format of the result by extending its LSBs
+    and MSBs; the format of the result is set by the creator.
+
+    The intermediate results are kept as operands, so code
+    generators can declare them. The last m_stages of lhs,
+    prod and pre are registers inside the slice. */
+class OpMulAdd : public OperationBase
+{
+public:
+    enum addmode_t
+    {
+        ADD_NONE,       ///< no adder
+        ADD_PLUS,       ///< x + y
+        ADD_MINUS,      ///< x - y
+        ADD_REVERSE     ///< y - x
+    };
+
+    OpMulAdd(const SharedOpPtr &a, const SharedOpPtr &d, addmode_t preMode, const SharedOpPtr &pre,
+             const SharedOpPtr &b, const SharedOpPtr &prod,
+             const SharedOpPtr &c, addmode_t postMode, const SharedOpPtr &lhs)
+        : m_a(a), m_d(d), m_pre(pre), m_b(b), m_prod(prod), m_c(c), m_lhs(lhs),
+          m_preMode(preMode), m_postMode(postMode), m_stages(0)
+    {
+        updateOutputPrecision();
+    }
+
+    /** accept a visitor */
+    virtual bool accept(OperationVisitorBase *visitor) override;
+
+    /** replace operand op1 with op2 if op1 is present */
+    virtual void replaceOperand(const SharedOpPtr &op1, SharedOpPtr op2) override;
+
+    /** calculate and set the Q(n,m) precision of the
+        pre-adder and the product */
+    virtual void updateOutputPrecision() const override
+    {
+        if (m_preMode != ADD_NONE)
+        {
+            m_pre->m_intBits  = std::max(m_a->m_intBits, m_d->m_intBits);
+            m_pre->m_fracBits = std::max(m_a->m_fracBits, m_d->m_fracBits);
+        }
+        SharedOpPtr mulInput = getMulInput();
+        m_prod->m_intBits  = mulInput->m_intBits + m_b->m_intBits - 1;
+        m_prod->m_fracBits = mulInput->m_fracBits + m_b->m_fracBits;
+    }
+
+    /** clone the object */
+    virtual OperationBase* clone() const override
+    {
+        return new OpMulAdd(*this);
+    }
+
+    virtual std::vector<SharedOpPtr> getInputs() const override
+    {
+        std::vector<SharedOpPtr> inputs = {m_a};
+        if (m_preMode != ADD_NONE)
+        {
+            inputs.push_back(m_d);
+        }
+        inputs.push_back(m_b);
+        if (m_postMode != ADD_NONE)
+        {
+            inputs.push_back(m_c);
+        }
+        return inputs;
+    }
+
+    virtual SharedOpPtr getLHS() const override
+    {
+        return m_lhs;
+    }
+
+    /** the first argument of the multiplier: the
+        pre-adder output or a */
+    SharedOpPtr getMulInput() const
+    {
+        return (m_preMode != ADD_NONE) ? m_pre : m_a;
+    }
+
+    /** get the number of results that can be registered */
+    uint32_t getMaxStages() const
+    {
+        return 1 + ((m_preMode != ADD_NONE) ? 1 : 0) + ((m_postMode != ADD_NONE) ? 1 : 0);
+    }
+
+    /** check if the result of the post-adder is registered */
+    bool isLHSRegistered() const
+    {
+        return (m_postMode != ADD_NONE) && (m_stages >= 1);
+    }
+
+    /** check if the product is registered */
+    bool isProdRegistered() const
+    {
+        return m_stages >= ((m_postMode != ADD_NONE) ? 2u : 1u);
+    }
+
+    /** check if the result of the pre-adder is registered */
+    bool isPreRegistered() const
+    {
+        return (m_preMode != ADD_NONE) && (m_stages >= getMaxStages());
+    }
+
+    /** get the number of clock cycles after a and d that
+        b is needed, to line up with a registered pre-adder */
+    uint32_t getBDelay() const
+    {
+        return isPreRegistered() ? 1 : 0;
+    }
+
+    /** get the number of clock cycles after a and d that
+        c is needed, to line up with the registered product */
+    uint32_t getCDelay() const
+    {
+        return getBDelay() + (((m_postMode != ADD_NONE) && isProdRegistered()) ? 1 : 0);
+    }
+
+    SharedOpPtr m_a;
+    SharedOpPtr m_d;        ///< empty without pre-adder
+    SharedOpPtr m_pre;      ///< empty without pre-adder
+    SharedOpPtr m_b;
+    SharedOpPtr m_prod;     ///< same as m_lhs without post-adder
+    SharedOpPtr m_c;        ///< empty without post-adder
+    SharedOpPtr m_lhs;
+    addmode_t   m_preMode;
+    addmode_t   m_postMode;
+    uint32_t    m_stages;   ///< pipeline registers inside the slice
+};
+
 /** A special operation that holds a sequence of instructions
     to be inserted into the top-level operations list.
     This object is primarily there to aid patching
@@ -734,6 +1055,12 @@ public:
     virtual bool visit(const OpRemoveLSBs *node) = 0;
     virtual bool visit(const OpRemoveMSBs *node) = 0;
 
+    virtual bool visit(const OpRegister *node) = 0;
+
+    virtual bool visit(const OpCSASum *node) = 0;
+    virtual bool visit(const OpCSACarry *node) = 0;
+    virtual bool visit(const OpMulAdd *node) = 0;
+
     virtual bool visit(const OperationSingle *node) = 0;
     virtual bool visit(const OperationDual *node) = 0;
     virtual bool visit(const OpPatchBlock *node) = 0;
@@ -741,6 +1068,12 @@ public:
 
 };
 
+/** check that the Q(n,m) precision of the results of
+    an instruction is the one updateOutputPrecision()
+    calculates, without changing it. a mismatch is
+    written to the report. returns false if there is one. */
+bool checkOutputPrecision(const OperationBase *statement, std::ostream &report);
+
 // *****************************************
 // **********  SSA PROGRAM CLASS  **********
 // *****************************************
@@ -751,6 +1084,15 @@ class Program
 public:
     Program() {}
 
+    /** delete all the statements */
+    ~Program()
+    {
+        for(auto statement : m_statements)
+        {
+            delete statement;
+        }
+    }
+
     /** convenience function to add a new statement to the list */
     void addStatement(OperationBase *statement)
     {
@@ -768,6 +1110,11 @@ public:
         any NULL operations. */
     void applyPatches();
 
+    /** merge the OpPatchBlock instructions like
+        applyPatches() and add the instructions of
+        the patch blocks to 'inserted'. */
+    void applyPatches(std::vector<const OperationBase*> &inserted);
+
     /** calculate and set the Q(n,m) precision of the
         operands / variables */
     void updateOutputPrecisions()
@@ -778,15 +1125,30 @@ public:
         }
     }
 
-    /** copy constructor to safely duplicate all the statements */
-    Program(const Program &obj)
-    {
-        m_operands = obj.m_operands;
-        for (auto statement : obj.m_statements)
-        {
-            m_statements.push_back(statement->clone());
-        }
-    }
+    /** calculate and set the Q(n,m) precision of the
+        results of the modified instructions and of the
+        instructions that depend on them, as far as the
+        precisions change. an inserted instruction, or an
+        instruction with a replaced operand, is a modified
+        instruction. call this after applyPatches().
+        returns the number of instructions recalculated. */
+    uint32_t updateOutputPrecisions(const std::vector<const OperationBase*> &modified);
+
+    /** check that the Q(n,m) precision of each result
+        is the one its instruction produces, without
+        changing it. each mismatch is written to the
+        report. returns false if there are any. */
+    bool verifyPrecisions(std::ostream &report) const;
+
+    /** copy constructor to safely duplicate all the statements.
+        the operands are duplicated too, so the passes that
+        change the Q(n,m) format of an operand in one program
+        do not change the other. the program must not contain
+        patch blocks. */
+    Program(const Program &obj);
+
+    /** statements are owned, so assignment is not allowed */
+    Program& operator=(const Program &obj) = delete;
 
     std::list<OperationBase*> m_statements;
     std::list<SharedOpPtr>    m_operands;
@@ -0,0 +1,152 @@
+/*
+
+    A fast single static assignment (SSA) evaluator
+    for running a program on many input vectors.
+
+    The program is translated once into a list of
+    instructions that refer to operands by index.
+    Values are stored as doubles, which represent
+    fixed-point values exactly as long as an operand
+    has no more than 52 bits. The fixed-point semantics
+    (wrap-around and truncation) are modelled
+    explicitly.
+
+*/
+
+#ifndef ssabatchevaluator_h
+#define ssabatchevaluator_h
+
+#include <map>
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include "ssa.h"
+
+namespace SSA
+{
+
+class BatchEvaluator : public OperationVisitorBase
+{
+public:
+    /** translate the program into the evaluator's
+        instruction list. check isValid() afterwards.
+        when 'ideal' is true, results never wrap around,
+        as if every operand had enough integer bits. */
+    explicit BatchEvaluator(const Program &ssa, bool ideal = false);
+
+    /** returns true if all instructions are supported */
+    bool isValid() const
+    {
+        return m_valid;
+    }
+
+    /** get the names of the inputs, in the order that
+        evaluate() expects them */
+    const std::vector<std::string>& getInputNames() const
+    {
+        return m_inputNames;
+    }
+
+    /** get the names of the outputs, in the order that
+        evaluate() produces them */
+    const std::vector<std::string>& getOutputNames() const
+    {
+        return m_outputNames;
+    }
+
+    /** fill a vector with random input values that are
+        representable in the input formats */
+    void randomizeInputs(std::vector<double> &inputs, uint32_t &seed) const;
+
+    /** run the program for one input vector.
+        this function is thread safe. */
+    void evaluate(const std::vector<double> &inputs, std::vector<double> &outputs) const;
+
+    /** run the program for one input vector, removing LSBs
+        from some of the results: the value with index i is
+        rounded towards minus infinity to a multiple of
+        1/scales[i], unless scales[i] is zero.
+        this function is thread safe. */
+    void evaluate(const std::vector<double> &inputs, std::vector<double> &outputs,
+                  const std::vector<double> &scales) const;
+
+    /** get the number of values */
+    size_t getValueCount() const
+    {
+        return m_index.size();
+    }
+
+    /** get the value index of an operand, or -1
+        if the program does not use it. */
+    int32_t getValueIndex(const SharedOpPtr &op) const
+    {
+        auto iter = m_index.find(op.get());
+        return (iter != m_index.end()) ? static_cast<int32_t>(iter->second) : -1;
+    }
+
+    virtual bool visit(const OpAssign *node) override;
+    virtual bool visit(const OpMul *node) override;
+    virtual bool visit(const OpAdd *node) override;
+    virtual bool visit(const OpSub *node) override;
+    virtual bool visit(const OpNegate *node) override;
+    virtual bool visit(const OpCSDMul *node) override;
+    virtual bool visit(const OpTruncate *node) override;
+    virtual bool visit(const OpReinterpret *node) override;
+
+    virtual bool visit(const OpExtendLSBs *node) override;
+    virtual bool visit(const OpExtendMSBs *node) override;
+    virtual bool visit(const OpRemoveLSBs *node) override;
+    virtual bool visit(const OpRemoveMSBs *node) override;
+    virtual bool visit(const OpRegister *node) override;
+
+    virtual bool visit(const OperationSingle *node) override { (void)node; return false; }
+    virtual bool visit(const OperationDual *node) override { (void)node; return false; }
+    virtual bool visit(const OpCSASum *node) override { (void)node; return false; }
+    virtual bool visit(const OpCSACarry *node) override { (void)node; return false; }
+    virtual bool visit(const OpMulAdd *node) override { (void)node; return false; }
+    virtual bool visit(const OpPatchBlock *node) override { (void)node; return false; }
+    virtual bool visit(const OpNull *node) override { (void)node; return true; }
+
+protected:
+    enum opcode_t
+    {
+        OP_COPY,        ///< dst = src1
+        OP_ADD,         ///< dst = wrap(src1 + src2)
+        OP_SUB,         ///< dst = wrap(src1 - src2)
+        OP_MUL,         ///< dst = wrap(src1 * src2)
+        OP_SCALE,       ///< dst = wrap(src1 * scale)
+        OP_FLOOR        ///< dst = wrap(floor(src1 * scale) / scale)
+    };
+
+    struct instruction_t
+    {
+        opcode_t    opcode;
+        uint32_t    dst;
+        uint32_t    src1;
+        uint32_t    src2;
+        double      scale;
+        double      range;      ///< 2^intBits of the result, zero: no wrap-around
+    };
+
+    /** get the index of an operand, allocating one if needed */
+    uint32_t getIndex(const SharedOpPtr &op);
+
+    /** add an instruction that writes to 'lhs' */
+    void addInstruction(opcode_t opcode, const SharedOpPtr &lhs,
+                        const SharedOpPtr &src1, const SharedOpPtr &src2,
+                        double scale, bool wrap);
+
+    bool m_valid;
+    bool m_ideal;
+    std::map<const OperandBase*, uint32_t>  m_index;        ///< value index of each operand
+    std::vector<instruction_t>              m_program;
+    std::vector<uint32_t>                   m_inputs;       ///< value index of each input
+    std::vector<uint32_t>                   m_outputs;      ///< value index of each output
+    std::vector<std::string>                m_inputNames;
+    std::vector<std::string>                m_outputNames;
+    std::vector< std::pair<int32_t,int32_t> > m_inputFormats;  ///< Q(n,m) of each input
+};
+
+} // namespace
+
+#endif
@@ -13,6 +13,7 @@
 #ifndef ssacreator_h
 #define ssacreator_h
 
+#include <map>
 #include <string>
 #include <iostream>
 #include "astnode.h"
@@ -30,6 +31,13 @@ public:
 
     bool process(AST::Statements &statements, SSA::Program &ssa);
 
+    /** quantize the named CSD declarations with a different
+        number of terms than the declarations specify. */
+    void setTermOverrides(const std::map<std::string, uint32_t> &terms)
+    {
+        m_termOverrides = terms;
+    }
+
     virtual void visit(const AST::Identifier *node) override;
     virtual void visit(const AST::IntegerConstant *node) override;
     virtual void visit(const AST::CSDDeclaration *node) override;
@@ -60,6 +68,7 @@ protected:
     SSA::Program                *m_ssa;         ///< SSA program statements
     std::string                 m_lastError;    ///< last generated error
     std::list<SharedOpPtr>      m_opStack;      ///< operand stack
+    std::map<std::string, uint32_t> m_termOverrides;  ///< number of terms per CSD name
 };
 
 } // namespace
@@ -65,6 +65,10 @@ public:
         }
     }
 
+    /** get the value of an operand. a view reads the
+        value of its source in its own format. */
+    fplib::SFix getOperandValue(const SharedOpPtr &op) const;
+
     virtual bool visit(const OpAssign *node) override;
     virtual bool visit(const OpMul *node) override;
     virtual bool visit(const OpAdd *node) override;
@@ -78,6 +82,10 @@ public:
     virtual bool visit(const OpExtendMSBs *node) override;
     virtual bool visit(const OpRemoveLSBs *node) override;
     virtual bool visit(const OpRemoveMSBs *node) override;
+    virtual bool visit(const OpRegister *node) override;
+    virtual bool visit(const OpCSASum *node) override;
+    virtual bool visit(const OpCSACarry *node) override;
+    virtual bool visit(const OpMulAdd *node) override;
 
     virtual bool visit(const OperationSingle *node) override;
     virtual bool visit(const OperationDual *node) override;
@@ -91,6 +99,23 @@ public:
     bool compareToRefEvaluator(const Evaluator &reference,
                                      std::stringstream &report);
 
+    /** Compare the outputs of this evaluator to a reference.
+        Returns true if the absolute difference of each output
+        is at most 'tolerance'. Intermediate variables are not
+        compared, as passes may change their values.
+    */
+    bool compareOutputsToRefEvaluator(const Evaluator &reference,
+                                      std::stringstream &report,
+                                      double tolerance);
+
+    /** Add the squared outputs of the reference to 'signal'
+        and the squared differences between the outputs of
+        this evaluator and the reference to 'noise', per
+        output name. */
+    void accumulateOutputNoise(const Evaluator &reference,
+                               std::map<std::string, double> &signal,
+                               std::map<std::string, double> &noise) const;
+
     /** Initialize the inputs to the same values as the reference
         evaluator */
     void initInputsFromRefEvaluator(const Evaluator &reference);
@@ -41,6 +41,10 @@ public:
     virtual bool visit(const OpExtendMSBs *node) override;
     virtual bool visit(const OpRemoveLSBs *node) override;
     virtual bool visit(const OpRemoveMSBs *node) override;
+    virtual bool visit(const OpRegister *node) override;
+    virtual bool visit(const OpCSASum *node) override;
+    virtual bool visit(const OpCSACarry *node) override;
+    virtual bool visit(const OpMulAdd *node) override;
 
     virtual bool visit(const OpPatchBlock *node) override;
     virtual bool visit(const OpNull *node) override;
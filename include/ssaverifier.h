@@ -0,0 +1,106 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Check an SSA program after a pass
+
+  In a single walk over the instructions, it checks
+  that:
+
+    each operand is defined once, by an instruction
+    before the ones that use it, unless it is an input
+    or a CSD constant.
+
+    the Q(n,m) format of each result is the one its
+    instruction produces.
+
+    the rules of each instruction hold: the bits to
+    extend or remove are not negative and leave at
+    least one bit, a reinterpretation or a view keeps
+    the number of bits, the arguments of a compressor
+    have the format of its result and the product and
+    post-adder argument of a multiply-add fit its result.
+
+  The first error is logged with the instruction that
+  causes it. This catches the width bugs of a pass
+  right behind it, which the evaluation only finds
+  when a random input happens to trigger them.
+
+*/
+
+#ifndef ssaverifier_h
+#define ssaverifier_h
+
+#include <set>
+#include <string>
+#include "ssa.h"
+
+namespace SSA {
+
+class Verifier : public OperationVisitorBase
+{
+public:
+    /** Check a program after the named pass.
+        returns false at the first error.
+    */
+    static bool execute(const Program &ssa, const char *passName);
+
+    virtual bool visit(const OpAssign *node) override { return checkSingle(node); }
+    virtual bool visit(const OpMul *node) override { return checkDual(node); }
+    virtual bool visit(const OpCSDMul *node) override { return checkSingle(node); }
+    virtual bool visit(const OpAdd *node) override { return checkDual(node); }
+    virtual bool visit(const OpSub *node) override { return checkDual(node); }
+    virtual bool visit(const OpNegate *node) override { return checkSingle(node); }
+    virtual bool visit(const OpTruncate *node) override { return checkSingle(node); }
+    virtual bool visit(const OpReinterpret *node) override;
+
+    virtual bool visit(const OpExtendLSBs *node) override;
+    virtual bool visit(const OpExtendMSBs *node) override;
+    virtual bool visit(const OpRemoveLSBs *node) override;
+    virtual bool visit(const OpRemoveMSBs *node) override;
+    virtual bool visit(const OpRegister *node) override { return checkSingle(node); }
+    virtual bool visit(const OpCSASum *node) override { return checkCompressor(node); }
+    virtual bool visit(const OpCSACarry *node) override { return checkCompressor(node); }
+    virtual bool visit(const OpMulAdd *node) override;
+
+    virtual bool visit(const OpPatchBlock *node) override;
+    virtual bool visit(const OpNull *node) override { (void)node; return true; }
+
+    // unsupported nodes!
+    virtual bool visit(const OperationSingle *node) override;
+    virtual bool visit(const OperationDual *node) override;
+
+protected:
+    /* hide constructor so use can't call it directly */
+    Verifier()
+    {
+    }
+
+    /** check that an input is defined */
+    bool checkInput(const SharedOpPtr &op);
+
+    /** check that a result is not defined yet, and define it */
+    bool define(const SharedOpPtr &op);
+
+    /** check the operands of an instruction with one argument */
+    bool checkSingle(const OperationSingle *node);
+
+    /** check the operands of an instruction with two arguments */
+    bool checkDual(const OperationDual *node);
+
+    /** check the operands and formats of a compressor */
+    bool checkCompressor(const OperationCompressor *node);
+
+    /** check the number of bits that an instruction extends or removes */
+    bool checkBits(const OperationSingle *node, int32_t bits, bool remove);
+
+    /** set the error message and return false */
+    bool fail(const std::string &error);
+
+    std::set<const OperandBase*> m_defined;
+    std::string m_error;
+};
+
+} // namespace
+
+#endif
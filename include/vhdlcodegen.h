@@ -10,7 +10,11 @@
 #define vhdlcodegen_h
 
 #include <iostream>
+#include <set>
+#include <string>
 #include "ssa.h"
+#include "knownbits.h"
+#include "scheduler.h"
 
 namespace SSA {
 
@@ -18,12 +22,19 @@ class VHDLCodeGen : public OperationVisitorBase
 {
 public:
     //VHDLCodeGen(std::ostream &os, Program &ssa) {}
-    static bool generateCode(std::ostream &os, Program &ssa, bool genTestbench = false)
+    static bool generateCode(std::ostream &os, Program &ssa, bool genTestbench = false,
+                             const Scheduler *schedule = NULL)
     {
-        VHDLCodeGen generator(os, ssa, genTestbench);
+        VHDLCodeGen generator(os, ssa, genTestbench, schedule);
         return generator.execute();
     }
 
+    /** generate an entity per cluster of output cones and a
+        top level entity with the given name that instantiates
+        them, so they can be synthesized independently. */
+    static bool generateHierarchy(std::ostream &os, Program &ssa, const std::string &name,
+                                  bool genTestbench = false);
+
     // supported nodes!
     virtual bool visit(const OpAssign *node) override;
     virtual bool visit(const OpMul *node) override;
@@ -36,6 +47,10 @@ public:
     virtual bool visit(const OpExtendMSBs *node) override;
     virtual bool visit(const OpRemoveLSBs *node) override;
     virtual bool visit(const OpRemoveMSBs *node) override;
+    virtual bool visit(const OpRegister *node) override;
+    virtual bool visit(const OpCSASum *node) override;
+    virtual bool visit(const OpCSACarry *node) override;
+    virtual bool visit(const OpMulAdd *node) override;
 
     virtual bool visit(const OpReinterpret *node) override;
 
@@ -48,15 +63,61 @@ public:
 
 
 protected:
-    VHDLCodeGen(std::ostream &os, Program &ssa, bool genTestbench);
+    VHDLCodeGen(std::ostream &os, Program &ssa, bool genTestbench, const Scheduler *schedule);
 
     bool execute();
+    bool genBody();
     void genProcessHeader(uint32_t indent);
+
+    /** generate the documentation of the signals that
+        the process reads and writes */
+    void genSignalDocs();
+    void genRegisterProcess(uint32_t indent);
     void genIndent(uint32_t indent);
 
     void genTestbenchHeader();
     void genTestbenchFooter();
 
+    /** generate the entity of the program with the inputs,
+        outputs, clock and reset as ports, and the start of
+        its architecture. the top level of a hierarchy does
+        not declare the registers, its entities do. */
+    void genEntityHeader(bool declareRegisters);
+
+    /** generate the instance of the entity of the program,
+        with each port connected to the signal of the same
+        name. */
+    void genInstance(std::ostream &os, const std::string &label) const;
+
+    /** generate an addition or subtraction. known-zero LSBs
+        are passed through and redundant sign bits are
+        recreated by a resize, so the carry chain only
+        covers the remaining bits. */
+    bool genAddSub(const OperationDual *node, bool isAdd);
+
+    /** return the bits 'hi' downto 'lo' of an operand,
+        sign extended if 'hi' is above its MSB. */
+    std::string genSlice(const SharedOpPtr &op, int32_t hi, int32_t lo);
+
+    /** generate the indentation and the left-hand side of
+        an assignment to an operand, which is a register,
+        an output signal or a variable. */
+    void genAssignment(const SharedOpPtr &op);
+
+    /** generate the declarations of the sequencer and
+        the shared operators of a folded program. */
+    void genFoldSignals(const char *prefix);
+
+    /** generate the shared operators of a folded program */
+    void genFoldOperators(uint32_t indent);
+
+    /** generate an operation on a shared operator. the
+        operands are selected in its control step. */
+    void genFoldOperation(const OperationDual *node, const Scheduler::slot_t *slot, const char *subtract);
+
+    /** get the name of a shared operator signal */
+    std::string getUnitName(Scheduler::resource_t resource, uint32_t unit, const char *suffix) const;
+
     // return a VHDL compatible length Hex literal
     std::string chopHexString(const std::string &hex, int32_t intBits, int32_t fracBits);
 
@@ -66,6 +127,23 @@ protected:
     std::string     m_prolog;
     std::string     m_epilog;
     bool            m_genTestbench;
+    uint32_t        m_latency;      ///< clock cycles from the inputs to the outputs
+    std::set<const OperandBase*> m_registers;  ///< outputs of the registers
+    KnownBits       m_knownBits;
+    uint32_t        m_savedBits;    ///< adder bits without carry logic
+
+    /** widths of the inputs and the result of a shared operator */
+    struct unit_t
+    {
+        int32_t aBits;
+        int32_t bBits;
+        int32_t yBits;
+    };
+
+    const Scheduler *m_schedule;    ///< schedule of a folded program, or NULL
+    std::vector<unit_t> m_units[Scheduler::RES_COUNT];
+    std::map<const OperandBase*, uint32_t> m_registerSteps;  ///< control step in which a register is loaded
+    std::string     m_entityName;   ///< entity of the hierarchy, empty for a single process
 };
 
 } // end namespace
@@ -46,6 +46,10 @@ public:
     virtual bool visit(const OpExtendMSBs *node) override { (void)node; return false; }
     virtual bool visit(const OpRemoveLSBs *node) override { (void)node; return false; }
     virtual bool visit(const OpRemoveMSBs *node) override { (void)node; return false; }
+    virtual bool visit(const OpRegister *node) override { (void)node; return false; }
+    virtual bool visit(const OpCSASum *node) override { (void)node; return false; }
+    virtual bool visit(const OpCSACarry *node) override { (void)node; return false; }
+    virtual bool visit(const OpMulAdd *node) override { (void)node; return false; }
     virtual bool visit(const OpNull *node) override { (void)node; return false; }
     virtual bool visit(const OperationSingle *node) override { (void)node; return false; }
     virtual bool visit(const OperationDual *node) override { (void)node; return false; }
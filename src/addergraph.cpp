@@ -0,0 +1,533 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Shift-and-add graph that multiplies a single
+                input by one or more constants (MCM).
+
+*/
+
+#include <map>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <stdexcept>
+#include "utils.h"
+#include "addergraph.h"
+
+typedef AdderGraph::term_t term_t;
+
+/** two terms that can be computed once and shared
+    between constants: hi + sign * lo * 2^-distance */
+struct pattern_t
+{
+    int32_t hiNode;
+    int32_t loNode;
+    int32_t distance;
+    int32_t sign;
+
+    bool operator<(const pattern_t &other) const
+    {
+        if (hiNode != other.hiNode) return hiNode < other.hiNode;
+        if (loNode != other.loNode) return loNode < other.loNode;
+        if (distance != other.distance) return distance < other.distance;
+        return sign < other.sign;
+    }
+};
+
+/** order two terms so 'hi' has the largest weight.
+    returns false if the terms cannot form a pattern. */
+static bool makePattern(const term_t &t1, const term_t &t2, pattern_t &pattern)
+{
+    const term_t *hi = &t1;
+    const term_t *lo = &t2;
+    if ((t2.shift > t1.shift) || ((t2.shift == t1.shift) && (t2.node > t1.node)))
+    {
+        std::swap(hi, lo);
+    }
+
+    if ((hi->shift == lo->shift) && (hi->node == lo->node))
+    {
+        return false;
+    }
+
+    pattern.hiNode   = hi->node;
+    pattern.loNode   = lo->node;
+    pattern.distance = hi->shift - lo->shift;
+    pattern.sign     = hi->sign * lo->sign;
+    return true;
+}
+
+/** find non-overlapping occurrences of a pattern in a list of terms.
+    when 'newNode' > 0, the occurrences are replaced by a term
+    that references the new node.
+    returns the number of occurrences. */
+static uint32_t matchPattern(std::vector<term_t> &terms, const pattern_t &pattern, int32_t newNode)
+{
+    std::vector<bool> used(terms.size(), false);
+    std::vector<term_t> result;
+    uint32_t matches = 0;
+
+    for(size_t i=0; i<terms.size(); i++)
+    {
+        if (used[i] || (terms[i].node != pattern.hiNode))
+        {
+            continue;
+        }
+
+        for(size_t j=0; j<terms.size(); j++)
+        {
+            if ((i == j) || used[j])
+            {
+                continue;
+            }
+
+            const term_t &lo = terms[j];
+            if ((lo.node == pattern.loNode) &&
+                (lo.shift == terms[i].shift - pattern.distance) &&
+                (lo.sign == terms[i].sign * pattern.sign))
+            {
+                used[i] = true;
+                used[j] = true;
+                matches++;
+
+                term_t shared;
+                shared.node  = newNode;
+                shared.shift = terms[i].shift;
+                shared.sign  = terms[i].sign;
+                result.push_back(shared);
+                break;
+            }
+        }
+    }
+
+    if (newNode > 0)
+    {
+        for(size_t i=0; i<terms.size(); i++)
+        {
+            if (!used[i])
+            {
+                result.push_back(terms[i]);
+            }
+        }
+        terms = result;
+    }
+    return matches;
+}
+
+/** add a node that sums two terms and return a term that references it */
+static term_t combineTerms(AdderGraph &graph, const term_t &t1, const term_t &t2)
+{
+    AdderGraph::node_t node;
+    term_t result;
+    result.shift = 0;
+    result.sign  = 1;
+
+    // the first term of a node is always positive so
+    // every node maps onto an adder or a subtractor.
+    if (t1.sign > 0)
+    {
+        node.a = t1;
+        node.b = t2;
+    }
+    else if (t2.sign > 0)
+    {
+        node.a = t2;
+        node.b = t1;
+    }
+    else
+    {
+        // -t1 - t2 = -(t1 + t2)
+        node.a = t1;
+        node.b = t2;
+        node.a.sign = 1;
+        node.b.sign = 1;
+        result.sign = -1;
+    }
+
+    graph.m_nodes.push_back(node);
+    result.node = static_cast<int32_t>(graph.m_nodes.size());
+    return result;
+}
+
+/** compute the values of the nodes that were added to the
+    graph since the values were last computed. a node only
+    refers to earlier nodes, so each value is computed once,
+    in node order. */
+static void extendValues(const AdderGraph &graph, std::vector<double> &values)
+{
+    if (values.size() == 0)
+    {
+        values.push_back(1.0);
+    }
+
+    while(values.size() <= graph.m_nodes.size())
+    {
+        const AdderGraph::node_t &n = graph.m_nodes[values.size()-1];
+        values.push_back(n.a.sign*ldexp(values.at(n.a.node), n.a.shift) +
+                         n.b.sign*ldexp(values.at(n.b.node), n.b.shift));
+    }
+}
+
+/** a partial sum of a constant that still has to be added */
+struct partialsum_t
+{
+    term_t   term;      ///< the term that holds the partial sum
+    uint32_t depth;     ///< number of adders on the longest path
+    int32_t  msb;       ///< position of the most significant bit of the weight
+};
+
+/** build a balanced tree that sums a list of terms.
+    the two shallowest partial sums are combined first so
+    the depth is ceil(log2(k)) for k input terms. Among
+    partial sums of equal depth, the ones that are closest
+    in magnitude are paired so the intermediate results
+    need as few bits as possible. */
+static term_t sumTerms(AdderGraph &graph, const std::vector<term_t> &terms)
+{
+    std::vector<double> values = graph.nodeValues();
+    std::vector<uint32_t> depths = graph.nodeDepths();
+    std::vector<partialsum_t> sums;
+    for(auto term : terms)
+    {
+        partialsum_t sum;
+        sum.term  = term;
+        sum.depth = depths.at(term.node);
+        sum.msb   = ilogb(ldexp(values.at(term.node), term.shift));
+        sums.push_back(sum);
+    }
+
+    while(sums.size() > 1)
+    {
+        // find the shallowest partial sum, the smallest one
+        // if there are several.
+        size_t first = 0;
+        for(size_t i=1; i<sums.size(); i++)
+        {
+            if ((sums[i].depth < sums[first].depth) ||
+                ((sums[i].depth == sums[first].depth) && (sums[i].msb < sums[first].msb)))
+            {
+                first = i;
+            }
+        }
+
+        // find the shallowest partner that is closest in magnitude
+        size_t second = (first == 0) ? 1 : 0;
+        for(size_t i=0; i<sums.size(); i++)
+        {
+            if ((i == first) || (i == second))
+            {
+                continue;
+            }
+
+            int32_t distance = abs(sums[i].msb - sums[first].msb);
+            int32_t bestDistance = abs(sums[second].msb - sums[first].msb);
+            if ((sums[i].depth < sums[second].depth) ||
+                ((sums[i].depth == sums[second].depth) && (distance < bestDistance)))
+            {
+                second = i;
+            }
+        }
+
+        partialsum_t sum;
+        sum.term  = combineTerms(graph, sums[first].term, sums[second].term);
+        sum.depth = std::max(sums[first].depth, sums[second].depth) + 1;
+        extendValues(graph, values);
+        sum.msb   = ilogb(values.at(sum.term.node));
+
+        sums.erase(sums.begin() + std::max(first, second));
+        sums.erase(sums.begin() + std::min(first, second));
+        sums.push_back(sum);
+    }
+    return sums.front().term;
+}
+
+AdderGraph AdderGraph::create(const std::vector<csd_t> &constants)
+{
+    AdderGraph graph;
+
+    // each digit of a constant is a shifted version of the input
+    std::vector< std::vector<term_t> > terms(constants.size());
+    for(size_t i=0; i<constants.size(); i++)
+    {
+        if (constants[i].digits.size() == 0)
+        {
+            throw std::runtime_error("CSD has no digits!");
+        }
+
+        for(auto digit : constants[i].digits)
+        {
+            term_t t;
+            t.node  = 0;
+            t.shift = digit.power;
+            t.sign  = digit.sign;
+            terms[i].push_back(t);
+        }
+    }
+
+    // common subexpression elimination over the digits:
+    // repeatedly compute the most frequent pair of terms
+    // as a separate node, until no pair occurs twice.
+    while(true)
+    {
+        std::map<pattern_t, uint32_t> candidates;
+        for(auto &list : terms)
+        {
+            for(size_t i=0; i<list.size(); i++)
+            {
+                for(size_t j=i+1; j<list.size(); j++)
+                {
+                    pattern_t p;
+                    if (makePattern(list[i], list[j], p))
+                    {
+                        candidates[p]++;
+                    }
+                }
+            }
+        }
+
+        // overlapping pairs are counted only once
+        // so we need to verify the candidates.
+        pattern_t best;
+        uint32_t bestCount = 1;
+        for(auto candidate : candidates)
+        {
+            if (candidate.second <= bestCount)
+            {
+                continue;
+            }
+
+            uint32_t count = 0;
+            for(auto &list : terms)
+            {
+                count += matchPattern(list, candidate.first, 0);
+            }
+
+            if (count > bestCount)
+            {
+                best = candidate.first;
+                bestCount = count;
+            }
+        }
+
+        if (bestCount < 2)
+        {
+            break;
+        }
+
+        AdderGraph::node_t node;
+        node.a.node  = best.hiNode;
+        node.a.shift = 0;
+        node.a.sign  = 1;
+        node.b.node  = best.loNode;
+        node.b.shift = -best.distance;
+        node.b.sign  = best.sign;
+        graph.m_nodes.push_back(node);
+
+        int32_t newNode = static_cast<int32_t>(graph.m_nodes.size());
+        for(auto &list : terms)
+        {
+            matchPattern(list, best, newNode);
+        }
+    }
+
+    // sum the remaining terms of each constant
+    // using an adder tree of minimal depth.
+    for(auto &list : terms)
+    {
+        graph.m_outputs.push_back(sumTerms(graph, list));
+    }
+
+    return graph;
+}
+
+std::string AdderGraph::makeKey(const std::vector<csd_t> &constants)
+{
+    // the generator version is part of the key so
+    // graphs made by older algorithms are not reused.
+    std::string key = "g2";
+    for(auto &constant : constants)
+    {
+        key += ";";
+        for(size_t i=0; i<constant.digits.size(); i++)
+        {
+            if (i != 0)
+            {
+                key += ",";
+            }
+            key += stringf("%c2^%d", (constant.digits[i].sign < 0) ? '-' : '+', constant.digits[i].power);
+        }
+    }
+    return key;
+}
+
+std::vector<size_t> AdderGraph::canonicalOrder(const std::vector<csd_t> &constants)
+{
+    std::vector< std::pair<std::string, size_t> > keys;
+    for(size_t i=0; i<constants.size(); i++)
+    {
+        std::vector<csd_t> single(1, constants[i]);
+        keys.push_back(std::make_pair(makeKey(single), i));
+    }
+    std::stable_sort(keys.begin(), keys.end(),
+        [](const std::pair<std::string, size_t> &k1, const std::pair<std::string, size_t> &k2)
+        {
+            return k1.first < k2.first;
+        });
+
+    std::vector<size_t> order;
+    for(auto key : keys)
+    {
+        order.push_back(key.second);
+    }
+    return order;
+}
+
+std::vector<double> AdderGraph::nodeValues() const
+{
+    std::vector<double> values;
+    extendValues(*this, values);
+    return values;
+}
+
+std::vector<uint32_t> AdderGraph::nodeDepths() const
+{
+    std::vector<uint32_t> depths(1, 0);
+    for(auto const &n : m_nodes)
+    {
+        depths.push_back(1 + std::max(depths.at(n.a.node), depths.at(n.b.node)));
+    }
+    return depths;
+}
+
+uint32_t AdderGraph::depth() const
+{
+    std::vector<uint32_t> depths = nodeDepths();
+    uint32_t maxDepth = 0;
+    for(auto output : m_outputs)
+    {
+        maxDepth = std::max(maxDepth, depths.at(output.node));
+    }
+    return maxDepth;
+}
+
+bool AdderGraph::produces(const std::vector<csd_t> &constants) const
+{
+    if (constants.size() != m_outputs.size())
+    {
+        return false;
+    }
+
+    // the values are multiples of 2^lo below 2^hi in
+    // magnitude. they are exact in a double when they
+    // span at most 53 bits.
+    const int64_t maxSpan = 53;
+    std::vector<int64_t> lo(1, 0);
+    std::vector<int64_t> hi(1, 1);
+    for(auto const &n : m_nodes)
+    {
+        lo.push_back(std::min(lo.at(n.a.node) + n.a.shift, lo.at(n.b.node) + n.b.shift));
+        hi.push_back(std::max(hi.at(n.a.node) + n.a.shift, hi.at(n.b.node) + n.b.shift) + 1);
+        if ((hi.back() - lo.back()) > maxSpan)
+        {
+            return false;
+        }
+    }
+
+    std::vector<double> values = nodeValues();
+    for(size_t i=0; i<constants.size(); i++)
+    {
+        double expected = 0.0;
+        int64_t minPower = 0;
+        int64_t maxPower = 0;
+        for(size_t j=0; j<constants[i].digits.size(); j++)
+        {
+            const csdigit_t &digit = constants[i].digits[j];
+            minPower = (j == 0) ? digit.power : std::min(minPower, static_cast<int64_t>(digit.power));
+            maxPower = (j == 0) ? digit.power : std::max(maxPower, static_cast<int64_t>(digit.power));
+            expected += ldexp(static_cast<double>(digit.sign), digit.power);
+        }
+
+        if ((maxPower - minPower) >= maxSpan)
+        {
+            return false;
+        }
+
+        const term_t &output = m_outputs[i];
+        if (output.sign*ldexp(values.at(output.node), output.shift) != expected)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void AdderGraph::write(std::ostream &os) const
+{
+    os << "nodes " << m_nodes.size() << "\n";
+    for(auto node : m_nodes)
+    {
+        os << node.a.node << " " << node.a.shift << " " << node.a.sign << " ";
+        os << node.b.node << " " << node.b.shift << " " << node.b.sign << "\n";
+    }
+
+    os << "outputs " << m_outputs.size() << "\n";
+    for(auto output : m_outputs)
+    {
+        os << output.node << " " << output.shift << " " << output.sign << "\n";
+    }
+}
+
+/** read a term and check that it references an existing node */
+static bool readTerm(std::istream &is, term_t &t, size_t nodeCount)
+{
+    is >> t.node >> t.shift >> t.sign;
+    if (!is)
+    {
+        return false;
+    }
+    return (t.node >= 0) && (static_cast<size_t>(t.node) <= nodeCount) &&
+           ((t.sign == 1) || (t.sign == -1));
+}
+
+bool AdderGraph::read(std::istream &is)
+{
+    std::string tag;
+    size_t count = 0;
+
+    m_nodes.clear();
+    m_outputs.clear();
+
+    is >> tag >> count;
+    if ((!is) || (tag != "nodes"))
+    {
+        return false;
+    }
+
+    for(size_t i=0; i<count; i++)
+    {
+        node_t node;
+        if (!readTerm(is, node.a, i) || !readTerm(is, node.b, i) || (node.a.sign < 0))
+        {
+            return false;
+        }
+        m_nodes.push_back(node);
+    }
+
+    is >> tag >> count;
+    if ((!is) || (tag != "outputs"))
+    {
+        return false;
+    }
+
+    for(size_t i=0; i<count; i++)
+    {
+        term_t output;
+        if (!readTerm(is, output, m_nodes.size()))
+        {
+            return false;
+        }
+        m_outputs.push_back(output);
+    }
+    return true;
+}
@@ -0,0 +1,123 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Persistent, content-addressed cache of
+                solved constant multiplier adder graphs.
+
+*/
+
+#include <cstdio>
+#include <fstream>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+#include "logging.h"
+#include "utils.h"
+#include "addergraphcache.h"
+
+#define CACHE_FILE_HEADER "fptool addergraph 1"
+
+AdderGraphCache::AdderGraphCache(const std::string &directory)
+    : m_directory(directory),
+      m_hits(0),
+      m_misses(0)
+{
+#ifdef _WIN32
+    _mkdir(directory.c_str());
+#else
+    mkdir(directory.c_str(), 0755);
+#endif
+}
+
+std::string AdderGraphCache::getFilename(const std::string &key) const
+{
+    // 64-bit FNV-1a hash of the key
+    uint64_t hash = 14695981039346656037ULL;
+    for(auto c : key)
+    {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 1099511628211ULL;
+    }
+
+    return m_directory + "/" + stringf("%016llx.adg", static_cast<unsigned long long>(hash));
+}
+
+AdderGraph AdderGraphCache::getGraph(const std::vector<csd_t> &constants)
+{
+    AdderGraph graph;
+    std::string key = AdderGraph::makeKey(constants);
+    if (!lookup(key, constants, graph))
+    {
+        graph = AdderGraph::create(constants);
+        store(key, graph);
+    }
+    return graph;
+}
+
+bool AdderGraphCache::lookup(const std::string &key, const std::vector<csd_t> &constants, AdderGraph &graph)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto iter = m_graphs.find(key);
+    if (iter != m_graphs.end())
+    {
+        graph = iter->second;
+        m_hits++;
+        return true;
+    }
+
+    std::ifstream file(getFilename(key));
+    if (file.is_open())
+    {
+        std::string header;
+        std::string storedKey;
+        std::getline(file, header);
+        std::getline(file, storedKey);
+        if ((header == CACHE_FILE_HEADER) && (storedKey == "key " + key) &&
+            graph.read(file) && graph.produces(constants))
+        {
+            m_graphs[key] = graph;
+            m_hits++;
+            return true;
+        }
+        doLog(LOG_WARN, "Ignoring invalid adder graph cache file %s\n", getFilename(key).c_str());
+    }
+
+    m_misses++;
+    return false;
+}
+
+void AdderGraphCache::store(const std::string &key, const AdderGraph &graph)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_graphs[key] = graph;
+
+    // write a temporary file and rename it, so other
+    // processes see either the old or the new file.
+    std::string filename = getFilename(key);
+    std::string tempname = filename + stringf(".%d.tmp", static_cast<int32_t>(getpid()));
+    std::ofstream file(tempname);
+    if (!file.is_open())
+    {
+        doLog(LOG_WARN, "Cannot write adder graph cache file %s\n", filename.c_str());
+        return;
+    }
+
+    file << CACHE_FILE_HEADER << "\n";
+    file << "key " << key << "\n";
+    graph.write(file);
+    file.close();
+
+    if (!file || (std::rename(tempname.c_str(), filename.c_str()) != 0))
+    {
+        doLog(LOG_WARN, "Cannot write adder graph cache file %s\n", filename.c_str());
+        std::remove(tempname.c_str());
+    }
+}
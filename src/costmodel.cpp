@@ -0,0 +1,269 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Area and timing cost model
+
+*/
+
+#include <stdlib.h>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include "logging.h"
+#include "ssaprint.h"
+#include "costmodel.h"
+
+using namespace SSA;
+
+CostModel::CostModel() :
+    m_family("default"),
+    m_adderLUTs(1.0),
+    m_compressorLUTs(1.0),
+    m_mulLUTs(0.5),
+    m_dspABits(25),
+    m_dspBBits(18),
+    m_dspMinBits(10),
+    m_ffs(1.0),
+    m_logicDelay(0.5),
+    m_carryDelay(0.05),
+    m_delays(DelayModel::MODEL_WIDTH)
+{
+    m_delays.setTiming(m_logicDelay, m_carryDelay);
+    m_cost.luts = 0.0;
+    m_cost.ffs  = 0.0;
+    m_cost.dsps = 0.0;
+}
+
+bool CostModel::readFamily(std::istream &is)
+{
+    std::string line;
+    uint32_t lineNumber = 0;
+    while(std::getline(is, line))
+    {
+        lineNumber++;
+        size_t comment = line.find('%');
+        if (comment != std::string::npos)
+        {
+            line = line.substr(0, comment);
+        }
+
+        std::stringstream ss(line);
+        std::vector<std::string> words;
+        std::string word;
+        while(ss >> word)
+        {
+            words.push_back(word);
+        }
+
+        if (words.size() == 0)
+        {
+            continue;
+        }
+
+        if (words.size() != 2)
+        {
+            doLog(LOG_ERROR, "Family file line %d: expected name value\n", lineNumber);
+            return false;
+        }
+
+        if (words[0] == "family")
+        {
+            m_family = words[1];
+            continue;
+        }
+
+        char *end = NULL;
+        double value = strtod(words[1].c_str(), &end);
+        if ((*end != 0) || (value < 0.0))
+        {
+            doLog(LOG_ERROR, "Family file line %d: invalid value '%s'\n",
+                  lineNumber, words[1].c_str());
+            return false;
+        }
+
+        if (words[0] == "adder_luts_per_bit")
+        {
+            m_adderLUTs = value;
+        }
+        else if (words[0] == "compressor_luts_per_bit")
+        {
+            m_compressorLUTs = value;
+        }
+        else if (words[0] == "mul_luts_per_bit")
+        {
+            m_mulLUTs = value;
+        }
+        else if (words[0] == "dsp_a_bits")
+        {
+            m_dspABits = static_cast<int32_t>(value);
+        }
+        else if (words[0] == "dsp_b_bits")
+        {
+            m_dspBBits = static_cast<int32_t>(value);
+        }
+        else if (words[0] == "dsp_min_bits")
+        {
+            m_dspMinBits = static_cast<int32_t>(value);
+        }
+        else if (words[0] == "ffs_per_bit")
+        {
+            m_ffs = value;
+        }
+        else if (words[0] == "logic_delay")
+        {
+            m_logicDelay = value;
+        }
+        else if (words[0] == "carry_delay")
+        {
+            m_carryDelay = value;
+        }
+        else
+        {
+            doLog(LOG_ERROR, "Family file line %d: unknown parameter '%s'\n",
+                  lineNumber, words[0].c_str());
+            return false;
+        }
+    }
+
+    if ((m_dspABits > 0) && (m_dspBBits <= 0))
+    {
+        doLog(LOG_ERROR, "Family file: dsp_b_bits must be set for DSP blocks\n");
+        return false;
+    }
+
+    m_delays.setTiming(m_logicDelay, m_carryDelay);
+    return true;
+}
+
+CostModel::cost_t CostModel::getCost(OperationBase *node)
+{
+    m_cost.luts = 0.0;
+    m_cost.ffs  = 0.0;
+    m_cost.dsps = 0.0;
+    if (!node->accept(this))
+    {
+        throw std::runtime_error("CostModel: unsupported instruction");
+    }
+    return m_cost;
+}
+
+void CostModel::report(const Program &ssa)
+{
+    doLog(LOG_INFO, "-------------------------\n");
+    doLog(LOG_INFO, "  Cost report (%s)\n", m_family.c_str());
+    doLog(LOG_INFO, "-------------------------\n");
+    doLog(LOG_INFO, "    LUTs      FFs  DSPs  delay/ns  instruction\n");
+
+    cost_t total = {0.0, 0.0, 0.0};
+    for(auto statement : ssa.m_statements)
+    {
+        cost_t cost = getCost(statement);
+        double delay = m_delays.getDelay(statement);
+        if ((cost.luts == 0.0) && (cost.ffs == 0.0) && (cost.dsps == 0.0))
+        {
+            continue;
+        }
+
+        std::stringstream ss;
+        Printer printer(ss, false);
+        statement->accept(&printer);
+        std::string text = ss.str();
+        if ((text.size() > 0) && (text.back() == '\n'))
+        {
+            text.pop_back();
+        }
+
+        doLog(LOG_INFO, "%8.1f %8.1f %5.0f %9.2f  %s\n", cost.luts, cost.ffs, cost.dsps, delay, text.c_str());
+        total.luts += cost.luts;
+        total.ffs  += cost.ffs;
+        total.dsps += cost.dsps;
+    }
+
+    doLog(LOG_INFO, "Total: %.0f LUTs, %.0f flip-flops, %.0f DSP blocks\n", total.luts, total.ffs, total.dsps);
+    doLog(LOG_INFO, "Critical path: %g ns\n", m_delays.calcCriticalPath(ssa));
+}
+
+bool CostModel::setAdderCost(const SharedOpPtr &lhs)
+{
+    m_cost.luts = m_adderLUTs*(lhs->m_intBits + lhs->m_fracBits);
+    return true;
+}
+
+bool CostModel::setCompressorCost(const SharedOpPtr &lhs)
+{
+    m_cost.luts = m_compressorLUTs*(lhs->m_intBits + lhs->m_fracBits);
+    return true;
+}
+
+void CostModel::setMultiplierCost(int32_t bits1, int32_t bits2)
+{
+    if ((m_dspABits <= 0) || (std::min(bits1, bits2) < m_dspMinBits))
+    {
+        m_cost.luts += m_mulLUTs*bits1*bits2;
+        return;
+    }
+
+    // a wide multiplication is split into tiles,
+    // in the orientation that needs the fewest.
+    int32_t tiles1 = ((bits1 + m_dspABits - 1) / m_dspABits) * ((bits2 + m_dspBBits - 1) / m_dspBBits);
+    int32_t tiles2 = ((bits2 + m_dspABits - 1) / m_dspABits) * ((bits1 + m_dspBBits - 1) / m_dspBBits);
+    m_cost.dsps += std::min(tiles1, tiles2);
+}
+
+bool CostModel::visit(const OpMul *node)
+{
+    setMultiplierCost(node->m_op1->m_intBits + node->m_op1->m_fracBits,
+                      node->m_op2->m_intBits + node->m_op2->m_fracBits);
+    return true;
+}
+
+bool CostModel::visit(const OpCSDMul *node)
+{
+    // an adder per non-zero digit after the first
+    size_t digits = node->m_csd.digits.size();
+    if (digits > 1)
+    {
+        setAdderCost(node->m_lhs);
+        m_cost.luts *= static_cast<double>(digits - 1);
+    }
+    return true;
+}
+
+bool CostModel::visit(const OpRegister *node)
+{
+    m_cost.ffs = m_ffs*(node->m_lhs->m_intBits + node->m_lhs->m_fracBits);
+    return true;
+}
+
+bool CostModel::visit(const OpMulAdd *node)
+{
+    SharedOpPtr mulInput = node->getMulInput();
+    setMultiplierCost(mulInput->m_intBits + mulInput->m_fracBits,
+                      node->m_b->m_intBits + node->m_b->m_fracBits);
+
+    // the adders and registers are inside the DSP
+    // block, unless the multiplication does not use one.
+    if (m_cost.dsps == 0.0)
+    {
+        if (node->m_preMode != OpMulAdd::ADD_NONE)
+        {
+            m_cost.luts += m_adderLUTs*(node->m_pre->m_intBits + node->m_pre->m_fracBits);
+        }
+        if (node->m_postMode != OpMulAdd::ADD_NONE)
+        {
+            m_cost.luts += m_adderLUTs*(node->m_lhs->m_intBits + node->m_lhs->m_fracBits);
+        }
+
+        SharedOpPtr ops[3] = {node->m_pre, node->m_prod, node->m_lhs};
+        bool registered[3] = {node->isPreRegistered(), node->isProdRegistered(), node->isLHSRegistered()};
+        for(uint32_t i=0; i<3; i++)
+        {
+            if (registered[i])
+            {
+                m_cost.ffs += m_ffs*(ops[i]->m_intBits + ops[i]->m_fracBits);
+            }
+        }
+    }
+    return true;
+}
@@ -54,6 +54,85 @@ bool convertToCSD(const double v, uint32_t terms, csd_t &result)
     return true;
 }
 
+/** convert mantissa * 2^exponent into canonical (non-adjacent) form */
+static bool convertDyadicToCSD(int64_t mantissa, int32_t exponent, csd_t &result)
+{
+    result.digits.clear();
+    result.value = ldexp(static_cast<double>(mantissa), exponent);
+    if (mantissa == 0)
+    {
+        return false;
+    }
+
+    // produce the digits starting with the
+    // smallest power of two.
+    std::vector<csdigit_t> digits;
+    while(mantissa != 0)
+    {
+        if ((mantissa & 1) != 0)
+        {
+            csdigit_t digit;
+            digit.power = exponent;
+            digit.sign  = ((mantissa & 3) == 1) ? 1 : -1;
+            mantissa -= digit.sign;
+            digits.push_back(digit);
+        }
+        mantissa /= 2;
+        exponent++;
+    }
+
+    result.digits.assign(digits.rbegin(), digits.rend());
+    result.intBits = result.digits[0].power+2;    // account for sign bit
+    result.fracBits= -result.digits.back().power;
+    return true;
+}
+
+bool convertIntegerToCSD(const int32_t v, csd_t &result)
+{
+    return convertDyadicToCSD(v, 0, result);
+}
+
+bool multiplyCSD(const csd_t &a, const csd_t &b, csd_t &result)
+{
+    if ((a.digits.size() == 0) || (b.digits.size() == 0))
+    {
+        return false;
+    }
+
+    // the digits are sorted from the largest to the
+    // smallest power, so the product needs the powers
+    // between the ones below.
+    int32_t minPower = a.digits.back().power + b.digits.back().power;
+    int32_t maxPower = a.digits.front().power + b.digits.front().power;
+    if (maxPower - minPower > 60)
+    {
+        return false;
+    }
+
+    int64_t mantissa = 0;
+    for(auto da : a.digits)
+    {
+        for(auto db : b.digits)
+        {
+            int64_t term = static_cast<int64_t>(1) << (da.power + db.power - minPower);
+            mantissa += (da.sign*db.sign > 0) ? term : -term;
+        }
+    }
+
+    return convertDyadicToCSD(mantissa, minPower, result);
+}
+
+csd_t negateCSD(const csd_t &csd)
+{
+    csd_t result = csd;
+    result.value = -csd.value;
+    for(auto &digit : result.digits)
+    {
+        digit.sign = -digit.sign;
+    }
+    return result;
+}
+
 fplib::SFix convertCSDToSFix(const csd_t &csd)
 {
     fplib::SFix num(csd.intBits, csd.fracBits);
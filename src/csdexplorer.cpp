@@ -0,0 +1,325 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Design space explorer for CSD term counts
+
+*/
+
+#include <map>
+#include <cmath>
+#include <algorithm>
+#include "logging.h"
+#include "parallel.h"
+#include "ssacreator.h"
+#include "ssabatchevaluator.h"
+#include "pass_constfold.h"
+#include "pass_csdmul.h"
+#include "csdexplorer.h"
+
+#define EXPLORE_REFTERMS  24        // terms of the reference constants
+#define EXPLORE_MAXPOINTS 100000    // largest number of design points
+
+CSDExplorer::CSDExplorer(AST::Statements &statements, AdderGraphCache *cache)
+    : m_statements(&statements),
+      m_cache(cache)
+{
+    for(auto node : statements.m_statements)
+    {
+        const AST::CSDDeclaration *csdNode = dynamic_cast<const AST::CSDDeclaration*>(node);
+        if (csdNode != NULL)
+        {
+            m_csdNodes.push_back(csdNode);
+        }
+    }
+}
+
+bool CSDExplorer::createProgram(const std::vector<uint32_t> &terms, SSA::Program &ssa) const
+{
+    std::map<std::string, uint32_t> overrides;
+    for(size_t i=0; i<m_csdNodes.size(); i++)
+    {
+        overrides[m_csdNodes[i]->m_identName] = terms[i];
+    }
+
+    SSA::Creator creator;
+    creator.setTermOverrides(overrides);
+    if (!creator.process(*m_statements, ssa))
+    {
+        return false;
+    }
+    return SSA::PassConstFold::execute(ssa);
+}
+
+uint32_t CSDExplorer::countAdders(const SSA::Program &ssa)
+{
+    uint32_t adders = 0;
+    for(auto statement : ssa.m_statements)
+    {
+        if ((dynamic_cast<const SSA::OpAdd*>(statement) != NULL) ||
+            (dynamic_cast<const SSA::OpSub*>(statement) != NULL) ||
+            (dynamic_cast<const SSA::OpNegate*>(statement) != NULL))
+        {
+            adders++;
+        }
+    }
+    return adders;
+}
+
+uint32_t CSDExplorer::calcLogicDepth(const SSA::Program &ssa)
+{
+    // the statements are in program order, so the depth of
+    // every operand is known before it is used.
+    std::map<const SSA::OperandBase*, uint32_t> depth;
+    uint32_t maxDepth = 0;
+    for(auto statement : ssa.m_statements)
+    {
+        const SSA::OperationSingle *single = dynamic_cast<const SSA::OperationSingle*>(statement);
+        const SSA::OperationDual *dual = dynamic_cast<const SSA::OperationDual*>(statement);
+
+        uint32_t d = 0;
+        const SSA::OperandBase *lhs = NULL;
+        if (single != NULL)
+        {
+            d   = depth[single->m_op.get()];
+            lhs = single->m_lhs.get();
+        }
+        else if (dual != NULL)
+        {
+            d   = std::max(depth[dual->m_op1.get()], depth[dual->m_op2.get()]);
+            lhs = dual->m_lhs.get();
+        }
+        else
+        {
+            continue;
+        }
+
+        if ((dynamic_cast<const SSA::OpAdd*>(statement) != NULL) ||
+            (dynamic_cast<const SSA::OpSub*>(statement) != NULL) ||
+            (dynamic_cast<const SSA::OpNegate*>(statement) != NULL))
+        {
+            d++;
+        }
+        depth[lhs] = d;
+        maxDepth = std::max(maxDepth, d);
+    }
+    return maxDepth;
+}
+
+void CSDExplorer::evaluatePoint(point_t &point) const
+{
+    point.valid = false;
+
+    SSA::Program ssa;
+    if (!createProgram(point.terms, ssa) || !SSA::PassCSDMul::execute(ssa, m_cache))
+    {
+        return;
+    }
+
+    SSA::BatchEvaluator eval(ssa);
+    if (!eval.isValid())
+    {
+        return;
+    }
+
+    double maxError = 0.0;
+    double sumSquares = 0.0;
+    size_t count = 0;
+    std::vector<double> outputs;
+    for(size_t i=0; i<m_inputs.size(); i++)
+    {
+        eval.evaluate(m_inputs[i], outputs);
+        for(size_t j=0; j<outputs.size(); j++)
+        {
+            double e = fabs(outputs[j] - m_reference[i][j]);
+            maxError = std::max(maxError, e);
+            sumSquares += e*e;
+            count++;
+        }
+    }
+
+    point.adders   = countAdders(ssa);
+    point.depth    = calcLogicDepth(ssa);
+    point.maxError = maxError;
+    point.rmsError = (count > 0) ? sqrt(sumSquares / count) : 0.0;
+    point.valid    = true;
+}
+
+bool CSDExplorer::explore(uint32_t maxTerms, uint32_t samples)
+{
+    if (m_csdNodes.size() == 0)
+    {
+        doLog(LOG_ERROR, "The design has no CSD declarations to explore\n");
+        return false;
+    }
+
+    // the reference uses constants that are as exact
+    // as a double allows and does not overflow.
+    SSA::Program refSSA;
+    std::vector<uint32_t> refTerms(m_csdNodes.size(), EXPLORE_REFTERMS);
+    if (!createProgram(refTerms, refSSA))
+    {
+        doLog(LOG_ERROR, "Cannot create the reference program\n");
+        return false;
+    }
+
+    SSA::BatchEvaluator refEval(refSSA, true);
+    if (!refEval.isValid())
+    {
+        doLog(LOG_ERROR, "The reference program contains unsupported operations\n");
+        return false;
+    }
+
+    uint32_t seed = 0x12345678;
+    m_inputs.resize(samples);
+    m_reference.resize(samples);
+    for(uint32_t i=0; i<samples; i++)
+    {
+        refEval.randomizeInputs(m_inputs[i], seed);
+        refEval.evaluate(m_inputs[i], m_reference[i]);
+    }
+
+    // more terms than needed for an exact value
+    // produce the same constant, so they are skipped.
+    std::vector<uint32_t> termLimit;
+    size_t pointCount = 1;
+    for(auto node : m_csdNodes)
+    {
+        uint32_t limit = 1;
+        while(limit < maxTerms)
+        {
+            csd_t csd;
+            convertToCSD(node->m_value, limit, csd);
+            if (csd.digits.size() < limit)
+            {
+                limit = std::max(static_cast<uint32_t>(csd.digits.size()), 1U);
+                break;
+            }
+            limit++;
+        }
+        termLimit.push_back(limit);
+        pointCount *= limit;
+        if (pointCount > EXPLORE_MAXPOINTS)
+        {
+            doLog(LOG_ERROR, "Too many design points, use a lower maximum number of terms\n");
+            return false;
+        }
+    }
+
+    m_points.clear();
+    std::vector<uint32_t> terms(m_csdNodes.size(), 1);
+    for(size_t p=0; p<pointCount; p++)
+    {
+        point_t point;
+        point.terms = terms;
+        m_points.push_back(point);
+
+        // next combination of term counts
+        for(size_t i=0; i<terms.size(); i++)
+        {
+            if (terms[i] < termLimit[i])
+            {
+                terms[i]++;
+                break;
+            }
+            terms[i] = 1;
+        }
+    }
+
+    doLog(LOG_INFO, "Exploring %d design points using %d threads\n",
+          static_cast<int32_t>(m_points.size()), getWorkerCount());
+
+    // the passes log a lot of information for
+    // every point, so keep them quiet.
+    setQuiet(true);
+    parallelFor(m_points.size(), [this](size_t i)
+    {
+        evaluatePoint(m_points[i]);
+    });
+    setQuiet(false);
+
+    findParetoFront();
+    doLog(LOG_INFO, "Pareto front has %d points\n", static_cast<int32_t>(m_front.size()));
+    return true;
+}
+
+void CSDExplorer::findParetoFront()
+{
+    std::vector<point_t> sorted;
+    for(auto &point : m_points)
+    {
+        if (point.valid)
+        {
+            sorted.push_back(point);
+        }
+    }
+
+    std::stable_sort(sorted.begin(), sorted.end(), [](const point_t &p1, const point_t &p2)
+    {
+        if (p1.adders != p2.adders) return p1.adders < p2.adders;
+        if (p1.depth != p2.depth) return p1.depth < p2.depth;
+        return p1.maxError < p2.maxError;
+    });
+
+    // a point can only be dominated by a point that comes
+    // earlier in the sorted order, and if it is, it is also
+    // dominated by a point on the front.
+    m_front.clear();
+    for(auto &point : sorted)
+    {
+        bool dominated = false;
+        for(auto &best : m_front)
+        {
+            if ((best.adders <= point.adders) && (best.depth <= point.depth) &&
+                (best.maxError <= point.maxError))
+            {
+                dominated = true;
+                break;
+            }
+        }
+
+        if (!dominated)
+        {
+            m_front.push_back(point);
+        }
+    }
+}
+
+void CSDExplorer::writeCSV(std::ostream &os) const
+{
+    os << "adders,depth,max_error,rms_error";
+    for(auto node : m_csdNodes)
+    {
+        os << "," << node->m_identName;
+    }
+    os << "\n";
+
+    for(auto &point : m_front)
+    {
+        os << point.adders << "," << point.depth << ",";
+        os << point.maxError << "," << point.rmsError;
+        for(auto terms : point.terms)
+        {
+            os << "," << terms;
+        }
+        os << "\n";
+    }
+}
+
+void CSDExplorer::writeJSON(std::ostream &os) const
+{
+    os << "[\n";
+    for(size_t p=0; p<m_front.size(); p++)
+    {
+        const point_t &point = m_front[p];
+        os << "  {\"adders\": " << point.adders << ", \"depth\": " << point.depth;
+        os << ", \"max_error\": " << point.maxError << ", \"rms_error\": " << point.rmsError;
+        os << ", \"terms\": {";
+        for(size_t i=0; i<m_csdNodes.size(); i++)
+        {
+            os << ((i == 0) ? "" : ", ") << "\"" << m_csdNodes[i]->m_identName << "\": " << point.terms[i];
+        }
+        os << "}}" << ((p+1 < m_front.size()) ? "," : "") << "\n";
+    }
+    os << "]\n";
+}
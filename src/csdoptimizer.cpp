@@ -0,0 +1,369 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Coefficient set quantization optimizer
+
+*/
+
+#include <cmath>
+#include <sstream>
+#include <algorithm>
+#include "logging.h"
+#include "utils.h"
+#include "parallel.h"
+#include "addergraph.h"
+#include "csdoptimizer.h"
+
+#define CSDOPT_MAXDIGITS 16
+
+CSDOptimizer::CSDOptimizer(AdderGraphCache *cache)
+    : m_cache(cache),
+      m_metric(METRIC_MAX),
+      m_bound(0.0),
+      m_adders(0),
+      m_error(0.0)
+{
+}
+
+void CSDOptimizer::addCoefficient(const std::string &name, double value)
+{
+    coefficient_t coef;
+    coef.name  = name;
+    coef.value = value;
+
+    // collect the quantized values with an increasing
+    // number of digits, until the value is exact.
+    for(uint32_t digits=1; digits<=CSDOPT_MAXDIGITS; digits++)
+    {
+        csd_t csd;
+        convertToCSD(value, digits, csd);
+        coef.options.push_back(csd);
+        if (csd.digits.size() < digits)
+        {
+            break;
+        }
+    }
+
+    m_coefficients.push_back(coef);
+}
+
+bool CSDOptimizer::readCoefficients(std::istream &is)
+{
+    std::string line;
+    uint32_t lineNumber = 0;
+    while(std::getline(is, line))
+    {
+        lineNumber++;
+        size_t comment = line.find('%');
+        if (comment != std::string::npos)
+        {
+            line = line.substr(0, comment);
+        }
+
+        std::stringstream ss(line);
+        std::vector<std::string> words;
+        std::string word;
+        while(ss >> word)
+        {
+            words.push_back(word);
+        }
+
+        if (words.size() == 0)
+        {
+            continue;
+        }
+
+        std::string name = stringf("c%d", static_cast<int32_t>(m_coefficients.size()));
+        if (words.size() == 2)
+        {
+            name = words[0];
+        }
+        else if (words.size() != 1)
+        {
+            doLog(LOG_ERROR, "Coefficient file line %d: expected [name] value\n", lineNumber);
+            return false;
+        }
+
+        char *end = NULL;
+        double value = strtod(words.back().c_str(), &end);
+        if (*end != 0)
+        {
+            doLog(LOG_ERROR, "Coefficient file line %d: invalid value '%s'\n",
+                  lineNumber, words.back().c_str());
+            return false;
+        }
+        addCoefficient(name, value);
+    }
+    return true;
+}
+
+bool CSDOptimizer::parseMetric(const std::string &spec, metric_t &metric, double &bound)
+{
+    size_t colon = spec.find(':');
+    if (colon == std::string::npos)
+    {
+        return false;
+    }
+
+    std::string name = spec.substr(0, colon);
+    if (name == "max")
+    {
+        metric = METRIC_MAX;
+    }
+    else if (name == "l2")
+    {
+        metric = METRIC_L2;
+    }
+    else
+    {
+        return false;
+    }
+
+    char *end = NULL;
+    std::string boundStr = spec.substr(colon+1);
+    bound = strtod(boundStr.c_str(), &end);
+    return (*end == 0) && (bound > 0.0);
+}
+
+double CSDOptimizer::calcError(const allocation_t &alloc) const
+{
+    double error = 0.0;
+    for(size_t i=0; i<m_coefficients.size(); i++)
+    {
+        double e = fabs(m_coefficients[i].value - getCSD(alloc, i).value);
+        if (m_metric == METRIC_MAX)
+        {
+            error = std::max(error, e);
+        }
+        else
+        {
+            error += e*e;
+        }
+    }
+    return (m_metric == METRIC_MAX) ? error : sqrt(error);
+}
+
+uint32_t CSDOptimizer::calcAdders(const allocation_t &alloc) const
+{
+    // build the set of constants in the same order as
+    // PassCSDMul does; zero coefficients need no adders.
+    std::vector<csd_t> unordered;
+    for(size_t i=0; i<m_coefficients.size(); i++)
+    {
+        if (getCSD(alloc, i).digits.size() != 0)
+        {
+            unordered.push_back(getCSD(alloc, i));
+        }
+    }
+
+    if (unordered.size() == 0)
+    {
+        return 0;
+    }
+
+    std::vector<csd_t> constants;
+    for(auto index : AdderGraph::canonicalOrder(unordered))
+    {
+        constants.push_back(unordered[index]);
+    }
+
+    if (m_cache != NULL)
+    {
+        return m_cache->getGraph(constants).adderCount();
+    }
+    return AdderGraph::create(constants).adderCount();
+}
+
+bool CSDOptimizer::optimize(metric_t metric, double bound)
+{
+    m_metric = metric;
+    m_bound  = bound;
+
+    if (m_coefficients.size() == 0)
+    {
+        doLog(LOG_ERROR, "No coefficients to optimize\n");
+        return false;
+    }
+
+    // start with the fewest digits that give each coefficient
+    // an error within the bound; no metric can do with less.
+    allocation_t alloc;
+    for(auto &coef : m_coefficients)
+    {
+        uint32_t digits = 1;
+        while((digits < coef.options.size()) &&
+              (fabs(coef.value - coef.options[digits-1].value) > bound))
+        {
+            digits++;
+        }
+        alloc.push_back(digits);
+    }
+
+    struct candidate_t
+    {
+        allocation_t alloc;
+        double       error;
+        uint32_t     adders;
+    };
+
+    // evaluate the candidates in parallel; each one
+    // requires an adder graph of the whole set.
+    auto evaluate = [this](std::vector<candidate_t> &candidates)
+    {
+        parallelFor(candidates.size(), [this, &candidates](size_t i)
+        {
+            candidates[i].error  = calcError(candidates[i].alloc);
+            candidates[i].adders = calcAdders(candidates[i].alloc);
+        });
+    };
+
+    candidate_t current;
+    current.alloc  = alloc;
+    current.error  = calcError(alloc);
+    current.adders = calcAdders(alloc);
+
+    // phase 1: add digits to the coefficient that reduces
+    // the error the most per additional adder, until the
+    // error bound is met.
+    while(current.error > bound)
+    {
+        std::vector<candidate_t> candidates;
+        for(size_t i=0; i<m_coefficients.size(); i++)
+        {
+            if (current.alloc[i] < m_coefficients[i].options.size())
+            {
+                candidate_t c = current;
+                c.alloc[i]++;
+                candidates.push_back(c);
+            }
+        }
+
+        if (candidates.size() == 0)
+        {
+            doLog(LOG_ERROR, "Error bound %g cannot be met with %d digits per coefficient\n",
+                  bound, CSDOPT_MAXDIGITS);
+            return false;
+        }
+
+        evaluate(candidates);
+
+        size_t best = 0;
+        double bestScore = -1.0;
+        for(size_t i=0; i<candidates.size(); i++)
+        {
+            double gain  = current.error - candidates[i].error;
+            double extra = std::max(0.0, static_cast<double>(candidates[i].adders) - current.adders);
+            double score = gain / (1.0 + extra);
+            if (score > bestScore)
+            {
+                best = i;
+                bestScore = score;
+            }
+        }
+        current = candidates[best];
+        doLog(LOG_DEBUG, "  error %g with %d adders\n", current.error, current.adders);
+    }
+
+    // phase 2: move single digits while this lowers the
+    // adder count, or the error at an equal adder count.
+    // adding a digit can lower the adder count when it
+    // creates a pattern that is shared with other coefficients.
+    while(true)
+    {
+        std::vector<candidate_t> candidates;
+        for(size_t i=0; i<m_coefficients.size(); i++)
+        {
+            if (current.alloc[i] > 1)
+            {
+                candidate_t c = current;
+                c.alloc[i]--;
+                candidates.push_back(c);
+            }
+            if (current.alloc[i] < m_coefficients[i].options.size())
+            {
+                candidate_t c = current;
+                c.alloc[i]++;
+                candidates.push_back(c);
+            }
+        }
+
+        evaluate(candidates);
+
+        const candidate_t *best = &current;
+        for(auto &c : candidates)
+        {
+            if ((c.error <= bound) &&
+                ((c.adders < best->adders) ||
+                 ((c.adders == best->adders) && (c.error < best->error))))
+            {
+                best = &c;
+            }
+        }
+
+        if (best == &current)
+        {
+            break;
+        }
+        current = *best;
+        doLog(LOG_DEBUG, "  error %g with %d adders\n", current.error, current.adders);
+    }
+
+    m_best   = current.alloc;
+    m_error  = current.error;
+    m_adders = current.adders;
+
+    doLog(LOG_INFO, "Optimized %d coefficients: %d adders, error %g\n",
+          static_cast<int32_t>(m_coefficients.size()), m_adders, m_error);
+    return true;
+}
+
+/** format a value so the tokenizer reads it as a float */
+static std::string formatFloat(double value)
+{
+    std::string txt = stringf("%.17g", fabs(value));
+    size_t expPos = txt.find('e');
+    if (txt.find('.') == std::string::npos)
+    {
+        if (expPos == std::string::npos)
+        {
+            txt += ".0";
+        }
+        else
+        {
+            txt.insert(expPos, ".0");
+        }
+    }
+
+    // the tokenizer does not accept a '+' in the exponent
+    size_t plusPos = txt.find("e+");
+    if (plusPos != std::string::npos)
+    {
+        txt.erase(plusPos+1, 1);
+    }
+    return (value < 0.0) ? "-" + txt : txt;
+}
+
+void CSDOptimizer::writeDeclarations(std::ostream &os) const
+{
+    const char *metricName = (m_metric == METRIC_MAX) ? "max" : "l2";
+    os << "% " << m_coefficients.size() << " coefficients, " << m_adders << " adders\n";
+    os << "% " << metricName << " error " << m_error << " (bound " << m_bound << ")\n";
+
+    for(size_t i=0; i<m_coefficients.size(); i++)
+    {
+        const coefficient_t &coef = m_coefficients[i];
+        const csd_t &csd = getCSD(m_best, i);
+        if (csd.digits.size() == 0)
+        {
+            os << "% " << coef.name << " quantizes to zero\n";
+            continue;
+        }
+
+        // the quantized value is written, which is
+        // converted into the same digits again.
+        os << "define " << coef.name << " = csd(" << formatFloat(csd.value) << ", "
+           << csd.digits.size() << ");";
+        os << "  % " << stringf("%.12g", coef.value) << "\n";
+    }
+}
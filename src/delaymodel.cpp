@@ -0,0 +1,146 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Combinational delay model
+
+*/
+
+#include <map>
+#include <cmath>
+#include <algorithm>
+#include "delaymodel.h"
+
+// default delay of a logic level, including routing, in ns
+#define DELAY_LOGIC 0.5
+
+// default delay per bit of a carry chain, in ns
+#define DELAY_CARRY 0.05
+
+using namespace SSA;
+
+DelayModel::DelayModel(model_t model) : m_model(model), m_delay(0.0),
+    m_logicDelay(DELAY_LOGIC), m_carryDelay(DELAY_CARRY)
+{
+}
+
+double DelayModel::getDelay(OperationBase *node)
+{
+    m_delay = 0.0;
+    if (!node->accept(this))
+    {
+        throw std::runtime_error("DelayModel: unsupported instruction");
+    }
+    return m_delay;
+}
+
+double DelayModel::calcCriticalPath(const Program &ssa)
+{
+    // inputs and register outputs start a path
+    // with an arrival time of zero.
+    std::map<const OperandBase*, double> arrival;
+    double critical = 0.0;
+    for(auto statement : ssa.m_statements)
+    {
+        double t = 0.0;
+        if (dynamic_cast<const OpRegister*>(statement) == NULL)
+        {
+            for(auto const &input : statement->getInputs())
+            {
+                auto iter = arrival.find(input.get());
+                if (iter != arrival.end())
+                {
+                    t = std::max(t, iter->second);
+                }
+            }
+            t += getDelay(statement);
+        }
+
+        SharedOpPtr lhs = statement->getLHS();
+        if (lhs)
+        {
+            arrival[lhs.get()] = t;
+        }
+        critical = std::max(critical, t);
+    }
+    return critical;
+}
+
+double DelayModel::adderDelay(int32_t bits) const
+{
+    return m_logicDelay + m_carryDelay*std::max(bits, 1);
+}
+
+bool DelayModel::setAdderDelay(const SharedOpPtr &lhs)
+{
+    if (m_model == MODEL_DEPTH)
+    {
+        m_delay = 1.0;
+    }
+    else
+    {
+        m_delay = adderDelay(lhs->m_intBits + lhs->m_fracBits);
+    }
+    return true;
+}
+
+bool DelayModel::setCompressorDelay()
+{
+    m_delay = (m_model == MODEL_DEPTH) ? 0.0 : m_logicDelay;
+    return true;
+}
+
+bool DelayModel::visit(const OpMul *node)
+{
+    if (m_model == MODEL_DEPTH)
+    {
+        m_delay = 1.0;
+        return true;
+    }
+
+    // the partial products are summed in a tree,
+    // followed by a carry chain of the full width.
+    int32_t w1 = node->m_op1->m_intBits + node->m_op1->m_fracBits;
+    int32_t w2 = node->m_op2->m_intBits + node->m_op2->m_fracBits;
+    double levels = ceil(log2(static_cast<double>(std::max(std::min(w1, w2), 2))));
+    m_delay = m_logicDelay*levels + adderDelay(node->m_lhs->m_intBits + node->m_lhs->m_fracBits);
+    return true;
+}
+
+bool DelayModel::visit(const OpMulAdd *node)
+{
+    if (m_model == MODEL_DEPTH)
+    {
+        m_delay = 1.0;
+        return true;
+    }
+
+    // as a multiplication, followed by the carry
+    // chain of the post-adder, if any.
+    int32_t w1 = node->getMulInput()->m_intBits + node->getMulInput()->m_fracBits;
+    int32_t w2 = node->m_b->m_intBits + node->m_b->m_fracBits;
+    double levels = ceil(log2(static_cast<double>(std::max(std::min(w1, w2), 2))));
+    m_delay = m_logicDelay*levels + adderDelay(node->m_prod->m_intBits + node->m_prod->m_fracBits);
+    if (node->m_postMode != OpMulAdd::ADD_NONE)
+    {
+        m_delay += adderDelay(node->m_lhs->m_intBits + node->m_lhs->m_fracBits);
+    }
+    return true;
+}
+
+bool DelayModel::visit(const OpCSDMul *node)
+{
+    // a CSD multiplier becomes an adder tree
+    // with one input per non-zero digit.
+    size_t digits = node->m_csd.digits.size();
+    if (digits < 2)
+    {
+        m_delay = 0.0;
+        return true;
+    }
+
+    double levels = ceil(log2(static_cast<double>(digits)));
+    setAdderDelay(node->m_lhs);
+    m_delay *= levels;
+    return true;
+}
@@ -0,0 +1,118 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Known-bits analysis
+
+*/
+
+#include <algorithm>
+#include "knownbits.h"
+
+using namespace SSA;
+
+void KnownBits::analyse(const Program &ssa)
+{
+    // the statements are in dependency order, so the
+    // inputs of each statement have been analysed.
+    m_bits.clear();
+    for(auto statement : ssa.m_statements)
+    {
+        if (!statement->accept(this))
+        {
+            throw std::runtime_error("KnownBits: unsupported instruction");
+        }
+    }
+}
+
+int32_t KnownBits::getZeroLSBs(const SharedOpPtr &op) const
+{
+    return op->m_fracBits - getBits(op).fracBits;
+}
+
+int32_t KnownBits::getSignBits(const SharedOpPtr &op) const
+{
+    return op->m_intBits - getBits(op).intBits;
+}
+
+KnownBits::bits_t KnownBits::getBits(const SharedOpPtr &op) const
+{
+    // a view has the bits of its source, like a reinterpret
+    const ViewOperand *view = dynamic_cast<const ViewOperand*>(op.get());
+    if (view != NULL)
+    {
+        bits_t bits = getBits(view->m_source);
+        bits.intBits  += view->m_intBits - view->m_source->m_intBits;
+        bits.fracBits += view->m_fracBits - view->m_source->m_fracBits;
+        return bits;
+    }
+
+    auto iter = m_bits.find(op.get());
+    if (iter != m_bits.end())
+    {
+        return iter->second;
+    }
+
+    bits_t bits;
+    bits.intBits  = op->m_intBits;
+    bits.fracBits = op->m_fracBits;
+    return bits;
+}
+
+bool KnownBits::setBits(const SharedOpPtr &lhs, int32_t intBits, int32_t fracBits)
+{
+    bits_t bits;
+    bits.intBits  = std::min(intBits, lhs->m_intBits);
+    bits.fracBits = std::min(fracBits, lhs->m_fracBits);
+
+    // at least the sign bit is unknown
+    if ((bits.intBits + bits.fracBits) < 1)
+    {
+        bits.intBits = 1 - bits.fracBits;
+    }
+    m_bits[lhs.get()] = bits;
+    return true;
+}
+
+bool KnownBits::copyBits(const OperationSingle *node)
+{
+    bits_t bits = getBits(node->m_op);
+    return setBits(node->m_lhs, bits.intBits, bits.fracBits);
+}
+
+bool KnownBits::setUnknown(const SharedOpPtr &lhs)
+{
+    return setBits(lhs, lhs->m_intBits, lhs->m_fracBits);
+}
+
+bool KnownBits::setAddSubBits(const OperationDual *node)
+{
+    bits_t b1 = getBits(node->m_op1);
+    bits_t b2 = getBits(node->m_op2);
+    return setBits(node->m_lhs, std::max(b1.intBits, b2.intBits) + 1,
+                   std::max(b1.fracBits, b2.fracBits));
+}
+
+bool KnownBits::visit(const OpMul *node)
+{
+    bits_t b1 = getBits(node->m_op1);
+    bits_t b2 = getBits(node->m_op2);
+    return setBits(node->m_lhs, b1.intBits + b2.intBits, b1.fracBits + b2.fracBits);
+}
+
+bool KnownBits::visit(const OpNegate *node)
+{
+    // the negation of the most negative value
+    // needs an additional bit.
+    bits_t bits = getBits(node->m_op);
+    return setBits(node->m_lhs, bits.intBits + 1, bits.fracBits);
+}
+
+bool KnownBits::visit(const OpReinterpret *node)
+{
+    // the bits stay the same, only the binary point moves
+    bits_t bits = getBits(node->m_op);
+    return setBits(node->m_lhs,
+                   bits.intBits + node->m_lhs->m_intBits - node->m_op->m_intBits,
+                   bits.fracBits + node->m_lhs->m_fracBits - node->m_op->m_fracBits);
+}
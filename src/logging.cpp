@@ -14,6 +14,7 @@
 #include "logging.h"
 
 static bool g_debugEnabled = false;
+static bool g_quiet = false;
 static FILE* g_logFile = NULL;
 
 void setDebugging(bool enabled)
@@ -21,6 +22,11 @@ void setDebugging(bool enabled)
     g_debugEnabled = enabled;
 }
 
+void setQuiet(bool quiet)
+{
+    g_quiet = quiet;
+}
+
 bool setLogFile(const char *filename)
 {
     if (g_logFile != NULL)
@@ -42,6 +48,11 @@ void closeLogFile()
 
 void doLog(logtype_t t, const char *format, ...)
 {
+    if (g_quiet && (t != LOG_ERROR))
+    {
+        return;
+    }
+
     switch(t)
     {
     case LOG_INFO:
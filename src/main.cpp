@@ -9,6 +9,9 @@
 #include <fstream>
 #include <sstream>
 #include <iomanip>
+#include <cmath>
+#include <limits>
+#include <map>
 
 #include "logging.h"
 #include "cmdline.h"
@@ -18,14 +21,35 @@
 #include "ssa.h"
 #include "ssacreator.h"
 #include "ssaprint.h"
+#include "ssaverifier.h"
 
 #include "ssaevaluator.h"
 #include "csd.h"
 #include "pass_addsub.h"
 #include "pass_truncate.h"
 #include "pass_csdmul.h"
+#include "pass_constfold.h"
+#include "pass_cse.h"
+#include "pass_dce.h"
+#include "pass_range.h"
+#include "pass_precision.h"
+#include "pass_pipeline.h"
+#include "pass_retime.h"
+#include "pass_carrysave.h"
+#include "pass_reassociate.h"
+#include "pass_negate.h"
+#include "pass_wordlength.h"
+#include "pass_dsp.h"
+#include "scheduler.h"
+#include "costmodel.h"
+#include "addergraphcache.h"
+#include "csdoptimizer.h"
+#include "csdexplorer.h"
 #include "pass_clean.h"
+#include "pass_peephole.h"
 #include "pass_removeoperands.h"
+#include "pass_partition.h"
+#include "parallel.h"
 #include "vhdlcodegen.h"
 #include "vhdlrealgen.h"
 #include "astgraphviz.h"
@@ -33,20 +57,179 @@
 #define __FPTOOLVERSION__ "0.1a"
 
 
+/** lower the constant multiplications and the additions
+    and clean up the result. returns false if the program
+    does not pass the verifier after a pass. */
+static bool optimizeProgram(SSA::Program &ssa, AdderGraphCache *graphCache, bool verbose)
+{
+    // ------------------------------------------------------------
+    // -- CSD PASS
+    // ------------------------------------------------------------
+    SSA::PassCSDMul::execute(ssa, graphCache);
+    if (!SSA::Verifier::execute(ssa, "CSDMul"))
+    {
+        return false;
+    }
+
+    // ------------------------------------------------------------
+    // -- ABSORB THE NEGATED CSD OUTPUTS INTO ADDERS
+    // ------------------------------------------------------------
+    if (!SSA::PassNegate::execute(ssa))
+    {
+        doLog(LOG_ERROR, "Negate pass failed\n");
+    }
+    if (!SSA::Verifier::execute(ssa, "Negate"))
+    {
+        return false;
+    }
+
+    if (verbose)
+    {
+        std::stringstream ss;
+        SSA::Printer::print(ssa, ss, true);
+        doLog(LOG_DEBUG, "\n%s", ss.str().c_str());
+    }
+
+
+    // ------------------------------------------------------------
+    // -- RANGE PASS
+    // ------------------------------------------------------------
+    if (!SSA::PassRange::execute(ssa))
+    {
+        doLog(LOG_ERROR, "Range pass failed\n");
+    }
+    if (!SSA::Verifier::execute(ssa, "Range"))
+    {
+        return false;
+    }
+
+    // ------------------------------------------------------------
+    // -- ADDSUB PASS
+    // ------------------------------------------------------------
+    if (!SSA::PassAddSub::execute(ssa))
+    {
+        doLog(LOG_ERROR, "ADDSUB pass failed\n");
+    }
+    if (!SSA::Verifier::execute(ssa, "AddSub"))
+    {
+        return false;
+    }
+
+    if (verbose)
+    {
+        std::stringstream ss;
+        SSA::Printer::print(ssa, ss, true);
+        doLog(LOG_DEBUG, "\n%s", ss.str().c_str());
+    }
+
+    // ------------------------------------------------------------
+    // -- TRUNCATE PASS
+    // ------------------------------------------------------------
+    if (!SSA::PassTruncate::execute(ssa))
+    {
+        doLog(LOG_ERROR, "TRUNCATE pass failed\n");
+    }
+    if (!SSA::Verifier::execute(ssa, "Truncate"))
+    {
+        return false;
+    }
+
+    // ------------------------------------------------------------
+    // -- REMOVE COMMON SUBEXPRESSIONS CREATED BY THE LOWERING
+    // ------------------------------------------------------------
+    if (!SSA::PassCSE::execute(ssa))
+    {
+        doLog(LOG_ERROR, "CSE pass failed\n");
+    }
+    if (!SSA::Verifier::execute(ssa, "CSE"))
+    {
+        return false;
+    }
+
+    if (verbose)
+    {
+        std::stringstream ss;
+        SSA::Printer::print(ssa, ss, true);
+        doLog(LOG_DEBUG, "\n%s", ss.str().c_str());
+    }
+
+    // ------------------------------------------------------------
+    // -- CLEAN PASS
+    // ------------------------------------------------------------
+    if (!SSA::PassClean::execute(ssa))
+    {
+        doLog(LOG_ERROR, "Clean pass failed\n");
+    }
+    if (!SSA::Verifier::execute(ssa, "Clean"))
+    {
+        return false;
+    }
+
+    // ------------------------------------------------------------
+    // -- REMOVE REDUNDANT WIDTH ADJUSTMENTS
+    // ------------------------------------------------------------
+    if (!SSA::PassPeephole::execute(ssa))
+    {
+        doLog(LOG_ERROR, "Peephole pass failed\n");
+    }
+    if (!SSA::Verifier::execute(ssa, "Peephole"))
+    {
+        return false;
+    }
+
+    if (verbose)
+    {
+        std::stringstream ss;
+        SSA::Printer::print(ssa, ss, true);
+        doLog(LOG_DEBUG, "\n%s", ss.str().c_str());
+    }
+
+    // ------------------------------------------------------------
+    // -- Remove instructions that do not reach an output
+    // ------------------------------------------------------------
+    if (!SSA::PassDCE::execute(ssa))
+    {
+        doLog(LOG_ERROR, "DCE pass failed\n");
+    }
+    if (!SSA::Verifier::execute(ssa, "DCE"))
+    {
+        return false;
+    }
+    return true;
+}
+
 int main(int argc, char *argv[])
 {
     bool verbose = false;
-    CmdLine cmdline("ogL","dVr");
+    CmdLine cmdline("ogLCextbwpfmaDcjH","dVrqRs");
 
     printf("FPTOOL version " __FPTOOLVERSION__ " compiled on " __DATE__ "\n\n");
     if (!cmdline.parseOptions(argc, argv))
     {
-        printf("\nUsage: fptool <source.fp>\n\n");
+        printf("\nUsage: fptool <source.fp>\n");
+        printf("       fptool -q <coefficients.txt>\n\n");
         printf("options: \n");
         printf("  -o <outputfile>    Output file for VHDL code.\n");
         printf("  -g <graphvizfile>  Output file for Graphviz/dot program visualisation.\n");
         printf("  -L <logfile>       Write output log to file.\n");
+        printf("  -C <cachedir>      Cache CSD adder graphs in a directory.\n");
         printf("  -r                 Generate REAL-based VHDL code.\n");
+        printf("  -q                 Quantize a coefficient set to CSD declarations.\n");
+        printf("  -e <metric:bound>  Error bound for -q, metric is max or l2 (default max:1e-3).\n");
+        printf("  -x <file.csv|json> Explore CSD term counts and write the Pareto front.\n");
+        printf("  -t <maxterms>      Maximum number of terms per CSD for -x (default 6).\n");
+        printf("  -b <bound>         Allow an output error up to bound to remove more LSBs.\n");
+        printf("  -w <metric:target> Truncate intermediates to an output error target, metric is max or snr.\n");
+        printf("  -s                 Use carry-save compressor trees for multi-operand additions.\n");
+        printf("  -p <depth|Xns>     Insert pipeline registers for a maximum adder depth or delay.\n");
+        printf("  -R                 Move the registers to minimize the critical path.\n");
+        printf("  -f <cycles>        Fold the program onto shared multipliers, a sample every cycles.\n");
+        printf("  -m <multipliers>   Number of shared multipliers for -f (default: fewest that fit).\n");
+        printf("  -a <adders>        Share the adders for -f too, 0 is the fewest that fit.\n");
+        printf("  -D <AxB[xP][:N]>   Map multiply-adds onto DSP slices with N pipeline registers.\n");
+        printf("  -c <familyfile>    Report the estimated LUTs, flip-flops, DSP blocks and delay.\n");
+        printf("  -j <threads>       Optimize clusters of output cones concurrently, 0 is all cores.\n");
+        printf("  -H <entity>        Generate an entity per cluster of output cones and a top level.\n");
         printf("  -d                 Enable debug output.\n");
         printf("  -V                 Enable verbose output.\n");
         printf("\n\n");
@@ -71,6 +254,57 @@ int main(int argc, char *argv[])
             setLogFile(logfile.c_str());
         }
 
+        // ------------------------------------------------------------
+        // -- COEFFICIENT SET QUANTIZATION
+        // ------------------------------------------------------------
+        if (cmdline.hasOption('q'))
+        {
+            std::ifstream coefStream(cmdline.getMainArg());
+            if (!coefStream.is_open())
+            {
+                printf("Error opening file! %s\n", cmdline.getMainArg().c_str());
+                return 1;
+            }
+
+            std::string metricSpec = "max:1e-3";
+            cmdline.getOption('e', metricSpec);
+
+            CSDOptimizer::metric_t metric;
+            double bound;
+            if (!CSDOptimizer::parseMetric(metricSpec, metric, bound))
+            {
+                doLog(LOG_ERROR, "Invalid error metric %s\n", metricSpec.c_str());
+                return 1;
+            }
+
+            std::string cacheDir;
+            AdderGraphCache *graphCache = NULL;
+            if (cmdline.getOption('C', cacheDir))
+            {
+                graphCache = new AdderGraphCache(cacheDir);
+            }
+
+            CSDOptimizer optimizer(graphCache);
+            bool ok = optimizer.readCoefficients(coefStream) && optimizer.optimize(metric, bound);
+            if (ok)
+            {
+                std::string outfile;
+                if (cmdline.getOption('o', outfile))
+                {
+                    std::ofstream outstream(outfile, std::ofstream::out);
+                    optimizer.writeDeclarations(outstream);
+                }
+                else
+                {
+                    optimizer.writeDeclarations(std::cout);
+                }
+            }
+
+            delete graphCache;
+            closeLogFile();
+            return ok ? 0 : 1;
+        }
+
         Reader* reader = Reader::open(cmdline.getMainArg().c_str());
         if (reader == 0)
         {
@@ -137,6 +371,46 @@ int main(int argc, char *argv[])
                 graphvizStream.close();
             }
 
+            // ------------------------------------------------------------
+            // -- EXPLORE CSD TERM COUNTS
+            // ------------------------------------------------------------
+            std::string exploreFilename;
+            if (cmdline.getOption('x', exploreFilename))
+            {
+                std::string maxTermsStr = "6";
+                cmdline.getOption('t', maxTermsStr);
+                uint32_t maxTerms = static_cast<uint32_t>(atoi(maxTermsStr.c_str()));
+
+                std::string cacheDir;
+                AdderGraphCache *graphCache = NULL;
+                if (cmdline.getOption('C', cacheDir))
+                {
+                    graphCache = new AdderGraphCache(cacheDir);
+                }
+
+                CSDExplorer explorer(statements, graphCache);
+                bool ok = (maxTerms > 0) && explorer.explore(maxTerms);
+                if (ok)
+                {
+                    std::ofstream exploreStream(exploreFilename, std::ofstream::out);
+                    bool json = (exploreFilename.size() >= 5) &&
+                                (exploreFilename.substr(exploreFilename.size()-5) == ".json");
+                    if (json)
+                    {
+                        explorer.writeJSON(exploreStream);
+                    }
+                    else
+                    {
+                        explorer.writeCSV(exploreStream);
+                    }
+                    doLog(LOG_INFO, "Pareto front written to %s\n", exploreFilename.c_str());
+                }
+
+                delete graphCache;
+                closeLogFile();
+                return ok ? 0 : 1;
+            }
+
             SSA::Creator ssaCreator;
             SSA::Program ssa;
             if (!ssaCreator.process(statements, ssa))
@@ -144,6 +418,30 @@ int main(int argc, char *argv[])
                 doLog(LOG_ERROR, "Error producing SSA: %s\n", ssaCreator.getLastError().c_str());
             }
 
+            // ------------------------------------------------------------
+            // -- FOLD CONSTANT PRODUCTS
+            // ------------------------------------------------------------
+            if (!SSA::PassConstFold::execute(ssa))
+            {
+                doLog(LOG_ERROR, "Error folding constants!\n");
+                return 1;
+            }
+            if (!SSA::Verifier::execute(ssa, "ConstFold"))
+            {
+                return 1;
+            }
+
+            // the reference evaluator and the fuzzer should not
+            // spend time on instructions that do not reach an output.
+            if (!SSA::PassDCE::execute(ssa))
+            {
+                doLog(LOG_ERROR, "DCE pass failed\n");
+            }
+            if (!SSA::Verifier::execute(ssa, "DCE"))
+            {
+                return 1;
+            }
+
             if (verbose)
             {
                 std::stringstream ss;
@@ -181,6 +479,8 @@ int main(int argc, char *argv[])
             // -- GENERATE A REFERENCE EVALUATOR TO CHECK OUR PASSES
             // ------------------------------------------------------------
 
+            // the copy has its own operands, so the passes
+            // that change their formats leave it alone.
             SSA::Program referenceSSA = ssa;
             SSA::Evaluator eval(referenceSSA);
 
@@ -192,15 +492,149 @@ int main(int argc, char *argv[])
             }
 
             // ------------------------------------------------------------
-            // -- CSD PASS
+            // -- REMOVE COMMON SUBEXPRESSIONS
+            // -- after the reference copy, so the fuzzer checks CSE too
             // ------------------------------------------------------------
-            SSA::PassCSDMul::execute(ssa);
+            if (!SSA::PassCSE::execute(ssa))
+            {
+                doLog(LOG_ERROR, "CSE pass failed\n");
+            }
+            if (!SSA::Verifier::execute(ssa, "CSE"))
+            {
+                return 1;
+            }
 
-            if (verbose)
+            // ------------------------------------------------------------
+            // -- REBALANCE CHAINS OF ADDITIONS AND SUBTRACTIONS
+            // ------------------------------------------------------------
+            if (!SSA::PassReassociate::execute(ssa))
             {
-                std::stringstream ss;
-                SSA::Printer::print(ssa, ss, true);
-                doLog(LOG_DEBUG, "\n%s", ss.str().c_str());
+                doLog(LOG_ERROR, "Reassociate pass failed\n");
+            }
+            if (!SSA::Verifier::execute(ssa, "Reassociate"))
+            {
+                return 1;
+            }
+
+            // ------------------------------------------------------------
+            // -- PRECISION PASS
+            // ------------------------------------------------------------
+            double errorBound = 0.0;
+            std::string errorBoundStr;
+            if (cmdline.getOption('b', errorBoundStr))
+            {
+                errorBound = atof(errorBoundStr.c_str());
+            }
+
+            if (!SSA::PassPrecision::execute(ssa, errorBound))
+            {
+                doLog(LOG_ERROR, "Precision pass failed\n");
+            }
+            if (!SSA::Verifier::execute(ssa, "Precision"))
+            {
+                return 1;
+            }
+
+            // ------------------------------------------------------------
+            // -- MOVE NEGATIONS INTO CONSTANT PRODUCTS
+            // ------------------------------------------------------------
+            if (!SSA::PassNegate::execute(ssa))
+            {
+                doLog(LOG_ERROR, "Negate pass failed\n");
+            }
+            if (!SSA::Verifier::execute(ssa, "Negate"))
+            {
+                return 1;
+            }
+
+            // ------------------------------------------------------------
+            // -- WORD-LENGTH OPTIMIZATION
+            // ------------------------------------------------------------
+            std::string wordLengthStr;
+            double snrTarget = -std::numeric_limits<double>::infinity();
+            if (cmdline.getOption('w', wordLengthStr))
+            {
+                SSA::PassWordLength::metric_t metric;
+                double target = 0.0;
+                if (!SSA::PassWordLength::parse(wordLengthStr, metric, target))
+                {
+                    doLog(LOG_ERROR, "Invalid word-length target '%s'\n", wordLengthStr.c_str());
+                    return 1;
+                }
+
+                // the validation checks the target of the user,
+                // the error bound of the pass is only reported.
+                double wordLengthError = 0.0;
+                if (!SSA::PassWordLength::execute(ssa, metric, target, wordLengthError))
+                {
+                    doLog(LOG_ERROR, "Word-length pass failed\n");
+                    return 1;
+                }
+                if (!SSA::Verifier::execute(ssa, "WordLength"))
+                {
+                    return 1;
+                }
+
+                if (metric == SSA::PassWordLength::METRIC_MAXERROR)
+                {
+                    errorBound += target;
+                }
+                else
+                {
+                    // a single output has no signal-to-noise ratio,
+                    // so the ratio is checked over the fuzzing runs.
+                    errorBound = std::numeric_limits<double>::infinity();
+                    snrTarget = target;
+                }
+            }
+
+            // ------------------------------------------------------------
+            // -- LOWER AND OPTIMIZE THE PROGRAM
+            // ------------------------------------------------------------
+            std::string cacheDir;
+            AdderGraphCache *graphCache = NULL;
+            if (cmdline.getOption('C', cacheDir))
+            {
+                doLog(LOG_INFO, "Adder graph cache: %s\n", cacheDir.c_str());
+                graphCache = new AdderGraphCache(cacheDir);
+            }
+
+            bool optimized = false;
+            std::string jobsStr;
+            if (cmdline.getOption('j', jobsStr))
+            {
+                // the clusters of output cones are optimized
+                // concurrently. common subexpressions that
+                // the lowering creates in different clusters
+                // are removed afterwards.
+                setWorkerCount(static_cast<uint32_t>(atoi(jobsStr.c_str())));
+                optimized = SSA::PassPartition::execute(ssa, [graphCache](SSA::Program &cluster)
+                {
+                    return optimizeProgram(cluster, graphCache, false);
+                });
+
+                if (optimized)
+                {
+                    if (!SSA::PassCSE::execute(ssa))
+                    {
+                        doLog(LOG_ERROR, "CSE pass failed\n");
+                    }
+                    if (!SSA::PassDCE::execute(ssa))
+                    {
+                        doLog(LOG_ERROR, "DCE pass failed\n");
+                    }
+                    optimized = SSA::Verifier::execute(ssa, "Partition");
+                }
+            }
+            else
+            {
+                optimized = optimizeProgram(ssa, graphCache, verbose);
+            }
+            delete graphCache;
+
+            if (!optimized)
+            {
+                return 1;
             }
 
 #if 0
@@ -227,56 +661,197 @@ int main(int argc, char *argv[])
 #endif
 
             // ------------------------------------------------------------
-            // -- ADDSUB PASS
+            // -- Remove unused variables
             // ------------------------------------------------------------
-            if (!SSA::PassAddSub::execute(ssa))
+            if (!SSA::PassRemoveOperands::execute(ssa))
+            {
+                doLog(LOG_ERROR, "RemoveOperands pass failed\n");
+            }
+            if (!SSA::Verifier::execute(ssa, "RemoveOperands"))
             {
-                doLog(LOG_ERROR, "ADDSUB pass failed\n");
+                return 1;
             }
 
-            if (verbose)
+            // ------------------------------------------------------------
+            // -- Lower multi-operand additions to compressor trees
+            // ------------------------------------------------------------
+            if (cmdline.hasOption('s'))
             {
-                std::stringstream ss;
-                SSA::Printer::print(ssa, ss, true);
-                doLog(LOG_DEBUG, "\n%s", ss.str().c_str());
+                if (!SSA::PassCarrySave::execute(ssa))
+                {
+                    doLog(LOG_ERROR, "CarrySave pass failed\n");
+                }
+                if (!SSA::Verifier::execute(ssa, "CarrySave"))
+                {
+                    return 1;
+                }
+
+                if (!SSA::PassRemoveOperands::execute(ssa))
+                {
+                    doLog(LOG_ERROR, "RemoveOperands pass failed\n");
+                }
+                if (!SSA::Verifier::execute(ssa, "RemoveOperands"))
+                {
+                    return 1;
+                }
             }
 
             // ------------------------------------------------------------
-            // -- TRUNCATE PASS
+            // -- Map multiply-add patterns onto DSP slices
             // ------------------------------------------------------------
-            if (!SSA::PassTruncate::execute(ssa))
+            std::string dspStr;
+            if (cmdline.getOption('D', dspStr))
             {
-                doLog(LOG_ERROR, "TRUNCATE pass failed\n");
+                if (cmdline.hasOption('p') || cmdline.hasOption('R') || cmdline.hasOption('f'))
+                {
+                    doLog(LOG_ERROR, "DSP mapping cannot be combined with pipelining or folding\n");
+                    return 1;
+                }
+
+                SSA::PassDSP::dsp_t dsp;
+                if (!SSA::PassDSP::parse(dspStr, dsp))
+                {
+                    doLog(LOG_ERROR, "Invalid DSP slice '%s'\n", dspStr.c_str());
+                    return 1;
+                }
+
+                if (!SSA::PassDSP::execute(ssa, dsp))
+                {
+                    doLog(LOG_ERROR, "DSP pass failed\n");
+                }
+                if (!SSA::Verifier::execute(ssa, "DSP"))
+                {
+                    return 1;
+                }
+
+                if (!SSA::PassRemoveOperands::execute(ssa))
+                {
+                    doLog(LOG_ERROR, "RemoveOperands pass failed\n");
+                }
+                if (!SSA::Verifier::execute(ssa, "RemoveOperands"))
+                {
+                    return 1;
+                }
             }
 
-            if (verbose)
+            // ------------------------------------------------------------
+            // -- Estimate the area and the delay
+            // ------------------------------------------------------------
+            std::string familyFile;
+            if (cmdline.getOption('c', familyFile))
             {
-                std::stringstream ss;
-                SSA::Printer::print(ssa, ss, true);
-                doLog(LOG_DEBUG, "\n%s", ss.str().c_str());
+                SSA::CostModel costs;
+                std::ifstream familyStream(familyFile);
+                if (!familyStream.good())
+                {
+                    doLog(LOG_ERROR, "Cannot open family file %s\n", familyFile.c_str());
+                    return 1;
+                }
+
+                if (!costs.readFamily(familyStream))
+                {
+                    return 1;
+                }
+                costs.report(ssa);
             }
 
             // ------------------------------------------------------------
-            // -- CLEAN PASS
+            // -- Insert pipeline registers
             // ------------------------------------------------------------
-            if (!SSA::PassClean::execute(ssa))
+            std::string pipelineStr;
+            if (cmdline.getOption('p', pipelineStr))
             {
-                doLog(LOG_ERROR, "Clean pass failed\n");
+                // a target ending in "ns" is a delay, otherwise
+                // it is the number of adders in series.
+                char *end = NULL;
+                double target = strtod(pipelineStr.c_str(), &end);
+                SSA::DelayModel::model_t model = SSA::DelayModel::MODEL_DEPTH;
+                if (std::string(end) == "ns")
+                {
+                    model = SSA::DelayModel::MODEL_WIDTH;
+                }
+                else if (*end != 0)
+                {
+                    target = 0.0;
+                }
+
+                if (target <= 0.0)
+                {
+                    doLog(LOG_ERROR, "Invalid pipeline target '%s'\n", pipelineStr.c_str());
+                    return 1;
+                }
+
+                if (!SSA::PassPipeline::execute(ssa, model, target))
+                {
+                    doLog(LOG_ERROR, "Pipeline pass failed\n");
+                }
+                if (!SSA::Verifier::execute(ssa, "Pipeline"))
+                {
+                    return 1;
+                }
             }
 
-            if (verbose)
+            // ------------------------------------------------------------
+            // -- Retime the registers
+            // ------------------------------------------------------------
+            if (cmdline.hasOption('R'))
             {
-                std::stringstream ss;
-                SSA::Printer::print(ssa, ss, true);
-                doLog(LOG_DEBUG, "\n%s", ss.str().c_str());
+                if (!SSA::PassRetime::execute(ssa))
+                {
+                    doLog(LOG_ERROR, "Retime pass failed\n");
+                }
+                if (!SSA::Verifier::execute(ssa, "Retime"))
+                {
+                    return 1;
+                }
             }
 
             // ------------------------------------------------------------
-            // -- Remove unused variables
+            // -- Fold the program onto shared operators
             // ------------------------------------------------------------
-            if (!SSA::PassRemoveOperands::execute(ssa))
+            SSA::Scheduler *schedule = NULL;
+            std::string foldStr;
+            if (cmdline.getOption('f', foldStr))
             {
-                doLog(LOG_ERROR, "RemoveOperands pass failed\n");
+                if (cmdline.hasOption('p') || cmdline.hasOption('R'))
+                {
+                    doLog(LOG_ERROR, "Folding cannot be combined with pipelining\n");
+                    return 1;
+                }
+
+                if (cmdline.hasOption('H'))
+                {
+                    doLog(LOG_ERROR, "Folding cannot be combined with hierarchical output\n");
+                    return 1;
+                }
+
+                schedule = new SSA::Scheduler(static_cast<uint32_t>(atoi(foldStr.c_str())));
+
+                std::string unitsStr = "0";
+                cmdline.getOption('m', unitsStr);
+                schedule->share(SSA::Scheduler::RES_MULTIPLIER, static_cast<uint32_t>(atoi(unitsStr.c_str())));
+                if (cmdline.getOption('a', unitsStr))
+                {
+                    schedule->share(SSA::Scheduler::RES_ADDER, static_cast<uint32_t>(atoi(unitsStr.c_str())));
+                }
+
+                if (!schedule->execute(ssa))
+                {
+                    doLog(LOG_ERROR, "Scheduling failed\n");
+                    return 1;
+                }
+            }
+
+            // ------------------------------------------------------------
+            // -- Replace the reinterpretations by views
+            // ------------------------------------------------------------
+            if (!SSA::PassClean::execute(ssa, true))
+            {
+                doLog(LOG_ERROR, "Clean pass failed\n");
+            }
+            if (!SSA::Verifier::execute(ssa, "Clean"))
+            {
+                return 1;
             }
 
 #if 0
@@ -301,7 +876,7 @@ int main(int argc, char *argv[])
             }
 
             std::stringstream report;            
-            if (!eval3.compareToRefEvaluator(eval, report))
+            if (!eval3.compareOutputsToRefEvaluator(eval, report, errorBound))
             {
                 doLog(LOG_INFO, "---=========================---\n");
                 doLog(LOG_INFO, "---=== EVALUATION FAILED ===---\n");
@@ -324,6 +899,8 @@ int main(int argc, char *argv[])
 
             doLog(LOG_INFO, "\n\n--== FUZZING ==--\n\n");
             bool fuzzError = false;
+            std::map<std::string, double> signal;
+            std::map<std::string, double> noise;
             for(uint32_t i=0; i<1000; i++)
             {
                 report.clear();
@@ -331,8 +908,27 @@ int main(int argc, char *argv[])
                 eval.runProgram();
                 eval3.initInputsFromRefEvaluator(eval);
                 eval3.runProgram();
-                if (!eval3.compareToRefEvaluator(eval, report))
+                if (!eval3.compareOutputsToRefEvaluator(eval, report, errorBound))
+                {
+                    fuzzError = true;
+                }
+                eval3.accumulateOutputNoise(eval, signal, noise);
+            }
+
+            // the ratio is estimated on other input vectors
+            // than those of the word-length pass, so it may
+            // come out a fraction of a dB below the target.
+            for(auto const &output : noise)
+            {
+                if (output.second <= 0.0)
                 {
+                    continue;
+                }
+
+                double snr = 10.0*log10(signal[output.first] / output.second);
+                if (snr < (snrTarget - 1.0))
+                {
+                    doLog(LOG_ERROR, "Output %s misses the SNR target: %.1f dB\n", output.first.c_str(), snr);
                     fuzzError = true;
                 }
             }
@@ -349,20 +945,31 @@ int main(int argc, char *argv[])
             // ------------------------------------------------------------
             // -- VHDL code generation
             // ------------------------------------------------------------
-            if (outstream.bad())
+            std::string entityName;
+            if (cmdline.getOption('H', entityName))
+            {
+                // the clusters are split off and merged again
+                std::ostream &os = outstream.bad() ? std::cout : outstream;
+                if (!SSA::VHDLCodeGen::generateHierarchy(os, ssa, entityName, !outstream.bad()))
+                {
+                    doLog(LOG_ERROR, "Error generating VHDL code!\n");
+                }
+            }
+            else if (outstream.bad())
             {
-                if (!SSA::VHDLCodeGen::generateCode(std::cout, ssa))
+                if (!SSA::VHDLCodeGen::generateCode(std::cout, ssa, false, schedule))
                 {
                     doLog(LOG_ERROR, "Error generating VHDL code!\n");
                 }
             }
             else
             {
-                if (!SSA::VHDLCodeGen::generateCode(outstream, ssa, true))
+                if (!SSA::VHDLCodeGen::generateCode(outstream, ssa, true, schedule))
                 {
                     doLog(LOG_ERROR, "Error generating VHDL code!\n");
                 }
             }
+            delete schedule;
         }
         else
         {
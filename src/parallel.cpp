@@ -0,0 +1,83 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Simple parallel loop helper
+
+*/
+
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <exception>
+#include "parallel.h"
+
+static uint32_t gs_workers = 0;
+
+uint32_t getWorkerCount()
+{
+    if (gs_workers != 0)
+    {
+        return gs_workers;
+    }
+
+    uint32_t hwThreads = std::thread::hardware_concurrency();
+    return (hwThreads == 0) ? 1 : hwThreads;
+}
+
+void setWorkerCount(uint32_t workers)
+{
+    gs_workers = workers;
+}
+
+void parallelFor(size_t count, const std::function<void(size_t)> &func)
+{
+    size_t workers = std::min(static_cast<size_t>(getWorkerCount()), count);
+    if (workers <= 1)
+    {
+        for(size_t i=0; i<count; i++)
+        {
+            func(i);
+        }
+        return;
+    }
+
+    // the workers take the next index from a shared
+    // counter so uneven work items are balanced.
+    std::atomic<size_t> next(0);
+    std::vector<std::exception_ptr> errors(workers);
+    std::vector<std::thread> threads;
+    for(size_t w=0; w<workers; w++)
+    {
+        threads.push_back(std::thread([&, w]()
+        {
+            try
+            {
+                size_t i;
+                while((i = next++) < count)
+                {
+                    func(i);
+                }
+            }
+            catch(...)
+            {
+                errors[w] = std::current_exception();
+                next = count;
+            }
+        }));
+    }
+
+    for(auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    for(auto &error : errors)
+    {
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+}
@@ -207,22 +207,36 @@ AST::InputDeclaration* Parser::acceptDefspec1(state_t &s)
 
 AST::CSDDeclaration *Parser::acceptDefspec2(state_t &s)
 {
-    // production: CSD LPAREN FLOAT COMMA INTEGER RPAREN
+    // production: CSD LPAREN [MINUS] FLOAT COMMA INTEGER RPAREN
 
     const uint32_t tokenList[] =
         {TOK_CSD, TOK_LPAREN, TOK_FLOAT, TOK_COMMA, TOK_INTEGER, TOK_RPAREN, 0};
+    const uint32_t negTokenList[] =
+        {TOK_CSD, TOK_LPAREN, TOK_MINUS, TOK_FLOAT, TOK_COMMA, TOK_INTEGER, TOK_RPAREN, 0};
 
     state_t savestate = s;
+    bool negative = false;
     if (!matchList(s, tokenList))
     {
         s=savestate;
-        return NULL;
+        if (!matchList(s, negTokenList))
+        {
+            s=savestate;
+            return NULL;
+        }
+        negative = true;
     }
 
     AST::CSDDeclaration* newNode = new AST::CSDDeclaration();
-    float    value = atof(getToken(s, -4).txt.c_str()); // first argument
+    double   value = atof(getToken(s, -4).txt.c_str()); // first argument
     uint32_t bits  = atoi(getToken(s, -2).txt.c_str()); // second argument
+    if (negative)
+    {
+        value = -value;
+    }
 
+    newNode->m_value = value;
+    newNode->m_terms = bits;
     if (!convertToCSD(value, bits, newNode->m_csd))
     {
         error(s,"acceptDefspec2: cannot convert CSD");
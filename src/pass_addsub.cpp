@@ -27,8 +27,12 @@ bool PassAddSub::execute(Program &ssa)
         }
     }
 
-    ssa.applyPatches(); // integrate the generate OpPatchBlock instructions.
-    ssa.updateOutputPrecisions();
+    // only the instructions of the patch blocks
+    // and the instructions that use their results
+    // can change precision.
+    std::vector<const OperationBase*> modified;
+    ssa.applyPatches(modified); // integrate the generate OpPatchBlock instructions.
+    ssa.updateOutputPrecisions(modified);
     return true;
 }
 
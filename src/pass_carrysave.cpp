@@ -0,0 +1,335 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Carry-save lowering SSA pass
+
+*/
+
+#include <cmath>
+#include <deque>
+#include "logging.h"
+#include "pass_carrysave.h"
+
+using namespace SSA;
+
+bool PassCarrySave::execute(Program &ssa)
+{
+    doLog(LOG_INFO, "--------------------------\n");
+    doLog(LOG_INFO, "  Running CarrySave pass\n");
+    doLog(LOG_INFO, "--------------------------\n");
+
+    PassCarrySave pass(ssa);
+
+    for(auto statement : ssa.m_statements)
+    {
+        if (statement->isPatchBlock())
+        {
+            doLog(LOG_ERROR, "CarrySave pass: unexpected patch block\n");
+            return false;
+        }
+
+        SharedOpPtr lhs = statement->getLHS();
+        if (lhs)
+        {
+            pass.m_definitions[lhs.get()] = statement;
+        }
+        for(auto const &input : statement->getInputs())
+        {
+            pass.m_uses[input.get()]++;
+        }
+    }
+
+    // the users of a result come after its definition, so
+    // visiting the statements backwards finds the root of
+    // each tree first.
+    std::map<OperationBase*, OperationBase*> replacements;
+    uint32_t trees = 0;
+    for(auto iter = ssa.m_statements.rbegin(); iter != ssa.m_statements.rend(); iter++)
+    {
+        if (replacements.find(*iter) != replacements.end())
+        {
+            continue;
+        }
+
+        OperationDual *node = dynamic_cast<OpAdd*>(*iter);
+        if (node == NULL)
+        {
+            node = dynamic_cast<OpSub*>(*iter);
+        }
+        if (node == NULL)
+        {
+            continue;
+        }
+
+        std::vector<term_t> terms;
+        std::vector<OperationBase*> merged;
+        pass.collectTerms(node->m_lhs, false, node->m_lhs, terms, merged);
+        if (terms.size() < 3)
+        {
+            continue;
+        }
+
+        OpPatchBlock *patch = pass.lowerTree(node, terms);
+        if (patch == NULL)
+        {
+            continue;
+        }
+
+        doLog(LOG_DEBUG, "Lowering %s with %d terms\n",
+              node->m_lhs->m_identName.c_str(), static_cast<int32_t>(terms.size()));
+
+        replacements[node] = patch;
+        pass.m_adders++;
+        for(auto statement : merged)
+        {
+            replacements[statement] = new OpNull();
+            if ((dynamic_cast<OpAdd*>(statement) != NULL) || (dynamic_cast<OpSub*>(statement) != NULL))
+            {
+                pass.m_adders++;
+            }
+        }
+        trees++;
+    }
+
+    for(auto &statement : ssa.m_statements)
+    {
+        auto iter = replacements.find(statement);
+        if (iter != replacements.end())
+        {
+            // patch blocks delete the instruction they replace
+            if (!iter->second->isPatchBlock())
+            {
+                delete statement;
+            }
+            statement = iter->second;
+        }
+    }
+
+    doLog(LOG_INFO, "Replaced %d adders by %d compressor trees with %d compressors\n",
+          pass.m_adders, trees, pass.m_compressors);
+
+    ssa.applyPatches();
+    return true;
+}
+
+PassCarrySave::range_t PassCarrySave::collectTerms(const SharedOpPtr &op, bool negative, const SharedOpPtr &root,
+                                                   std::vector<term_t> &terms, std::vector<OperationBase*> &merged)
+{
+    OperationBase *definition = NULL;
+    auto iter = m_definitions.find(op.get());
+    if (iter != m_definitions.end())
+    {
+        definition = iter->second;
+    }
+
+    OpAdd        *add       = dynamic_cast<OpAdd*>(definition);
+    OpSub        *sub       = dynamic_cast<OpSub*>(definition);
+    OpNegate     *negate    = dynamic_cast<OpNegate*>(definition);
+    OpExtendLSBs *extendLSB = dynamic_cast<OpExtendLSBs*>(definition);
+    OpExtendMSBs *extendMSB = dynamic_cast<OpExtendMSBs*>(definition);
+    OpRemoveMSBs *removeMSB = dynamic_cast<OpRemoveMSBs*>(definition);
+
+    // an intermediate result can only be merged when
+    // the tree is its only user.
+    bool mergeable = (add != NULL) || (sub != NULL) || (negate != NULL) ||
+                     (extendLSB != NULL) || (extendMSB != NULL) || (removeMSB != NULL);
+    if ((op != root) &&
+        ((!mergeable) || (m_uses[op.get()] != 1) ||
+         (dynamic_cast<OutputOperand*>(op.get()) != NULL) ||
+         (op->m_fracBits > root->m_fracBits)))
+    {
+        mergeable = false;
+    }
+
+    size_t termCount   = terms.size();
+    size_t mergedCount = merged.size();
+    range_t range;
+    if (mergeable)
+    {
+        if (op != root)
+        {
+            merged.push_back(definition);
+        }
+
+        if ((add != NULL) || (sub != NULL))
+        {
+            OperationDual *dual = (add != NULL) ? static_cast<OperationDual*>(add) : static_cast<OperationDual*>(sub);
+            range_t r1 = collectTerms(dual->m_op1, negative, root, terms, merged);
+            range_t r2 = collectTerms(dual->m_op2, (sub != NULL) ? !negative : negative, root, terms, merged);
+            range.minValue = r1.minValue + r2.minValue;
+            range.maxValue = r1.maxValue + r2.maxValue;
+        }
+        else if (negate != NULL)
+        {
+            // the terms of the argument are negated, so
+            // their range is already the range of -x.
+            range = collectTerms(negate->m_op, !negative, root, terms, merged);
+        }
+        else
+        {
+            range = collectTerms(static_cast<OperationSingle*>(definition)->m_op, negative, root, terms, merged);
+        }
+
+        // the terms are summed modulo the word size of the root.
+        // a narrower intermediate result must not wrap around,
+        // as it is no longer reduced modulo its own word size.
+        // the range is the one of the signed term, so it is
+        // negated to get the range of the merged sum itself.
+        double minValue = negative ? -range.maxValue : range.minValue;
+        double maxValue = negative ? -range.minValue : range.maxValue;
+        if ((op == root) || (op->m_intBits >= root->m_intBits) ||
+            (calcIntBits(minValue, maxValue, op->m_fracBits) <= op->m_intBits))
+        {
+            return range;
+        }
+
+        terms.resize(termCount);
+        merged.resize(mergedCount);
+    }
+
+    term_t term;
+    term.op       = op;
+    term.negative = negative;
+    terms.push_back(term);
+
+    // a term can take any value of its format, but extending
+    // an operand does not change its value: look through
+    // them to find the narrowest format.
+    SharedOpPtr source = op;
+    while((iter = m_definitions.find(source.get())) != m_definitions.end())
+    {
+        OperationSingle *single = dynamic_cast<OpExtendMSBs*>(iter->second);
+        if (single == NULL)
+        {
+            single = dynamic_cast<OpExtendLSBs*>(iter->second);
+        }
+        if (single == NULL)
+        {
+            break;
+        }
+        source = single->m_op;
+    }
+
+    double minValue = -ldexp(1.0, source->m_intBits-1);
+    double maxValue = ldexp(1.0, source->m_intBits-1) - ldexp(1.0, -source->m_fracBits);
+    range.minValue = negative ? -maxValue : minValue;
+    range.maxValue = negative ? -minValue : maxValue;
+    return range;
+}
+
+SharedOpPtr PassCarrySave::alignTerm(const SharedOpPtr &op, const SharedOpPtr &root, OpPatchBlock *patch)
+{
+    SharedOpPtr result = op;
+    if (result->m_fracBits < root->m_fracBits)
+    {
+        SharedOpPtr tmp = IntermediateOperand::createNewIntermediate();
+        patch->addStatement(new OpExtendLSBs(result, tmp, root->m_fracBits - result->m_fracBits));
+        m_ssa->addOperand(tmp);
+        result = tmp;
+    }
+
+    if (result->m_intBits < root->m_intBits)
+    {
+        SharedOpPtr tmp = IntermediateOperand::createNewIntermediate();
+        patch->addStatement(new OpExtendMSBs(result, tmp, root->m_intBits - result->m_intBits));
+        m_ssa->addOperand(tmp);
+        result = tmp;
+    }
+    else if (result->m_intBits > root->m_intBits)
+    {
+        SharedOpPtr tmp = IntermediateOperand::createNewIntermediate();
+        patch->addStatement(new OpRemoveMSBs(result, tmp, result->m_intBits - root->m_intBits));
+        m_ssa->addOperand(tmp);
+        result = tmp;
+    }
+    return result;
+}
+
+OpPatchBlock* PassCarrySave::lowerTree(const OperationDual *node, const std::vector<term_t> &terms)
+{
+    uint32_t negatives = 0;
+    for(auto const &term : terms)
+    {
+        if (term.negative)
+        {
+            negatives++;
+        }
+    }
+
+    // there are terms-2 compressors, each with a carry
+    // input, and the final adder can add one more.
+    if (negatives > (terms.size() - 1))
+    {
+        return NULL;
+    }
+
+    struct vector_t
+    {
+        SharedOpPtr op;
+        bool        inverted;
+    };
+
+    OpPatchBlock *patch = new OpPatchBlock(node);
+    std::deque<vector_t> queue;
+    for(auto const &term : terms)
+    {
+        vector_t v;
+        v.op       = alignTerm(term.op, node->m_lhs, patch);
+        v.inverted = term.negative;
+        queue.push_back(v);
+    }
+
+    // compress the oldest three vectors until two are left,
+    // which gives a tree of logarithmic depth.
+    uint32_t carries = negatives;
+    OpCSASum *lastSum = NULL;
+    while(queue.size() > 2)
+    {
+        vector_t v[3];
+        uint32_t invertMask = 0;
+        for(uint32_t i=0; i<3; i++)
+        {
+            v[i] = queue.front();
+            queue.pop_front();
+            if (v[i].inverted)
+            {
+                invertMask |= (1 << i);
+            }
+        }
+
+        bool carryIn = (carries > 0);
+        if (carryIn)
+        {
+            carries--;
+        }
+
+        SharedOpPtr sum   = IntermediateOperand::createNewIntermediate();
+        SharedOpPtr carry = IntermediateOperand::createNewIntermediate();
+        lastSum = new OpCSASum(v[0].op, v[1].op, v[2].op, sum, invertMask);
+        patch->addStatement(lastSum);
+        patch->addStatement(new OpCSACarry(v[0].op, v[1].op, v[2].op, carry, invertMask, carryIn));
+        m_ssa->addOperand(sum);
+        m_ssa->addOperand(carry);
+        m_compressors++;
+
+        vector_t s = {sum, false};
+        vector_t c = {carry, false};
+        queue.push_back(s);
+        queue.push_back(c);
+    }
+
+    // the last two vectors are the outputs of the last compressor
+    if (carries > 0)
+    {
+        // inverting an argument inverts the sum, and
+        // carry - ~sum = carry + sum + 1
+        lastSum->m_invertMask ^= 1;
+        patch->addStatement(new OpSub(queue[1].op, queue[0].op, node->m_lhs, true));
+    }
+    else
+    {
+        patch->addStatement(new OpAdd(queue[0].op, queue[1].op, node->m_lhs, true));
+    }
+    return patch;
+}
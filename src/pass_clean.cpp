@@ -4,25 +4,26 @@
 
   Description:  Clean the SSA list after the CSDMul pass
 
-  1) remove re-interpret nodes.
-  2) remove superfluous assignment nodes.
+  1) remove superfluous assignment nodes.
+  2) replace re-interpret nodes by views.
 
 */
 
+#include <algorithm>
 #include "logging.h"
 #include "pass_clean.h"
 
 using namespace SSA;
 
-bool PassClean::execute(Program &ssa)
+bool PassClean::execute(Program &ssa, bool createViews)
 {
     doLog(LOG_INFO, "----------------------\n");
     doLog(LOG_INFO, "  Running Clean pass\n");
     doLog(LOG_INFO, "----------------------\n");
 
-    PassClean pass(ssa);
+    PassClean pass(ssa, createViews);
 
-    // remove re-interpreted nodes
+    // remove assignments and re-interpreted nodes
     for(auto statement : ssa.m_statements)
     {
         if (!statement->accept(&pass))
@@ -32,10 +33,18 @@ bool PassClean::execute(Program &ssa)
     }
 
     ssa.applyPatches();
-    //Note: we should not call updateOutputPrecision
-    //      here as the removed reinterpret nodes
-    //      will cause erronous results.
-    //ssa.updateOutputPrecisions();
+
+    // the removed nodes do not change the precision of
+    // their users, as views keep the re-interpreted format,
+    // but assignments of a different format would.
+    std::vector<const OperationBase*> modified(pass.m_modified.begin(), pass.m_modified.end());
+    uint32_t updated = ssa.updateOutputPrecisions(modified);
+    doLog(LOG_DEBUG, "Recalculated the precision of %d instructions\n", updated);
+
+    if (createViews)
+    {
+        doLog(LOG_INFO, "Replaced %d reinterpretations by views\n", pass.m_views);
+    }
     return true;
 }
 
@@ -66,15 +75,25 @@ bool PassClean::visit(const OpAssign *node)
 
 bool PassClean::visit(const OpReinterpret *node)
 {
-#if 0
-    // remove all reinterpret nodes
-    // and replace the left-hand side variable with the
-    // original variable.
+    // replacing the left-hand side variable with the
+    // original variable loses its format. a view keeps
+    // the format, so the users and their results do not
+    // change, but it is not an operand of the program.
+    if (!m_createViews || (dynamic_cast<IntermediateOperand*>(node->m_lhs.get()) == NULL))
+    {
+        return true;
+    }
+
+    doLog(LOG_DEBUG, "Replacing variable (%s) by a view of %s\n",
+          node->m_lhs->m_identName.c_str(),
+          node->m_op->m_identName.c_str());
 
-    doLog(LOG_DEBUG, "Replacing variable (%s)\n", node->m_lhs->m_identName.c_str());
-    substituteOperands(node->m_lhs, node->m_op);
+    SharedOpPtr lhs = node->m_lhs;
+    SharedOpPtr view = ViewOperand::create(node->m_op, node->m_intBits, node->m_fracBits);
+    substituteOperands(lhs, view);
+    m_ssa->m_operands.remove(lhs);
     replaceWithNull(node);
-#endif
+    m_views++;
     return true;
 }
 
@@ -82,6 +101,11 @@ void PassClean::substituteOperands(const SharedOpPtr &op1, SharedOpPtr op2)
 {
     for(auto statement : m_ssa->m_statements)
     {
+        std::vector<SharedOpPtr> inputs = statement->getInputs();
+        if (std::find(inputs.begin(), inputs.end(), op1) != inputs.end())
+        {
+            m_modified.insert(statement);
+        }
         statement->replaceOperand(op1,op2);
     }
 }
@@ -93,6 +117,7 @@ void PassClean::replaceWithNull(const OperationBase *node)
     {
         if ((*iter) == node)
         {
+            m_modified.erase(node);
             delete (*iter);
             (*iter) = new OpNull();
         }
@@ -0,0 +1,319 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Constant folding SSA pass
+
+*/
+
+#include <memory>
+#include <algorithm>
+#include "logging.h"
+#include "csd.h"
+#include "pass_constfold.h"
+
+using namespace SSA;
+
+bool PassConstFold::execute(Program &ssa)
+{
+    doLog(LOG_INFO, "--------------------------\n");
+    doLog(LOG_INFO, "  Running ConstFold pass\n");
+    doLog(LOG_INFO, "--------------------------\n");
+
+    PassConstFold pass(ssa);
+    pass.countUses();
+
+    // the statements are visited in program order so
+    // a folded constant is substituted before its
+    // uses are visited.
+    for(auto statement : ssa.m_statements)
+    {
+        if (!statement->accept(&pass))
+        {
+            return false;
+        }
+    }
+
+    // only the new instructions and the instructions
+    // with a substituted constant can change precision.
+    std::vector<const OperationBase*> modified(pass.m_modified.begin(), pass.m_modified.end());
+    ssa.applyPatches(modified);
+    ssa.updateOutputPrecisions(modified);
+    return true;
+}
+
+void PassConstFold::countUses()
+{
+    for(auto statement : m_ssa->m_statements)
+    {
+        OperationSingle *single = dynamic_cast<OperationSingle*>(statement);
+        OperationDual *dual = dynamic_cast<OperationDual*>(statement);
+        if (single != NULL)
+        {
+            m_uses[single->m_op.get()]++;
+        }
+        else if (dual != NULL)
+        {
+            m_uses[dual->m_op1.get()]++;
+            m_uses[dual->m_op2.get()]++;
+        }
+    }
+}
+
+bool PassConstFold::checkNotConstant(const SharedOpPtr &op) const
+{
+    if (op->isCSD() || (m_factors.find(op.get()) != m_factors.end()))
+    {
+        doLog(LOG_ERROR, "Constant %s can only be used in a multiplication\n", op->m_identName.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool PassConstFold::getFactors(const SharedOpPtr &op, factors_t &factors) const
+{
+    factors.clear();
+    if (op->isCSD())
+    {
+        CSDOperand *csdop = dynamic_cast<CSDOperand*>(op.get());
+        factor_t factor;
+        factor.csd  = csdop->m_csd;
+        factor.name = csdop->m_identName;
+        factors.push_back(factor);
+        return true;
+    }
+
+    auto iter = m_factors.find(op.get());
+    if (iter != m_factors.end())
+    {
+        factors = iter->second;
+        return true;
+    }
+    return false;
+}
+
+void PassConstFold::foldFactors(const OperationBase *node, const SharedOpPtr &result,
+                                const factors_t &factors1, const factors_t &factors2)
+{
+    // multiply each factor into the first one that
+    // keeps the product exact, or keep it separate.
+    factors_t product = factors1;
+    for(auto factor : factors2)
+    {
+        bool folded = false;
+        for(auto &existing : product)
+        {
+            csd_t csd;
+            if (multiplyCSD(existing.csd, factor.csd, csd))
+            {
+                existing.csd  = csd;
+                existing.name = existing.name + "*" + factor.name;
+                folded = true;
+                break;
+            }
+        }
+        if (!folded)
+        {
+            product.push_back(factor);
+        }
+    }
+
+    if (product.size() == 1)
+    {
+        replaceWithConstant(node, result, product.front().csd, product.front().name);
+        return;
+    }
+
+    doLog(LOG_DEBUG, "Cannot fold %s into one CSD constant, keeping %d factors\n",
+          result->m_identName.c_str(), static_cast<int>(product.size()));
+
+    // the uses of the result apply the factors
+    // one after the other when they are visited.
+    m_factors[result.get()] = product;
+    replaceNode(node, new OpNull());
+}
+
+void PassConstFold::expandFactors(const OperationBase *node, const SharedOpPtr &variable,
+                                  const factors_t &factors, const SharedOpPtr &result)
+{
+    OpPatchBlock *patch = new OpPatchBlock(node);
+    SharedOpPtr op = variable;
+    for(size_t i=0; i<factors.size(); i++)
+    {
+        SharedOpPtr lhs = result;
+        if ((i+1) < factors.size())
+        {
+            lhs = IntermediateOperand::createNewIntermediate();
+            m_ssa->addOperand(lhs);
+        }
+        patch->addStatement(new OpCSDMul(op, factors[i].csd, factors[i].name, lhs));
+        op = lhs;
+    }
+
+    // the patch block deletes the node when it is applied.
+    auto iter = std::find(m_ssa->m_statements.begin(), m_ssa->m_statements.end(), node);
+    if (iter != m_ssa->m_statements.end())
+    {
+        m_modified.erase(*iter);
+        (*iter) = patch;
+    }
+}
+
+bool PassConstFold::visit(const OpMul *node)
+{
+    factors_t factors1;
+    factors_t factors2;
+    bool isConstant1 = getFactors(node->m_op1, factors1);
+    bool isConstant2 = getFactors(node->m_op2, factors2);
+
+    if (isConstant1 && isConstant2)
+    {
+        foldFactors(node, node->m_lhs, factors1, factors2);
+        return true;
+    }
+
+    // an operand became a constant through folding,
+    // so it can be a CSD multiplication instead.
+    SharedOpPtr variable;
+    factors_t factors;
+    if (isConstant1)
+    {
+        variable = node->m_op2;
+        factors  = factors1;
+    }
+    else if (isConstant2)
+    {
+        variable = node->m_op1;
+        factors  = factors2;
+    }
+    else
+    {
+        return true;
+    }
+
+    if (factors.size() > 1)
+    {
+        doLog(LOG_DEBUG, "Replacing multiplication with %d constants by CSD multiplications\n",
+              static_cast<int>(factors.size()));
+        expandFactors(node, variable, factors, node->m_lhs);
+        return true;
+    }
+
+    doLog(LOG_DEBUG, "Replacing multiplication with constant %s by a CSD multiplication\n",
+          factors.front().name.c_str());
+
+    OpCSDMul *mulop = new OpCSDMul(variable, factors.front().csd, factors.front().name, node->m_lhs);
+    replaceNode(node, mulop);
+
+    // the new node may be folded with a constant product that uses it.
+    return visit(mulop);
+}
+
+bool PassConstFold::visit(const OpCSDMul *node)
+{
+    factors_t factors;
+    if (getFactors(node->m_op, factors))
+    {
+        factor_t factor;
+        factor.csd  = node->m_csd;
+        factor.name = node->m_csdName;
+        foldFactors(node, node->m_lhs, factors_t(1, factor), factors);
+        return true;
+    }
+
+    // merge c2 * (c1 * x) into (c2*c1) * x if nobody
+    // else needs the intermediate result c1 * x.
+    auto inner = m_csdMuls.find(node->m_op.get());
+    if ((inner != m_csdMuls.end()) && (m_uses[node->m_op.get()] == 1))
+    {
+        const OpCSDMul *innerNode = inner->second;
+
+        csd_t product;
+        if (multiplyCSD(innerNode->m_csd, node->m_csd, product))
+        {
+            std::string name = innerNode->m_csdName + "*" + node->m_csdName;
+            doLog(LOG_DEBUG, "Merging constant products into %s\n", name.c_str());
+
+            OpCSDMul *mulop = new OpCSDMul(innerNode->m_op, product, name, node->m_lhs);
+            m_csdMuls.erase(inner);
+            replaceNode(innerNode, new OpNull());
+            replaceNode(node, mulop);
+            m_csdMuls[mulop->m_lhs.get()] = mulop;
+            return true;
+        }
+    }
+
+    m_csdMuls[node->m_lhs.get()] = node;
+    return true;
+}
+
+bool PassConstFold::visit(const OpNegate *node)
+{
+    if (node->m_op->isCSD())
+    {
+        CSDOperand *csdop = dynamic_cast<CSDOperand*>(node->m_op.get());
+        replaceWithConstant(node, node->m_lhs, negateCSD(csdop->m_csd),
+                            "-" + csdop->m_identName);
+        return true;
+    }
+
+    // negate the first factor of a constant product.
+    auto iter = m_factors.find(node->m_op.get());
+    if (iter != m_factors.end())
+    {
+        factors_t factors = iter->second;
+        factors.front().csd  = negateCSD(factors.front().csd);
+        factors.front().name = "-" + factors.front().name;
+        m_factors[node->m_lhs.get()] = factors;
+        replaceNode(node, new OpNull());
+    }
+    return true;
+}
+
+void PassConstFold::replaceWithConstant(const OperationBase *node, const SharedOpPtr &result,
+                                        const csd_t &csd, const std::string &name)
+{
+    doLog(LOG_DEBUG, "Folding %s into constant %s = %f\n",
+          result->m_identName.c_str(), name.c_str(), csd.value);
+
+    std::shared_ptr<CSDOperand> csdop = std::make_shared<CSDOperand>();
+    csdop->m_csd = csd;
+    csdop->m_identName = name;
+    csdop->m_intBits = 0;
+    csdop->m_fracBits = 0;
+    m_ssa->addOperand(csdop);
+
+    // keep a reference to the result; deleting the node
+    // releases the operand.
+    SharedOpPtr oldResult = result;
+    replaceNode(node, new OpNull());
+    substituteOperands(oldResult, csdop);
+}
+
+void PassConstFold::substituteOperands(const SharedOpPtr &op1, SharedOpPtr op2)
+{
+    for(auto statement : m_ssa->m_statements)
+    {
+        auto inputs = statement->getInputs();
+        if (std::find(inputs.begin(), inputs.end(), op1) != inputs.end())
+        {
+            statement->replaceOperand(op1,op2);
+            m_modified.insert(statement);
+        }
+    }
+}
+
+void PassConstFold::replaceNode(const OperationBase *node, OperationBase *newNode)
+{
+    auto iter = std::find(m_ssa->m_statements.begin(), m_ssa->m_statements.end(), node);
+    if (iter != m_ssa->m_statements.end())
+    {
+        m_modified.erase(*iter);
+        if (dynamic_cast<OpNull*>(newNode) == NULL)
+        {
+            m_modified.insert(newNode);
+        }
+        delete (*iter);
+        (*iter) = newNode;
+    }
+}
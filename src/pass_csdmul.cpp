@@ -7,6 +7,8 @@
 */
 
 #include <memory>
+#include <cmath>
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 #include "logging.h"
@@ -17,16 +19,17 @@
 using namespace SSA;
 
 
-bool PassCSDMul::execute(Program &ssa)
+bool PassCSDMul::execute(Program &ssa, AdderGraphCache *cache)
 {
     doLog(LOG_INFO, "-----------------------\n");
     doLog(LOG_INFO, "  Running CSDMul pass\n");
     doLog(LOG_INFO, "-----------------------\n");
 
-    PassCSDMul pass(ssa);
+    PassCSDMul pass(ssa, cache);
 
     // look for CSD * variable, variable * CSD
-    // or CSD * CSD
+    // or CSD * CSD and group the CSD multiplications
+    // by their input operand.
     for(auto operation : ssa.m_statements)
     {
         if (!operation->accept(&pass))
@@ -35,8 +38,36 @@ bool PassCSDMul::execute(Program &ssa)
         }
     }
 
-    ssa.applyPatches(); // integrate the generate OpPatchBlock instructions.
-    ssa.updateOutputPrecisions();
+    // expand each group at the position of its first
+    // multiplication and remove the others.
+    for(auto &group : pass.m_groups)
+    {
+        OpPatchBlock *patch = new OpPatchBlock(group.front());
+        pass.expandCSD(group, patch, ssa.m_operands);
+        pass.patchNode(group.front(), patch);
+
+        for(size_t i=1; i<group.size(); i++)
+        {
+            auto iter = std::find(ssa.m_statements.begin(), ssa.m_statements.end(), group[i]);
+            if (iter != ssa.m_statements.end())
+            {
+                *iter = new OpNull();
+                delete group[i];
+            }
+        }
+    }
+
+    if (cache != NULL)
+    {
+        doLog(LOG_INFO, "Adder graph cache: %d hits, %d misses\n", cache->getHits(), cache->getMisses());
+    }
+
+    // only the instructions of the patch blocks
+    // and the instructions that use their results
+    // can change precision.
+    std::vector<const OperationBase*> modified;
+    ssa.applyPatches(modified); // integrate the generate OpPatchBlock instructions.
+    ssa.updateOutputPrecisions(modified);
     return true;
 }
 
@@ -58,11 +89,24 @@ void PassCSDMul::patchNode(const SSA::OperationBase *node, SSA::OpPatchBlock *pa
 
 bool PassCSDMul::visit(const OpCSDMul *node)
 {
-    doLog(LOG_INFO, "Expanding CSD %s\n", node->m_csdName.c_str());
+    if (node->m_op->isCSD())
+    {
+        doLog(LOG_ERROR, "CSD %s is multiplied by CSD %s\n",
+              node->m_csdName.c_str(),
+              node->m_op->m_identName.c_str());
+        return false;
+    }
 
-    OpPatchBlock *patch = new OpPatchBlock(node);
-    expandCSD(node->m_csd, node->m_op, node->m_lhs, patch, m_ssa->m_operands);
-    patchNode(node, patch); // replace the MUL node.
+    auto iter = m_groupIndex.find(node->m_op.get());
+    if (iter == m_groupIndex.end())
+    {
+        m_groupIndex[node->m_op.get()] = m_groups.size();
+        m_groups.push_back(std::vector<const OpCSDMul*>(1, node));
+    }
+    else
+    {
+        m_groups[iter->second].push_back(node);
+    }
     return true;
 }
 
@@ -88,146 +132,192 @@ bool PassCSDMul::visit(const OpMul *node)
     return true;
 }
 
-void PassCSDMul::expandCSD(const csd_t &csd,
-                           const SharedOpPtr &input,
-                           const SharedOpPtr &output,
+SharedOpPtr PassCSDMul::shiftOperand(const SharedOpPtr &op, int32_t shift,
+                                     SSA::OpPatchBlock *patch,
+                                     std::list<SharedOpPtr> &operands)
+{
+    if (shift == 0)
+    {
+        return op;
+    }
+
+    auto key = std::make_pair(static_cast<const OperandBase*>(op.get()), shift);
+    auto iter = m_shifted.find(key);
+    if (iter != m_shifted.end())
+    {
+        return iter->second;
+    }
+
+    // a multiplication by 2^shift is nothing more than
+    // a re-interpretation of the operand: only the Q(n,m)
+    // changes to Q(n+shift,m-shift).
+    SharedOpPtr result = IntermediateOperand::createNewIntermediate();
+    SSA::OpReinterpret *reinterpret = new SSA::OpReinterpret(op,
+                                                             result,
+                                                             op->m_intBits+shift,
+                                                             op->m_fracBits-shift);
+    patch->m_statements.push_back(reinterpret);
+    operands.push_back(result);
+    m_shifted[key] = result;
+    return result;
+}
+
+void PassCSDMul::expandCSD(const std::vector<const OpCSDMul*> &nodes,
                            SSA::OpPatchBlock *patch,
                            std::list<SharedOpPtr> &operands)
 {
     // the procedure is as follows:
     //
-    // y = csd*input
+    // y_i = csd_i*input
     //
-    // 1) create the first shift variable
-    //    this variable is nothing more
-    //    than a re-interpretation of the
-    //    input variable: only the Q(n,m)
-    //    changes to Q(n+shift,m+shift)
+    // 1) find an adder graph that computes
+    //    all the constants. Each node of the
+    //    graph is the sum or difference of two
+    //    shifted earlier nodes or the input.
+    //
+    // 2) a shifted node is nothing more than
+    //    a re-interpretation of the node:
+    //    only the Q(n,m) changes to
+    //    Q(n+shift,m-shift).
     //
     //    note that the shift is negative
     //    for multiplication with a fractional
     //    digit of 'csd'.
     //
-    // 2) create the second shift variable
-    //    by the same procedure. Now, we
-    //    need to extend LSBs to make
-    //    sure the binary point of both
-    //    terms are aligned so we can
-    //    add or subtract them
-    //
-    // 3) store the result in a new
-    //    temporary variable and insert
-    //    the addition/subtraction in the
-    //    SSA list.
+    // 3) store each node in a new temporary
+    //    variable and insert the addition or
+    //    subtraction in the SSA list. The
+    //    LSB alignment is left to the AddSub
+    //    pass.
     //
-    // 4) goto 2 while there are still
-    //    digits that need processing.
+    // 4) each output is a shifted node, which
+    //    is negated if the output term is
+    //    negative. The Negate pass absorbs the
+    //    negation into the addition or subtraction
+    //    that uses the output.
 
-    // If the CSD is negative
-    // make it positive and insert a negation node
-    // at the output, which then can be absorbed
-    // into an addition or subtraction in later
-    // optimization passes.
+    const SharedOpPtr &input = nodes.front()->m_op;
+    m_shifted.clear();
 
-    // get the digit with the smallest
-    // power.
-    auto digitIter = csd.digits.rbegin();   // start at the last digit (smallest power)
-    if (digitIter == csd.digits.rend())
+    std::vector<csd_t> unordered;
+    for(auto node : nodes)
     {
-        // CSD has no digits!
-        // FIXME: change handling with error() function
-        //        and log support
-        throw std::runtime_error("CSD has no digits!");
-
-        //return;
+        unordered.push_back(node->m_csd);
+        doLog(LOG_INFO, "Expanding CSD %s\n", node->m_csdName.c_str());
     }
 
-    int32_t shift = digitIter->power;
-
-    // create first shifted version of
-    // input and insert it into the operand
-    // list.
-    SharedOpPtr result = IntermediateOperand::createNewIntermediate();
-    SSA::OpReinterpret *reinterpret = new SSA::OpReinterpret(input,
-                                                             result,
-                                                             input->m_intBits+shift,
-                                                             input->m_fracBits-shift);
-    patch->m_statements.push_back(reinterpret);
-    operands.push_back(result);
+    // sort the constants so the key of a set of constants
+    // does not depend on program order.
+    std::vector<size_t> order = AdderGraph::canonicalOrder(unordered);
+    std::vector<csd_t> constants;
+    for(auto index : order)
+    {
+        constants.push_back(unordered[index]);
+    }
 
-    // if the first digit is negative, we need to
-    // insert a negation operation becuase the first
-    // digit is always the left operand of the
-    // + or - operation: it will always be
-    // taken as a positive value / input.
-    if (digitIter->sign < 0)
+    AdderGraph graph;
+    if (m_cache != NULL)
+    {
+        graph = m_cache->getGraph(constants);
+    }
+    else
     {
-        SharedOpPtr insertResult = IntermediateOperand::createNewIntermediate();
-        SSA::OpNegate *negate = new SSA::OpNegate(result, insertResult);
-        patch->m_statements.push_back(negate);
-        operands.push_back(insertResult);
-        result = insertResult;
+        graph = AdderGraph::create(constants);
     }
 
-    digitIter++;
+    doLog(LOG_INFO, "  %d constant(s) of %s use %d adders, depth %d\n",
+          static_cast<int32_t>(constants.size()), input->m_identName.c_str(),
+          graph.adderCount(), graph.depth());
 
-    // while there are digits in CSD
-    // keep on adding new terms
-    SharedOpPtr t1 = result;
-    while(digitIter != csd.digits.rend())
+    // a node that multiplies the input by c needs enough
+    // integer bits to hold |c| * 2^(intBits-1), the magnitude
+    // of the most negative input value.
+    const int32_t inputIntBits = input->m_intBits;
+
+    std::vector<double> values = graph.nodeValues();
+    std::vector<SharedOpPtr> nodeOps;
+    nodeOps.push_back(input);
+    for(size_t k=0; k<graph.m_nodes.size(); k++)
     {
-        // create new term
-        shift = digitIter->power;
+        const AdderGraph::node_t &node = graph.m_nodes[k];
+        SharedOpPtr t1 = shiftOperand(nodeOps.at(node.a.node), node.a.shift, patch, operands);
+        SharedOpPtr t2 = shiftOperand(nodeOps.at(node.b.node), node.b.shift, patch, operands);
 
-        SharedOpPtr t2 = IntermediateOperand::createNewIntermediate();
-        reinterpret = new SSA::OpReinterpret(input,
-                                             t2,
-                                             input->m_intBits+shift,
-                                             input->m_fracBits-shift);
-        operands.push_back(t2);
-        patch->m_statements.push_back(reinterpret);
+        // only add an extension bit if the largest
+        // term cannot hold the result.
+        double magnitude = fabs(values.at(k+1));
+        int32_t intBits  = std::max(t1->m_intBits, t2->m_intBits);
+        bool noExtension = magnitude < ldexp(1.0, intBits - inputIntBits);
 
-        // add the terms
-        result = IntermediateOperand::createNewIntermediate();
+        SharedOpPtr result = IntermediateOperand::createNewIntermediate();
         operands.push_back(result);
-        if (digitIter->sign > 0)
+        if (node.b.sign > 0)
         {
-            // the sum of t1 and t2 will always be larger in
-            // magnitude so we _do_ need an additional sign extension bit.
-            SSA::OpAdd *adder = new SSA::OpAdd(t1,t2,result);
+            SSA::OpAdd *adder = new SSA::OpAdd(t1, t2, result, noExtension);
             patch->m_statements.push_back(adder);
         }
         else
         {
-            // the weight of t2 is always smaller than t1
-            // so the result of t1-t2 will always be smaller in
-            // magnitude than t1. As a result, we do not need an addition
-            // sign extension bit.
-            SSA::OpSub *subber = new SSA::OpSub(t1,t2,result, true);
+            SSA::OpSub *subber = new SSA::OpSub(t1, t2, result, noExtension);
             patch->m_statements.push_back(subber);
         }
-        t1 = result;
-        digitIter++;
-    }
-
-#if 0
-    // sanity check: the output size and temporary
-    // variable t1 must match!
-    operand_t outputOp = ssa.getOperand(y_idx);
-    operand_t tempOp   = ssa.getOperand(t1);
-    if ((outputOp.info.fracBits != tempOp.info.fracBits) || (outputOp.info.intBits != tempOp.info.intBits))
-    {
-        doLog(LOG_WARN, "CSD output operand size mismatch: \n");
-        doLog(LOG_WARN, "  output: %s Q(%d,%d)\n", outputOp.info.txt.c_str(), outputOp.info.intBits, outputOp.info.fracBits);
-        doLog(LOG_WARN, "  temp  : %s Q(%d,%d)\n", tempOp.info.txt.c_str(), tempOp.info.intBits, tempOp.info.fracBits);
-        doLog(LOG_WARN, "Creating truncation statement to fix this ..\n");
-        // Note: this is most likely ok, because the CSD constant will not cause overflow
-        //       as a work-around we insert a truncate node
-        t1 = ssa.createTruncateNode(ssa_iter, t1, outputOp.info.intBits, outputOp.info.fracBits);
-    }
-#endif
-
-    // make the final assignment
-    SSA::OpAssign *assign = new SSA::OpAssign(result, output);
-    patch->m_statements.push_back(assign);
+        nodeOps.push_back(result);
+    }
+
+    for(size_t i=0; i<order.size(); i++)
+    {
+        const OpCSDMul *csdmul = nodes[order[i]];
+        const AdderGraph::term_t &term = graph.m_outputs[i];
+
+        SharedOpPtr result = shiftOperand(nodeOps.at(term.node), term.shift, patch, operands);
+        if (term.sign < 0)
+        {
+            // the most negative value has no positive
+            // counterpart, so add an MSB if the node
+            // can reach it.
+            double magnitude = fabs(ldexp(values.at(term.node), term.shift));
+            if (magnitude >= ldexp(1.0, result->m_intBits - inputIntBits))
+            {
+                SharedOpPtr extended = IntermediateOperand::createNewIntermediate();
+                patch->m_statements.push_back(new SSA::OpExtendMSBs(result, extended, 1));
+                operands.push_back(extended);
+                result = extended;
+            }
+
+            SharedOpPtr negated = IntermediateOperand::createNewIntermediate();
+            patch->m_statements.push_back(new SSA::OpNegate(result, negated));
+            operands.push_back(negated);
+            result = negated;
+        }
+
+        // make the result match the precision of the
+        // original CSD multiplication so the program stays
+        // bit-exact with respect to the reference.
+        const SharedOpPtr &output = csdmul->m_lhs;
+        if (result->m_fracBits != output->m_fracBits)
+        {
+            doLog(LOG_WARN, "CSD output operand %s has Q(%d,%d), expected Q(%d,%d)\n",
+                  output->m_identName.c_str(),
+                  result->m_intBits, result->m_fracBits,
+                  output->m_intBits, output->m_fracBits);
+        }
+        else if (result->m_intBits > output->m_intBits)
+        {
+            SharedOpPtr tmp = IntermediateOperand::createNewIntermediate();
+            patch->m_statements.push_back(new SSA::OpRemoveMSBs(result, tmp, result->m_intBits - output->m_intBits));
+            operands.push_back(tmp);
+            result = tmp;
+        }
+        else if (result->m_intBits < output->m_intBits)
+        {
+            SharedOpPtr tmp = IntermediateOperand::createNewIntermediate();
+            patch->m_statements.push_back(new SSA::OpExtendMSBs(result, tmp, output->m_intBits - result->m_intBits));
+            operands.push_back(tmp);
+            result = tmp;
+        }
+
+        // make the final assignment
+        SSA::OpAssign *assign = new SSA::OpAssign(result, output);
+        patch->m_statements.push_back(assign);
+    }
 }
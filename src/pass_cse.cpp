@@ -0,0 +1,171 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Common subexpression elimination SSA pass
+
+*/
+
+#include <algorithm>
+#include "logging.h"
+#include "utils.h"
+#include "addergraph.h"
+#include "pass_cse.h"
+
+using namespace SSA;
+
+bool PassCSE::execute(Program &ssa)
+{
+    doLog(LOG_INFO, "--------------------\n");
+    doLog(LOG_INFO, "  Running CSE pass\n");
+    doLog(LOG_INFO, "--------------------\n");
+
+    PassCSE pass(ssa);
+
+    // the statements are visited in program order, so
+    // the operands of an instruction have already been
+    // rewired when its key is made.
+    for(auto statement : ssa.m_statements)
+    {
+        if (!statement->accept(&pass))
+        {
+            return false;
+        }
+    }
+
+    doLog(LOG_INFO, "Removed %d duplicate instructions\n", pass.m_removed);
+
+    ssa.applyPatches();
+    return true;
+}
+
+std::string PassCSE::makeKey(const char *opcode, const OperationSingle *node,
+                             int32_t param1, int32_t param2) const
+{
+    return stringf("%s %p %d %d Q(%d,%d)", opcode, node->m_op.get(), param1, param2,
+                   node->m_lhs->m_intBits, node->m_lhs->m_fracBits);
+}
+
+std::string PassCSE::makeKey(const char *opcode, const OperationDual *node,
+                             bool commutative, int32_t param) const
+{
+    const OperandBase *op1 = node->m_op1.get();
+    const OperandBase *op2 = node->m_op2.get();
+    if (commutative && (op2 < op1))
+    {
+        std::swap(op1, op2);
+    }
+
+    return stringf("%s %p %p %d Q(%d,%d)", opcode, op1, op2, param,
+                   node->m_lhs->m_intBits, node->m_lhs->m_fracBits);
+}
+
+void PassCSE::hashCons(const OperationBase *node, const SharedOpPtr &lhs, const std::string &key)
+{
+    auto iter = m_results.find(key);
+    if (iter == m_results.end())
+    {
+        m_results[key] = lhs;
+        return;
+    }
+
+    doLog(LOG_DEBUG, "Replacing %s by %s\n", lhs->m_identName.c_str(),
+          iter->second->m_identName.c_str());
+
+    // keep a reference to the result; deleting the node
+    // releases the operand.
+    SharedOpPtr oldResult = lhs;
+    auto statement = std::find(m_ssa->m_statements.begin(), m_ssa->m_statements.end(), node);
+    if (statement != m_ssa->m_statements.end())
+    {
+        delete (*statement);
+        (*statement) = new OpNull();
+    }
+
+    substituteOperands(oldResult, iter->second);
+    m_removed++;
+}
+
+bool PassCSE::visit(const OpMul *node)
+{
+    hashCons(node, node->m_lhs, makeKey("MUL", node, true));
+    return true;
+}
+
+bool PassCSE::visit(const OpCSDMul *node)
+{
+    // constants with different names but the same digits
+    // produce the same result.
+    std::vector<csd_t> constants(1, node->m_csd);
+    std::string key = makeKey("CSDMUL", node) + AdderGraph::makeKey(constants);
+    hashCons(node, node->m_lhs, key);
+    return true;
+}
+
+bool PassCSE::visit(const OpAdd *node)
+{
+    hashCons(node, node->m_lhs, makeKey("ADD", node, true, node->m_noExtension ? 1 : 0));
+    return true;
+}
+
+bool PassCSE::visit(const OpSub *node)
+{
+    hashCons(node, node->m_lhs, makeKey("SUB", node, false, node->m_noExtension ? 1 : 0));
+    return true;
+}
+
+bool PassCSE::visit(const OpTruncate *node)
+{
+    hashCons(node, node->m_lhs, makeKey("TRUNCATE", node, node->m_intBits, node->m_fracBits));
+    return true;
+}
+
+bool PassCSE::visit(const OpNegate *node)
+{
+    hashCons(node, node->m_lhs, makeKey("NEGATE", node));
+    return true;
+}
+
+bool PassCSE::visit(const OpReinterpret *node)
+{
+    hashCons(node, node->m_lhs, makeKey("REINTERPRET", node, node->m_intBits, node->m_fracBits));
+    return true;
+}
+
+bool PassCSE::visit(const OpExtendLSBs *node)
+{
+    hashCons(node, node->m_lhs, makeKey("EXTENDLSBS", node, node->m_bits));
+    return true;
+}
+
+bool PassCSE::visit(const OpExtendMSBs *node)
+{
+    hashCons(node, node->m_lhs, makeKey("EXTENDMSBS", node, node->m_bits));
+    return true;
+}
+
+bool PassCSE::visit(const OpRemoveLSBs *node)
+{
+    hashCons(node, node->m_lhs, makeKey("REMOVELSBS", node, node->m_bits));
+    return true;
+}
+
+bool PassCSE::visit(const OpRemoveMSBs *node)
+{
+    hashCons(node, node->m_lhs, makeKey("REMOVEMSBS", node, node->m_bits));
+    return true;
+}
+
+bool PassCSE::visit(const OpRegister *node)
+{
+    hashCons(node, node->m_lhs, makeKey("REGISTER", node));
+    return true;
+}
+
+void PassCSE::substituteOperands(const SharedOpPtr &op1, SharedOpPtr op2)
+{
+    for(auto statement : m_ssa->m_statements)
+    {
+        statement->replaceOperand(op1,op2);
+    }
+}
@@ -0,0 +1,81 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Dead instruction elimination SSA pass
+
+*/
+
+#include "logging.h"
+#include "pass_dce.h"
+
+using namespace SSA;
+
+bool PassDCE::execute(Program &ssa)
+{
+    doLog(LOG_INFO, "--------------------\n");
+    doLog(LOG_INFO, "  Running DCE pass\n");
+    doLog(LOG_INFO, "--------------------\n");
+
+    PassDCE pass(ssa);
+
+    // in SSA form the users of a result come after its
+    // definition, so a single backward sweep finds all
+    // live instructions.
+    uint32_t removed = 0;
+    for(auto iter = ssa.m_statements.rbegin(); iter != ssa.m_statements.rend(); iter++)
+    {
+        pass.m_dead = NULL;
+        if (!(*iter)->accept(&pass))
+        {
+            doLog(LOG_ERROR, "DCE pass: unsupported instruction\n");
+            return false;
+        }
+
+        if (pass.m_dead != NULL)
+        {
+            delete (*iter);
+            (*iter) = new OpNull();
+            removed++;
+        }
+    }
+
+    doLog(LOG_INFO, "Removed %d dead instructions\n", removed);
+
+    ssa.applyPatches();
+    return true;
+}
+
+bool PassDCE::isLive(const SharedOpPtr &op) const
+{
+    if (dynamic_cast<const OutputOperand*>(op.get()) != NULL)
+    {
+        return true;
+    }
+    return m_live.find(op.get()) != m_live.end();
+}
+
+bool PassDCE::markLive(const OperationSingle *node)
+{
+    if (!isLive(node->m_lhs))
+    {
+        m_dead = node;
+        return true;
+    }
+
+    m_live.insert(node->m_op.get());
+    return true;
+}
+
+bool PassDCE::markLive(const OperationDual *node)
+{
+    if (!isLive(node->m_lhs))
+    {
+        m_dead = node;
+        return true;
+    }
+
+    m_live.insert(node->m_op1.get());
+    m_live.insert(node->m_op2.get());
+    return true;
+}
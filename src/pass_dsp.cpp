@@ -0,0 +1,474 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  DSP slice mapping SSA pass
+
+*/
+
+#include <stdlib.h>
+#include <algorithm>
+#include "logging.h"
+#include "pass_dsp.h"
+
+using namespace SSA;
+
+/** get an addition or subtraction that
+    does not extend its result, or NULL */
+static OperationDual* getAddSub(OperationBase *node)
+{
+    OpAdd *add = dynamic_cast<OpAdd*>(node);
+    if ((add != NULL) && add->m_noExtension)
+    {
+        return add;
+    }
+    OpSub *sub = dynamic_cast<OpSub*>(node);
+    if ((sub != NULL) && sub->m_noExtension)
+    {
+        return sub;
+    }
+    return NULL;
+}
+
+bool PassDSP::parse(const std::string &str, dsp_t &dsp)
+{
+    // AxB[xP][:stages]
+    const char *p = str.c_str();
+    char *end = NULL;
+    dsp.aBits  = strtoul(p, &end, 10);
+    if (*end != 'x')
+    {
+        return false;
+    }
+    dsp.bBits  = strtoul(end+1, &end, 10);
+    dsp.pBits  = 48;
+    dsp.stages = 0;
+    if (*end == 'x')
+    {
+        dsp.pBits = strtoul(end+1, &end, 10);
+    }
+    if (*end == ':')
+    {
+        dsp.stages = strtoul(end+1, &end, 10);
+    }
+    return (*end == 0) && (dsp.aBits > 0) && (dsp.bBits > 0) && (dsp.pBits > 0);
+}
+
+bool PassDSP::execute(Program &ssa, const dsp_t &dsp)
+{
+    doLog(LOG_INFO, "----------------------------\n");
+    doLog(LOG_INFO, "  Running DSP mapping pass\n");
+    doLog(LOG_INFO, "----------------------------\n");
+
+    for(auto statement : ssa.m_statements)
+    {
+        if (statement->isPatchBlock())
+        {
+            doLog(LOG_ERROR, "DSP pass: unexpected patch block\n");
+            return false;
+        }
+    }
+
+    PassDSP pass(ssa, dsp);
+    pass.analyse();
+    for(auto statement : ssa.m_statements)
+    {
+        OpMul *mul = dynamic_cast<OpMul*>(statement);
+        if ((mul != NULL) && (pass.m_replacements.find(mul) == pass.m_replacements.end()))
+        {
+            pass.map(mul);
+        }
+    }
+
+    for(auto &statement : ssa.m_statements)
+    {
+        auto iter = pass.m_replacements.find(statement);
+        if (iter != pass.m_replacements.end())
+        {
+            delete statement;
+            statement = iter->second;
+        }
+    }
+    ssa.applyPatches();
+
+    doLog(LOG_INFO, "Mapped %d multiplications onto %dx%d DSP slices\n",
+          pass.m_mapped, dsp.aBits, dsp.bBits);
+
+    if ((pass.m_mapped > 0) && (dsp.stages > 0))
+    {
+        pass.balance();
+    }
+    return true;
+}
+
+void PassDSP::analyse()
+{
+    m_definitions.clear();
+    m_users.clear();
+    for(auto statement : m_ssa->m_statements)
+    {
+        for(auto const &input : statement->getInputs())
+        {
+            m_users[input.get()].push_back(statement);
+        }
+
+        SharedOpPtr lhs = statement->getLHS();
+        if (lhs)
+        {
+            m_definitions[lhs.get()] = statement;
+        }
+    }
+}
+
+OperationBase* PassDSP::getSingleUser(const SharedOpPtr &op) const
+{
+    if ((dynamic_cast<IntermediateOperand*>(op.get()) == NULL))
+    {
+        return NULL;
+    }
+
+    auto iter = m_users.find(op.get());
+    if ((iter == m_users.end()) || (iter->second.size() != 1))
+    {
+        return NULL;
+    }
+
+    OperationBase *user = iter->second.front();
+    if (m_replacements.find(user) != m_replacements.end())
+    {
+        return NULL;
+    }
+    return user;
+}
+
+OperationDual* PassDSP::getAdder(const SharedOpPtr &op, const OperationBase *user) const
+{
+    if (getSingleUser(op) != user)
+    {
+        return NULL;
+    }
+
+    auto iter = m_definitions.find(op.get());
+    if ((iter == m_definitions.end()) || (m_replacements.find(iter->second) != m_replacements.end()))
+    {
+        return NULL;
+    }
+
+    // the inputs of the pre-adder are not aligned by the slice
+    OperationDual *adder = getAddSub(iter->second);
+    if ((adder == NULL) || (adder->m_op1->m_fracBits != op->m_fracBits) ||
+        (adder->m_op2->m_fracBits != op->m_fracBits))
+    {
+        return NULL;
+    }
+    return adder;
+}
+
+bool PassDSP::map(OpMul *mul)
+{
+    // a pre-adder is only used when its result fits port A
+    // and the other input of the multiplier fits port B.
+    SharedOpPtr ops[2] = {mul->m_op1, mul->m_op2};
+    OperationDual *preAdder = NULL;
+    SharedOpPtr a, d, pre, b;
+    OpMulAdd::addmode_t preMode = OpMulAdd::ADD_NONE;
+    for(uint32_t i=0; (i<2) && (preAdder == NULL); i++)
+    {
+        OperationDual *adder = getAdder(ops[i], mul);
+        if ((adder != NULL) && (getWidth(ops[i]) <= m_dsp.aBits) && (getWidth(ops[1-i]) <= m_dsp.bBits))
+        {
+            preAdder = adder;
+            a   = adder->m_op1;
+            d   = adder->m_op2;
+            pre = ops[i];
+            b   = ops[1-i];
+            preMode = (dynamic_cast<OpAdd*>(adder) != NULL) ? OpMulAdd::ADD_PLUS : OpMulAdd::ADD_MINUS;
+        }
+    }
+
+    if (preAdder == NULL)
+    {
+        if ((getWidth(ops[0]) <= m_dsp.aBits) && (getWidth(ops[1]) <= m_dsp.bBits))
+        {
+            a = ops[0];
+            b = ops[1];
+        }
+        else if ((getWidth(ops[1]) <= m_dsp.aBits) && (getWidth(ops[0]) <= m_dsp.bBits))
+        {
+            a = ops[1];
+            b = ops[0];
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    SharedOpPtr prod = mul->m_lhs;
+    if (getWidth(prod) > m_dsp.pBits)
+    {
+        return false;
+    }
+
+    // the product can be extended to the format of the
+    // post-adder, as long as nothing else uses it.
+    std::vector<OperationBase*> chain;
+    SharedOpPtr x = prod;
+    OperationBase *user = getSingleUser(x);
+    while((dynamic_cast<OpExtendLSBs*>(user) != NULL) || (dynamic_cast<OpExtendMSBs*>(user) != NULL))
+    {
+        chain.push_back(user);
+        x = user->getLHS();
+        user = getSingleUser(x);
+    }
+
+    OperationDual *postAdder = getAddSub(user);
+    SharedOpPtr c;
+    OpMulAdd::addmode_t postMode = OpMulAdd::ADD_NONE;
+    if ((postAdder != NULL) && (getWidth(postAdder->m_lhs) <= m_dsp.pBits))
+    {
+        if (postAdder->m_op1 == x)
+        {
+            c = postAdder->m_op2;
+            postMode = (dynamic_cast<OpAdd*>(postAdder) != NULL) ? OpMulAdd::ADD_PLUS : OpMulAdd::ADD_MINUS;
+        }
+        else
+        {
+            c = postAdder->m_op1;
+            postMode = (dynamic_cast<OpAdd*>(postAdder) != NULL) ? OpMulAdd::ADD_PLUS : OpMulAdd::ADD_REVERSE;
+        }
+
+        // c is not aligned by the slice
+        if (c->m_fracBits != postAdder->m_lhs->m_fracBits)
+        {
+            postMode = OpMulAdd::ADD_NONE;
+            c.reset();
+        }
+    }
+
+    // a lone multiplication needs no slice template
+    if ((preAdder == NULL) && (postMode == OpMulAdd::ADD_NONE))
+    {
+        return false;
+    }
+
+    if (postMode != OpMulAdd::ADD_NONE)
+    {
+        OpMulAdd *fused = new OpMulAdd(a, d, preMode, pre, b, prod, c, postMode, postAdder->m_lhs);
+        m_replacements[postAdder] = fused;
+        m_replacements[mul] = new OpNull();
+        for(auto node : chain)
+        {
+            m_replacements[node] = new OpNull();
+        }
+    }
+    else
+    {
+        OpMulAdd *fused = new OpMulAdd(a, d, preMode, pre, b, prod, c, postMode, prod);
+        m_replacements[mul] = fused;
+    }
+
+    if (preAdder != NULL)
+    {
+        m_replacements[preAdder] = new OpNull();
+    }
+
+    m_mapped++;
+    return true;
+}
+
+void PassDSP::balance()
+{
+    // determine the clock cycle in which each instruction
+    // starts: a slice starts as soon as a and d are
+    // available and b and c are available when needed.
+    std::map<const OperationBase*, uint32_t> starts;
+    uint32_t latency = 0;
+    for(auto statement : m_ssa->m_statements)
+    {
+        SharedOpPtr lhs = statement->getLHS();
+        if (!lhs)
+        {
+            continue;
+        }
+
+        uint32_t start = 0;
+        uint32_t cycle = 0;
+        OpMulAdd *mulAdd = dynamic_cast<OpMulAdd*>(statement);
+        if (mulAdd != NULL)
+        {
+            mulAdd->m_stages = std::min(m_dsp.stages, mulAdd->getMaxStages());
+            start = std::max(getCycle(mulAdd->m_a), getCycle(mulAdd->m_d));
+            if (getCycle(mulAdd->m_b) > mulAdd->getBDelay())
+            {
+                start = std::max(start, getCycle(mulAdd->m_b) - mulAdd->getBDelay());
+            }
+            if (getCycle(mulAdd->m_c) > mulAdd->getCDelay())
+            {
+                start = std::max(start, getCycle(mulAdd->m_c) - mulAdd->getCDelay());
+            }
+            cycle = start + mulAdd->m_stages;
+        }
+        else
+        {
+            for(auto const &input : statement->getInputs())
+            {
+                start = std::max(start, getCycle(input));
+            }
+            cycle = start;
+            if (dynamic_cast<OpRegister*>(statement) != NULL)
+            {
+                cycle++;
+            }
+        }
+
+        starts[statement] = start;
+        m_cycles[lhs.get()] = cycle;
+        if (dynamic_cast<OutputOperand*>(lhs.get()) != NULL)
+        {
+            latency = std::max(latency, cycle);
+        }
+    }
+
+    // rebuild the program with the registers. outputs that
+    // are ready before the last cycle are written to a new
+    // intermediate first, which is delayed to the last cycle.
+    std::list<OperationBase*> statements;
+    std::map<const OperandBase*, SharedOpPtr> renamed;
+    std::vector<std::pair<SharedOpPtr, SharedOpPtr> > outputs;
+    auto getInput = [&renamed](const SharedOpPtr &op)
+        {
+            auto iter = renamed.find(op.get());
+            return (iter != renamed.end()) ? iter->second : op;
+        };
+
+    for(auto statement : m_ssa->m_statements)
+    {
+        SharedOpPtr lhs = statement->getLHS();
+        if (!lhs)
+        {
+            continue;
+        }
+
+        uint32_t start = starts[statement];
+        OperationBase *copy = statement->clone();
+        OpMulAdd *mulAdd = dynamic_cast<OpMulAdd*>(copy);
+        if (mulAdd != NULL)
+        {
+            // the operands are set one by one, as the
+            // same operand can be needed in different cycles.
+            mulAdd->m_a = getDelayed(getInput(mulAdd->m_a), start, statements);
+            mulAdd->m_b = getDelayed(getInput(mulAdd->m_b), start + mulAdd->getBDelay(), statements);
+            if (mulAdd->m_d)
+            {
+                mulAdd->m_d = getDelayed(getInput(mulAdd->m_d), start, statements);
+            }
+            if (mulAdd->m_c)
+            {
+                mulAdd->m_c = getDelayed(getInput(mulAdd->m_c), start + mulAdd->getCDelay(), statements);
+            }
+        }
+        else
+        {
+            for(auto const &input : statement->getInputs())
+            {
+                SharedOpPtr delayed = getDelayed(getInput(input), start, statements);
+                if (delayed != input)
+                {
+                    copy->replaceOperand(input, delayed);
+                }
+            }
+        }
+
+        uint32_t cycle = m_cycles[lhs.get()];
+        if ((dynamic_cast<OutputOperand*>(lhs.get()) != NULL) && (cycle < latency))
+        {
+            SharedOpPtr tmp = IntermediateOperand::createNewIntermediate();
+            tmp->m_intBits  = lhs->m_intBits;
+            tmp->m_fracBits = lhs->m_fracBits;
+
+            OperationSingle     *single     = dynamic_cast<OperationSingle*>(copy);
+            OperationDual       *dual       = dynamic_cast<OperationDual*>(copy);
+            OperationCompressor *compressor = dynamic_cast<OperationCompressor*>(copy);
+            if (single != NULL)
+            {
+                single->m_lhs = tmp;
+            }
+            else if (dual != NULL)
+            {
+                dual->m_lhs = tmp;
+            }
+            else if (compressor != NULL)
+            {
+                compressor->m_lhs = tmp;
+            }
+            else if (mulAdd != NULL)
+            {
+                if (mulAdd->m_prod == mulAdd->m_lhs)
+                {
+                    mulAdd->m_prod = tmp;
+                }
+                mulAdd->m_lhs = tmp;
+            }
+
+            m_ssa->addOperand(tmp);
+            renamed[lhs.get()] = tmp;
+            m_cycles[tmp.get()] = cycle;
+            outputs.push_back(std::make_pair(tmp, lhs));
+        }
+
+        statements.push_back(copy);
+    }
+
+    for(auto const &output : outputs)
+    {
+        SharedOpPtr delayed = getDelayed(output.first, latency, statements);
+        statements.push_back(new OpAssign(delayed, output.second));
+    }
+
+    for(auto statement : m_ssa->m_statements)
+    {
+        delete statement;
+    }
+    m_ssa->m_statements = statements;
+
+    doLog(LOG_INFO, "Inserted %d registers to balance the slices\n", m_registers);
+    doLog(LOG_INFO, "Latency: %d clock cycles\n", latency);
+}
+
+uint32_t PassDSP::getCycle(const SharedOpPtr &op) const
+{
+    auto iter = m_cycles.find(op.get());
+    if (iter != m_cycles.end())
+    {
+        return iter->second;
+    }
+    return 0;
+}
+
+SharedOpPtr PassDSP::getDelayed(const SharedOpPtr &op, uint32_t cycle,
+                                std::list<OperationBase*> &statements)
+{
+    // constants are available in every cycle
+    if ((cycle <= getCycle(op)) || (dynamic_cast<CSDOperand*>(op.get()) != NULL))
+    {
+        return op;
+    }
+
+    auto key  = std::make_pair(static_cast<const OperandBase*>(op.get()), cycle);
+    auto iter = m_delayed.find(key);
+    if (iter != m_delayed.end())
+    {
+        return iter->second;
+    }
+
+    SharedOpPtr previous = getDelayed(op, cycle-1, statements);
+    SharedOpPtr reg = IntermediateOperand::createNewIntermediate();
+    statements.push_back(new OpRegister(previous, reg));
+    m_ssa->addOperand(reg);
+
+    m_cycles[reg.get()] = cycle;
+    m_delayed[key] = reg;
+    m_registers++;
+    return reg;
+}
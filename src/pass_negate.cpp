@@ -0,0 +1,390 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Negation absorption SSA pass
+
+*/
+
+#include <cmath>
+#include <algorithm>
+#include "logging.h"
+#include "pass_negate.h"
+
+using namespace SSA;
+
+bool PassNegate::execute(Program &ssa)
+{
+    doLog(LOG_INFO, "-----------------------\n");
+    doLog(LOG_INFO, "  Running Negate pass\n");
+    doLog(LOG_INFO, "-----------------------\n");
+
+    PassNegate pass(ssa);
+
+    // moving a negation or removing one can make another
+    // rewrite possible, so repeat until nothing changes.
+    bool changed = true;
+    while(changed)
+    {
+        for(auto statement : ssa.m_statements)
+        {
+            if (statement->isPatchBlock())
+            {
+                doLog(LOG_ERROR, "Negate pass: unexpected patch block\n");
+                return false;
+            }
+        }
+
+        pass.analyse();
+        pass.m_replacements.clear();
+
+        changed = false;
+        for(auto statement : ssa.m_statements)
+        {
+            OpNegate *negate = dynamic_cast<OpNegate*>(statement);
+            if ((negate != NULL) && (pass.m_replacements.find(negate) == pass.m_replacements.end()))
+            {
+                changed |= pass.absorb(negate);
+            }
+        }
+
+        for(auto &statement : ssa.m_statements)
+        {
+            auto iter = pass.m_replacements.find(statement);
+            if (iter != pass.m_replacements.end())
+            {
+                // patch blocks delete the instruction they replace
+                if (!iter->second->isPatchBlock())
+                {
+                    delete statement;
+                }
+                statement = iter->second;
+            }
+        }
+        ssa.applyPatches();
+    }
+
+    doLog(LOG_INFO, "Removed %d negations\n", pass.m_removed);
+    return true;
+}
+
+void PassNegate::analyse()
+{
+    m_definitions.clear();
+    m_users.clear();
+    m_ranges.clear();
+
+    // the statements are in dependency order, so the
+    // ranges of the inputs are known.
+    for(auto statement : m_ssa->m_statements)
+    {
+        for(auto const &input : statement->getInputs())
+        {
+            m_users[input.get()].push_back(statement);
+        }
+
+        SharedOpPtr lhs = statement->getLHS();
+        if (!lhs)
+        {
+            continue;
+        }
+        m_definitions[lhs.get()] = statement;
+
+        OperationSingle *single = dynamic_cast<OperationSingle*>(statement);
+        OperationDual   *dual   = dynamic_cast<OperationDual*>(statement);
+
+        range_t range;
+        if ((dynamic_cast<OpAdd*>(statement) != NULL) || (dynamic_cast<OpSub*>(statement) != NULL))
+        {
+            range_t r1 = getRange(dual->m_op1);
+            range_t r2 = getRange(dual->m_op2);
+            if (dynamic_cast<OpAdd*>(statement) != NULL)
+            {
+                range.minValue = r1.minValue + r2.minValue;
+                range.maxValue = r1.maxValue + r2.maxValue;
+            }
+            else
+            {
+                range.minValue = r1.minValue - r2.maxValue;
+                range.maxValue = r1.maxValue - r2.minValue;
+            }
+        }
+        else if (dynamic_cast<OpMul*>(statement) != NULL)
+        {
+            range_t r1 = getRange(dual->m_op1);
+            range_t r2 = getRange(dual->m_op2);
+            double p[4] = {r1.minValue*r2.minValue, r1.minValue*r2.maxValue,
+                           r1.maxValue*r2.minValue, r1.maxValue*r2.maxValue};
+            range.minValue = *std::min_element(p, p+4);
+            range.maxValue = *std::max_element(p, p+4);
+        }
+        else if (dynamic_cast<OpCSDMul*>(statement) != NULL)
+        {
+            const csd_t &csd = static_cast<OpCSDMul*>(statement)->m_csd;
+            range_t r = getRange(single->m_op);
+            range.minValue = std::min(csd.value*r.minValue, csd.value*r.maxValue);
+            range.maxValue = std::max(csd.value*r.minValue, csd.value*r.maxValue);
+        }
+        else if (dynamic_cast<OpNegate*>(statement) != NULL)
+        {
+            range_t r = getRange(single->m_op);
+            range.minValue = -r.maxValue;
+            range.maxValue = -r.minValue;
+        }
+        else if (dynamic_cast<OpReinterpret*>(statement) != NULL)
+        {
+            // the bits stay the same, only the scale changes
+            range_t r = getRange(single->m_op);
+            range.minValue = ldexp(r.minValue, single->m_op->m_fracBits - lhs->m_fracBits);
+            range.maxValue = ldexp(r.maxValue, single->m_op->m_fracBits - lhs->m_fracBits);
+        }
+        else if ((dynamic_cast<OpAssign*>(statement) != NULL) ||
+                 (dynamic_cast<OpExtendLSBs*>(statement) != NULL) ||
+                 (dynamic_cast<OpExtendMSBs*>(statement) != NULL) ||
+                 (dynamic_cast<OpRemoveMSBs*>(statement) != NULL) ||
+                 (dynamic_cast<OpRegister*>(statement) != NULL))
+        {
+            range = getRange(single->m_op);
+        }
+        else
+        {
+            continue;
+        }
+
+        // a range that does not fit the format wraps around
+        if (calcIntBits(range.minValue, range.maxValue, lhs->m_fracBits) <= lhs->m_intBits)
+        {
+            m_ranges[lhs.get()] = range;
+        }
+    }
+}
+
+PassNegate::range_t PassNegate::getRange(const SharedOpPtr &op) const
+{
+    auto iter = m_ranges.find(op.get());
+    if (iter != m_ranges.end())
+    {
+        return iter->second;
+    }
+
+    range_t range;
+    range.minValue = -ldexp(1.0, op->m_intBits-1);
+    range.maxValue = ldexp(1.0, op->m_intBits-1) - ldexp(1.0, -op->m_fracBits);
+    return range;
+}
+
+bool PassNegate::canWrap(const SharedOpPtr &op) const
+{
+    return getRange(op).minValue <= -ldexp(1.0, op->m_intBits-1);
+}
+
+OperationBase* PassNegate::getSingleUser(const SharedOpPtr &op) const
+{
+    if ((dynamic_cast<IntermediateOperand*>(op.get()) == NULL))
+    {
+        return NULL;
+    }
+
+    auto iter = m_users.find(op.get());
+    if ((iter == m_users.end()) || (iter->second.size() != 1))
+    {
+        return NULL;
+    }
+
+    OperationBase *user = iter->second.front();
+    if (m_replacements.find(user) != m_replacements.end())
+    {
+        return NULL;
+    }
+    return user;
+}
+
+void PassNegate::replace(OperationBase *node, OpPatchBlock *patch)
+{
+    m_replacements[node] = patch;
+}
+
+void PassNegate::remove(OperationBase *node)
+{
+    m_replacements[node] = new OpNull();
+}
+
+void PassNegate::addCSDMul(OpPatchBlock *patch, const SharedOpPtr &op, const csd_t &csd,
+                           const std::string &csdName, const SharedOpPtr &lhs)
+{
+    // the exact product is reduced to the format of the
+    // original result, which wraps around at the same
+    // bit position as the original negation.
+    int32_t intBits  = lhs->m_intBits;
+    SharedOpPtr product = IntermediateOperand::createNewIntermediate();
+    patch->addStatement(new OpCSDMul(op, csd, csdName, product));
+    m_ssa->addOperand(product);
+
+    if (product->m_intBits > intBits)
+    {
+        patch->addStatement(new OpRemoveMSBs(product, lhs, product->m_intBits - intBits));
+    }
+    else if (product->m_intBits < intBits)
+    {
+        patch->addStatement(new OpExtendMSBs(product, lhs, intBits - product->m_intBits));
+    }
+    else
+    {
+        patch->addStatement(new OpAssign(product, lhs));
+    }
+}
+
+bool PassNegate::absorb(OpNegate *negate)
+{
+    const SharedOpPtr &x = negate->m_op;
+    const SharedOpPtr &n = negate->m_lhs;
+
+    // -(c*x) becomes (-c)*x
+    auto defIter = m_definitions.find(x.get());
+    OpCSDMul *product = (defIter != m_definitions.end()) ? dynamic_cast<OpCSDMul*>(defIter->second) : NULL;
+    if ((product != NULL) && (getSingleUser(x) == negate) &&
+        (m_replacements.find(product) == m_replacements.end()))
+    {
+        doLog(LOG_DEBUG, "Negating constant %s of %s\n", product->m_csdName.c_str(), n->m_identName.c_str());
+
+        OpPatchBlock *patch = new OpPatchBlock(negate);
+        addCSDMul(patch, product->m_op, negateCSD(product->m_csd), "-" + product->m_csdName, n);
+        replace(negate, patch);
+        remove(product);
+        m_removed++;
+        return true;
+    }
+
+    OperationBase *user = getSingleUser(n);
+    if (user == NULL)
+    {
+        return false;
+    }
+
+    // -(-x) becomes x. this is exact, as the most
+    // negative value wraps around to itself.
+    OpNegate *negate2 = dynamic_cast<OpNegate*>(user);
+    if (negate2 != NULL)
+    {
+        doLog(LOG_DEBUG, "Removing double negation of %s\n", x->m_identName.c_str());
+
+        OpPatchBlock *patch = new OpPatchBlock(negate2);
+        patch->addStatement(new OpAssign(x, negate2->m_lhs));
+        replace(negate2, patch);
+        remove(negate);
+        m_removed += 2;
+        return true;
+    }
+
+    // move the negation past a format change:
+    // f(-x) becomes -f(x). outputs are only written
+    // by assignments, so an assignment to an output
+    // stays where it is.
+    OperationSingle *single = dynamic_cast<OperationSingle*>(user);
+    bool toOutput = (single != NULL) && (dynamic_cast<OutputOperand*>(single->m_lhs.get()) != NULL);
+    if (((dynamic_cast<OpAssign*>(user) != NULL) && !toOutput) ||
+        (dynamic_cast<OpExtendLSBs*>(user) != NULL) ||
+        (dynamic_cast<OpRemoveMSBs*>(user) != NULL) ||
+        ((dynamic_cast<OpExtendMSBs*>(user) != NULL) && !canWrap(x)))
+    {
+        doLog(LOG_DEBUG, "Moving negation of %s to %s\n",
+              x->m_identName.c_str(), single->m_lhs->m_identName.c_str());
+
+        OpPatchBlock *patch = new OpPatchBlock(user);
+        OperationSingle *copy = static_cast<OperationSingle*>(user->clone());
+        SharedOpPtr tmp = IntermediateOperand::createNewIntermediate();
+        copy->m_op  = x;
+        copy->m_lhs = tmp;
+        copy->updateOutputPrecision();
+        m_ssa->addOperand(tmp);
+        patch->addStatement(copy);
+        if (toOutput)
+        {
+            SharedOpPtr negated = IntermediateOperand::createNewIntermediate();
+            m_ssa->addOperand(negated);
+            patch->addStatement(new OpNegate(tmp, negated));
+            patch->addStatement(new OpAssign(negated, single->m_lhs));
+        }
+        else
+        {
+            patch->addStatement(new OpNegate(tmp, single->m_lhs));
+        }
+        replace(user, patch);
+        remove(negate);
+        return true;
+    }
+
+    // c*(-x) becomes (-c)*x
+    OpCSDMul *product2 = dynamic_cast<OpCSDMul*>(user);
+    if ((product2 != NULL) && !canWrap(x))
+    {
+        doLog(LOG_DEBUG, "Negating constant %s of %s\n",
+              product2->m_csdName.c_str(), product2->m_lhs->m_identName.c_str());
+
+        OpPatchBlock *patch = new OpPatchBlock(product2);
+        addCSDMul(patch, x, negateCSD(product2->m_csd), "-" + product2->m_csdName, product2->m_lhs);
+        replace(product2, patch);
+        remove(negate);
+        m_removed++;
+        return true;
+    }
+
+    OpAdd *add = dynamic_cast<OpAdd*>(user);
+    OpSub *sub = dynamic_cast<OpSub*>(user);
+    if ((add == NULL) && (sub == NULL))
+    {
+        return false;
+    }
+
+    // y+(-x) and y-(-x) differ from y-x and y+x when -x
+    // wraps around, unless the result wraps around at
+    // the same bit position.
+    OperationDual *dual = static_cast<OperationDual*>(user);
+    const SharedOpPtr &lhs = dual->m_lhs;
+    bool noExtension = (add != NULL) ? add->m_noExtension : sub->m_noExtension;
+    if (canWrap(x) && (!noExtension || (lhs->m_intBits > x->m_intBits)))
+    {
+        return false;
+    }
+
+    OperationBase *replacement = NULL;
+    if (add != NULL)
+    {
+        const SharedOpPtr &y = (dual->m_op1 == n) ? dual->m_op2 : dual->m_op1;
+        replacement = new OpSub(y, x, lhs, noExtension);
+    }
+    else if (dual->m_op2 == n)
+    {
+        replacement = new OpAdd(dual->m_op1, x, lhs, noExtension);
+    }
+    else
+    {
+        // (-x)-(-z) becomes z-x
+        defIter = m_definitions.find(dual->m_op2.get());
+        OpNegate *negate3 = (defIter != m_definitions.end()) ? dynamic_cast<OpNegate*>(defIter->second) : NULL;
+        if ((negate3 == NULL) || (getSingleUser(dual->m_op2) != user) ||
+            (m_replacements.find(negate3) != m_replacements.end()))
+        {
+            return false;
+        }
+
+        const SharedOpPtr &z = negate3->m_op;
+        if (canWrap(z) && (!noExtension || (lhs->m_intBits > z->m_intBits)))
+        {
+            return false;
+        }
+
+        replacement = new OpSub(z, x, lhs, noExtension);
+        remove(negate3);
+        m_removed++;
+    }
+
+    doLog(LOG_DEBUG, "Absorbing negation of %s into %s\n", x->m_identName.c_str(), lhs->m_identName.c_str());
+
+    OpPatchBlock *patch = new OpPatchBlock(user);
+    patch->addStatement(replacement);
+    replace(user, patch);
+    remove(negate);
+    m_removed++;
+    return true;
+}
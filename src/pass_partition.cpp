@@ -0,0 +1,344 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Partition the program into output cones
+                and optimize them concurrently
+
+*/
+
+#include <stdint.h>
+#include <map>
+#include <set>
+#include "logging.h"
+#include "parallel.h"
+#include "pass_partition.h"
+
+using namespace SSA;
+
+/** find the representative of a cone in a union-find forest */
+static size_t findRoot(std::vector<size_t> &parents, size_t cone)
+{
+    while(parents[cone] != cone)
+    {
+        parents[cone] = parents[parents[cone]];
+        cone = parents[cone];
+    }
+    return cone;
+}
+
+/** get the operand that holds the bits of an input */
+static const OperandBase* getSource(const SharedOpPtr &op)
+{
+    const ViewOperand *view = dynamic_cast<const ViewOperand*>(op.get());
+    return (view != NULL) ? view->m_source.get() : op.get();
+}
+
+/** get the variable operand of a multiplication by a constant,
+    or NULL if the instruction is not one */
+static const OperandBase* getMultiplicand(const OperationBase *statement)
+{
+    const OpCSDMul *csdMul = dynamic_cast<const OpCSDMul*>(statement);
+    if (csdMul != NULL)
+    {
+        return getSource(csdMul->m_op);
+    }
+
+    const OpMul *mul = dynamic_cast<const OpMul*>(statement);
+    if ((mul != NULL) && (mul->m_op1->isCSD() != mul->m_op2->isCSD()))
+    {
+        return getSource(mul->m_op1->isCSD() ? mul->m_op2 : mul->m_op1);
+    }
+    return NULL;
+}
+
+/** get the results of an instruction, including the
+    internal results of a multiply-add */
+static std::vector<SharedOpPtr> getResults(const OperationBase *statement)
+{
+    std::vector<SharedOpPtr> results = {statement->getLHS()};
+    const OpMulAdd *mulAdd = dynamic_cast<const OpMulAdd*>(statement);
+    if (mulAdd != NULL)
+    {
+        if (mulAdd->m_preMode != OpMulAdd::ADD_NONE)
+        {
+            results.push_back(mulAdd->m_pre);
+        }
+        if (mulAdd->m_prod != mulAdd->m_lhs)
+        {
+            results.push_back(mulAdd->m_prod);
+        }
+    }
+    return results;
+}
+
+/** join the cone of an operand with another one, or
+    make it the cone of the operand if it has none */
+static void join(std::map<const OperandBase*, size_t> &cones, std::vector<size_t> &parents,
+                 const OperandBase *op, size_t cone)
+{
+    auto iter = cones.find(op);
+    if (iter == cones.end())
+    {
+        cones[op] = cone;
+        return;
+    }
+
+    size_t root = findRoot(parents, iter->second);
+    if (root != cone)
+    {
+        parents[root] = cone;
+    }
+}
+
+bool PassPartition::execute(Program &ssa, const std::function<bool(Program &)> &passes)
+{
+    doLog(LOG_INFO, "----------------------------\n");
+    doLog(LOG_INFO, "  Running Partition pass\n");
+    doLog(LOG_INFO, "----------------------------\n");
+
+    PassPartition pass(ssa);
+    pass.findClusters();
+    pass.split(false);
+
+    doLog(LOG_INFO, "Optimizing %d clusters of output cones on %d threads\n",
+          static_cast<uint32_t>(pass.m_clusters.size()), getWorkerCount());
+    doLog(LOG_INFO, "Removed %d instructions that do not reach an output\n", pass.m_removed);
+    for(size_t i=0; i<pass.m_clusters.size(); i++)
+    {
+        doLog(LOG_INFO, "Cluster %d: %d instructions\n", static_cast<uint32_t>(i),
+              static_cast<uint32_t>(pass.m_clusters[i]->m_statements.size()));
+    }
+
+    // the log messages of the clusters would be mixed,
+    // only errors are reported.
+    std::vector<char> ok(pass.m_clusters.size(), 0);
+    setQuiet(true);
+    parallelFor(pass.m_clusters.size(), [&](size_t i)
+    {
+        ok[i] = passes(*pass.m_clusters[i]) ? 1 : 0;
+    });
+    setQuiet(false);
+
+    pass.merge();
+    for(size_t i=0; i<ok.size(); i++)
+    {
+        if (!ok[i])
+        {
+            doLog(LOG_ERROR, "Optimizing cluster %d failed\n", static_cast<uint32_t>(i));
+            return false;
+        }
+    }
+
+    pass.rename();
+    doLog(LOG_INFO, "Merged %d instructions\n", static_cast<uint32_t>(ssa.m_statements.size()));
+    return true;
+}
+
+bool PassPartition::forEachCluster(Program &ssa, const std::function<bool(uint32_t, Program &)> &func)
+{
+    PassPartition pass(ssa);
+    pass.findClusters();
+    pass.split(true);
+
+    bool ok = true;
+    for(size_t i=0; (i<pass.m_clusters.size()) && ok; i++)
+    {
+        ok = func(static_cast<uint32_t>(i), *pass.m_clusters[i]);
+    }
+
+    pass.merge();
+    return ok;
+}
+
+void PassPartition::findClusters()
+{
+    m_statements.assign(m_ssa->m_statements.begin(), m_ssa->m_statements.end());
+
+    // in SSA form the users of a result come after its
+    // definition, so a backward sweep reaches each
+    // instruction after all cones that need it. each
+    // output starts a cone, and cones that meet, or that
+    // multiply the same operand by a constant, are joined.
+    std::vector<size_t> parents;
+    std::vector<size_t> cones(m_statements.size(), SIZE_MAX);
+    std::map<const OperandBase*, size_t> needed;
+    std::map<const OperandBase*, size_t> multiplied;
+    for(size_t i=m_statements.size(); i>0; i--)
+    {
+        const OperationBase *statement = m_statements[i-1];
+        SharedOpPtr lhs = statement->getLHS();
+        if (!lhs)
+        {
+            continue;
+        }
+
+        size_t cone;
+        auto iter = needed.find(lhs.get());
+        if (iter != needed.end())
+        {
+            cone = findRoot(parents, iter->second);
+        }
+        else if (dynamic_cast<const OutputOperand*>(lhs.get()) != NULL)
+        {
+            cone = parents.size();
+            parents.push_back(cone);
+        }
+        else
+        {
+            continue;
+        }
+
+        cones[i-1] = cone;
+        for(auto input : statement->getInputs())
+        {
+            // all cones may read the inputs and constants
+            const OperandBase *source = getSource(input);
+            if ((dynamic_cast<const InputOperand*>(source) != NULL) || source->isCSD())
+            {
+                continue;
+            }
+
+            join(needed, parents, source, cone);
+        }
+
+        // the constant multiplications of an operand
+        // share their partial products.
+        const OperandBase *multiplicand = getMultiplicand(statement);
+        if (multiplicand != NULL)
+        {
+            join(multiplied, parents, multiplicand, cone);
+        }
+    }
+
+    // number the clusters by their first instruction
+    std::map<size_t, int32_t> numbers;
+    m_cluster.assign(m_statements.size(), -1);
+    for(size_t i=0; i<m_statements.size(); i++)
+    {
+        if (cones[i] == SIZE_MAX)
+        {
+            continue;
+        }
+
+        size_t root = findRoot(parents, cones[i]);
+        auto iter = numbers.find(root);
+        if (iter == numbers.end())
+        {
+            iter = numbers.insert(std::make_pair(root, static_cast<int32_t>(numbers.size()))).first;
+        }
+        m_cluster[i] = iter->second;
+    }
+
+    m_clusters.clear();
+    for(size_t i=0; i<numbers.size(); i++)
+    {
+        m_clusters.push_back(std::unique_ptr<Program>(new Program()));
+    }
+}
+
+void PassPartition::split(bool usedOnly)
+{
+    std::map<const OperandBase*, int32_t> owners;
+    std::set<std::pair<const OperandBase*, int32_t> > used;
+    for(size_t i=0; i<m_statements.size(); i++)
+    {
+        if (m_cluster[i] < 0)
+        {
+            delete m_statements[i];
+            m_removed++;
+            continue;
+        }
+
+        m_clusters[m_cluster[i]]->addStatement(m_statements[i]);
+        for(auto result : getResults(m_statements[i]))
+        {
+            owners[result.get()] = m_cluster[i];
+        }
+        for(auto input : m_statements[i]->getInputs())
+        {
+            used.insert(std::make_pair(getSource(input), m_cluster[i]));
+        }
+    }
+    m_ssa->m_statements.clear();
+    m_statements.clear();
+
+    // the inputs, outputs and constants are known to
+    // all clusters, or to the ones that use them, and
+    // an intermediate only to its own.
+    for(auto operand : m_ssa->m_operands)
+    {
+        if (dynamic_cast<IntermediateOperand*>(operand.get()) == NULL)
+        {
+            for(size_t i=0; i<m_clusters.size(); i++)
+            {
+                int32_t cluster = static_cast<int32_t>(i);
+                auto owner = owners.find(operand.get());
+                if (!usedOnly || (used.count(std::make_pair(operand.get(), cluster)) != 0) ||
+                    ((owner != owners.end()) && (owner->second == cluster)))
+                {
+                    m_clusters[i]->addOperand(operand);
+                }
+            }
+            continue;
+        }
+
+        auto iter = owners.find(operand.get());
+        if (iter != owners.end())
+        {
+            m_clusters[iter->second]->addOperand(operand);
+        }
+    }
+}
+
+void PassPartition::merge()
+{
+    std::list<SharedOpPtr> operands;
+    std::set<const OperandBase*> known;
+    for(auto operand : m_ssa->m_operands)
+    {
+        if (dynamic_cast<IntermediateOperand*>(operand.get()) == NULL)
+        {
+            operands.push_back(operand);
+            known.insert(operand.get());
+        }
+    }
+
+    for(auto &cluster : m_clusters)
+    {
+        for(auto operand : cluster->m_operands)
+        {
+            if (known.insert(operand.get()).second)
+            {
+                operands.push_back(operand);
+            }
+        }
+
+        // the statements are owned by the program again
+        m_ssa->m_statements.splice(m_ssa->m_statements.end(), cluster->m_statements);
+    }
+    m_ssa->m_operands = operands;
+    m_clusters.clear();
+}
+
+void PassPartition::rename()
+{
+    std::set<const OperandBase*> renamed;
+    for(auto statement : m_ssa->m_statements)
+    {
+        IntermediateOperand *lhs = dynamic_cast<IntermediateOperand*>(statement->getLHS().get());
+        if ((lhs != NULL) && renamed.insert(lhs).second)
+        {
+            lhs->rename();
+        }
+    }
+
+    for(auto operand : m_ssa->m_operands)
+    {
+        IntermediateOperand *op = dynamic_cast<IntermediateOperand*>(operand.get());
+        if ((op != NULL) && renamed.insert(op).second)
+        {
+            op->rename();
+        }
+    }
+}
@@ -0,0 +1,364 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Peephole SSA pass for width adjustments
+
+*/
+
+#include "logging.h"
+#include "pass_peephole.h"
+
+using namespace SSA;
+
+/** the result is a copy of operand 'op' */
+static void addCopy(const SharedOpPtr &op, std::vector<PassPeephole::instr_t> &result)
+{
+    PassPeephole::instr_t copy;
+    copy.opcode   = PassPeephole::OPC_ASSIGN;
+    copy.op       = op;
+    copy.bits     = 0;
+    copy.intBits  = 0;
+    copy.fracBits = 0;
+    result.push_back(copy);
+}
+
+/** extending or removing zero bits does nothing */
+static bool removeZeroBits(const PassPeephole::instr_t &outer, const PassPeephole::instr_t &inner,
+                           std::vector<PassPeephole::instr_t> &result)
+{
+    (void)inner;
+    if (outer.bits != 0)
+    {
+        return false;
+    }
+    addCopy(outer.op, result);
+    return true;
+}
+
+/** reinterpreting to the same format does nothing */
+static bool removeSameFormat(const PassPeephole::instr_t &outer, const PassPeephole::instr_t &inner,
+                             std::vector<PassPeephole::instr_t> &result)
+{
+    (void)inner;
+    if ((outer.intBits != outer.op->m_intBits) || (outer.fracBits != outer.op->m_fracBits))
+    {
+        return false;
+    }
+    addCopy(outer.op, result);
+    return true;
+}
+
+/** the outer instruction can use the input of the inner one */
+static bool bypassInner(const PassPeephole::instr_t &outer, const PassPeephole::instr_t &inner,
+                        std::vector<PassPeephole::instr_t> &result)
+{
+    result.push_back(outer);
+    result.back().op = inner.op;
+    return true;
+}
+
+/** an assignment of a result becomes the instruction producing it */
+static bool replaceAssign(const PassPeephole::instr_t &outer, const PassPeephole::instr_t &inner,
+                          std::vector<PassPeephole::instr_t> &result)
+{
+    (void)outer;
+    result.push_back(inner);
+    return true;
+}
+
+/** two extensions or removals of the same kind are merged */
+static bool mergeBits(const PassPeephole::instr_t &outer, const PassPeephole::instr_t &inner,
+                      std::vector<PassPeephole::instr_t> &result)
+{
+    result.push_back(outer);
+    result.back().op   = inner.op;
+    result.back().bits = outer.bits + inner.bits;
+    return true;
+}
+
+/** removing extended bits cancels (part of) the extension */
+static bool cancelBits(const PassPeephole::instr_t &outer, const PassPeephole::instr_t &inner,
+                       std::vector<PassPeephole::instr_t> &result)
+{
+    int32_t bits = inner.bits - outer.bits;
+    if (bits == 0)
+    {
+        addCopy(inner.op, result);
+    }
+    else if (bits > 0)
+    {
+        result.push_back(inner);
+        result.back().bits = bits;
+    }
+    else
+    {
+        result.push_back(outer);
+        result.back().op   = inner.op;
+        result.back().bits = -bits;
+    }
+    return true;
+}
+
+/** the LSBs and MSBs are independent, so the
+    instructions on them can be swapped, unless
+    the LSBs would be removed from an operand
+    that does not have enough bits yet. */
+static bool swapInner(const PassPeephole::instr_t &outer, const PassPeephole::instr_t &inner,
+                      std::vector<PassPeephole::instr_t> &result)
+{
+    if ((outer.opcode == PassPeephole::OPC_REMOVELSBS) &&
+        ((inner.op->m_intBits + inner.op->m_fracBits - outer.bits) < 1))
+    {
+        return false;
+    }
+
+    result.push_back(outer);
+    result.back().op = inner.op;
+    result.push_back(inner);
+    return true;
+}
+
+// the rules are tried in this order, the first
+// one that matches an instruction is applied.
+static const PassPeephole::rule_t rules[] =
+{
+    {"zero-extendlsbs",     PassPeephole::OPC_EXTENDLSBS,   PassPeephole::OPC_NONE,         false,  removeZeroBits},
+    {"zero-removelsbs",     PassPeephole::OPC_REMOVELSBS,   PassPeephole::OPC_NONE,         false,  removeZeroBits},
+    {"zero-extendmsbs",     PassPeephole::OPC_EXTENDMSBS,   PassPeephole::OPC_NONE,         false,  removeZeroBits},
+    {"zero-removemsbs",     PassPeephole::OPC_REMOVEMSBS,   PassPeephole::OPC_NONE,         false,  removeZeroBits},
+    {"same-reinterpret",    PassPeephole::OPC_REINTERPRET,  PassPeephole::OPC_NONE,         false,  removeSameFormat},
+    {"forward-assign",      PassPeephole::OPC_ANY,          PassPeephole::OPC_ASSIGN,       false,  bypassInner},
+    {"assign-of",           PassPeephole::OPC_ASSIGN,       PassPeephole::OPC_ANY,          false,  replaceAssign},
+    {"merge-reinterprets",  PassPeephole::OPC_REINTERPRET,  PassPeephole::OPC_REINTERPRET,  false,  bypassInner},
+    {"merge-extendlsbs",    PassPeephole::OPC_EXTENDLSBS,   PassPeephole::OPC_EXTENDLSBS,   false,  mergeBits},
+    {"merge-removelsbs",    PassPeephole::OPC_REMOVELSBS,   PassPeephole::OPC_REMOVELSBS,   false,  mergeBits},
+    {"merge-extendmsbs",    PassPeephole::OPC_EXTENDMSBS,   PassPeephole::OPC_EXTENDMSBS,   false,  mergeBits},
+    {"merge-removemsbs",    PassPeephole::OPC_REMOVEMSBS,   PassPeephole::OPC_REMOVEMSBS,   false,  mergeBits},
+    {"cancel-lsbs",         PassPeephole::OPC_REMOVELSBS,   PassPeephole::OPC_EXTENDLSBS,   false,  cancelBits},
+    {"cancel-msbs",         PassPeephole::OPC_REMOVEMSBS,   PassPeephole::OPC_EXTENDMSBS,   false,  cancelBits},
+    {"swap-extendlsbs",     PassPeephole::OPC_EXTENDLSBS,   PassPeephole::OPC_EXTENDMSBS,   true,   swapInner},
+    {"swap-extendlsbs",     PassPeephole::OPC_EXTENDLSBS,   PassPeephole::OPC_REMOVEMSBS,   true,   swapInner},
+    {"swap-removelsbs",     PassPeephole::OPC_REMOVELSBS,   PassPeephole::OPC_EXTENDMSBS,   true,   swapInner},
+    {"swap-removelsbs",     PassPeephole::OPC_REMOVELSBS,   PassPeephole::OPC_REMOVEMSBS,   true,   swapInner}
+};
+
+/** check if an opcode matches the opcode of a rule */
+static bool matches(PassPeephole::opcode_t pattern, PassPeephole::opcode_t opcode)
+{
+    if (pattern == PassPeephole::OPC_ANY)
+    {
+        return opcode != PassPeephole::OPC_NONE;
+    }
+    return pattern == opcode;
+}
+
+bool PassPeephole::execute(Program &ssa)
+{
+    doLog(LOG_INFO, "-------------------------\n");
+    doLog(LOG_INFO, "  Running Peephole pass\n");
+    doLog(LOG_INFO, "-------------------------\n");
+
+    PassPeephole pass(ssa);
+
+    // a rewrite can enable another one further
+    // down, so repeat until nothing changes.
+    uint32_t total = 0;
+    uint32_t iterations = 0;
+    while(true)
+    {
+        uint32_t count = pass.rewrite();
+        ssa.applyPatches(); // remove the null operations
+        if (count == 0)
+        {
+            break;
+        }
+        total += count;
+        iterations++;
+    }
+
+    doLog(LOG_INFO, "Applied %d rewrites in %d iterations\n", total, iterations);
+    return true;
+}
+
+bool PassPeephole::decode(const OperationBase *node, instr_t &instr)
+{
+    instr.bits     = 0;
+    instr.intBits  = 0;
+    instr.fracBits = 0;
+    if (const OpAssign *assign = dynamic_cast<const OpAssign*>(node))
+    {
+        instr.opcode = OPC_ASSIGN;
+        instr.op     = assign->m_op;
+    }
+    else if (const OpReinterpret *reinterpret = dynamic_cast<const OpReinterpret*>(node))
+    {
+        instr.opcode   = OPC_REINTERPRET;
+        instr.op       = reinterpret->m_op;
+        instr.intBits  = reinterpret->m_intBits;
+        instr.fracBits = reinterpret->m_fracBits;
+    }
+    else if (const OpExtendLSBs *extendLSBs = dynamic_cast<const OpExtendLSBs*>(node))
+    {
+        instr.opcode = OPC_EXTENDLSBS;
+        instr.op     = extendLSBs->m_op;
+        instr.bits   = extendLSBs->m_bits;
+    }
+    else if (const OpRemoveLSBs *removeLSBs = dynamic_cast<const OpRemoveLSBs*>(node))
+    {
+        instr.opcode = OPC_REMOVELSBS;
+        instr.op     = removeLSBs->m_op;
+        instr.bits   = removeLSBs->m_bits;
+    }
+    else if (const OpExtendMSBs *extendMSBs = dynamic_cast<const OpExtendMSBs*>(node))
+    {
+        instr.opcode = OPC_EXTENDMSBS;
+        instr.op     = extendMSBs->m_op;
+        instr.bits   = extendMSBs->m_bits;
+    }
+    else if (const OpRemoveMSBs *removeMSBs = dynamic_cast<const OpRemoveMSBs*>(node))
+    {
+        instr.opcode = OPC_REMOVEMSBS;
+        instr.op     = removeMSBs->m_op;
+        instr.bits   = removeMSBs->m_bits;
+    }
+    else
+    {
+        instr.opcode = OPC_NONE;
+        return false;
+    }
+    return true;
+}
+
+OperationBase* PassPeephole::create(const instr_t &instr, const SharedOpPtr &lhs)
+{
+    switch(instr.opcode)
+    {
+    case OPC_ASSIGN:
+        return new OpAssign(instr.op, lhs);
+    case OPC_REINTERPRET:
+        return new OpReinterpret(instr.op, lhs, instr.intBits, instr.fracBits);
+    case OPC_EXTENDLSBS:
+        return new OpExtendLSBs(instr.op, lhs, instr.bits);
+    case OPC_REMOVELSBS:
+        return new OpRemoveLSBs(instr.op, lhs, instr.bits);
+    case OPC_EXTENDMSBS:
+        return new OpExtendMSBs(instr.op, lhs, instr.bits);
+    case OPC_REMOVEMSBS:
+        return new OpRemoveMSBs(instr.op, lhs, instr.bits);
+    default:
+        throw std::runtime_error("PassPeephole: cannot create instruction");
+    }
+}
+
+uint32_t PassPeephole::rewrite()
+{
+    m_uses.clear();
+    for(auto statement : m_ssa->m_statements)
+    {
+        for(auto const &input : statement->getInputs())
+        {
+            m_uses[input.get()]++;
+        }
+    }
+
+    uint32_t count = 0;
+    m_definitions.clear();
+    for(auto iter = m_ssa->m_statements.begin(); iter != m_ssa->m_statements.end(); iter++)
+    {
+        instr_t outer;
+        if (decode(*iter, outer))
+        {
+            instr_t inner;
+            auto def = m_definitions.find(outer.op.get());
+            if (def == m_definitions.end())
+            {
+                inner.opcode = OPC_NONE;
+            }
+            else
+            {
+                decode(def->second, inner);
+            }
+
+            SharedOpPtr lhs = (*iter)->getLHS();
+            bool isOutput = (dynamic_cast<OutputOperand*>(lhs.get()) != NULL);
+            for(auto const &rule : rules)
+            {
+                std::vector<instr_t> result;
+                if (!matches(rule.outer, outer.opcode) ||
+                    ((rule.inner != OPC_NONE) && !matches(rule.inner, inner.opcode)) ||
+                    (rule.singleUse && (m_uses[outer.op.get()] != 1)) ||
+                    !rule.rewrite(outer, inner, result) ||
+                    ((result.size() == 1) && (result[0].opcode == outer.opcode) && (result[0].op == outer.op)))
+                {
+                    continue;
+                }
+
+                if ((result.size() == 1) && (result[0].opcode == OPC_ASSIGN) && !isOutput)
+                {
+                    // a copy of an intermediate result:
+                    // use the operand instead.
+                    doLog(LOG_DEBUG, "%s: %s is replaced by %s\n", rule.name,
+                          lhs->m_identName.c_str(), result[0].op->m_identName.c_str());
+                    for(auto statement : m_ssa->m_statements)
+                    {
+                        statement->replaceOperand(lhs, result[0].op);
+                    }
+                    replace(iter, new OpNull());
+                    count++;
+                    break;
+                }
+
+                // outputs are only written by assignments,
+                // and the result must keep its format.
+                if (isOutput && (result.back().opcode != OPC_ASSIGN))
+                {
+                    continue;
+                }
+
+                int32_t intBits  = lhs->m_intBits;
+                int32_t fracBits = lhs->m_fracBits;
+                OperationBase *first = NULL;
+                if (result.size() > 1)
+                {
+                    SharedOpPtr tmp = IntermediateOperand::createNewIntermediate();
+                    first = create(result[0], tmp);
+                    result[1].op = tmp;
+                }
+                OperationBase *node = create(result.back(), lhs);
+
+                if ((lhs->m_intBits != intBits) || (lhs->m_fracBits != fracBits))
+                {
+                    lhs->m_intBits  = intBits;
+                    lhs->m_fracBits = fracBits;
+                    delete first;
+                    delete node;
+                    continue;
+                }
+
+                doLog(LOG_DEBUG, "%s: %s\n", rule.name, lhs->m_identName.c_str());
+                if (first != NULL)
+                {
+                    m_ssa->addOperand(first->getLHS());
+                    m_ssa->m_statements.insert(iter, first);
+                }
+                replace(iter, node);
+                count++;
+                break;
+            }
+        }
+
+        SharedOpPtr lhs = (*iter)->getLHS();
+        if (lhs)
+        {
+            m_definitions[lhs.get()] = *iter;
+        }
+    }
+    return count;
+}
+
+void PassPeephole::replace(std::list<OperationBase*>::iterator iter, OperationBase *node)
+{
+    delete (*iter);
+    (*iter) = node;
+}
@@ -0,0 +1,273 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Pipeline register insertion SSA pass
+
+*/
+
+#include <vector>
+#include <algorithm>
+#include "logging.h"
+#include "pass_pipeline.h"
+
+using namespace SSA;
+
+bool PassPipeline::execute(Program &ssa, DelayModel::model_t model, double targetDelay)
+{
+    doLog(LOG_INFO, "-------------------------\n");
+    doLog(LOG_INFO, "  Running Pipeline pass\n");
+    doLog(LOG_INFO, "-------------------------\n");
+
+    DelayModel delays(model);
+    double before = delays.calcCriticalPath(ssa);
+
+    PassPipeline pass(ssa);
+
+    // assign each instruction to the earliest stage in
+    // which its inputs are available and the delay
+    // within the stage stays below the target.
+    std::map<const OperationBase*, uint32_t> nodeStages;
+    std::map<const OperandBase*, double> arrival;
+    uint32_t latency = 0;
+    for(auto statement : ssa.m_statements)
+    {
+        if (dynamic_cast<OpPatchBlock*>(statement) != NULL)
+        {
+            doLog(LOG_ERROR, "Pipeline pass: unexpected patch block\n");
+            return false;
+        }
+
+        SharedOpPtr lhs = statement->getLHS();
+        if (!lhs)
+        {
+            continue;
+        }
+
+        std::vector<SharedOpPtr> inputs = statement->getInputs();
+        uint32_t stage = 0;
+        for(auto const &input : inputs)
+        {
+            stage = std::max(stage, pass.getStage(input));
+        }
+
+        // operands from earlier stages come from a
+        // register, so they arrive at the start of the stage.
+        double t = 0.0;
+        for(auto const &input : inputs)
+        {
+            auto iter = arrival.find(input.get());
+            if ((iter != arrival.end()) && (pass.getStage(input) == stage))
+            {
+                t = std::max(t, iter->second);
+            }
+        }
+
+        double delay = delays.getDelay(statement);
+        if ((t > 0.0) && ((t + delay) > targetDelay))
+        {
+            stage++;
+            t = 0.0;
+        }
+
+        if (delay > targetDelay)
+        {
+            doLog(LOG_WARN, "Pipeline pass: %s has a delay of %g %s, which exceeds the target\n",
+                  lhs->m_identName.c_str(), delay, delays.getUnit());
+        }
+
+        nodeStages[statement] = stage;
+        pass.m_stages[lhs.get()] = stage;
+        arrival[lhs.get()] = t + delay;
+
+        if (dynamic_cast<OutputOperand*>(lhs.get()) != NULL)
+        {
+            latency = std::max(latency, stage);
+        }
+    }
+
+    if (latency == 0)
+    {
+        doLog(LOG_INFO, "No pipeline registers needed\n");
+        return true;
+    }
+
+    // rebuild the program with the registers. outputs that
+    // are ready before the last stage are written to a new
+    // intermediate first, which is delayed to the last stage.
+    std::list<OperationBase*> statements;
+    std::map<const OperandBase*, SharedOpPtr> renamed;
+    std::vector<std::pair<SharedOpPtr, SharedOpPtr> > outputs;
+    for(auto statement : ssa.m_statements)
+    {
+        SharedOpPtr lhs = statement->getLHS();
+        if (!lhs)
+        {
+            continue;
+        }
+
+        uint32_t stage = nodeStages[statement];
+        OperationBase *copy = statement->clone();
+        for(auto const &input : statement->getInputs())
+        {
+            SharedOpPtr op = input;
+            auto iter = renamed.find(input.get());
+            if (iter != renamed.end())
+            {
+                op = iter->second;
+            }
+
+            SharedOpPtr delayed = pass.getDelayed(op, stage, statements);
+            if (delayed != input)
+            {
+                copy->replaceOperand(input, delayed);
+            }
+        }
+
+        if ((dynamic_cast<OutputOperand*>(lhs.get()) != NULL) && (stage < latency))
+        {
+            SharedOpPtr tmp = IntermediateOperand::createNewIntermediate();
+            tmp->m_intBits  = lhs->m_intBits;
+            tmp->m_fracBits = lhs->m_fracBits;
+
+            OperationSingle *single = dynamic_cast<OperationSingle*>(copy);
+            OperationDual   *dual   = dynamic_cast<OperationDual*>(copy);
+            if (single != NULL)
+            {
+                single->m_lhs = tmp;
+            }
+            else if (dual != NULL)
+            {
+                dual->m_lhs = tmp;
+            }
+            else
+            {
+                delete copy;
+                doLog(LOG_ERROR, "Pipeline pass: cannot rename output %s\n", lhs->m_identName.c_str());
+                return false;
+            }
+
+            ssa.addOperand(tmp);
+            renamed[lhs.get()] = tmp;
+            pass.m_stages[tmp.get()] = stage;
+            outputs.push_back(std::make_pair(tmp, lhs));
+        }
+
+        statements.push_back(copy);
+    }
+
+    for(auto const &output : outputs)
+    {
+        SharedOpPtr delayed = pass.getDelayed(output.first, latency, statements);
+        statements.push_back(new OpAssign(delayed, output.second));
+    }
+
+    for(auto statement : ssa.m_statements)
+    {
+        delete statement;
+    }
+    ssa.m_statements = statements;
+
+    doLog(LOG_INFO, "Inserted %d registers (%d bits)\n", pass.m_registers, pass.m_registerBits);
+    doLog(LOG_INFO, "Latency: %d clock cycles\n", latency);
+    doLog(LOG_INFO, "Critical path: %g %s before, %g %s after\n",
+          before, delays.getUnit(), delays.calcCriticalPath(ssa), delays.getUnit());
+    return true;
+}
+
+uint32_t PassPipeline::getStage(const SharedOpPtr &op) const
+{
+    auto iter = m_stages.find(op.get());
+    if (iter != m_stages.end())
+    {
+        return iter->second;
+    }
+    return 0;
+}
+
+SharedOpPtr PassPipeline::getDelayed(const SharedOpPtr &op, uint32_t stage,
+                                     std::list<OperationBase*> &statements)
+{
+    // constants are available in every stage
+    if ((stage <= getStage(op)) || (dynamic_cast<CSDOperand*>(op.get()) != NULL))
+    {
+        return op;
+    }
+
+    auto key  = std::make_pair(static_cast<const OperandBase*>(op.get()), stage);
+    auto iter = m_delayed.find(key);
+    if (iter != m_delayed.end())
+    {
+        return iter->second;
+    }
+
+    SharedOpPtr previous = getDelayed(op, stage-1, statements);
+    SharedOpPtr reg = IntermediateOperand::createNewIntermediate();
+    statements.push_back(new OpRegister(previous, reg));
+    m_ssa->addOperand(reg);
+
+    m_stages[reg.get()] = stage;
+    m_delayed[key] = reg;
+    m_registers++;
+    m_registerBits += reg->m_intBits + reg->m_fracBits;
+    return reg;
+}
+
+uint32_t PassPipeline::calcLatency(const Program &ssa)
+{
+    std::map<const OperandBase*, uint32_t> latencies;
+    uint32_t latency = 0;
+    for(auto statement : ssa.m_statements)
+    {
+        SharedOpPtr lhs = statement->getLHS();
+        if (!lhs)
+        {
+            continue;
+        }
+
+        uint32_t cycles = 0;
+        OpMulAdd *mulAdd = dynamic_cast<OpMulAdd*>(statement);
+        if (mulAdd != NULL)
+        {
+            // b and c of a DSP slice are needed later than
+            // a and d when the slice has internal registers.
+            std::vector<std::pair<SharedOpPtr, uint32_t> > inputs;
+            inputs.push_back(std::make_pair(mulAdd->m_a, 0));
+            inputs.push_back(std::make_pair(mulAdd->m_d, 0));
+            inputs.push_back(std::make_pair(mulAdd->m_b, mulAdd->getBDelay()));
+            inputs.push_back(std::make_pair(mulAdd->m_c, mulAdd->getCDelay()));
+            for(auto const &input : inputs)
+            {
+                auto iter = latencies.find(input.first.get());
+                if ((iter != latencies.end()) && (iter->second > input.second))
+                {
+                    cycles = std::max(cycles, iter->second - input.second);
+                }
+            }
+            cycles += mulAdd->m_stages;
+        }
+        else
+        {
+            for(auto const &input : statement->getInputs())
+            {
+                auto iter = latencies.find(input.get());
+                if (iter != latencies.end())
+                {
+                    cycles = std::max(cycles, iter->second);
+                }
+            }
+        }
+
+        if (dynamic_cast<OpRegister*>(statement) != NULL)
+        {
+            cycles++;
+        }
+
+        latencies[lhs.get()] = cycles;
+        if (dynamic_cast<OutputOperand*>(lhs.get()) != NULL)
+        {
+            latency = std::max(latency, cycles);
+        }
+    }
+    return latency;
+}
@@ -0,0 +1,533 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Backward required-precision SSA pass
+
+*/
+
+#include <cmath>
+#include <algorithm>
+#include "logging.h"
+#include "pass_precision.h"
+
+#define PRECISION_MAXGUARDBITS 32
+
+using namespace SSA;
+
+bool PassPrecision::execute(Program &ssa, double errorBound)
+{
+    doLog(LOG_INFO, "--------------------------\n");
+    doLog(LOG_INFO, "  Running Precision pass\n");
+    doLog(LOG_INFO, "--------------------------\n");
+
+    // an output is kept exact when no number of guard bits
+    // gives an error within the bound, other than zero.
+    // this happens when a single LSB exceeds the bound.
+    int32_t guardBits = -1;
+    std::set<const OperandBase*> exactOutputs;
+    if (errorBound > 0.0)
+    {
+        std::set<const OperandBase*> outputs;
+        for(auto operand : ssa.m_operands)
+        {
+            if (dynamic_cast<const OutputOperand*>(operand.get()) != NULL)
+            {
+                outputs.insert(operand.get());
+            }
+        }
+
+        for(auto output : outputs)
+        {
+            std::set<const OperandBase*> others = outputs;
+            others.erase(output);
+
+            bool feasible = false;
+            for(int32_t guard=0; (guard<=PRECISION_MAXGUARDBITS) && !feasible; guard++)
+            {
+                PassPrecision pass(ssa, guard, others);
+                if (!pass.collect())
+                {
+                    return false;
+                }
+                double error = pass.calcErrors()[output];
+                feasible = (error > 0.0) && (error <= errorBound);
+            }
+
+            if (!feasible)
+            {
+                doLog(LOG_INFO, "Output %s is kept exact\n", output->m_identName.c_str());
+                exactOutputs.insert(output);
+            }
+        }
+
+        // find the fewest guard bits that keep the outputs
+        // within the error bound.
+        for(int32_t guard=0; guard<=PRECISION_MAXGUARDBITS; guard++)
+        {
+            PassPrecision pass(ssa, guard, exactOutputs);
+            if (!pass.collect())
+            {
+                return false;
+            }
+
+            double maxError = 0.0;
+            for(auto output : pass.calcErrors())
+            {
+                maxError = std::max(maxError, output.second);
+            }
+
+            doLog(LOG_DEBUG, "  %d guard bits: error %g\n", guard, maxError);
+            if (maxError <= errorBound)
+            {
+                doLog(LOG_INFO, "Using %d guard bits for error bound %g\n", guard, errorBound);
+                guardBits = guard;
+                break;
+            }
+        }
+    }
+
+    PassPrecision pass(ssa, guardBits, exactOutputs);
+    if (!pass.collect())
+    {
+        return false;
+    }
+
+    int32_t removed = pass.apply();
+    doLog(LOG_INFO, "Removed %d LSBs\n", removed);
+
+    // apply() recalculates the precisions in program
+    // order, so only the LSB removals and the
+    // instructions that use them are updated again.
+    std::vector<const OperationBase*> modified;
+    ssa.applyPatches(modified);
+    ssa.updateOutputPrecisions(modified);
+    return true;
+}
+
+bool PassPrecision::collect()
+{
+    // in SSA form the users of a result come after its
+    // definition, so a single backward sweep is enough.
+    for(auto iter = m_ssa->m_statements.rbegin(); iter != m_ssa->m_statements.rend(); iter++)
+    {
+        if (!(*iter)->accept(this))
+        {
+            doLog(LOG_ERROR, "Precision pass: unsupported instruction\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+std::map<const OperandBase*, double> PassPrecision::calcErrors() const
+{
+    // forward sweep: the error of a result is bounded by the
+    // errors of its inputs, including the removed LSBs,
+    // multiplied by the gain of the instruction.
+    std::map<const OperandBase*, double> errors;
+    std::map<const OperandBase*, double> outputErrors;
+    for(auto statement : m_ssa->m_statements)
+    {
+        auto nodeIter = m_nodes.find(statement);
+        if (nodeIter == m_nodes.end())
+        {
+            continue;
+        }
+
+        const nodeinfo_t &info = nodeIter->second;
+        double error = 0.0;
+        for(size_t i=0; i<info.inputs.size(); i++)
+        {
+            const SharedOpPtr &input = info.inputs[i];
+            auto errorIter = errors.find(input.get());
+            double inputError = (errorIter != errors.end()) ? errorIter->second : 0.0;
+
+            // removing LSBs below the exact precision
+            // introduces an error.
+            int32_t exactBits = info.exactFracBits[i];
+            if (info.rounds)
+            {
+                exactBits = std::min(exactBits, info.roundFracBits);
+            }
+
+            if (info.fracBits[i] < exactBits)
+            {
+                inputError += ldexp(1.0, -info.fracBits[i]) - ldexp(1.0, -exactBits);
+            }
+            error += info.gains[i] * inputError;
+        }
+
+        // an error at the input of a floor operation
+        // results in at most the same number of LSBs
+        // of the result, rounded up.
+        if (info.rounds && (error > 0.0))
+        {
+            error = ldexp(ceil(ldexp(error, info.roundFracBits)), -info.roundFracBits);
+        }
+
+        const SharedOpPtr &lhs = info.lhs;
+        errors[lhs.get()] = error;
+        if (dynamic_cast<const OutputOperand*>(lhs.get()) != NULL)
+        {
+            outputErrors[lhs.get()] = error;
+        }
+    }
+    return outputErrors;
+}
+
+int32_t PassPrecision::apply()
+{
+    int32_t removed = 0;
+    for(auto &statement : m_ssa->m_statements)
+    {
+        // the inputs may have lost LSBs already
+        statement->updateOutputPrecision();
+
+        auto nodeIter = m_nodes.find(statement);
+        if (nodeIter == m_nodes.end())
+        {
+            continue;
+        }
+
+        const nodeinfo_t &info = nodeIter->second;
+        OpPatchBlock *patch = new OpPatchBlock(statement);
+        OperationBase *replacement = statement->clone();
+        for(size_t i=0; i<info.inputs.size(); i++)
+        {
+            // an input keeps at least one bit, which
+            // only makes it more precise.
+            const SharedOpPtr &input = info.inputs[i];
+            int32_t fracBits = std::max(info.fracBits[i], 1 - input->m_intBits);
+            if ((fracBits >= input->m_fracBits) ||
+                (info.rounds && (fracBits >= info.roundFracBits)))
+            {
+                continue;
+            }
+
+            doLog(LOG_DEBUG, "Removing %d LSBs of %s\n",
+                  input->m_fracBits - fracBits, input->m_identName.c_str());
+
+            SharedOpPtr tmp = IntermediateOperand::createNewIntermediate();
+            patch->addStatement(new OpRemoveLSBs(input, tmp, input->m_fracBits - fracBits));
+            m_ssa->addOperand(tmp);
+            replacement->replaceOperand(input, tmp);
+            removed += input->m_fracBits - fracBits;
+        }
+
+        if (patch->m_statements.size() == 0)
+        {
+            delete replacement;
+            delete patch;
+            continue;
+        }
+
+        replacement->updateOutputPrecision();
+        patch->addStatement(replacement);
+        statement = patch;
+    }
+    return removed;
+}
+
+bool PassPrecision::getRequired(const SharedOpPtr &lhs, required_t &req) const
+{
+    auto iter = m_required.find(lhs.get());
+    if (iter != m_required.end())
+    {
+        req = iter->second;
+    }
+    else if (dynamic_cast<const OutputOperand*>(lhs.get()) != NULL)
+    {
+        req.fracBits = lhs->m_fracBits;
+        req.exact    = (m_exactOutputs.find(lhs.get()) != m_exactOutputs.end());
+    }
+    else
+    {
+        return false;
+    }
+
+    // an output needs all its bits, even when
+    // it is used by other instructions too.
+    if (dynamic_cast<const OutputOperand*>(lhs.get()) != NULL)
+    {
+        req.fracBits = lhs->m_fracBits;
+    }
+    return true;
+}
+
+void PassPrecision::require(const OperationBase *node, const SharedOpPtr &lhs,
+                            const required_t &req, nodeinfo_t &info)
+{
+    info.lhs = lhs;
+    info.exactFracBits = info.fracBits;
+    for(size_t i=0; i<info.inputs.size(); i++)
+    {
+        const OperandBase *input = info.inputs[i].get();
+        info.exactFracBits[i] = std::min(info.exactFracBits[i], input->m_fracBits);
+        info.fracBits[i] = info.exactFracBits[i];
+
+        // keep a number of guard bits below the
+        // required precision when errors are allowed.
+        if (info.approximate && (m_guardBits >= 0) && !req.exact)
+        {
+            info.fracBits[i] = std::min(info.fracBits[i],
+                req.fracBits + m_guardBits + info.extraGuardBits);
+        }
+
+        auto iter = m_required.find(input);
+        if (iter == m_required.end())
+        {
+            required_t inputReq;
+            inputReq.fracBits = info.fracBits[i];
+            inputReq.exact    = req.exact;
+            m_required[input] = inputReq;
+        }
+        else
+        {
+            iter->second.fracBits = std::max(iter->second.fracBits, info.fracBits[i]);
+            iter->second.exact    = iter->second.exact || req.exact;
+        }
+    }
+    m_nodes[node] = info;
+}
+
+bool PassPrecision::visit(const OpAssign *node)
+{
+    required_t req;
+    if (getRequired(node->m_lhs, req))
+    {
+        nodeinfo_t info;
+        info.inputs   = {node->m_op};
+        info.fracBits = {req.fracBits};
+        info.gains    = {1.0};
+        require(node, node->m_lhs, req, info);
+    }
+    return true;
+}
+
+bool PassPrecision::visit(const OpMul *node)
+{
+    // errors are multiplied by the other input,
+    // so all upstream results must be exact.
+    required_t req;
+    if (getRequired(node->m_lhs, req))
+    {
+        nodeinfo_t info;
+        info.inputs   = {node->m_op1, node->m_op2};
+        info.fracBits = {node->m_op1->m_fracBits, node->m_op2->m_fracBits};
+        info.gains    = {ldexp(1.0, node->m_op2->m_intBits-1), ldexp(1.0, node->m_op1->m_intBits-1)};
+        req.exact = true;
+        require(node, node->m_lhs, req, info);
+    }
+    return true;
+}
+
+bool PassPrecision::visit(const OpCSDMul *node)
+{
+    required_t req;
+    if (getRequired(node->m_lhs, req))
+    {
+        // a single digit 2^k is a shift of the input.
+        // -2^k is not, as floor(-x) != -floor(x).
+        const csd_t &csd = node->m_csd;
+        int32_t fracBits = node->m_op->m_fracBits;
+        if ((csd.digits.size() == 1) && (csd.value > 0.0))
+        {
+            fracBits = req.fracBits + csd.digits.front().power;
+        }
+
+        // the magnitude of the constant is less
+        // than 2^(Pmax+1).
+        int32_t Pmax = csd.digits.front().power;
+
+        nodeinfo_t info;
+        info.inputs   = {node->m_op};
+        info.fracBits = {fracBits};
+        info.approximate = true;
+        info.extraGuardBits = Pmax+1;
+        info.gains    = {fabs(csd.value)};
+        require(node, node->m_lhs, req, info);
+    }
+    return true;
+}
+
+bool PassPrecision::visit(const OpAdd *node)
+{
+    required_t req;
+    if (getRequired(node->m_lhs, req))
+    {
+        // floor(a + b) = a + floor(b) if a has no LSBs
+        // below the floor.
+        int32_t fracBits1 = node->m_op1->m_fracBits;
+        int32_t fracBits2 = node->m_op2->m_fracBits;
+        if (fracBits1 <= req.fracBits)
+        {
+            fracBits2 = req.fracBits;
+        }
+        else if (fracBits2 <= req.fracBits)
+        {
+            fracBits1 = req.fracBits;
+        }
+
+        nodeinfo_t info;
+        info.inputs   = {node->m_op1, node->m_op2};
+        info.fracBits = {fracBits1, fracBits2};
+        info.approximate = true;
+        info.gains    = {1.0, 1.0};
+        require(node, node->m_lhs, req, info);
+    }
+    return true;
+}
+
+bool PassPrecision::visit(const OpSub *node)
+{
+    required_t req;
+    if (getRequired(node->m_lhs, req))
+    {
+        // floor(a - b) = floor(a) - b if b has no LSBs
+        // below the floor. floor(-b) != -floor(b), so
+        // the LSBs of b cannot be removed.
+        int32_t fracBits1 = node->m_op1->m_fracBits;
+        int32_t fracBits2 = node->m_op2->m_fracBits;
+        if (fracBits2 <= req.fracBits)
+        {
+            fracBits1 = req.fracBits;
+        }
+
+        nodeinfo_t info;
+        info.inputs   = {node->m_op1, node->m_op2};
+        info.fracBits = {fracBits1, fracBits2};
+        info.approximate = true;
+        info.gains    = {1.0, 1.0};
+        require(node, node->m_lhs, req, info);
+    }
+    return true;
+}
+
+bool PassPrecision::visit(const OpTruncate *node)
+{
+    required_t req;
+    if (getRequired(node->m_lhs, req))
+    {
+        // an error may cause a different wrap-around
+        // when MSBs are removed.
+        bool exact = req.exact || (node->m_intBits < node->m_op->m_intBits);
+
+        nodeinfo_t info;
+        info.inputs   = {node->m_op};
+        info.fracBits = {std::min(req.fracBits, node->m_fracBits)};
+        info.gains    = {1.0};
+        info.rounds   = true;
+        info.roundFracBits = node->m_fracBits;
+        req.exact = exact;
+        require(node, node->m_lhs, req, info);
+    }
+    return true;
+}
+
+bool PassPrecision::visit(const OpNegate *node)
+{
+    required_t req;
+    if (getRequired(node->m_lhs, req))
+    {
+        // floor(-x) != -floor(x)
+        nodeinfo_t info;
+        info.inputs   = {node->m_op};
+        info.fracBits = {node->m_op->m_fracBits};
+        info.approximate = true;
+        info.gains    = {1.0};
+        require(node, node->m_lhs, req, info);
+    }
+    return true;
+}
+
+bool PassPrecision::visit(const OpReinterpret *node)
+{
+    // the input must keep its width
+    required_t req;
+    if (getRequired(node->m_lhs, req))
+    {
+        nodeinfo_t info;
+        info.inputs   = {node->m_op};
+        info.fracBits = {node->m_op->m_fracBits};
+        info.gains    = {ldexp(1.0, node->m_op->m_fracBits - node->m_fracBits)};
+        req.exact = true;
+        require(node, node->m_lhs, req, info);
+    }
+    return true;
+}
+
+bool PassPrecision::visit(const OpExtendLSBs *node)
+{
+    required_t req;
+    if (getRequired(node->m_lhs, req))
+    {
+        nodeinfo_t info;
+        info.inputs   = {node->m_op};
+        info.fracBits = {req.fracBits};
+        info.gains    = {1.0};
+        require(node, node->m_lhs, req, info);
+    }
+    return true;
+}
+
+bool PassPrecision::visit(const OpExtendMSBs *node)
+{
+    required_t req;
+    if (getRequired(node->m_lhs, req))
+    {
+        nodeinfo_t info;
+        info.inputs   = {node->m_op};
+        info.fracBits = {req.fracBits};
+        info.gains    = {1.0};
+        require(node, node->m_lhs, req, info);
+    }
+    return true;
+}
+
+bool PassPrecision::visit(const OpRemoveLSBs *node)
+{
+    // the number of removed bits is relative to
+    // the input, so the input must keep its LSBs.
+    required_t req;
+    if (getRequired(node->m_lhs, req))
+    {
+        nodeinfo_t info;
+        info.inputs   = {node->m_op};
+        info.fracBits = {node->m_op->m_fracBits};
+        info.gains    = {1.0};
+        info.rounds   = true;
+        info.roundFracBits = node->m_lhs->m_fracBits;
+        require(node, node->m_lhs, req, info);
+    }
+    return true;
+}
+
+bool PassPrecision::visit(const OpRemoveMSBs *node)
+{
+    required_t req;
+    if (getRequired(node->m_lhs, req))
+    {
+        nodeinfo_t info;
+        info.inputs   = {node->m_op};
+        info.fracBits = {req.fracBits};
+        info.gains    = {1.0};
+        req.exact = true;
+        require(node, node->m_lhs, req, info);
+    }
+    return true;
+}
+
+bool PassPrecision::visit(const OpRegister *node)
+{
+    required_t req;
+    if (getRequired(node->m_lhs, req))
+    {
+        nodeinfo_t info;
+        info.inputs   = {node->m_op};
+        info.fracBits = {req.fracBits};
+        info.gains    = {1.0};
+        require(node, node->m_lhs, req, info);
+    }
+    return true;
+}
@@ -0,0 +1,291 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Interval (value range) analysis SSA pass
+
+*/
+
+#include <cmath>
+#include <algorithm>
+#include "logging.h"
+#include "pass_range.h"
+
+using namespace SSA;
+
+bool PassRange::execute(Program &ssa)
+{
+    doLog(LOG_INFO, "----------------------\n");
+    doLog(LOG_INFO, "  Running Range pass\n");
+    doLog(LOG_INFO, "----------------------\n");
+
+    PassRange pass(ssa);
+    for(auto statement : ssa.m_statements)
+    {
+        SharedOpPtr lhs = statement->getLHS();
+        if (lhs)
+        {
+            pass.m_intBits[lhs.get()] = lhs->m_intBits;
+        }
+    }
+
+    // the statements are in dependency order, so the
+    // ranges of all inputs are known when a statement
+    // is visited. the precision of each result is
+    // recalculated first, as the inputs may have been
+    // narrowed.
+    for(auto iter = ssa.m_statements.begin(); iter != ssa.m_statements.end(); iter++)
+    {
+        OperationBase *statement = *iter;
+        pass.keepInputFormat(iter);
+        statement->updateOutputPrecision();
+        if (!statement->accept(&pass))
+        {
+            doLog(LOG_ERROR, "Range pass: unsupported instruction\n");
+            return false;
+        }
+    }
+
+    doLog(LOG_INFO, "Narrowed %d additions/subtractions\n", pass.m_narrowed);
+
+    // the loop has recalculated the precisions in
+    // program order, so only the narrowed instructions
+    // and the instructions that use them are updated.
+    std::vector<const OperationBase*> modified;
+    ssa.applyPatches(modified);
+    ssa.updateOutputPrecisions(modified);
+    return true;
+}
+
+void PassRange::keepInputFormat(std::list<OperationBase*>::iterator position)
+{
+    OperationSingle *node = dynamic_cast<OperationSingle*>(*position);
+    if ((dynamic_cast<OpReinterpret*>(node) == NULL) &&
+        (dynamic_cast<OpRemoveMSBs*>(node) == NULL) &&
+        (dynamic_cast<OpRemoveLSBs*>(node) == NULL))
+    {
+        return;
+    }
+
+    // the pass only narrows, so the input has at
+    // most the integer bits it had before.
+    SharedOpPtr op = node->m_op;
+    auto iter = m_intBits.find(op.get());
+    if ((iter == m_intBits.end()) || (op->m_intBits >= iter->second))
+    {
+        return;
+    }
+
+    SharedOpPtr extended = IntermediateOperand::createNewIntermediate();
+    m_ssa->addOperand(extended);
+    m_ssa->m_statements.insert(position, new OpExtendMSBs(op, extended, iter->second - op->m_intBits));
+    node->replaceOperand(op, extended);
+
+    range_t r = getRange(op);
+    setRange(extended, r.minValue, r.maxValue);
+}
+
+PassRange::range_t PassRange::getRange(const SharedOpPtr &op) const
+{
+    auto iter = m_ranges.find(op.get());
+    if (iter != m_ranges.end())
+    {
+        return iter->second;
+    }
+
+    range_t range;
+    range.minValue = -ldexp(1.0, op->m_intBits-1);
+    range.maxValue = ldexp(1.0, op->m_intBits-1) - ldexp(1.0, -op->m_fracBits);
+    return range;
+}
+
+void PassRange::setRange(const SharedOpPtr &op, double minValue, double maxValue)
+{
+    if (calcIntBits(minValue, maxValue, op->m_fracBits) > op->m_intBits)
+    {
+        // the result wraps around
+        m_ranges.erase(op.get());
+        return;
+    }
+
+    range_t range;
+    range.minValue = minValue;
+    range.maxValue = maxValue;
+    m_ranges[op.get()] = range;
+}
+
+PassRange::range_t PassRange::floorRange(const range_t &range, int32_t fracBits)
+{
+    range_t result;
+    result.minValue = ldexp(floor(ldexp(range.minValue, fracBits)), -fracBits);
+    result.maxValue = ldexp(floor(ldexp(range.maxValue, fracBits)), -fracBits);
+    return result;
+}
+
+bool PassRange::narrowAddSub(const OperationDual *node, bool noExtension,
+                             double minValue, double maxValue, bool isAdd)
+{
+    int32_t naturalBits = std::max(node->m_op1->m_intBits, node->m_op2->m_intBits);
+    int32_t neededBits  = calcIntBits(minValue, maxValue, node->m_lhs->m_fracBits);
+
+    if ((neededBits > naturalBits) || ((neededBits == naturalBits) && noExtension))
+    {
+        return true;
+    }
+
+    doLog(LOG_DEBUG, "Narrowing %s to %d integer bits\n",
+          node->m_lhs->m_identName.c_str(), neededBits);
+
+    OpPatchBlock *patch = new OpPatchBlock(node);
+
+    // the result fits in neededBits, so only the lower
+    // neededBits integer bits of the inputs contribute.
+    SharedOpPtr ops[2] = {node->m_op1, node->m_op2};
+    for(auto &op : ops)
+    {
+        // keep at least one bit
+        int32_t bits = std::max(neededBits, 1 - op->m_fracBits);
+        if (op->m_intBits > bits)
+        {
+            SharedOpPtr tmp = IntermediateOperand::createNewIntermediate();
+            patch->addStatement(new OpRemoveMSBs(op, tmp, op->m_intBits - bits));
+            m_ssa->addOperand(tmp);
+            op = tmp;
+        }
+    }
+
+    if (isAdd)
+    {
+        patch->addStatement(new OpAdd(ops[0], ops[1], node->m_lhs, true));
+    }
+    else
+    {
+        patch->addStatement(new OpSub(ops[0], ops[1], node->m_lhs, true));
+    }
+
+    auto iter = std::find(m_ssa->m_statements.begin(), m_ssa->m_statements.end(), node);
+    if (iter == m_ssa->m_statements.end())
+    {
+        doLog(LOG_ERROR, "Range pass: cannot find instruction\n");
+        return false;
+    }
+    *iter = patch;
+
+    m_narrowed++;
+    return true;
+}
+
+bool PassRange::visit(const OpAssign *node)
+{
+    range_t r = getRange(node->m_op);
+    setRange(node->m_lhs, r.minValue, r.maxValue);
+    return true;
+}
+
+bool PassRange::visit(const OpMul *node)
+{
+    range_t r1 = getRange(node->m_op1);
+    range_t r2 = getRange(node->m_op2);
+    double p[4] = {r1.minValue * r2.minValue, r1.minValue * r2.maxValue,
+                   r1.maxValue * r2.minValue, r1.maxValue * r2.maxValue};
+
+    setRange(node->m_lhs, *std::min_element(p, p+4), *std::max_element(p, p+4));
+    return true;
+}
+
+bool PassRange::visit(const OpCSDMul *node)
+{
+    range_t r = getRange(node->m_op);
+    double p1 = node->m_csd.value * r.minValue;
+    double p2 = node->m_csd.value * r.maxValue;
+    setRange(node->m_lhs, std::min(p1,p2), std::max(p1,p2));
+    return true;
+}
+
+bool PassRange::visit(const OpAdd *node)
+{
+    range_t r1 = getRange(node->m_op1);
+    range_t r2 = getRange(node->m_op2);
+    double minValue = r1.minValue + r2.minValue;
+    double maxValue = r1.maxValue + r2.maxValue;
+
+    if (!narrowAddSub(node, node->m_noExtension, minValue, maxValue, true))
+    {
+        return false;
+    }
+    setRange(node->m_lhs, minValue, maxValue);
+    return true;
+}
+
+bool PassRange::visit(const OpSub *node)
+{
+    range_t r1 = getRange(node->m_op1);
+    range_t r2 = getRange(node->m_op2);
+    double minValue = r1.minValue - r2.maxValue;
+    double maxValue = r1.maxValue - r2.minValue;
+
+    if (!narrowAddSub(node, node->m_noExtension, minValue, maxValue, false))
+    {
+        return false;
+    }
+    setRange(node->m_lhs, minValue, maxValue);
+    return true;
+}
+
+bool PassRange::visit(const OpTruncate *node)
+{
+    range_t r = floorRange(getRange(node->m_op), node->m_fracBits);
+    setRange(node->m_lhs, r.minValue, r.maxValue);
+    return true;
+}
+
+bool PassRange::visit(const OpNegate *node)
+{
+    range_t r = getRange(node->m_op);
+    setRange(node->m_lhs, -r.maxValue, -r.minValue);
+    return true;
+}
+
+bool PassRange::visit(const OpReinterpret *node)
+{
+    // the bits stay the same, only the binary point moves
+    range_t r = getRange(node->m_op);
+    int32_t shift = node->m_op->m_fracBits - node->m_fracBits;
+    setRange(node->m_lhs, ldexp(r.minValue, shift), ldexp(r.maxValue, shift));
+    return true;
+}
+
+bool PassRange::visit(const OpExtendLSBs *node)
+{
+    range_t r = getRange(node->m_op);
+    setRange(node->m_lhs, r.minValue, r.maxValue);
+    return true;
+}
+
+bool PassRange::visit(const OpExtendMSBs *node)
+{
+    range_t r = getRange(node->m_op);
+    setRange(node->m_lhs, r.minValue, r.maxValue);
+    return true;
+}
+
+bool PassRange::visit(const OpRemoveLSBs *node)
+{
+    range_t r = floorRange(getRange(node->m_op), node->m_lhs->m_fracBits);
+    setRange(node->m_lhs, r.minValue, r.maxValue);
+    return true;
+}
+
+bool PassRange::visit(const OpRemoveMSBs *node)
+{
+    range_t r = getRange(node->m_op);
+    setRange(node->m_lhs, r.minValue, r.maxValue);
+    return true;
+}
+
+bool PassRange::visit(const OpRegister *node)
+{
+    range_t r = getRange(node->m_op);
+    setRange(node->m_lhs, r.minValue, r.maxValue);
+    return true;
+}
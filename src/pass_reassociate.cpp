@@ -0,0 +1,246 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Reassociation SSA pass
+
+*/
+
+#include <algorithm>
+#include "logging.h"
+#include "delaymodel.h"
+#include "pass_reassociate.h"
+
+using namespace SSA;
+
+bool PassReassociate::execute(Program &ssa)
+{
+    doLog(LOG_INFO, "-----------------------------\n");
+    doLog(LOG_INFO, "  Running Reassociate pass\n");
+    doLog(LOG_INFO, "-----------------------------\n");
+
+    PassReassociate pass(ssa);
+
+    for(auto statement : ssa.m_statements)
+    {
+        if (statement->isPatchBlock())
+        {
+            doLog(LOG_ERROR, "Reassociate pass: unexpected patch block\n");
+            return false;
+        }
+
+        SharedOpPtr lhs = statement->getLHS();
+        if (lhs)
+        {
+            pass.m_definitions[lhs.get()] = statement;
+        }
+        for(auto const &input : statement->getInputs())
+        {
+            pass.m_uses[input.get()]++;
+        }
+    }
+
+    DelayModel depth(DelayModel::MODEL_DEPTH);
+    double before = depth.calcCriticalPath(ssa);
+
+    // the users of a result come after its definition, so
+    // visiting the statements backwards finds the root of
+    // each chain first.
+    std::map<OperationBase*, OperationBase*> replacements;
+    for(auto iter = ssa.m_statements.rbegin(); iter != ssa.m_statements.rend(); iter++)
+    {
+        if (replacements.find(*iter) != replacements.end())
+        {
+            continue;
+        }
+
+        OpAdd *add = dynamic_cast<OpAdd*>(*iter);
+        OpSub *sub = dynamic_cast<OpSub*>(*iter);
+        if (((add == NULL) || add->m_noExtension) && ((sub == NULL) || sub->m_noExtension))
+        {
+            continue;
+        }
+
+        OperationDual *node = static_cast<OperationDual*>(*iter);
+        std::vector<term_t> terms;
+        std::vector<OperationBase*> merged;
+        pass.collectTerms(node->m_lhs, false, node->m_lhs, terms, merged);
+        if (terms.size() < 3)
+        {
+            continue;
+        }
+
+        OpPatchBlock *patch = pass.buildTree(node, terms);
+        if (patch == NULL)
+        {
+            continue;
+        }
+
+        doLog(LOG_DEBUG, "Rebuilding %s with %d terms\n",
+              node->m_lhs->m_identName.c_str(), static_cast<int32_t>(terms.size()));
+
+        replacements[node] = patch;
+        for(auto statement : merged)
+        {
+            replacements[statement] = new OpNull();
+        }
+        pass.m_chains++;
+    }
+
+    for(auto &statement : ssa.m_statements)
+    {
+        auto iter = replacements.find(statement);
+        if (iter != replacements.end())
+        {
+            // patch blocks delete the instruction they replace
+            if (!iter->second->isPatchBlock())
+            {
+                delete statement;
+            }
+            statement = iter->second;
+        }
+    }
+
+    ssa.applyPatches();
+
+    doLog(LOG_INFO, "Rebuilt %d chains, adder depth %g before, %g after\n",
+          pass.m_chains, before, depth.calcCriticalPath(ssa));
+    return true;
+}
+
+void PassReassociate::collectTerms(const SharedOpPtr &op, bool negative, const SharedOpPtr &root,
+                                   std::vector<term_t> &terms, std::vector<OperationBase*> &merged)
+{
+    OperationBase *definition = NULL;
+    auto iter = m_definitions.find(op.get());
+    if (iter != m_definitions.end())
+    {
+        definition = iter->second;
+    }
+
+    OpAdd    *add    = dynamic_cast<OpAdd*>(definition);
+    OpSub    *sub    = dynamic_cast<OpSub*>(definition);
+    OpNegate *negate = dynamic_cast<OpNegate*>(definition);
+
+    // only instructions that cannot wrap around are merged
+    bool mergeable = ((add != NULL) && !add->m_noExtension) ||
+                     ((sub != NULL) && !sub->m_noExtension) ||
+                     ((negate != NULL) && (negate->m_lhs->m_intBits > negate->m_op->m_intBits));
+
+    // an intermediate result can only be merged when
+    // the chain is its only user.
+    if ((op != root) &&
+        ((m_uses[op.get()] != 1) || (dynamic_cast<OutputOperand*>(op.get()) != NULL)))
+    {
+        mergeable = false;
+    }
+
+    if (!mergeable)
+    {
+        term_t term;
+        term.op       = op;
+        term.negative = negative;
+        terms.push_back(term);
+        return;
+    }
+
+    if (op != root)
+    {
+        merged.push_back(definition);
+    }
+
+    if (negate != NULL)
+    {
+        collectTerms(negate->m_op, !negative, root, terms, merged);
+    }
+    else
+    {
+        OperationDual *dual = static_cast<OperationDual*>(definition);
+        collectTerms(dual->m_op1, negative, root, terms, merged);
+        collectTerms(dual->m_op2, (sub != NULL) ? !negative : negative, root, terms, merged);
+    }
+}
+
+OpPatchBlock* PassReassociate::buildTree(const OperationDual *node, std::vector<term_t> terms)
+{
+    // a tree of only negative terms would need a negation
+    // at the root, which can wrap around.
+    bool hasPositive = false;
+    for(auto const &term : terms)
+    {
+        if (!term.negative)
+        {
+            hasPositive = true;
+        }
+    }
+
+    if (!hasPositive)
+    {
+        return NULL;
+    }
+
+    OpPatchBlock *patch = new OpPatchBlock(node);
+
+    // combine the terms pairwise, one level of the tree
+    // at a time. sorting each level by the number of
+    // integer bits combines the smallest terms first, so
+    // the carries grow as little as possible.
+    while(terms.size() > 1)
+    {
+        std::stable_sort(terms.begin(), terms.end(), [](const term_t &a, const term_t &b)
+        {
+            return a.op->m_intBits < b.op->m_intBits;
+        });
+
+        std::vector<term_t> level;
+        for(size_t i=0; i+1<terms.size(); i+=2)
+        {
+            const term_t &t1 = terms[i];
+            const term_t &t2 = terms[i+1];
+
+            SharedOpPtr result = IntermediateOperand::createNewIntermediate();
+            m_ssa->addOperand(result);
+
+            // two negative terms give a negative sum
+            term_t sum;
+            sum.op       = result;
+            sum.negative = t1.negative && t2.negative;
+            if (t1.negative == t2.negative)
+            {
+                patch->addStatement(new OpAdd(t1.op, t2.op, result));
+            }
+            else if (t2.negative)
+            {
+                patch->addStatement(new OpSub(t1.op, t2.op, result));
+            }
+            else
+            {
+                patch->addStatement(new OpSub(t2.op, t1.op, result));
+            }
+            level.push_back(sum);
+        }
+
+        if ((terms.size() % 2) != 0)
+        {
+            level.push_back(terms.back());
+        }
+        terms = level;
+    }
+
+    // the result keeps its format, so the users and the
+    // reference evaluator see the same operand. the format
+    // is absolute because the Range pass can narrow the
+    // rebuilt tree after this pass.
+    const SharedOpPtr &result = terms[0].op;
+    const SharedOpPtr &lhs = node->m_lhs;
+    if ((result->m_intBits != lhs->m_intBits) || (result->m_fracBits != lhs->m_fracBits))
+    {
+        // the value is exact, so it fits the original format
+        patch->addStatement(new OpTruncate(result, lhs, lhs->m_intBits, lhs->m_fracBits));
+    }
+    else
+    {
+        patch->addStatement(new OpAssign(result, lhs));
+    }
+    return patch;
+}
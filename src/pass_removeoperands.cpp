@@ -141,6 +141,48 @@ bool PassRemoveOperands::visit(const OpRemoveMSBs *node)
     return true;
 }
 
+bool PassRemoveOperands::visit(const OpRegister *node)
+{
+    node->m_lhs->m_usedFlag = true;
+    node->m_op->m_usedFlag = true;
+    return true;
+}
+
+bool PassRemoveOperands::visit(const OpCSASum *node)
+{
+    node->m_lhs->m_usedFlag = true;
+    node->m_op1->m_usedFlag = true;
+    node->m_op2->m_usedFlag = true;
+    node->m_op3->m_usedFlag = true;
+    return true;
+}
+
+bool PassRemoveOperands::visit(const OpCSACarry *node)
+{
+    node->m_lhs->m_usedFlag = true;
+    node->m_op1->m_usedFlag = true;
+    node->m_op2->m_usedFlag = true;
+    node->m_op3->m_usedFlag = true;
+    return true;
+}
+
+bool PassRemoveOperands::visit(const OpMulAdd *node)
+{
+    // the intermediate results are declared by
+    // the code generator, so keep them too.
+    node->m_lhs->m_usedFlag = true;
+    node->m_prod->m_usedFlag = true;
+    for(auto const &op : node->getInputs())
+    {
+        op->m_usedFlag = true;
+    }
+    if (node->m_pre)
+    {
+        node->m_pre->m_usedFlag = true;
+    }
+    return true;
+}
+
 bool PassRemoveOperands::visit(const OpRemoveLSBs *node)
 {
     node->m_lhs->m_usedFlag = true;
@@ -0,0 +1,368 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Register retiming SSA pass
+
+*/
+
+#include <set>
+#include <algorithm>
+#include "logging.h"
+#include "pass_pipeline.h"
+#include "pass_retime.h"
+
+// the binary search stops when the interval is smaller than this
+#define RETIME_RESOLUTION 0.01
+
+using namespace SSA;
+
+bool PassRetime::execute(Program &ssa)
+{
+    doLog(LOG_INFO, "-----------------------\n");
+    doLog(LOG_INFO, "  Running Retime pass\n");
+    doLog(LOG_INFO, "-----------------------\n");
+
+    PassRetime pass(ssa);
+    if (!pass.buildGraph())
+    {
+        return false;
+    }
+
+    uint32_t registers = 0;
+    for(auto statement : ssa.m_statements)
+    {
+        if (dynamic_cast<OpRegister*>(statement) != NULL)
+        {
+            registers++;
+        }
+    }
+
+    double before = pass.m_delays.calcCriticalPath(ssa);
+    if (registers == 0)
+    {
+        doLog(LOG_INFO, "No registers to move\n");
+        doLog(LOG_INFO, "Critical path: %g ns\n", before);
+        return true;
+    }
+
+    // the period cannot be less than the slowest instruction
+    double lower = *std::max_element(pass.m_vertexDelays.begin(), pass.m_vertexDelays.end());
+
+    std::vector<int32_t> best(pass.m_vertices.size(), 0);
+    std::vector<double> arrival;
+    double bestPeriod = pass.calcArrival(best, arrival);
+    double upper = bestPeriod;
+
+    while((upper - lower) > RETIME_RESOLUTION)
+    {
+        double period = (lower + upper) / 2.0;
+        std::vector<int32_t> lags;
+        if (pass.findRetiming(period, lags))
+        {
+            upper = pass.calcArrival(lags, arrival);
+            if (upper < bestPeriod)
+            {
+                best = lags;
+                bestPeriod = upper;
+            }
+        }
+        else
+        {
+            lower = period;
+        }
+    }
+
+    uint32_t moved = 0;
+    for(auto lag : best)
+    {
+        moved += std::abs(lag);
+    }
+
+    if (moved == 0)
+    {
+        doLog(LOG_INFO, "Registers are already placed optimally\n");
+        doLog(LOG_INFO, "Critical path: %g ns\n", before);
+        return true;
+    }
+
+    uint32_t latency = PassPipeline::calcLatency(ssa);
+    pass.rebuild(best);
+
+    if (PassPipeline::calcLatency(ssa) != latency)
+    {
+        doLog(LOG_ERROR, "Retime pass: latency changed\n");
+        return false;
+    }
+
+    uint32_t newRegisters = 0;
+    for(auto statement : ssa.m_statements)
+    {
+        if (dynamic_cast<OpRegister*>(statement) != NULL)
+        {
+            newRegisters++;
+        }
+    }
+
+    doLog(LOG_INFO, "Retimed %d instructions, %d registers before, %d after\n",
+          moved, registers, newRegisters);
+    doLog(LOG_INFO, "Critical path: %g ns before, %g ns after\n",
+          before, pass.m_delays.calcCriticalPath(ssa));
+    return true;
+}
+
+bool PassRetime::buildGraph()
+{
+    // the operand at the end of a chain of registers
+    struct source_t
+    {
+        uint32_t    vertex;
+        int32_t     registers;
+        SharedOpPtr operand;
+    };
+
+    std::map<const OperandBase*, source_t> sources;
+
+    m_vertices.push_back(NULL);
+    m_vertexDelays.push_back(0.0);
+    m_inputEdges.push_back(std::vector<uint32_t>());
+
+    std::vector<uint32_t> outputVertices;
+    for(auto statement : m_ssa->m_statements)
+    {
+        if (dynamic_cast<OpPatchBlock*>(statement) != NULL)
+        {
+            doLog(LOG_ERROR, "Retime pass: unexpected patch block\n");
+            return false;
+        }
+
+        SharedOpPtr lhs = statement->getLHS();
+        if (!lhs)
+        {
+            continue;
+        }
+
+        OpRegister *reg = dynamic_cast<OpRegister*>(statement);
+        if (reg != NULL)
+        {
+            source_t source;
+            auto iter = sources.find(reg->m_op.get());
+            if (iter != sources.end())
+            {
+                source = iter->second;
+            }
+            else
+            {
+                source.vertex    = 0;
+                source.registers = 0;
+                source.operand   = reg->m_op;
+            }
+            source.registers++;
+            sources[lhs.get()] = source;
+            continue;
+        }
+
+        uint32_t vertex = m_vertices.size();
+        m_vertices.push_back(statement);
+        m_vertexDelays.push_back(m_delays.getDelay(statement));
+        m_inputEdges.push_back(std::vector<uint32_t>());
+
+        for(auto const &input : statement->getInputs())
+        {
+            edge_t edge;
+            edge.to = vertex;
+            auto iter = sources.find(input.get());
+            if (iter != sources.end())
+            {
+                edge.from    = iter->second.vertex;
+                edge.weight  = iter->second.registers;
+                edge.operand = iter->second.operand;
+            }
+            else
+            {
+                // an input or a constant
+                edge.from    = 0;
+                edge.weight  = 0;
+                edge.operand = input;
+            }
+            m_inputEdges[vertex].push_back(m_edges.size());
+            m_edges.push_back(edge);
+        }
+
+        source_t source;
+        source.vertex    = vertex;
+        source.registers = 0;
+        source.operand   = lhs;
+        sources[lhs.get()] = source;
+
+        if (dynamic_cast<OutputOperand*>(lhs.get()) != NULL)
+        {
+            outputVertices.push_back(vertex);
+        }
+    }
+
+    // the outputs are connected to the sink
+    uint32_t sink = m_vertices.size();
+    m_vertices.push_back(NULL);
+    m_vertexDelays.push_back(0.0);
+    m_inputEdges.push_back(std::vector<uint32_t>());
+    for(auto vertex : outputVertices)
+    {
+        edge_t edge;
+        edge.from   = vertex;
+        edge.to     = sink;
+        edge.weight = 0;
+        m_inputEdges[sink].push_back(m_edges.size());
+        m_edges.push_back(edge);
+    }
+    return true;
+}
+
+double PassRetime::calcArrival(const std::vector<int32_t> &lags, std::vector<double> &arrival) const
+{
+    // every edge goes from an earlier to a later vertex,
+    // so a single sweep handles the combinational paths.
+    arrival.assign(m_vertices.size(), 0.0);
+    double period = 0.0;
+    for(size_t v=0; v<m_vertices.size(); v++)
+    {
+        double t = 0.0;
+        for(auto e : m_inputEdges[v])
+        {
+            const edge_t &edge = m_edges[e];
+            if ((edge.weight + lags[edge.to] - lags[edge.from]) <= 0)
+            {
+                t = std::max(t, arrival[edge.from]);
+            }
+        }
+        arrival[v] = t + m_vertexDelays[v];
+        period = std::max(period, arrival[v]);
+    }
+    return period;
+}
+
+bool PassRetime::isLegal(const std::vector<int32_t> &lags) const
+{
+    for(auto const &edge : m_edges)
+    {
+        if ((edge.weight + lags[edge.to] - lags[edge.from]) < 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool PassRetime::findRetiming(double period, std::vector<int32_t> &lags) const
+{
+    // FEAS: delay every instruction whose arrival time exceeds
+    // the period by one register, at most |V|-1 times. the
+    // source and sink keep a lag of zero.
+    lags.assign(m_vertices.size(), 0);
+    std::vector<double> arrival;
+    for(size_t i=1; i<m_vertices.size(); i++)
+    {
+        calcArrival(lags, arrival);
+
+        bool changed = false;
+        for(size_t v=1; v+1<m_vertices.size(); v++)
+        {
+            if (arrival[v] > period)
+            {
+                lags[v]++;
+                changed = true;
+            }
+        }
+
+        if (!changed)
+        {
+            break;
+        }
+    }
+
+    return isLegal(lags) && (calcArrival(lags, arrival) <= period);
+}
+
+void PassRetime::rebuild(const std::vector<int32_t> &lags)
+{
+    std::set<const OperandBase*> oldRegisters;
+    for(auto statement : m_ssa->m_statements)
+    {
+        if (dynamic_cast<OpRegister*>(statement) != NULL)
+        {
+            oldRegisters.insert(statement->getLHS().get());
+        }
+    }
+
+    std::list<OperationBase*> statements;
+    for(size_t v=1; v+1<m_vertices.size(); v++)
+    {
+        OperationBase *copy = m_vertices[v]->clone();
+
+        std::vector<SharedOpPtr> inputs;
+        for(auto e : m_inputEdges[v])
+        {
+            const edge_t &edge = m_edges[e];
+            int32_t registers = edge.weight + lags[edge.to] - lags[edge.from];
+            inputs.push_back(getDelayed(edge.operand, registers, statements));
+        }
+
+        // set the inputs by position, as two inputs can
+        // be the same operand with different delays.
+        OperationSingle     *single     = dynamic_cast<OperationSingle*>(copy);
+        OperationDual       *dual       = dynamic_cast<OperationDual*>(copy);
+        OperationCompressor *compressor = dynamic_cast<OperationCompressor*>(copy);
+        if (single != NULL)
+        {
+            single->m_op = inputs[0];
+        }
+        else if (dual != NULL)
+        {
+            dual->m_op1 = inputs[0];
+            dual->m_op2 = inputs[1];
+        }
+        else if (compressor != NULL)
+        {
+            compressor->m_op1 = inputs[0];
+            compressor->m_op2 = inputs[1];
+            compressor->m_op3 = inputs[2];
+        }
+        statements.push_back(copy);
+    }
+
+    for(auto statement : m_ssa->m_statements)
+    {
+        delete statement;
+    }
+    m_ssa->m_statements = statements;
+
+    m_ssa->m_operands.remove_if([&oldRegisters](const SharedOpPtr &op)
+    {
+        return oldRegisters.count(op.get()) != 0;
+    });
+}
+
+SharedOpPtr PassRetime::getDelayed(const SharedOpPtr &op, int32_t registers,
+                                   std::list<OperationBase*> &statements)
+{
+    // constants are available at any time
+    if ((registers <= 0) || op->isCSD())
+    {
+        return op;
+    }
+
+    auto key  = std::make_pair(static_cast<const OperandBase*>(op.get()), registers);
+    auto iter = m_delayed.find(key);
+    if (iter != m_delayed.end())
+    {
+        return iter->second;
+    }
+
+    SharedOpPtr previous = getDelayed(op, registers-1, statements);
+    SharedOpPtr reg = IntermediateOperand::createNewIntermediate();
+    statements.push_back(new OpRegister(previous, reg));
+    m_ssa->addOperand(reg);
+
+    m_delayed[key] = reg;
+    return reg;
+}
@@ -27,8 +27,12 @@ bool PassTruncate::execute(Program &ssa)
         }
     }
 
-    ssa.applyPatches(); // integrate the generate OpPatchBlock instructions.
-    ssa.updateOutputPrecisions();
+    // only the instructions of the patch blocks
+    // and the instructions that use their results
+    // can change precision.
+    std::vector<const OperationBase*> modified;
+    ssa.applyPatches(modified); // integrate the generate OpPatchBlock instructions.
+    ssa.updateOutputPrecisions(modified);
     return true;
 }
 
@@ -56,6 +60,24 @@ bool PassTruncate::visit(const OpTruncate *node)
 
     SharedOpPtr inOp = node->m_op;
 
+    // **********************************************************************
+    //   Extend MSBs
+    // **********************************************************************
+
+    // the MSBs are extended before the LSBs are removed,
+    // otherwise an operand with few integer bits can be
+    // left without any bits, e.g. Q(0,11) -> Q(0,0) -> Q(4,0).
+    if (node->m_op->m_intBits < node->m_intBits)
+    {
+        SharedOpPtr tmp = IntermediateOperand::createNewIntermediate();
+        OpExtendMSBs* instr = new OpExtendMSBs(inOp, tmp, node->m_intBits - node->m_op->m_intBits);
+        m_ssa->addOperand(tmp);
+        patch->addStatement(instr);
+
+        // replace the input operand with the new temporary output
+        inOp = tmp;
+    }
+
     // **********************************************************************
     //   Handle LSBs
     // **********************************************************************
@@ -87,7 +109,7 @@ bool PassTruncate::visit(const OpTruncate *node)
     }
 
     // **********************************************************************
-    //   Handle MSBs
+    //   Remove MSBs
     // **********************************************************************
 
     if (node->m_op->m_intBits > node->m_intBits)
@@ -101,17 +123,6 @@ bool PassTruncate::visit(const OpTruncate *node)
         // replace the input operand with the new temporary output
         inOp = tmp;
     }
-    else if (node->m_op->m_intBits < node->m_intBits)
-    {
-        // extend the MSBs
-        SharedOpPtr tmp = IntermediateOperand::createNewIntermediate();
-        OpExtendMSBs* instr = new OpExtendMSBs(inOp, tmp, node->m_intBits - node->m_op->m_intBits);
-        m_ssa->addOperand(tmp);
-        patch->addStatement(instr);
-
-        // replace the input operand with the new temporary output
-        inOp = tmp;
-    }
     else
     {
         // no MSBs need to be harmed
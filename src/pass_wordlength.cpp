@@ -0,0 +1,586 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Word-length optimization SSA pass
+
+*/
+
+#include <stdlib.h>
+#include <cmath>
+#include <set>
+#include <limits>
+#include <algorithm>
+#include "logging.h"
+#include "parallel.h"
+#include "pass_wordlength.h"
+
+#define WORDLENGTH_SAMPLES 1000
+#define WORDLENGTH_VALIDATIONSAMPLES 4000
+
+using namespace SSA;
+
+bool PassWordLength::parse(const std::string &str, metric_t &metric, double &target)
+{
+    size_t colon = str.find(':');
+    if (colon == std::string::npos)
+    {
+        return false;
+    }
+
+    std::string name = str.substr(0, colon);
+    if (name == "max")
+    {
+        metric = METRIC_MAXERROR;
+    }
+    else if (name == "snr")
+    {
+        metric = METRIC_SNR;
+    }
+    else
+    {
+        return false;
+    }
+
+    std::string value = str.substr(colon+1);
+    char *end = NULL;
+    target = strtod(value.c_str(), &end);
+    if ((value.size() == 0) || (*end != 0))
+    {
+        return false;
+    }
+
+    // an error target must be positive, an SNR
+    // target can be any number of dB.
+    return (metric == METRIC_SNR) || (target > 0.0);
+}
+
+bool PassWordLength::execute(Program &ssa, metric_t metric, double target, double &errorBound)
+{
+    doLog(LOG_INFO, "------------------------------\n");
+    doLog(LOG_INFO, "  Running Word-length pass\n");
+    doLog(LOG_INFO, "------------------------------\n");
+
+    errorBound = 0.0;
+    PassWordLength pass(ssa, metric, target);
+    pass.normalise();
+
+    BatchEvaluator eval(ssa);
+    if (!eval.isValid())
+    {
+        doLog(LOG_ERROR, "Word-length pass: the program contains unsupported operations\n");
+        return false;
+    }
+
+    if (!pass.analyse(eval))
+    {
+        return false;
+    }
+
+    std::vector<int32_t> fracBits;
+    for(auto const &candidate : pass.m_candidates)
+    {
+        fracBits.push_back(candidate.fracBits);
+    }
+
+    double startArea = pass.calcArea(fracBits);
+    doLog(LOG_INFO, "%d candidates, estimated area %.0f LUTs\n",
+          static_cast<int32_t>(pass.m_candidates.size()), startArea);
+
+    // the evaluator is thread safe, so the candidates
+    // of each round are searched in parallel.
+    std::vector<std::pair<size_t, int32_t> > history;  // candidate and its previous bits
+    double area = startArea;
+    while(true)
+    {
+        std::vector<int32_t> bestBits(pass.m_candidates.size(), 0);
+        std::vector<double>  areas(pass.m_candidates.size(), area);
+        parallelFor(pass.m_candidates.size(), [&pass, &eval, &fracBits, &bestBits, &areas](size_t i)
+            {
+                // the error grows with the number of removed
+                // bits, so a binary search finds the most bits
+                // that can be removed. fractional bits are not
+                // removed beyond the binary point and the result
+                // keeps at least one bit.
+                std::vector<int32_t> bits = fracBits;
+                int32_t minBits = std::max(0, 1 - pass.m_candidates[i].statement->getLHS()->m_intBits);
+                int32_t lo = 0;
+                int32_t hi = std::max(fracBits[i] - minBits, 0);
+                while(lo < hi)
+                {
+                    int32_t mid = (lo + hi + 1) / 2;
+                    bits[i] = fracBits[i] - mid;
+                    if (pass.meetsTarget(eval, bits, pass.m_inputs, pass.m_reference))
+                    {
+                        lo = mid;
+                    }
+                    else
+                    {
+                        hi = mid - 1;
+                    }
+                }
+                bits[i] = fracBits[i] - lo;
+                bestBits[i] = bits[i];
+                areas[i] = pass.calcArea(bits);
+            });
+
+        int32_t best = -1;
+        for(size_t i=0; i<pass.m_candidates.size(); i++)
+        {
+            if ((areas[i] < area) && ((best < 0) || (areas[i] < areas[best])))
+            {
+                best = static_cast<int32_t>(i);
+            }
+        }
+
+        if (best < 0)
+        {
+            break;
+        }
+
+        doLog(LOG_DEBUG, "  %s: %d -> %d fractional bits, area %.0f LUTs\n",
+              pass.m_candidates[best].statement->getLHS()->m_identName.c_str(),
+              fracBits[best], bestBits[best], areas[best]);
+
+        history.push_back(std::make_pair(static_cast<size_t>(best), fracBits[best]));
+        fracBits[best] = bestBits[best];
+        area = areas[best];
+    }
+
+    // check the result on input vectors that were not
+    // used by the search and undo the last truncations
+    // until it meets the target on those too.
+    std::vector<std::vector<double> > inputs(WORDLENGTH_VALIDATIONSAMPLES);
+    std::vector<std::vector<double> > reference(WORDLENGTH_VALIDATIONSAMPLES);
+    uint32_t seed = 0x9E3779B9;
+    for(size_t i=0; i<inputs.size(); i++)
+    {
+        eval.randomizeInputs(inputs[i], seed);
+        eval.evaluate(inputs[i], reference[i]);
+    }
+
+    while(!pass.meetsTarget(eval, fracBits, inputs, reference) && (history.size() > 0))
+    {
+        fracBits[history.back().first] = history.back().second;
+        history.pop_back();
+    }
+
+    if (!pass.meetsTarget(eval, fracBits, inputs, reference))
+    {
+        doLog(LOG_ERROR, "Word-length pass: the error target cannot be met\n");
+        return false;
+    }
+    error_t error = pass.measure(eval, fracBits, inputs, reference);
+
+    area = pass.calcArea(fracBits);
+    errorBound = pass.calcErrorBound(fracBits);
+    pass.apply(fracBits);
+
+    doLog(LOG_INFO, "Truncated %d results, estimated area %.0f -> %.0f LUTs\n",
+          static_cast<int32_t>(history.size()), startArea, area);
+    if (pass.m_metric == METRIC_SNR)
+    {
+        doLog(LOG_INFO, "Measured error: max %g, SNR %.1f dB\n", error.maxError, error.minSNR);
+    }
+    else
+    {
+        doLog(LOG_INFO, "Measured error: max %g\n", error.maxError);
+    }
+    doLog(LOG_INFO, "Error bound: %g\n", errorBound);
+    return true;
+}
+
+void PassWordLength::normalise()
+{
+    for(auto iter = m_ssa->m_statements.begin(); iter != m_ssa->m_statements.end(); iter++)
+    {
+        OperationSingle *single = dynamic_cast<OperationSingle*>(*iter);
+        if ((dynamic_cast<OpExtendLSBs*>(single) != NULL) || (dynamic_cast<OpRemoveLSBs*>(single) != NULL))
+        {
+            SharedOpPtr lhs = single->m_lhs;
+            *iter = new OpTruncate(single->m_op, lhs, lhs->m_intBits, lhs->m_fracBits);
+            delete single;
+        }
+    }
+}
+
+bool PassWordLength::analyse(const BatchEvaluator &eval)
+{
+    m_inputs.resize(WORDLENGTH_SAMPLES);
+    m_reference.resize(WORDLENGTH_SAMPLES);
+    uint32_t seed = 0x12345678;
+    for(size_t i=0; i<m_inputs.size(); i++)
+    {
+        eval.randomizeInputs(m_inputs[i], seed);
+        eval.evaluate(m_inputs[i], m_reference[i]);
+    }
+
+    // a reinterpretation depends on the format of its
+    // input, so results that reach one without passing
+    // a truncation must keep their format.
+    std::set<const OperandBase*> fixedFormat;
+    for(auto iter = m_ssa->m_statements.rbegin(); iter != m_ssa->m_statements.rend(); iter++)
+    {
+        OperationBase *statement = *iter;
+        SharedOpPtr lhs = statement->getLHS();
+        bool fixed = (dynamic_cast<OpReinterpret*>(statement) != NULL) ||
+                     ((dynamic_cast<OpTruncate*>(statement) == NULL) && lhs && (fixedFormat.count(lhs.get()) > 0));
+        if (fixed)
+        {
+            for(auto const &input : statement->getInputs())
+            {
+                fixedFormat.insert(input.get());
+            }
+        }
+    }
+
+    m_candidates.clear();
+    m_candidateIndex.clear();
+    for(auto statement : m_ssa->m_statements)
+    {
+        if ((dynamic_cast<OpAdd*>(statement) == NULL) &&
+            (dynamic_cast<OpSub*>(statement) == NULL) &&
+            (dynamic_cast<OpMul*>(statement) == NULL) &&
+            (dynamic_cast<OpCSDMul*>(statement) == NULL) &&
+            (dynamic_cast<OpNegate*>(statement) == NULL) &&
+            (dynamic_cast<OpTruncate*>(statement) == NULL))
+        {
+            continue;
+        }
+
+        SharedOpPtr lhs = statement->getLHS();
+        if ((dynamic_cast<IntermediateOperand*>(lhs.get()) == NULL) ||
+            (lhs->m_fracBits <= 0) || (fixedFormat.count(lhs.get()) > 0))
+        {
+            continue;
+        }
+
+        candidate_t candidate;
+        candidate.statement  = statement;
+        candidate.valueIndex = eval.getValueIndex(lhs);
+        candidate.fracBits   = lhs->m_fracBits;
+        if (candidate.valueIndex < 0)
+        {
+            continue;
+        }
+
+        m_candidateIndex[statement] = m_candidates.size();
+        m_candidates.push_back(candidate);
+    }
+
+    if (m_candidates.size() == 0)
+    {
+        doLog(LOG_INFO, "No intermediate results to truncate\n");
+    }
+    return true;
+}
+
+PassWordLength::error_t PassWordLength::measure(const BatchEvaluator &eval, const std::vector<int32_t> &fracBits,
+                                                const std::vector<std::vector<double> > &inputs,
+                                                const std::vector<std::vector<double> > &reference) const
+{
+    std::vector<double> scales(eval.getValueCount(), 0.0);
+    for(size_t i=0; i<m_candidates.size(); i++)
+    {
+        if (fracBits[i] < m_candidates[i].fracBits)
+        {
+            scales[m_candidates[i].valueIndex] = ldexp(1.0, fracBits[i]);
+        }
+    }
+
+    size_t outputCount = eval.getOutputNames().size();
+    std::vector<double> signal(outputCount, 0.0);
+    std::vector<double> noise(outputCount, 0.0);
+
+    error_t error;
+    error.maxError = 0.0;
+    std::vector<double> outputs;
+    for(size_t i=0; i<inputs.size(); i++)
+    {
+        eval.evaluate(inputs[i], outputs, scales);
+        for(size_t j=0; j<outputCount; j++)
+        {
+            double e = outputs[j] - reference[i][j];
+            error.maxError = std::max(error.maxError, fabs(e));
+            signal[j] += reference[i][j]*reference[i][j];
+            noise[j]  += e*e;
+        }
+    }
+
+    error.minSNR = std::numeric_limits<double>::infinity();
+    for(size_t j=0; j<outputCount; j++)
+    {
+        if (noise[j] > 0.0)
+        {
+            error.minSNR = std::min(error.minSNR, 10.0*log10(signal[j] / noise[j]));
+        }
+    }
+    return error;
+}
+
+bool PassWordLength::meetsTarget(const BatchEvaluator &eval, const std::vector<int32_t> &fracBits,
+                                 const std::vector<std::vector<double> > &inputs,
+                                 const std::vector<std::vector<double> > &reference) const
+{
+    // a truncation that can make a result wrap around
+    // has no error bound. such rare, large errors are
+    // not caught by the samples either.
+    double bound = calcErrorBound(fracBits);
+    if (m_metric == METRIC_SNR)
+    {
+        return std::isfinite(bound) && (measure(eval, fracBits, inputs, reference).minSNR >= m_target);
+    }
+    return bound <= m_target;
+}
+
+double PassWordLength::calcArea(const std::vector<int32_t> &fracBits) const
+{
+    // propagate the number of fractional bits through
+    // the program; the integer bits do not change.
+    std::map<const OperandBase*, int32_t> frac;
+    auto getFrac = [&frac](const SharedOpPtr &op)
+        {
+            auto iter = frac.find(op.get());
+            return (iter != frac.end()) ? iter->second : op->m_fracBits;
+        };
+
+    double area = 0.0;
+    for(auto statement : m_ssa->m_statements)
+    {
+        SharedOpPtr lhs = statement->getLHS();
+        if (!lhs)
+        {
+            continue;
+        }
+
+        int32_t f = lhs->m_fracBits;
+        const OperationDual *dual = dynamic_cast<const OperationDual*>(statement);
+        const OperationSingle *single = dynamic_cast<const OperationSingle*>(statement);
+        if (dynamic_cast<const OpMul*>(statement) != NULL)
+        {
+            int32_t f1 = getFrac(dual->m_op1);
+            int32_t f2 = getFrac(dual->m_op2);
+            f = f1 + f2;
+            area += 0.5*(dual->m_op1->m_intBits + f1)*(dual->m_op2->m_intBits + f2);
+        }
+        else if ((dynamic_cast<const OpAdd*>(statement) != NULL) ||
+                 (dynamic_cast<const OpSub*>(statement) != NULL))
+        {
+            f = std::max(getFrac(dual->m_op1), getFrac(dual->m_op2));
+            area += lhs->m_intBits + f;
+        }
+        else if (dynamic_cast<const OpTruncate*>(statement) != NULL)
+        {
+            f = lhs->m_fracBits;
+        }
+        else if (single != NULL)
+        {
+            // the other instructions keep the distance
+            // between the input and result LSBs.
+            f = getFrac(single->m_op) + (lhs->m_fracBits - single->m_op->m_fracBits);
+            const OpCSDMul *csdMul = dynamic_cast<const OpCSDMul*>(statement);
+            if ((csdMul != NULL) && (csdMul->m_csd.digits.size() > 1))
+            {
+                area += (csdMul->m_csd.digits.size() - 1)*(lhs->m_intBits + f);
+            }
+            else if (dynamic_cast<const OpNegate*>(statement) != NULL)
+            {
+                area += lhs->m_intBits + f;
+            }
+        }
+
+        auto iter = m_candidateIndex.find(statement);
+        if (iter != m_candidateIndex.end())
+        {
+            f = std::min(f, fracBits[iter->second]);
+        }
+        frac[lhs.get()] = f;
+    }
+    return area;
+}
+
+/** the range of values of an operand format */
+static std::pair<double, double> formatRange(const SharedOpPtr &op)
+{
+    return std::make_pair(-ldexp(1.0, op->m_intBits-1),
+                          ldexp(1.0, op->m_intBits-1) - ldexp(1.0, -op->m_fracBits));
+}
+
+double PassWordLength::calcErrorBound(const std::vector<int32_t> &fracBits) const
+{
+    // propagate the largest absolute error of each
+    // result through the program. a truncation adds
+    // less than an LSB of its result.
+    std::map<const OperandBase*, double> errors;
+    auto getError = [&errors](const SharedOpPtr &op)
+        {
+            auto iter = errors.find(op.get());
+            return (iter != errors.end()) ? iter->second : 0.0;
+        };
+
+    // the range of each result without truncations.
+    // an error can make a result wrap around where
+    // the original result does not, so a product,
+    // negation or removal of MSBs whose result can
+    // reach the limits of its format must not see
+    // an error.
+    std::map<const OperandBase*, std::pair<double, double> > ranges;
+    auto getRange = [&ranges](const SharedOpPtr &op) -> std::pair<double, double>
+        {
+            auto iter = ranges.find(op.get());
+            return (iter != ranges.end()) ? iter->second : formatRange(op);
+        };
+
+    // the largest magnitude of an operand
+    auto getMax = [](const SharedOpPtr &op)
+        {
+            return ldexp(1.0, op->m_intBits-1);
+        };
+
+    double maxError = 0.0;
+    for(auto statement : m_ssa->m_statements)
+    {
+        SharedOpPtr lhs = statement->getLHS();
+        if (!lhs)
+        {
+            continue;
+        }
+
+        double e = 0.0;
+        std::pair<double, double> range = formatRange(lhs);
+        bool canWrap = false;
+        const OperationDual *dual = dynamic_cast<const OperationDual*>(statement);
+        const OperationSingle *single = dynamic_cast<const OperationSingle*>(statement);
+        if (dynamic_cast<const OpMul*>(statement) != NULL)
+        {
+            double e1 = getError(dual->m_op1);
+            double e2 = getError(dual->m_op2);
+            e = getMax(dual->m_op1)*e2 + getMax(dual->m_op2)*e1 + e1*e2;
+
+            std::pair<double, double> r1 = getRange(dual->m_op1);
+            std::pair<double, double> r2 = getRange(dual->m_op2);
+            double p[4] = {r1.first*r2.first, r1.first*r2.second, r1.second*r2.first, r1.second*r2.second};
+            range = std::make_pair(*std::min_element(p, p+4), *std::max_element(p, p+4));
+
+            // the product of the most negative inputs wraps
+            canWrap = true;
+        }
+        else if (dual != NULL)
+        {
+            e = getError(dual->m_op1) + getError(dual->m_op2);
+
+            std::pair<double, double> r1 = getRange(dual->m_op1);
+            std::pair<double, double> r2 = getRange(dual->m_op2);
+            if (dynamic_cast<const OpAdd*>(statement) != NULL)
+            {
+                range = std::make_pair(r1.first + r2.first, r1.second + r2.second);
+            }
+            else if (dynamic_cast<const OpSub*>(statement) != NULL)
+            {
+                range = std::make_pair(r1.first - r2.second, r1.second - r2.first);
+            }
+        }
+        else if (single != NULL)
+        {
+            e = getError(single->m_op);
+            range = getRange(single->m_op);
+            const OpCSDMul *csdMul = dynamic_cast<const OpCSDMul*>(statement);
+            if (csdMul != NULL)
+            {
+                e *= fabs(csdMul->m_csd.value);
+                double c = csdMul->m_csd.value;
+                range = std::make_pair(std::min(c*range.first, c*range.second),
+                                       std::max(c*range.first, c*range.second));
+            }
+            else if (dynamic_cast<const OpNegate*>(statement) != NULL)
+            {
+                range = std::make_pair(-range.second, -range.first);
+                canWrap = true;
+            }
+            else if (dynamic_cast<const OpTruncate*>(statement) != NULL)
+            {
+                if (e > 0.0)
+                {
+                    // an error in the input can move the
+                    // result to the next multiple of the LSB.
+                    e += ldexp(1.0, -lhs->m_fracBits);
+                }
+                range.first -= ldexp(1.0, -lhs->m_fracBits);
+                canWrap = (lhs->m_intBits < single->m_op->m_intBits);
+            }
+            else if (dynamic_cast<const OpReinterpret*>(statement) != NULL)
+            {
+                e = ldexp(e, single->m_op->m_fracBits - lhs->m_fracBits);
+                range = std::make_pair(ldexp(range.first, single->m_op->m_fracBits - lhs->m_fracBits),
+                                       ldexp(range.second, single->m_op->m_fracBits - lhs->m_fracBits));
+            }
+            else if (dynamic_cast<const OpRemoveMSBs*>(statement) != NULL)
+            {
+                canWrap = true;
+            }
+        }
+
+        auto iter = m_candidateIndex.find(statement);
+        if ((iter != m_candidateIndex.end()) && (fracBits[iter->second] < m_candidates[iter->second].fracBits))
+        {
+            e += ldexp(1.0, -fracBits[iter->second]);
+        }
+
+        std::pair<double, double> limits = formatRange(lhs);
+        if (canWrap && (e > 0.0) && (((range.first - e) < limits.first) || ((range.second + e) > limits.second)))
+        {
+            return std::numeric_limits<double>::infinity();
+        }
+        if ((range.first < limits.first) || (range.second > limits.second))
+        {
+            range = limits;
+        }
+        errors[lhs.get()] = e;
+        ranges[lhs.get()] = range;
+
+        if (dynamic_cast<const OutputOperand*>(lhs.get()) != NULL)
+        {
+            maxError = std::max(maxError, e);
+        }
+    }
+    return maxError;
+}
+
+void PassWordLength::apply(const std::vector<int32_t> &fracBits)
+{
+    std::vector<const OperationBase*> modified;
+    for(size_t i=0; i<m_candidates.size(); i++)
+    {
+        const candidate_t &candidate = m_candidates[i];
+        if (fracBits[i] >= candidate.fracBits)
+        {
+            continue;
+        }
+
+        // an existing truncation is made narrower,
+        // other results get a truncation behind them
+        // that replaces them in the later instructions.
+        OpTruncate *truncate = dynamic_cast<OpTruncate*>(candidate.statement);
+        if (truncate != NULL)
+        {
+            truncate->m_fracBits = fracBits[i];
+            modified.push_back(truncate);
+            continue;
+        }
+
+        SharedOpPtr lhs = candidate.statement->getLHS();
+        SharedOpPtr result = IntermediateOperand::createNewIntermediate();
+        m_ssa->addOperand(result);
+
+        auto iter = std::find(m_ssa->m_statements.begin(), m_ssa->m_statements.end(), candidate.statement);
+        iter++;
+        for(auto later = iter; later != m_ssa->m_statements.end(); later++)
+        {
+            (*later)->replaceOperand(lhs, result);
+        }
+        OpTruncate *inserted = new OpTruncate(lhs, result, lhs->m_intBits, fracBits[i]);
+        m_ssa->m_statements.insert(iter, inserted);
+        modified.push_back(inserted);
+    }
+    m_ssa->updateOutputPrecisions(modified);
+}
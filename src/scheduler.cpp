@@ -0,0 +1,287 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Resource-constrained list scheduler
+
+*/
+
+#include <algorithm>
+#include "logging.h"
+#include "scheduler.h"
+
+using namespace SSA;
+
+Scheduler::Scheduler(uint32_t steps) : m_steps(steps)
+{
+    for(uint32_t i=0; i<RES_COUNT; i++)
+    {
+        m_shared[i] = false;
+        m_auto[i]   = false;
+        m_units[i]  = 0;
+        m_ops[i]    = 0;
+    }
+}
+
+void Scheduler::share(resource_t resource, uint32_t units)
+{
+    m_shared[resource] = true;
+    m_auto[resource]   = (units == 0);
+    m_units[resource]  = units;
+}
+
+const char* Scheduler::getName(resource_t resource)
+{
+    switch(resource)
+    {
+    case RES_MULTIPLIER:
+        return "multipliers";
+    case RES_ADDER:
+        return "adders";
+    default:
+        return "?";
+    }
+}
+
+Scheduler::resource_t Scheduler::getResource(const OperationBase *node) const
+{
+    if ((dynamic_cast<const OpMul*>(node) != NULL) && m_shared[RES_MULTIPLIER])
+    {
+        return RES_MULTIPLIER;
+    }
+
+    // a shared adder computes at its own width, so the
+    // binary points of the operands must line up with
+    // the result and the operands must not be wider.
+    const OperationDual *dual = dynamic_cast<const OperationDual*>(node);
+    if ((dual != NULL) && m_shared[RES_ADDER] &&
+        ((dynamic_cast<const OpAdd*>(node) != NULL) || (dynamic_cast<const OpSub*>(node) != NULL)))
+    {
+        const SharedOpPtr &lhs = dual->m_lhs;
+        for(auto const &op : dual->getInputs())
+        {
+            if ((op->m_fracBits != lhs->m_fracBits) || (op->m_intBits > lhs->m_intBits))
+            {
+                return RES_COUNT;
+            }
+        }
+        return RES_ADDER;
+    }
+    return RES_COUNT;
+}
+
+bool Scheduler::execute(const Program &ssa)
+{
+    doLog(LOG_INFO, "-----------------------\n");
+    doLog(LOG_INFO, "  Running Scheduler\n");
+    doLog(LOG_INFO, "-----------------------\n");
+
+    if (m_steps == 0)
+    {
+        doLog(LOG_ERROR, "Scheduler: at least one clock cycle per sample is needed\n");
+        return false;
+    }
+
+    // the priority of an operation is the number of
+    // shared operations on the longest path from it
+    // to an output, including itself.
+    std::map<const OperandBase*, uint32_t> tails;
+    for(uint32_t i=0; i<RES_COUNT; i++)
+    {
+        m_ops[i] = 0;
+    }
+    m_priority.clear();
+    for(auto iter = ssa.m_statements.rbegin(); iter != ssa.m_statements.rend(); iter++)
+    {
+        const OperationBase *statement = *iter;
+        if (dynamic_cast<const OpRegister*>(statement) != NULL)
+        {
+            doLog(LOG_ERROR, "Scheduler: the program already has registers\n");
+            return false;
+        }
+
+        SharedOpPtr lhs = statement->getLHS();
+        if (!lhs)
+        {
+            continue;
+        }
+
+        uint32_t tail = tails[lhs.get()];
+        resource_t resource = getResource(statement);
+        if (resource != RES_COUNT)
+        {
+            tail++;
+            m_priority[statement] = tail;
+            m_ops[resource]++;
+        }
+
+        for(auto const &input : statement->getInputs())
+        {
+            uint32_t &t = tails[input.get()];
+            t = std::max(t, tail);
+        }
+    }
+
+    // without a given number of operators, start with
+    // the fewest that could do all operations.
+    for(uint32_t i=0; i<RES_COUNT; i++)
+    {
+        if (m_auto[i])
+        {
+            m_units[i] = (m_ops[i] + m_steps - 1) / m_steps;
+        }
+    }
+
+    uint32_t used = listSchedule(ssa);
+    while(used > m_steps)
+    {
+        // add an operator of the kind that has
+        // the most operations per operator.
+        int32_t best = -1;
+        double bestLoad = 0.0;
+        for(uint32_t i=0; i<RES_COUNT; i++)
+        {
+            if (m_auto[i] && (m_units[i] < m_ops[i]))
+            {
+                double load = static_cast<double>(m_ops[i]) / m_units[i];
+                if (load > bestLoad)
+                {
+                    best = i;
+                    bestLoad = load;
+                }
+            }
+        }
+
+        if (best < 0)
+        {
+            doLog(LOG_ERROR, "Scheduler: the program needs %d clock cycles per sample with these operators\n", used);
+            return false;
+        }
+        m_units[best]++;
+        used = listSchedule(ssa);
+    }
+
+    for(uint32_t i=0; i<RES_COUNT; i++)
+    {
+        if (m_shared[i])
+        {
+            doLog(LOG_INFO, "%d %s shared by %d operations\n", m_units[i],
+                  getName(static_cast<resource_t>(i)), m_ops[i]);
+        }
+    }
+    doLog(LOG_INFO, "Scheduled in %d of %d clock cycles per sample\n", used, m_steps);
+    return true;
+}
+
+uint32_t Scheduler::listSchedule(const Program &ssa)
+{
+    const uint32_t notReady = 0xFFFFFFFF;
+
+    m_slots.clear();
+    uint32_t remaining = 0;
+    for(uint32_t i=0; i<RES_COUNT; i++)
+    {
+        remaining += m_ops[i];
+    }
+
+    uint32_t step = 0;
+    while(remaining > 0)
+    {
+        // determine the step from which each operand is
+        // available. inputs are available from step 0,
+        // the results of shared operators one step after
+        // the step they are computed in.
+        std::map<const OperandBase*, uint32_t> ready;
+        std::vector<const OperationBase*> candidates;
+        for(auto statement : ssa.m_statements)
+        {
+            SharedOpPtr lhs = statement->getLHS();
+            if (!lhs)
+            {
+                continue;
+            }
+
+            uint32_t available = 0;
+            for(auto const &input : statement->getInputs())
+            {
+                auto iter = ready.find(input.get());
+                if (iter != ready.end())
+                {
+                    available = std::max(available, iter->second);
+                }
+            }
+
+            if (getResource(statement) == RES_COUNT)
+            {
+                ready[lhs.get()] = available;
+                continue;
+            }
+
+            auto slot = m_slots.find(statement);
+            if (slot != m_slots.end())
+            {
+                ready[lhs.get()] = slot->second.step + 1;
+            }
+            else
+            {
+                if (available <= step)
+                {
+                    candidates.push_back(statement);
+                }
+                ready[lhs.get()] = notReady;
+            }
+        }
+
+        // operations on the longest paths first; the sort
+        // is stable so ties keep the program order.
+        std::stable_sort(candidates.begin(), candidates.end(),
+            [this](const OperationBase *a, const OperationBase *b)
+            {
+                return m_priority.at(a) > m_priority.at(b);
+            });
+
+        uint32_t busy[RES_COUNT] = {0};
+        std::vector<const OperationBase*> placed;
+        for(auto candidate : candidates)
+        {
+            resource_t resource = getResource(candidate);
+            if (busy[resource] < m_units[resource])
+            {
+                busy[resource]++;
+                placed.push_back(candidate);
+            }
+        }
+
+        // the widest operations of each step go to the first
+        // operator, so narrow operations share narrow operators.
+        std::stable_sort(placed.begin(), placed.end(),
+            [](const OperationBase *a, const OperationBase *b)
+            {
+                return (a->getLHS()->m_intBits + a->getLHS()->m_fracBits) >
+                       (b->getLHS()->m_intBits + b->getLHS()->m_fracBits);
+            });
+
+        uint32_t unit[RES_COUNT] = {0};
+        for(auto node : placed)
+        {
+            slot_t slot;
+            slot.resource = getResource(node);
+            slot.unit     = unit[slot.resource]++;
+            slot.step     = step;
+            m_slots[node] = slot;
+            remaining--;
+        }
+        step++;
+    }
+    return step;
+}
+
+const Scheduler::slot_t* Scheduler::getSlot(const OperationBase *node) const
+{
+    auto iter = m_slots.find(node);
+    if (iter == m_slots.end())
+    {
+        return NULL;
+    }
+    return &iter->second;
+}
@@ -9,8 +9,29 @@
 
 */
 
+#include <atomic>
+#include <map>
+#include <set>
 #include "ssa.h"
 
+uint32_t SSA::IntermediateOperand::getNextIndex()
+{
+    static std::atomic<uint32_t> tempIdx(0);
+    return tempIdx++;
+}
+
+int32_t SSA::calcIntBits(double minValue, double maxValue, int32_t fracBits)
+{
+    // start with a single sign bit and grow the
+    // format until the interval fits.
+    int32_t intBits = 1 - fracBits;
+    while((minValue < -ldexp(1.0, intBits-1)) ||
+          (maxValue > ldexp(1.0, intBits-1) - ldexp(1.0, -fracBits)))
+    {
+        intBits++;
+    }
+    return intBits;
+}
 
 bool SSA::OpAdd::accept(SSA::OperationVisitorBase *visitor)
 {
@@ -82,6 +103,26 @@ bool SSA::OpRemoveMSBs::accept(SSA::OperationVisitorBase *visitor)
     return visitor->visit(this);
 }
 
+bool SSA::OpRegister::accept(SSA::OperationVisitorBase *visitor)
+{
+    return visitor->visit(this);
+}
+
+bool SSA::OpCSASum::accept(SSA::OperationVisitorBase *visitor)
+{
+    return visitor->visit(this);
+}
+
+bool SSA::OpCSACarry::accept(SSA::OperationVisitorBase *visitor)
+{
+    return visitor->visit(this);
+}
+
+bool SSA::OpMulAdd::accept(SSA::OperationVisitorBase *visitor)
+{
+    return visitor->visit(this);
+}
+
 
 void SSA::OperationSingle::replaceOperand(const SharedOpPtr &op1, SharedOpPtr op2)
 {
@@ -105,6 +146,44 @@ void SSA::OperationDual::replaceOperand(const SharedOpPtr &op1, SharedOpPtr op2)
 }
 
 
+void SSA::OperationCompressor::replaceOperand(const SharedOpPtr &op1, SharedOpPtr op2)
+{
+    if (m_op1 == op1)
+    {
+        m_op1 = op2;
+    }
+    if (m_op2 == op1)
+    {
+        m_op2 = op2;
+    }
+    if (m_op3 == op1)
+    {
+        m_op3 = op2;
+    }
+}
+
+
+void SSA::OpMulAdd::replaceOperand(const SharedOpPtr &op1, SharedOpPtr op2)
+{
+    if (m_a == op1)
+    {
+        m_a = op2;
+    }
+    if (m_d == op1)
+    {
+        m_d = op2;
+    }
+    if (m_b == op1)
+    {
+        m_b = op2;
+    }
+    if (m_c == op1)
+    {
+        m_c = op2;
+    }
+}
+
+
 void SSA::OpPatchBlock::replaceOperand(const SharedOpPtr &op1, SharedOpPtr op2)
 {
     for(OperationBase* statement : m_statements)
@@ -114,7 +193,108 @@ void SSA::OpPatchBlock::replaceOperand(const SharedOpPtr &op1, SharedOpPtr op2)
 }
 
 
+/** get the copy of an operand, making it on first use */
+static SSA::SharedOpPtr copyOperand(const SSA::SharedOpPtr &op,
+                                    std::map<const SSA::OperandBase*, SSA::SharedOpPtr> &copies)
+{
+    using namespace SSA;
+    if (!op)
+    {
+        return op;
+    }
+
+    auto iter = copies.find(op.get());
+    if (iter != copies.end())
+    {
+        return iter->second;
+    }
+
+    SharedOpPtr copy;
+    const ViewOperand *view = dynamic_cast<const ViewOperand*>(op.get());
+    if (view != NULL)
+    {
+        copy = ViewOperand::create(copyOperand(view->m_source, copies), op->m_intBits, op->m_fracBits);
+    }
+    else if (dynamic_cast<const InputOperand*>(op.get()) != NULL)
+    {
+        copy = std::make_shared<InputOperand>(*static_cast<const InputOperand*>(op.get()));
+    }
+    else if (dynamic_cast<const OutputOperand*>(op.get()) != NULL)
+    {
+        copy = std::make_shared<OutputOperand>(*static_cast<const OutputOperand*>(op.get()));
+    }
+    else if (dynamic_cast<const IntermediateOperand*>(op.get()) != NULL)
+    {
+        copy = std::make_shared<IntermediateOperand>(*static_cast<const IntermediateOperand*>(op.get()));
+    }
+    else if (dynamic_cast<const CSDOperand*>(op.get()) != NULL)
+    {
+        copy = std::make_shared<CSDOperand>(*static_cast<const CSDOperand*>(op.get()));
+    }
+    else
+    {
+        throw std::runtime_error("Program: cannot copy operand " + op->m_identName);
+    }
+
+    copies[op.get()] = copy;
+    return copy;
+}
+
+SSA::Program::Program(const Program &obj)
+{
+    std::map<const OperandBase*, SharedOpPtr> copies;
+    for(auto operand : obj.m_operands)
+    {
+        m_operands.push_back(copyOperand(operand, copies));
+    }
+
+    for(auto statement : obj.m_statements)
+    {
+        if (statement->isPatchBlock())
+        {
+            throw std::runtime_error("Program: cannot copy a patch block");
+        }
+
+        OperationBase *copy = statement->clone();
+        for(auto input : copy->getInputs())
+        {
+            copy->replaceOperand(input, copyOperand(input, copies));
+        }
+
+        // the results are not replaced by replaceOperand
+        OperationSingle *single = dynamic_cast<OperationSingle*>(copy);
+        OperationDual *dual = dynamic_cast<OperationDual*>(copy);
+        OperationCompressor *compressor = dynamic_cast<OperationCompressor*>(copy);
+        OpMulAdd *mulAdd = dynamic_cast<OpMulAdd*>(copy);
+        if (single != NULL)
+        {
+            single->m_lhs = copyOperand(single->m_lhs, copies);
+        }
+        else if (dual != NULL)
+        {
+            dual->m_lhs = copyOperand(dual->m_lhs, copies);
+        }
+        else if (compressor != NULL)
+        {
+            compressor->m_lhs = copyOperand(compressor->m_lhs, copies);
+        }
+        else if (mulAdd != NULL)
+        {
+            mulAdd->m_pre  = copyOperand(mulAdd->m_pre, copies);
+            mulAdd->m_prod = copyOperand(mulAdd->m_prod, copies);
+            mulAdd->m_lhs  = copyOperand(mulAdd->m_lhs, copies);
+        }
+        m_statements.push_back(copy);
+    }
+}
+
 void SSA::Program::applyPatches()
+{
+    std::vector<const OperationBase*> inserted;
+    applyPatches(inserted);
+}
+
+void SSA::Program::applyPatches(std::vector<const OperationBase*> &inserted)
 {
     auto iter = m_statements.begin();
     while(iter != m_statements.end())
@@ -127,6 +307,9 @@ void SSA::Program::applyPatches()
             m_statements.insert(iter,
                                 patchBlock->m_statements.begin(),
                                 patchBlock->m_statements.end());
+            inserted.insert(inserted.end(),
+                            patchBlock->m_statements.begin(),
+                            patchBlock->m_statements.end());
 
             // delete the patch block instruction itself
             if (patchBlock->m_replacedInstruction != NULL)
@@ -148,3 +331,142 @@ void SSA::Program::applyPatches()
         }
     }
 }
+
+/** get the results of an instruction whose precision
+    is calculated by updateOutputPrecision() */
+static std::vector<SSA::SharedOpPtr> getResults(const SSA::OperationBase *statement)
+{
+    std::vector<SSA::SharedOpPtr> results;
+    SSA::SharedOpPtr lhs = statement->getLHS();
+    if (lhs)
+    {
+        results.push_back(lhs);
+    }
+
+    // the multiply-add instruction calculates the
+    // precision of its internal results, not of its
+    // left-hand side.
+    const SSA::OpMulAdd *mulAdd = dynamic_cast<const SSA::OpMulAdd*>(statement);
+    if (mulAdd != NULL)
+    {
+        if (mulAdd->m_preMode != SSA::OpMulAdd::ADD_NONE)
+        {
+            results.push_back(mulAdd->m_pre);
+        }
+        results.push_back(mulAdd->m_prod);
+    }
+    return results;
+}
+
+uint32_t SSA::Program::updateOutputPrecisions(const std::vector<const OperationBase*> &modified)
+{
+    // the statements are in dependency order, so the
+    // worklist is ordered by position: a statement is
+    // recalculated once, after all its inputs.
+    std::vector<OperationBase*> statements(m_statements.begin(), m_statements.end());
+    std::map<const OperationBase*, size_t> positions;
+    std::map<const OperandBase*, std::vector<size_t> > users;
+    for(size_t i=0; i<statements.size(); i++)
+    {
+        positions[statements[i]] = i;
+        for(auto input : statements[i]->getInputs())
+        {
+            users[input.get()].push_back(i);
+        }
+    }
+
+    std::set<size_t> worklist;
+    for(auto statement : modified)
+    {
+        auto iter = positions.find(statement);
+        if (iter != positions.end())
+        {
+            worklist.insert(iter->second);
+        }
+    }
+
+    // the users of a modified statement are always
+    // recalculated, as its result may be new to them.
+    std::set<size_t> forced(worklist);
+    uint32_t count = 0;
+    while(!worklist.empty())
+    {
+        size_t index = *worklist.begin();
+        worklist.erase(worklist.begin());
+
+        std::vector<SharedOpPtr> results = getResults(statements[index]);
+        std::vector<std::pair<int32_t, int32_t> > formats;
+        for(auto result : results)
+        {
+            formats.push_back(std::make_pair(result->m_intBits, result->m_fracBits));
+        }
+
+        statements[index]->updateOutputPrecision();
+        count++;
+
+        for(size_t i=0; i<results.size(); i++)
+        {
+            if ((forced.count(index) == 0) &&
+                (results[i]->m_intBits == formats[i].first) &&
+                (results[i]->m_fracBits == formats[i].second))
+            {
+                continue;
+            }
+
+            auto iter = users.find(results[i].get());
+            if (iter != users.end())
+            {
+                worklist.insert(iter->second.begin(), iter->second.end());
+            }
+        }
+    }
+    return count;
+}
+
+bool SSA::checkOutputPrecision(const OperationBase *statement, std::ostream &report)
+{
+    std::vector<SharedOpPtr> results = getResults(statement);
+    std::vector<std::pair<int32_t, int32_t> > formats;
+    for(auto result : results)
+    {
+        formats.push_back(std::make_pair(result->m_intBits, result->m_fracBits));
+    }
+
+    // calculate the precision and restore
+    // the stored one.
+    bool ok = true;
+    statement->updateOutputPrecision();
+    for(size_t i=0; i<results.size(); i++)
+    {
+        if ((results[i]->m_intBits != formats[i].first) ||
+            (results[i]->m_fracBits != formats[i].second))
+        {
+            report << results[i]->m_identName << " is Q(" << formats[i].first << "," << formats[i].second << ")";
+            report << " but its instruction produces Q(" << results[i]->m_intBits << "," << results[i]->m_fracBits << ")\n";
+            ok = false;
+        }
+        results[i]->m_intBits  = formats[i].first;
+        results[i]->m_fracBits = formats[i].second;
+    }
+    return ok;
+}
+
+bool SSA::Program::verifyPrecisions(std::ostream &report) const
+{
+    bool ok = true;
+    for(auto statement : m_statements)
+    {
+        // the instructions of a patch block are
+        // checked after applyPatches()
+        if (statement->isPatchBlock())
+        {
+            continue;
+        }
+
+        if (!checkOutputPrecision(statement, report))
+        {
+            ok = false;
+        }
+    }
+    return ok;
+}
@@ -0,0 +1,241 @@
+/*
+
+    A fast single static assignment (SSA) evaluator
+    for running a program on many input vectors.
+
+*/
+
+#include <cmath>
+#include "ssabatchevaluator.h"
+
+using namespace SSA;
+
+BatchEvaluator::BatchEvaluator(const Program &ssa, bool ideal)
+    : m_valid(true),
+      m_ideal(ideal)
+{
+    // inputs and outputs are sorted by name so programs
+    // derived from the same source can be compared.
+    std::map<std::string, SharedOpPtr> inputs;
+    std::map<std::string, SharedOpPtr> outputs;
+    for(auto operand : ssa.m_operands)
+    {
+        if (dynamic_cast<InputOperand*>(operand.get()) != NULL)
+        {
+            inputs[operand->m_identName] = operand;
+        }
+        else if (dynamic_cast<OutputOperand*>(operand.get()) != NULL)
+        {
+            outputs[operand->m_identName] = operand;
+        }
+    }
+
+    for(auto input : inputs)
+    {
+        m_inputNames.push_back(input.first);
+        m_inputs.push_back(getIndex(input.second));
+        m_inputFormats.push_back(std::make_pair(input.second->m_intBits, input.second->m_fracBits));
+    }
+
+    for(auto statement : ssa.m_statements)
+    {
+        if (!statement->accept(this))
+        {
+            m_valid = false;
+        }
+    }
+
+    for(auto output : outputs)
+    {
+        m_outputNames.push_back(output.first);
+        m_outputs.push_back(getIndex(output.second));
+    }
+}
+
+uint32_t BatchEvaluator::getIndex(const SharedOpPtr &op)
+{
+    auto iter = m_index.find(op.get());
+    if (iter != m_index.end())
+    {
+        return iter->second;
+    }
+
+    uint32_t index = static_cast<uint32_t>(m_index.size());
+    m_index[op.get()] = index;
+    return index;
+}
+
+void BatchEvaluator::addInstruction(opcode_t opcode, const SharedOpPtr &lhs,
+                                    const SharedOpPtr &src1, const SharedOpPtr &src2,
+                                    double scale, bool wrap)
+{
+    instruction_t instr;
+    instr.opcode = opcode;
+    instr.src1   = getIndex(src1);
+    instr.src2   = (src2) ? getIndex(src2) : 0;
+    instr.dst    = getIndex(lhs);
+    instr.scale  = scale;
+    instr.range  = (wrap && !m_ideal) ? ldexp(1.0, lhs->m_intBits) : 0.0;
+    m_program.push_back(instr);
+}
+
+void BatchEvaluator::randomizeInputs(std::vector<double> &inputs, uint32_t &seed) const
+{
+    inputs.resize(m_inputs.size());
+    for(size_t i=0; i<m_inputs.size(); i++)
+    {
+        // 64-bit random number from two xorshift steps
+        uint64_t r = 0;
+        for(uint32_t k=0; k<2; k++)
+        {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            r = (r << 32) | seed;
+        }
+
+        int32_t bits = m_inputFormats[i].first + m_inputFormats[i].second;
+        int64_t value = static_cast<int64_t>(r >> (64-bits)) - (static_cast<int64_t>(1) << (bits-1));
+        inputs[i] = ldexp(static_cast<double>(value), -m_inputFormats[i].second);
+    }
+}
+
+void BatchEvaluator::evaluate(const std::vector<double> &inputs, std::vector<double> &outputs) const
+{
+    evaluate(inputs, outputs, std::vector<double>());
+}
+
+void BatchEvaluator::evaluate(const std::vector<double> &inputs, std::vector<double> &outputs,
+                              const std::vector<double> &scales) const
+{
+    std::vector<double> values(m_index.size(), 0.0);
+    for(size_t i=0; i<m_inputs.size(); i++)
+    {
+        values[m_inputs[i]] = inputs.at(i);
+    }
+
+    for(auto &instr : m_program)
+    {
+        double v = values[instr.src1];
+        switch(instr.opcode)
+        {
+        case OP_COPY:
+            break;
+        case OP_ADD:
+            v += values[instr.src2];
+            break;
+        case OP_SUB:
+            v -= values[instr.src2];
+            break;
+        case OP_MUL:
+            v *= values[instr.src2];
+            break;
+        case OP_SCALE:
+            v *= instr.scale;
+            break;
+        case OP_FLOOR:
+            v = floor(v * instr.scale) / instr.scale;
+            break;
+        }
+
+        // two's complement wrap-around into [-range/2, range/2)
+        if (instr.range != 0.0)
+        {
+            v -= instr.range * floor((v + 0.5*instr.range) / instr.range);
+        }
+
+        if ((instr.dst < scales.size()) && (scales[instr.dst] != 0.0))
+        {
+            v = floor(v * scales[instr.dst]) / scales[instr.dst];
+        }
+        values[instr.dst] = v;
+    }
+
+    outputs.resize(m_outputs.size());
+    for(size_t i=0; i<m_outputs.size(); i++)
+    {
+        outputs[i] = values[m_outputs[i]];
+    }
+}
+
+bool BatchEvaluator::visit(const OpAssign *node)
+{
+    addInstruction(OP_COPY, node->m_lhs, node->m_op, SharedOpPtr(), 1.0, false);
+    return true;
+}
+
+bool BatchEvaluator::visit(const OpMul *node)
+{
+    addInstruction(OP_MUL, node->m_lhs, node->m_op1, node->m_op2, 1.0, true);
+    return true;
+}
+
+bool BatchEvaluator::visit(const OpAdd *node)
+{
+    addInstruction(OP_ADD, node->m_lhs, node->m_op1, node->m_op2, 1.0, true);
+    return true;
+}
+
+bool BatchEvaluator::visit(const OpSub *node)
+{
+    addInstruction(OP_SUB, node->m_lhs, node->m_op1, node->m_op2, 1.0, true);
+    return true;
+}
+
+bool BatchEvaluator::visit(const OpNegate *node)
+{
+    addInstruction(OP_SCALE, node->m_lhs, node->m_op, SharedOpPtr(), -1.0, true);
+    return true;
+}
+
+bool BatchEvaluator::visit(const OpCSDMul *node)
+{
+    addInstruction(OP_SCALE, node->m_lhs, node->m_op, SharedOpPtr(), node->m_csd.value, true);
+    return true;
+}
+
+bool BatchEvaluator::visit(const OpTruncate *node)
+{
+    // removing LSBs rounds towards minus infinity
+    addInstruction(OP_FLOOR, node->m_lhs, node->m_op, SharedOpPtr(), ldexp(1.0, node->m_fracBits), true);
+    return true;
+}
+
+bool BatchEvaluator::visit(const OpReinterpret *node)
+{
+    // the bits stay the same, so the value is scaled
+    double scale = ldexp(1.0, node->m_lhs->m_intBits - node->m_op->m_intBits);
+    addInstruction(OP_SCALE, node->m_lhs, node->m_op, SharedOpPtr(), scale, false);
+    return true;
+}
+
+bool BatchEvaluator::visit(const OpExtendLSBs *node)
+{
+    addInstruction(OP_COPY, node->m_lhs, node->m_op, SharedOpPtr(), 1.0, false);
+    return true;
+}
+
+bool BatchEvaluator::visit(const OpExtendMSBs *node)
+{
+    addInstruction(OP_COPY, node->m_lhs, node->m_op, SharedOpPtr(), 1.0, false);
+    return true;
+}
+
+bool BatchEvaluator::visit(const OpRemoveLSBs *node)
+{
+    addInstruction(OP_FLOOR, node->m_lhs, node->m_op, SharedOpPtr(), ldexp(1.0, node->m_lhs->m_fracBits), false);
+    return true;
+}
+
+bool BatchEvaluator::visit(const OpRemoveMSBs *node)
+{
+    addInstruction(OP_COPY, node->m_lhs, node->m_op, SharedOpPtr(), 1.0, true);
+    return true;
+}
+
+bool BatchEvaluator::visit(const OpRegister *node)
+{
+    // the steady-state value of a register is its input
+    addInstruction(OP_COPY, node->m_lhs, node->m_op, SharedOpPtr(), 1.0, false);
+    return true;
+}
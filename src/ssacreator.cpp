@@ -1,5 +1,6 @@
 
 #include "ssacreator.h"
+#include "utils.h"
 #include <memory>
 
 using namespace SSA;
@@ -285,6 +286,13 @@ void Creator::visit(const AST::CSDDeclaration *node)
     std::shared_ptr<CSDOperand> csdop = std::make_shared<CSDOperand>();
     csdop->m_csd = node->m_csd;
     csdop->m_identName = node->m_identName;
+
+    auto iter = m_termOverrides.find(node->m_identName);
+    if (iter != m_termOverrides.end())
+    {
+        csdop->m_csd = csd_t();
+        convertToCSD(node->m_value, iter->second, csdop->m_csd);
+    }
     csdop->m_intBits = 0;
     csdop->m_fracBits = 0;
 
@@ -322,8 +330,19 @@ void Creator::visit(const AST::InputDeclaration *node)
 
 void Creator::visit(const AST::IntegerConstant *node)
 {
-    (void)node;
-    // not implemented yet
+    // an integer literal is an exact CSD constant
+    // so it can be multiplied without a multiplier.
+    std::shared_ptr<CSDOperand> csdop = std::make_shared<CSDOperand>();
+    if (!convertIntegerToCSD(node->m_value, csdop->m_csd))
+    {
+        error("Creator::visit IntegerConstant - zero is not a valid constant");
+    }
+    csdop->m_identName = stringf("%d", node->m_value);
+    csdop->m_intBits = 0;
+    csdop->m_fracBits = 0;
+
+    m_ssa->addOperand(csdop);
+    PushOperand(csdop);
 }
 
 
@@ -228,6 +228,107 @@ bool SSA::Printer::visit(const OpRemoveMSBs *node)
     return true;
 }
 
+bool SSA::Printer::visit(const OpRegister *node)
+{
+    if (m_printLHSPrecision)
+    {
+        m_s << "Q(" << node->m_lhs->m_intBits;
+        m_s << "," << node->m_lhs->m_fracBits;
+        m_s << ")\t";
+    }
+    m_s << node->m_lhs->m_identName.c_str() << " := REGISTER(" << node->m_op->m_identName.c_str() << ")\n";
+    return true;
+}
+
+/** print the arguments of a 3:2 compressor; inverted
+    arguments are prefixed with a '~' */
+static void printCompressorArgs(std::ostream &s, const SSA::OperationCompressor *node)
+{
+    SSA::SharedOpPtr ops[3] = {node->m_op1, node->m_op2, node->m_op3};
+    for(uint32_t i=0; i<3; i++)
+    {
+        if (i != 0)
+        {
+            s << ",";
+        }
+        s << (node->isInverted(i) ? "~" : "") << ops[i]->m_identName.c_str();
+    }
+}
+
+bool SSA::Printer::visit(const OpCSASum *node)
+{
+    if (m_printLHSPrecision)
+    {
+        m_s << "Q(" << node->m_lhs->m_intBits;
+        m_s << "," << node->m_lhs->m_fracBits;
+        m_s << ")\t";
+    }
+    m_s << node->m_lhs->m_identName.c_str() << " := CSASUM(";
+    printCompressorArgs(m_s, node);
+    m_s << ")\n";
+    return true;
+}
+
+bool SSA::Printer::visit(const OpCSACarry *node)
+{
+    if (m_printLHSPrecision)
+    {
+        m_s << "Q(" << node->m_lhs->m_intBits;
+        m_s << "," << node->m_lhs->m_fracBits;
+        m_s << ")\t";
+    }
+    m_s << node->m_lhs->m_identName.c_str() << " := CSACARRY(";
+    printCompressorArgs(m_s, node);
+    m_s << (node->m_carryIn ? ") + 1\n" : ")\n");
+    return true;
+}
+
+bool SSA::Printer::visit(const OpMulAdd *node)
+{
+    if (m_printLHSPrecision)
+    {
+        m_s << "Q(" << node->m_lhs->m_intBits;
+        m_s << "," << node->m_lhs->m_fracBits;
+        m_s << ")\t";
+    }
+    m_s << node->m_lhs->m_identName.c_str() << " := MULADD(";
+    if (node->m_postMode == OpMulAdd::ADD_REVERSE)
+    {
+        m_s << node->m_c->m_identName.c_str() << " - ";
+    }
+
+    switch(node->m_preMode)
+    {
+    case OpMulAdd::ADD_PLUS:
+        m_s << "(" << node->m_a->m_identName.c_str() << " + " << node->m_d->m_identName.c_str() << ")";
+        break;
+    case OpMulAdd::ADD_MINUS:
+        m_s << "(" << node->m_a->m_identName.c_str() << " - " << node->m_d->m_identName.c_str() << ")";
+        break;
+    case OpMulAdd::ADD_REVERSE:
+        m_s << "(" << node->m_d->m_identName.c_str() << " - " << node->m_a->m_identName.c_str() << ")";
+        break;
+    default:
+        m_s << node->m_a->m_identName.c_str();
+        break;
+    }
+    m_s << " * " << node->m_b->m_identName.c_str();
+
+    switch(node->m_postMode)
+    {
+    case OpMulAdd::ADD_PLUS:
+        m_s << " + " << node->m_c->m_identName.c_str();
+        break;
+    case OpMulAdd::ADD_MINUS:
+        m_s << " - " << node->m_c->m_identName.c_str();
+        break;
+    default:
+        break;
+    }
+    m_s << ", " << node->m_stages << ")\n";
+    return true;
+}
+
 bool SSA::Printer::visit(const OpNull *node)
 {
     (void)node;
@@ -0,0 +1,250 @@
+/*
+
+  FPTOOL - a fixed-point math to VHDL generation tool
+
+  Description:  Check an SSA program after a pass
+
+*/
+
+#include <sstream>
+#include "logging.h"
+#include "ssaprint.h"
+#include "ssaverifier.h"
+
+using namespace SSA;
+
+bool Verifier::execute(const Program &ssa, const char *passName)
+{
+    Verifier verifier;
+    for(auto statement : ssa.m_statements)
+    {
+        std::stringstream precision;
+        bool ok = statement->accept(&verifier);
+        if (ok && !statement->isPatchBlock() && !checkOutputPrecision(statement, precision))
+        {
+            ok = verifier.fail(precision.str());
+        }
+
+        if (!ok)
+        {
+            std::stringstream ss;
+            Printer printer(ss, true);
+            statement->accept(&printer);
+            doLog(LOG_ERROR, "Verifier: after the %s pass: %s", passName, verifier.m_error.c_str());
+            doLog(LOG_ERROR, "  in %s", ss.str().c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Verifier::fail(const std::string &error)
+{
+    m_error = error;
+    if ((m_error.size() == 0) || (m_error.back() != '\n'))
+    {
+        m_error += "\n";
+    }
+    return false;
+}
+
+bool Verifier::checkInput(const SharedOpPtr &op)
+{
+    if (!op)
+    {
+        return fail("missing argument");
+    }
+
+    const ViewOperand *view = dynamic_cast<const ViewOperand*>(op.get());
+    if (view != NULL)
+    {
+        const SharedOpPtr &source = view->m_source;
+        if (dynamic_cast<const ViewOperand*>(source.get()) != NULL)
+        {
+            return fail("view " + op->m_identName + " of a view");
+        }
+        if ((op->m_intBits + op->m_fracBits) != (source->m_intBits + source->m_fracBits))
+        {
+            return fail("view " + op->m_identName + " changes the number of bits");
+        }
+        return checkInput(source);
+    }
+
+    if ((dynamic_cast<const InputOperand*>(op.get()) != NULL) || op->isCSD())
+    {
+        return true;
+    }
+
+    if (m_defined.count(op.get()) == 0)
+    {
+        return fail(op->m_identName + " is used before it is defined");
+    }
+    return true;
+}
+
+bool Verifier::define(const SharedOpPtr &op)
+{
+    if (!op)
+    {
+        return fail("missing result");
+    }
+
+    if ((dynamic_cast<const InputOperand*>(op.get()) != NULL) ||
+        (dynamic_cast<const ViewOperand*>(op.get()) != NULL) ||
+        op->isCSD())
+    {
+        return fail(op->m_identName + " cannot be the result of an instruction");
+    }
+
+    if (!m_defined.insert(op.get()).second)
+    {
+        return fail(op->m_identName + " is defined more than once");
+    }
+
+    if ((op->m_intBits + op->m_fracBits) < 1)
+    {
+        return fail(op->m_identName + " has no bits");
+    }
+    return true;
+}
+
+bool Verifier::checkSingle(const OperationSingle *node)
+{
+    return checkInput(node->m_op) && define(node->m_lhs);
+}
+
+bool Verifier::checkDual(const OperationDual *node)
+{
+    return checkInput(node->m_op1) && checkInput(node->m_op2) && define(node->m_lhs);
+}
+
+bool Verifier::checkCompressor(const OperationCompressor *node)
+{
+    SharedOpPtr ops[3] = {node->m_op1, node->m_op2, node->m_op3};
+    for(uint32_t i=0; i<3; i++)
+    {
+        if (!checkInput(ops[i]))
+        {
+            return false;
+        }
+        if ((ops[i]->m_intBits != node->m_op1->m_intBits) || (ops[i]->m_fracBits != node->m_op1->m_fracBits))
+        {
+            return fail("compressor arguments have different formats");
+        }
+    }
+    return define(node->m_lhs);
+}
+
+bool Verifier::checkBits(const OperationSingle *node, int32_t bits, bool remove)
+{
+    if (!checkSingle(node))
+    {
+        return false;
+    }
+
+    if (bits < 0)
+    {
+        return fail("negative number of bits");
+    }
+
+    int32_t opBits = node->m_op->m_intBits + node->m_op->m_fracBits;
+    if (remove && (bits >= opBits))
+    {
+        return fail("all bits of " + node->m_op->m_identName + " are removed");
+    }
+    return true;
+}
+
+bool Verifier::visit(const OpReinterpret *node)
+{
+    if (!checkSingle(node))
+    {
+        return false;
+    }
+
+    if ((node->m_lhs->m_intBits + node->m_lhs->m_fracBits) != (node->m_op->m_intBits + node->m_op->m_fracBits))
+    {
+        return fail("reinterpretation changes the number of bits");
+    }
+    return true;
+}
+
+bool Verifier::visit(const OpExtendLSBs *node)
+{
+    return checkBits(node, node->m_bits, false);
+}
+
+bool Verifier::visit(const OpExtendMSBs *node)
+{
+    return checkBits(node, node->m_bits, false);
+}
+
+bool Verifier::visit(const OpRemoveLSBs *node)
+{
+    return checkBits(node, node->m_bits, true);
+}
+
+bool Verifier::visit(const OpRemoveMSBs *node)
+{
+    return checkBits(node, node->m_bits, true);
+}
+
+bool Verifier::visit(const OpMulAdd *node)
+{
+    if (!checkInput(node->m_a) || !checkInput(node->m_b))
+    {
+        return false;
+    }
+
+    if (node->m_preMode != OpMulAdd::ADD_NONE)
+    {
+        if (!checkInput(node->m_d) || !define(node->m_pre))
+        {
+            return false;
+        }
+    }
+
+    if (!define(node->m_prod))
+    {
+        return false;
+    }
+
+    // without a post-adder, the product is the result
+    if (node->m_postMode == OpMulAdd::ADD_NONE)
+    {
+        return true;
+    }
+
+    if (!checkInput(node->m_c) || !define(node->m_lhs))
+    {
+        return false;
+    }
+
+    SharedOpPtr args[2] = {node->m_prod, node->m_c};
+    for(uint32_t i=0; i<2; i++)
+    {
+        if ((args[i]->m_intBits > node->m_lhs->m_intBits) || (args[i]->m_fracBits > node->m_lhs->m_fracBits))
+        {
+            return fail(args[i]->m_identName + " does not fit the post-adder result");
+        }
+    }
+    return true;
+}
+
+bool Verifier::visit(const OpPatchBlock *node)
+{
+    (void)node;
+    return fail("patch block left in the program");
+}
+
+bool Verifier::visit(const OperationSingle *node)
+{
+    (void)node;
+    return fail("unsupported instruction");
+}
+
+bool Verifier::visit(const OperationDual *node)
+{
+    (void)node;
+    return fail("unsupported instruction");
+}
@@ -9,13 +9,98 @@
 #include "logging.h"
 #include <algorithm>
 #include "ssaevaluator.h"
+#include "pass_partition.h"
+#include "pass_pipeline.h"
 #include "vhdlcodegen.h"
 
 using namespace SSA;
 
-VHDLCodeGen::VHDLCodeGen(std::ostream &os, Program &ssa, bool genTestbench) :
-    m_os(os), m_ssa(&ssa), m_indent(0), m_genTestbench(genTestbench)
+VHDLCodeGen::VHDLCodeGen(std::ostream &os, Program &ssa, bool genTestbench, const Scheduler *schedule) :
+    m_os(os), m_ssa(&ssa), m_indent(0), m_genTestbench(genTestbench), m_latency(0), m_savedBits(0),
+    m_schedule(schedule)
 {
+    for(auto statement : ssa.m_statements)
+    {
+        OpRegister *reg = dynamic_cast<OpRegister*>(statement);
+        if (reg != NULL)
+        {
+            m_registers.insert(reg->m_lhs.get());
+        }
+
+        // the pipeline registers inside a DSP slice
+        OpMulAdd *mulAdd = dynamic_cast<OpMulAdd*>(statement);
+        if (mulAdd != NULL)
+        {
+            if (mulAdd->isPreRegistered())
+            {
+                m_registers.insert(mulAdd->m_pre.get());
+            }
+            if (mulAdd->isProdRegistered())
+            {
+                m_registers.insert(mulAdd->m_prod.get());
+            }
+            if (mulAdd->isLHSRegistered())
+            {
+                m_registers.insert(mulAdd->m_lhs.get());
+            }
+        }
+    }
+    m_latency = PassPipeline::calcLatency(ssa);
+    m_knownBits.analyse(ssa);
+
+    if (m_schedule != NULL)
+    {
+        // the results of the shared operators are held in
+        // registers until the end of the sample period. the
+        // results of the last step go to the outputs directly.
+        // the outputs are registers that are loaded in the
+        // last step, so they are all valid at the same time.
+        uint32_t lastStep = m_schedule->getSteps() - 1;
+        for(auto statement : ssa.m_statements)
+        {
+            const Scheduler::slot_t *slot = m_schedule->getSlot(statement);
+            if (slot != NULL)
+            {
+                const OperationDual *node = dynamic_cast<const OperationDual*>(statement);
+                std::vector<unit_t> &units = m_units[slot->resource];
+                if (units.size() <= slot->unit)
+                {
+                    unit_t unit = {0, 0, 0};
+                    units.resize(slot->unit+1, unit);
+                }
+
+                // a multiplier has the width of its widest
+                // operands, an adder that of its widest result.
+                unit_t &unit = units[slot->unit];
+                if (slot->resource == Scheduler::RES_MULTIPLIER)
+                {
+                    unit.aBits = std::max(unit.aBits, node->m_op1->m_intBits + node->m_op1->m_fracBits);
+                    unit.bBits = std::max(unit.bBits, node->m_op2->m_intBits + node->m_op2->m_fracBits);
+                    unit.yBits = unit.aBits + unit.bBits;
+                }
+                else
+                {
+                    unit.yBits = std::max(unit.yBits, node->m_lhs->m_intBits + node->m_lhs->m_fracBits);
+                    unit.aBits = unit.yBits;
+                    unit.bBits = unit.yBits;
+                }
+
+                if (slot->step < lastStep)
+                {
+                    m_registers.insert(node->m_lhs.get());
+                    m_registerSteps[node->m_lhs.get()] = slot->step;
+                }
+            }
+
+            SharedOpPtr lhs = statement->getLHS();
+            if (lhs && (dynamic_cast<OutputOperand*>(lhs.get()) != NULL))
+            {
+                m_registers.insert(lhs.get());
+                m_registerSteps[lhs.get()] = lastStep;
+            }
+        }
+        m_latency = m_schedule->getSteps();
+    }
 
 }
 
@@ -34,6 +119,25 @@ bool VHDLCodeGen::execute()
         genTestbenchHeader();
     }
 
+    if (!genBody())
+    {
+        return false;
+    }
+
+    doLog(LOG_INFO, "Removed %d bits from carry chains\n", m_savedBits);
+
+    m_os << m_epilog;
+
+    if (m_genTestbench)
+    {
+        genTestbenchFooter();
+    }
+
+    return true;
+}
+
+bool VHDLCodeGen::genBody()
+{
     genProcessHeader(m_indent);
 
     m_indent += 2;
@@ -46,34 +150,193 @@ bool VHDLCodeGen::execute()
     genIndent(m_indent);
     m_os << "end process;\n";
 
-    m_os << m_epilog;
-
-    if (m_genTestbench)
+    if (m_schedule != NULL)
     {
-        genTestbenchFooter();
+        genFoldOperators(m_indent);
     }
 
+    if (m_registers.size() != 0)
+    {
+        genRegisterProcess(m_indent);
+    }
     return true;
 }
 
-void VHDLCodeGen::genIndent(uint32_t indent)
+bool VHDLCodeGen::generateHierarchy(std::ostream &os, Program &ssa, const std::string &name, bool genTestbench)
 {
-    for(uint32_t i=0; i<indent; i++)
+    doLog(LOG_INFO, "------------------------------------\n");
+    doLog(LOG_INFO, "  Running VHDLCodeGen (hierarchical)\n");
+    doLog(LOG_INFO, "------------------------------------\n");
+
+    // each cluster of output cones becomes an entity,
+    // the top level connects them to its ports.
+    std::stringstream instances;
+    uint32_t savedBits = 0;
+    bool ok = PassPartition::forEachCluster(ssa, [&](uint32_t index, Program &cluster)
     {
-        m_os << " ";
+        std::stringstream ss;
+        ss << name << "_cone" << index;
+
+        VHDLCodeGen generator(os, cluster, false, NULL);
+        generator.m_entityName = ss.str();
+        generator.m_indent = 2;
+        generator.genEntityHeader(true);
+        if (!generator.genBody())
+        {
+            return false;
+        }
+        os << "end rtl;\n\n";
+
+        ss.str("");
+        ss << "cone" << index;
+        generator.genInstance(instances, ss.str());
+        savedBits += generator.m_savedBits;
+        doLog(LOG_INFO, "Entity %s_cone%d: %d instructions\n", name.c_str(), index,
+              static_cast<uint32_t>(cluster.m_statements.size()));
+        return true;
+    });
+
+    if (!ok)
+    {
+        return false;
+    }
+    doLog(LOG_INFO, "Removed %d bits from carry chains\n", savedBits);
+
+    VHDLCodeGen top(os, ssa, genTestbench, NULL);
+    top.m_entityName = name;
+    top.m_indent = 2;
+    top.genEntityHeader(false);
+    os << instances.str();
+    os << "end rtl;\n\n";
+
+    if (genTestbench)
+    {
+        top.genTestbenchHeader();
+        top.genInstance(os, "dut");
+        top.genTestbenchFooter();
     }
+    return true;
 }
 
-void VHDLCodeGen::genProcessHeader(uint32_t indent)
+void VHDLCodeGen::genEntityHeader(bool declareRegisters)
 {
     //
-    // <input signal documentation>
-    // <output signal documentation>
-    // proc_comb: process( <sensitivity list )
-    //   <variable list>
+    // entity <name> is
+    //   port(
+    //     <clock and reset>
+    //     <inputs and outputs>
+    //   );
+    // end <name>;
+    //
+    // architecture rtl of <name> is
+    //   <register signals>
     // begin
     //
 
+    // the declaration and the comment of each port
+    std::vector<std::pair<std::string, std::string> > ports;
+    if (m_registers.size() != 0)
+    {
+        ports.push_back(std::make_pair("clk : in std_logic", ""));
+        ports.push_back(std::make_pair("rst : in std_logic", "  -- asynchronous, active high"));
+    }
+
+    for(auto operand : m_ssa->m_operands)
+    {
+        const char *mode = NULL;
+        if (dynamic_cast<InputOperand*>(operand.get()) != NULL)
+        {
+            mode = " : in ";
+        }
+        else if (dynamic_cast<OutputOperand*>(operand.get()) != NULL)
+        {
+            mode = " : out ";
+        }
+
+        if (mode != NULL)
+        {
+            std::stringstream decl;
+            decl << operand->m_identName << mode;
+            decl << "SIGNED(" << operand->m_intBits + operand->m_fracBits-1 << " downto 0)";
+            std::stringstream comment;
+            comment << "  -- Q(" << operand->m_intBits << "," << operand->m_fracBits << ")";
+            ports.push_back(std::make_pair(decl.str(), comment.str()));
+        }
+    }
+
+    m_os << "library ieee;\n";
+    m_os << "use ieee.std_logic_1164.all;\n";
+    m_os << "use ieee.numeric_std.all;\n\n";
+    m_os << "entity " << m_entityName << " is\n";
+    m_os << "  port(\n";
+    for(size_t i=0; i<ports.size(); i++)
+    {
+        m_os << "    " << ports[i].first;
+        if (i+1 < ports.size())
+        {
+            m_os << ";";
+        }
+        m_os << ports[i].second << "\n";
+    }
+    m_os << "  );\n";
+    m_os << "end " << m_entityName << ";\n\n";
+
+    m_os << "architecture rtl of " << m_entityName << " is\n";
+    for(auto operand : m_ssa->m_operands)
+    {
+        if (declareRegisters && (m_registers.count(operand.get()) != 0))
+        {
+            // an output is the register itself
+            genIndent(m_indent);
+            m_os << "signal ";
+            if (dynamic_cast<OutputOperand*>(operand.get()) == NULL)
+            {
+                m_os << operand->m_identName.c_str() << ", ";
+            }
+            m_os << operand->m_identName.c_str() << "_d";
+            m_os << " : SIGNED(" << operand->m_intBits + operand->m_fracBits-1 << " downto 0);  --";
+            m_os << " Q(" << operand->m_intBits << "," << operand->m_fracBits << ");\n";
+        }
+    }
+    m_os << "begin\n";
+}
+
+void VHDLCodeGen::genInstance(std::ostream &os, const std::string &label) const
+{
+    os << "\n  " << label << ": entity work." << m_entityName << "\n";
+    os << "    port map(";
+
+    bool isFirst = true;
+    if (m_registers.size() != 0)
+    {
+        os << "clk => clk, rst => rst";
+        isFirst = false;
+    }
+
+    for(auto operand : m_ssa->m_operands)
+    {
+        if ((dynamic_cast<InputOperand*>(operand.get()) != NULL) ||
+            (dynamic_cast<OutputOperand*>(operand.get()) != NULL))
+        {
+            if (!isFirst)
+                os << ", ";
+            os << operand->m_identName << " => " << operand->m_identName;
+            isFirst = false;
+        }
+    }
+    os << ");\n";
+}
+
+void VHDLCodeGen::genIndent(uint32_t indent)
+{
+    for(uint32_t i=0; i<indent; i++)
+    {
+        m_os << " ";
+    }
+}
+
+void VHDLCodeGen::genSignalDocs()
+{
     // generate documentation for output signals
     m_os << "  -- *** OUTPUT SIGNALS ***\n";
 
@@ -104,6 +367,61 @@ void VHDLCodeGen::genProcessHeader(uint32_t indent)
         }
     }
 
+    // generate documentation for register signals
+    if (m_registers.size() != 0)
+    {
+        m_os << "\n";
+        m_os << "  -- *** CLOCK AND RESET ***\n";
+        genIndent(m_indent);
+        m_os << "-- signal clk : std_logic;\n";
+        genIndent(m_indent);
+        m_os << "-- signal rst : std_logic;  -- asynchronous, active high\n";
+
+        if (m_schedule != NULL)
+        {
+            m_os << "\n";
+            m_os << "  -- *** SEQUENCER AND SHARED OPERATORS ***\n";
+            genFoldSignals("-- signal ");
+        }
+
+        m_os << "\n";
+        m_os << "  -- *** REGISTER SIGNALS ***\n";
+        for(auto operand : m_ssa->m_operands)
+        {
+            if (m_registers.count(operand.get()) != 0)
+            {
+                // an output is the register itself
+                genIndent(m_indent);
+                m_os << "-- signal ";
+                if (dynamic_cast<OutputOperand*>(operand.get()) == NULL)
+                {
+                    m_os << operand->m_identName.c_str() << ", ";
+                }
+                m_os << operand->m_identName.c_str() << "_d";
+                m_os << " : SIGNED(" << operand->m_intBits + operand->m_fracBits-1 << " downto 0);  --";
+                m_os << " Q(" << operand->m_intBits << "," << operand->m_fracBits << ");\n";
+            }
+        }
+    }
+}
+
+void VHDLCodeGen::genProcessHeader(uint32_t indent)
+{
+    //
+    // <input signal documentation>
+    // <output signal documentation>
+    // proc_comb: process( <sensitivity list )
+    //   <variable list>
+    // begin
+    //
+
+    // the signals of an entity are declared by
+    // its ports and architecture.
+    if (m_entityName.empty())
+    {
+        genSignalDocs();
+    }
+
     // generate process header with sensitivity list
     m_os << "\n";
     m_os << "  -------------------\n";
@@ -116,23 +434,40 @@ void VHDLCodeGen::genProcessHeader(uint32_t indent)
     bool isFirst = true;
     for(auto operand : m_ssa->m_operands)
     {
+        // the output registers of a folded
+        // program are not read by the process.
         InputOperand *op = dynamic_cast<InputOperand*>(operand.get());
-        if (op != NULL)
+        bool isOutput = (dynamic_cast<OutputOperand*>(operand.get()) != NULL);
+        if ((op != NULL) || ((m_registers.count(operand.get()) != 0) && !isOutput))
         {
             if (!isFirst)
                 m_os << ",";
-            m_os << op->m_identName.c_str();
+            m_os << operand->m_identName.c_str();
             isFirst = false;
         }
     }
+
+    if (m_schedule != NULL)
+    {
+        m_os << ",fold_step";
+        for(uint32_t r=0; r<Scheduler::RES_COUNT; r++)
+        {
+            Scheduler::resource_t resource = static_cast<Scheduler::resource_t>(r);
+            for(uint32_t i=0; i<m_units[r].size(); i++)
+            {
+                m_os << "," << getUnitName(resource, i, "y");
+            }
+        }
+    }
     m_os << ")\n"; // terminate process header
     m_indent+=2;
 
     // write the variable list
     for(auto operand : m_ssa->m_operands)
     {
+        // register outputs are signals
         IntermediateOperand *op = dynamic_cast<IntermediateOperand*>(operand.get());
-        if (op != NULL)
+        if ((op != NULL) && (m_registers.count(op) == 0))
         {
             genIndent(m_indent);
             m_os << "variable " << op->m_identName.c_str();
@@ -146,9 +481,122 @@ void VHDLCodeGen::genProcessHeader(uint32_t indent)
             //doLog(LOG_INFO, "Skipping variable %s\n", operand->m_identName.c_str());
         }
     }
+
+    // the full-width products of the DSP slices
+    for(auto statement : m_ssa->m_statements)
+    {
+        OpMulAdd *mulAdd = dynamic_cast<OpMulAdd*>(statement);
+        if (mulAdd != NULL)
+        {
+            SharedOpPtr op1 = mulAdd->getMulInput();
+            int32_t bits = op1->m_intBits + op1->m_fracBits + mulAdd->m_b->m_intBits + mulAdd->m_b->m_fracBits;
+            genIndent(m_indent);
+            m_os << "variable " << mulAdd->m_prod->m_identName.c_str() << "_full";
+            m_os << " : SIGNED(" << bits-1 << " downto 0);\n";
+        }
+    }
     m_indent-=2;
     genIndent(m_indent);
     m_os << "begin\n";
+
+    // the shared operators are idle unless
+    // an operation is selected.
+    if (m_schedule != NULL)
+    {
+        for(uint32_t r=0; r<Scheduler::RES_COUNT; r++)
+        {
+            Scheduler::resource_t resource = static_cast<Scheduler::resource_t>(r);
+            for(uint32_t i=0; i<m_units[r].size(); i++)
+            {
+                genIndent(m_indent+2);
+                m_os << getUnitName(resource, i, "a") << " <= (others => '0');\n";
+                genIndent(m_indent+2);
+                m_os << getUnitName(resource, i, "b") << " <= (others => '0');\n";
+                if (resource == Scheduler::RES_ADDER)
+                {
+                    genIndent(m_indent+2);
+                    m_os << getUnitName(resource, i, "sub") << " <= '0';\n";
+                }
+            }
+        }
+    }
+}
+
+void VHDLCodeGen::genRegisterProcess(uint32_t indent)
+{
+    //
+    // proc_reg: process(clk, rst)
+    // begin
+    //   if (rst = '1') then
+    //     <register> <= (others => '0');
+    //   elsif rising_edge(clk) then
+    //     <register> <= <register>_d;
+    //   end if;
+    // end process;
+    //
+
+    m_os << "\n";
+    genIndent(indent);
+    m_os << "proc_reg: process(clk, rst)\n";
+    genIndent(indent);
+    m_os << "begin\n";
+    genIndent(indent+2);
+    m_os << "if (rst = '1') then\n";
+    if (m_schedule != NULL)
+    {
+        genIndent(indent+4);
+        m_os << "fold_step <= 0;\n";
+    }
+    for(auto operand : m_ssa->m_operands)
+    {
+        if (m_registers.count(operand.get()) != 0)
+        {
+            genIndent(indent+4);
+            m_os << operand->m_identName.c_str() << " <= (others => '0');\n";
+        }
+    }
+    genIndent(indent+2);
+    m_os << "elsif rising_edge(clk) then\n";
+    if (m_schedule != NULL)
+    {
+        genIndent(indent+4);
+        m_os << "if (fold_step = " << m_schedule->getSteps()-1 << ") then\n";
+        genIndent(indent+6);
+        m_os << "fold_step <= 0;\n";
+        genIndent(indent+4);
+        m_os << "else\n";
+        genIndent(indent+6);
+        m_os << "fold_step <= fold_step + 1;\n";
+        genIndent(indent+4);
+        m_os << "end if;\n";
+    }
+    for(auto operand : m_ssa->m_operands)
+    {
+        if (m_registers.count(operand.get()) != 0)
+        {
+            // the registers of a folded program are
+            // only loaded in their control step.
+            uint32_t extraIndent = 0;
+            auto step = m_registerSteps.find(operand.get());
+            if (step != m_registerSteps.end())
+            {
+                genIndent(indent+4);
+                m_os << "if (fold_step = " << step->second << ") then\n";
+                extraIndent = 2;
+            }
+            genIndent(indent+4+extraIndent);
+            m_os << operand->m_identName.c_str() << " <= " << operand->m_identName.c_str() << "_d;\n";
+            if (step != m_registerSteps.end())
+            {
+                genIndent(indent+4);
+                m_os << "end if;\n";
+            }
+        }
+    }
+    genIndent(indent+2);
+    m_os << "end if;\n";
+    genIndent(indent);
+    m_os << "end process;\n";
 }
 
 void VHDLCodeGen::genTestbenchHeader()
@@ -187,8 +635,41 @@ void VHDLCodeGen::genTestbenchHeader()
             m_os << " Q(" << outOp->m_intBits << "," << outOp->m_fracBits << ");\n";
         }
     }
+
+    // generate clock, reset and register signals
+    if (m_registers.size() != 0)
+    {
+        m_os << "  signal clk : std_logic := '0';\n";
+        m_os << "  signal rst : std_logic := '1';\n";
+        if (m_schedule != NULL)
+        {
+            genFoldSignals("  signal ");
+        }
+        for(auto operand : m_ssa->m_operands)
+        {
+            // the registers of a hierarchy are
+            // declared by its entities.
+            if ((m_registers.count(operand.get()) != 0) && m_entityName.empty())
+            {
+                genIndent(m_indent);
+                m_os << "  signal ";
+                if (dynamic_cast<OutputOperand*>(operand.get()) == NULL)
+                {
+                    m_os << operand->m_identName.c_str() << ", ";
+                }
+                m_os << operand->m_identName.c_str() << "_d";
+                m_os << " : SIGNED(" << operand->m_intBits + operand->m_fracBits-1 << " downto 0);  --";
+                m_os << " Q(" << operand->m_intBits << "," << operand->m_fracBits << ");\n";
+            }
+        }
+    }
     m_os << "\n\n";
     m_os << "begin\n\n";
+
+    if (m_registers.size() != 0)
+    {
+        m_os << "  clk <= not clk after 5 ns when sim_done = '0' else '0';\n\n";
+    }
 }
 
 void VHDLCodeGen::genTestbenchFooter()
@@ -223,6 +704,17 @@ void VHDLCodeGen::genTestbenchFooter()
     }
     m_os << "    wait for 1 ns;\n";
 
+    // release the reset and wait until the
+    // inputs have reached the outputs.
+    if (m_registers.size() != 0)
+    {
+        m_os << "    rst <= '0';\n";
+        m_os << "    for i in 1 to " << m_latency << " loop\n";
+        m_os << "      wait until rising_edge(clk);\n";
+        m_os << "    end loop;\n";
+        m_os << "    wait for 1 ns;\n";
+    }
+
     // check values for all outputs!
     for(auto operand : m_ssa->m_operands)
     {
@@ -245,6 +737,10 @@ void VHDLCodeGen::genTestbenchFooter()
         }
     }
 
+    if (m_registers.size() != 0)
+    {
+        m_os << "    sim_done <= '1';\n";
+    }
     m_os << "    wait;\n";
     m_os << "  end process proc_stim;\n";
     m_os << "end behavioral;\n";
@@ -276,7 +772,12 @@ bool VHDLCodeGen::visit(const OpAssign *node)
 {
     genIndent(m_indent);
     OutputOperand *outOp = dynamic_cast<OutputOperand*>(node->m_lhs.get());
-    if (outOp != NULL)
+    if ((outOp != NULL) && (m_registers.count(outOp) != 0))
+    {
+        // output register of a folded program
+        m_os << node->m_lhs->m_identName.c_str() << "_d <= " << node->m_op->m_identName.c_str() << ";\n";
+    }
+    else if (outOp != NULL)
     {
         // signal, so use <=
         m_os << node->m_lhs->m_identName.c_str() << " <= " << node->m_op->m_identName.c_str() << ";\n";
@@ -298,6 +799,13 @@ bool VHDLCodeGen::visit(const OpNegate *node)
 
 bool VHDLCodeGen::visit(const OpMul *node)
 {
+    const Scheduler::slot_t *slot = (m_schedule != NULL) ? m_schedule->getSlot(node) : NULL;
+    if (slot != NULL)
+    {
+        genFoldOperation(node, slot, "'0'");
+        return true;
+    }
+
     genIndent(m_indent);
     m_os << node->m_lhs->m_identName.c_str() << " := " << node->m_op1->m_identName.c_str() << " * " << node->m_op2->m_identName.c_str() << ";\n";
     return true;
@@ -314,9 +822,14 @@ bool VHDLCodeGen::visit(const OpAdd *node)
         //FIXME: better error reporting.
         return false;
     }
-    genIndent(m_indent);
-    m_os << node->m_lhs->m_identName.c_str() << " := " << node->m_op1->m_identName.c_str() << " + " << node->m_op2->m_identName.c_str() << ";\n";
-    return true;
+
+    const Scheduler::slot_t *slot = (m_schedule != NULL) ? m_schedule->getSlot(node) : NULL;
+    if (slot != NULL)
+    {
+        genFoldOperation(node, slot, "'0'");
+        return true;
+    }
+    return genAddSub(node, true);
 }
 
 bool VHDLCodeGen::visit(const OpSub *node)
@@ -330,8 +843,181 @@ bool VHDLCodeGen::visit(const OpSub *node)
         //FIXME: better error reporting.
         return false;
     }
+
+    const Scheduler::slot_t *slot = (m_schedule != NULL) ? m_schedule->getSlot(node) : NULL;
+    if (slot != NULL)
+    {
+        genFoldOperation(node, slot, "'1'");
+        return true;
+    }
+    return genAddSub(node, false);
+}
+
+std::string VHDLCodeGen::getUnitName(Scheduler::resource_t resource, uint32_t unit, const char *suffix) const
+{
+    std::stringstream ss;
+    ss << ((resource == Scheduler::RES_MULTIPLIER) ? "fold_mul" : "fold_add") << unit << "_" << suffix;
+    return ss.str();
+}
+
+void VHDLCodeGen::genFoldSignals(const char *prefix)
+{
+    genIndent(m_indent);
+    m_os << prefix << "fold_step : integer range 0 to " << m_schedule->getSteps()-1 << ";";
+    m_os << "  -- control step, a new sample every " << m_schedule->getSteps() << " cycles\n";
+    for(uint32_t r=0; r<Scheduler::RES_COUNT; r++)
+    {
+        Scheduler::resource_t resource = static_cast<Scheduler::resource_t>(r);
+        for(uint32_t i=0; i<m_units[r].size(); i++)
+        {
+            const unit_t &unit = m_units[r][i];
+            genIndent(m_indent);
+            m_os << prefix << getUnitName(resource, i, "a") << " : SIGNED(" << unit.aBits-1 << " downto 0);\n";
+            genIndent(m_indent);
+            m_os << prefix << getUnitName(resource, i, "b") << " : SIGNED(" << unit.bBits-1 << " downto 0);\n";
+            genIndent(m_indent);
+            m_os << prefix << getUnitName(resource, i, "y") << " : SIGNED(" << unit.yBits-1 << " downto 0);\n";
+            if (resource == Scheduler::RES_ADDER)
+            {
+                genIndent(m_indent);
+                m_os << prefix << getUnitName(resource, i, "sub") << " : std_logic;\n";
+            }
+        }
+    }
+}
+
+void VHDLCodeGen::genFoldOperators(uint32_t indent)
+{
+    m_os << "\n";
+    for(uint32_t r=0; r<Scheduler::RES_COUNT; r++)
+    {
+        Scheduler::resource_t resource = static_cast<Scheduler::resource_t>(r);
+        for(uint32_t i=0; i<m_units[r].size(); i++)
+        {
+            std::string a = getUnitName(resource, i, "a");
+            std::string b = getUnitName(resource, i, "b");
+            genIndent(indent);
+            m_os << getUnitName(resource, i, "y") << " <= ";
+            if (resource == Scheduler::RES_MULTIPLIER)
+            {
+                m_os << a << " * " << b << ";\n";
+            }
+            else
+            {
+                m_os << a << " - " << b << " when " << getUnitName(resource, i, "sub") << " = '1' else ";
+                m_os << a << " + " << b << ";\n";
+            }
+        }
+    }
+}
+
+void VHDLCodeGen::genFoldOperation(const OperationDual *node, const Scheduler::slot_t *slot, const char *subtract)
+{
+    const unit_t &unit = m_units[slot->resource][slot->unit];
+
+    genIndent(m_indent);
+    m_os << "if (fold_step = " << slot->step << ") then\n";
+    genIndent(m_indent+2);
+    m_os << getUnitName(slot->resource, slot->unit, "a") << " <= resize(" << node->m_op1->m_identName << "," << unit.aBits << ");\n";
+    genIndent(m_indent+2);
+    m_os << getUnitName(slot->resource, slot->unit, "b") << " <= resize(" << node->m_op2->m_identName << "," << unit.bBits << ");\n";
+    if (slot->resource == Scheduler::RES_ADDER)
+    {
+        genIndent(m_indent+2);
+        m_os << getUnitName(slot->resource, slot->unit, "sub") << " <= " << subtract << ";\n";
+    }
+    genIndent(m_indent);
+    m_os << "end if;\n";
+
+    // the result wraps around like the operator it
+    // replaces, so the MSBs are removed, not resized.
+    const SharedOpPtr &lhs = node->m_lhs;
+    genIndent(m_indent);
+    if (m_registers.count(lhs.get()) != 0)
+    {
+        m_os << lhs->m_identName << "_d <= ";
+    }
+    else
+    {
+        m_os << lhs->m_identName << " := ";
+    }
+    m_os << getUnitName(slot->resource, slot->unit, "y") << "(" << lhs->m_intBits + lhs->m_fracBits - 1 << " downto 0);";
+    m_os << " -- step " << slot->step << "\n";
+}
+
+std::string VHDLCodeGen::genSlice(const SharedOpPtr &op, int32_t hi, int32_t lo)
+{
+    // a slice above the MSB of the operand
+    // is made by sign extension.
+    int32_t msb = op->m_intBits + op->m_fracBits - 1;
+    std::stringstream ss;
+    if (hi <= msb)
+    {
+        ss << op->m_identName << "(" << hi << " downto " << lo << ")";
+    }
+    else
+    {
+        ss << "resize(" << op->m_identName << "(" << msb << " downto " << lo << "), " << hi-lo+1 << ")";
+    }
+    return ss.str();
+}
+
+bool VHDLCodeGen::genAddSub(const OperationDual *node, bool isAdd)
+{
+    const SharedOpPtr &lhs = node->m_lhs;
+    const SharedOpPtr &op1 = node->m_op1;
+    const SharedOpPtr &op2 = node->m_op2;
+    const char *opStr = isAdd ? " + " : " - ";
+
     genIndent(m_indent);
-    m_os << node->m_lhs->m_identName.c_str() << " := " << node->m_op1->m_identName.c_str() << " - " << node->m_op2->m_identName.c_str() << ";\n";
+    m_os << lhs->m_identName.c_str() << " := ";
+
+    // the bits can only be matched up when the binary points
+    // line up. a narrower operand is sign extended by VHDL.
+    int32_t bits  = lhs->m_intBits + lhs->m_fracBits;
+    int32_t bits1 = op1->m_intBits + op1->m_fracBits;
+    int32_t bits2 = op2->m_intBits + op2->m_fracBits;
+    if ((op1->m_fracBits != lhs->m_fracBits) || (op2->m_fracBits != lhs->m_fracBits) ||
+        (bits1 > bits) || (bits2 > bits))
+    {
+        m_os << op1->m_identName.c_str() << opStr << op2->m_identName.c_str() << ";\n";
+        return true;
+    }
+
+    // below the known-zero LSBs of one operand, the
+    // result is equal to the other operand. for a
+    // subtraction, this only holds for the subtrahend.
+    int32_t zero1 = m_knownBits.getZeroLSBs(op1);
+    int32_t zero2 = m_knownBits.getZeroLSBs(op2);
+    int32_t lsbs  = isAdd ? std::max(zero1, zero2) : zero2;
+    const SharedOpPtr &lsbSource = ((zero2 >= zero1) || !isAdd) ? op1 : op2;
+
+    // the sum of two operands with s redundant sign bits
+    // has at least s-1 of them.
+    int32_t sign1 = m_knownBits.getSignBits(op1) + bits - bits1;
+    int32_t sign2 = m_knownBits.getSignBits(op2) + bits - bits2;
+    int32_t msbs  = std::min(sign1, sign2) - 1;
+    lsbs = std::max(0, std::min(lsbs, std::min(bits1, bits2) - 1));
+    msbs = std::max(0, std::min(msbs, bits-1-lsbs));
+
+    if ((lsbs == 0) && (msbs == 0))
+    {
+        m_os << op1->m_identName.c_str() << opStr << op2->m_identName.c_str() << ";\n";
+        return true;
+    }
+
+    int32_t hi = bits - 1 - msbs;
+    std::stringstream expr;
+    expr << "(" << genSlice(op1, hi, lsbs) << opStr << genSlice(op2, hi, lsbs) << ")";
+    if (lsbs > 0)
+    {
+        expr << " & " << lsbSource->m_identName << "(" << lsbs-1 << " downto 0)";
+    }
+
+    m_os << "resize(" << expr.str() << ", " << bits << ");";
+    m_os << " -- carry chain over bits " << hi << " downto " << lsbs << "\n";
+
+    m_savedBits += lsbs + msbs;
     return true;
 }
 
@@ -395,3 +1081,132 @@ bool VHDLCodeGen::visit(const OpReinterpret *node)
     return true;
 }
 
+/** get the arguments of a 3:2 compressor as VHDL expressions */
+static void getCompressorArgs(const OperationCompressor *node, std::string args[3])
+{
+    SharedOpPtr ops[3] = {node->m_op1, node->m_op2, node->m_op3};
+    for(uint32_t i=0; i<3; i++)
+    {
+        args[i] = ops[i]->m_identName;
+        if (node->isInverted(i))
+        {
+            args[i] = "(not " + args[i] + ")";
+        }
+    }
+}
+
+bool VHDLCodeGen::visit(const OpCSASum *node)
+{
+    std::string args[3];
+    getCompressorArgs(node, args);
+
+    genIndent(m_indent);
+    m_os << node->m_lhs->m_identName.c_str() << " := ";
+    m_os << args[0] << " xor " << args[1] << " xor " << args[2] << ";\n";
+    return true;
+}
+
+bool VHDLCodeGen::visit(const OpCSACarry *node)
+{
+    std::string args[3];
+    getCompressorArgs(node, args);
+
+    genIndent(m_indent);
+    m_os << node->m_lhs->m_identName.c_str() << " := shift_left(";
+    m_os << "(" << args[0] << " and " << args[1] << ") or ";
+    m_os << "(" << args[0] << " and " << args[2] << ") or ";
+    m_os << "(" << args[1] << " and " << args[2] << "), 1);\n";
+    if (node->m_carryIn)
+    {
+        genIndent(m_indent);
+        m_os << node->m_lhs->m_identName.c_str() << "(0) := '1'; -- carry in\n";
+    }
+    return true;
+}
+
+void VHDLCodeGen::genAssignment(const SharedOpPtr &op)
+{
+    genIndent(m_indent);
+    if (m_registers.count(op.get()) != 0)
+    {
+        m_os << op->m_identName.c_str() << "_d <= ";
+    }
+    else if (dynamic_cast<OutputOperand*>(op.get()) != NULL)
+    {
+        m_os << op->m_identName.c_str() << " <= ";
+    }
+    else
+    {
+        m_os << op->m_identName.c_str() << " := ";
+    }
+}
+
+/** get the expression of a pre-adder or post-adder */
+static std::string getAddExpression(OpMulAdd::addmode_t mode, const std::string &x, const std::string &y)
+{
+    switch(mode)
+    {
+    case OpMulAdd::ADD_PLUS:
+        return x + " + " + y;
+    case OpMulAdd::ADD_MINUS:
+        return x + " - " + y;
+    case OpMulAdd::ADD_REVERSE:
+        return y + " - " + x;
+    default:
+        return x;
+    }
+}
+
+bool VHDLCodeGen::visit(const OpMulAdd *node)
+{
+    // the template follows the structure of a DSP slice, so
+    // synthesis maps the adders and registers into it.
+    genIndent(m_indent);
+    m_os << "-- DSP slice with " << node->m_stages << " pipeline registers\n";
+
+    if (node->m_preMode != OpMulAdd::ADD_NONE)
+    {
+        std::stringstream a, d;
+        int32_t bits = node->m_pre->m_intBits + node->m_pre->m_fracBits;
+        a << "resize(" << node->m_a->m_identName << ", " << bits << ")";
+        d << "resize(" << node->m_d->m_identName << ", " << bits << ")";
+        genAssignment(node->m_pre);
+        m_os << getAddExpression(node->m_preMode, a.str(), d.str()) << ";\n";
+    }
+
+    // the product of the multiplier has one more
+    // MSB than the product in fplib.
+    std::string full = node->m_prod->m_identName + "_full";
+    int32_t prodBits = node->m_prod->m_intBits + node->m_prod->m_fracBits;
+    genIndent(m_indent);
+    m_os << full << " := " << node->getMulInput()->m_identName << " * " << node->m_b->m_identName << ";\n";
+    genAssignment(node->m_prod);
+    m_os << full << "(" << prodBits-1 << " downto 0);\n";
+
+    if (node->m_postMode != OpMulAdd::ADD_NONE)
+    {
+        std::stringstream x, y;
+        int32_t bits  = node->m_lhs->m_intBits + node->m_lhs->m_fracBits;
+        int32_t shift = node->m_lhs->m_fracBits - node->m_prod->m_fracBits;
+        if (shift > 0)
+        {
+            x << "shift_left(resize(" << node->m_prod->m_identName << ", " << bits << "), " << shift << ")";
+        }
+        else
+        {
+            x << "resize(" << node->m_prod->m_identName << ", " << bits << ")";
+        }
+        y << "resize(" << node->m_c->m_identName << ", " << bits << ")";
+        genAssignment(node->m_lhs);
+        m_os << getAddExpression(node->m_postMode, x.str(), y.str()) << ";\n";
+    }
+    return true;
+}
+
+bool VHDLCodeGen::visit(const OpRegister *node)
+{
+    // the register itself is in proc_reg
+    genIndent(m_indent);
+    m_os << node->m_lhs->m_identName.c_str() << "_d <= " << node->m_op->m_identName.c_str() << ";\n";
+    return true;
+}
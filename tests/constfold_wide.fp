@@ -0,0 +1,14 @@
+% Wide constant product test
+%
+% k0^4 spans more bits than a folded CSD constant
+% can hold, so ConstFold keeps it as a product of
+% factors and applies them one after the other.
+%
+
+define k0 = csd(-3.975483,6);
+define x = input(1,7);
+define y = input(2,5);
+
+o0 = k0*k0*k0*k0*x;
+o1 = y*(k0*k0*k0*k0) + x;
+o2 = -(k0*k0*k0*k0)*(x*k0);
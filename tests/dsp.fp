@@ -0,0 +1,13 @@
+% DSP mapping test, run with "-D 25x18:2"
+%
+% The addition before the multiplication becomes the
+% pre-adder and the addition after it the post-adder
+% of a DSP slice.
+%
+
+define a = input(1,15);
+define b = input(1,15);
+define c = input(1,15);
+define d = input(2,14);
+
+y = (a + b)*c + d;
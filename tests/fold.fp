@@ -0,0 +1,14 @@
+% Folding test, run with "-f 4"
+%
+% Four products share the multipliers of a
+% folded program that takes a sample every
+% four clock cycles.
+%
+
+define a = input(1,7);
+define b = input(1,7);
+define c = input(2,6);
+define d = input(2,6);
+
+y = a*b + c*d;
+z = a*c - b*d;
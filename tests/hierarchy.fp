@@ -0,0 +1,13 @@
+% Hierarchy test, run with "-j 2 -H top"
+%
+% The outputs only share inputs, so each output
+% cone becomes an entity of its own.
+%
+
+define a = input(1,7);
+define b = input(1,7);
+define c = input(1,7);
+define k = csd(0.375,2);
+
+y = a + b;
+z = k*c - a;
@@ -0,0 +1,13 @@
+% Known-bits test
+%
+% The products by 4 and 8 have LSBs that are known
+% to be zero, so their adders do not need a carry
+% chain for those bits.
+%
+
+define a = input(1,7);
+define b = input(1,7);
+define c = input(1,11);
+
+y = 4*a + 8*b;
+z = 4*a + c;
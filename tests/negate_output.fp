@@ -0,0 +1,14 @@
+% Negated output test
+%
+% The Negate pass moves negations past format changes.
+% An output is only written by an assignment, so the
+% negation of an output stays in an intermediate.
+%
+
+define a = input(1,7);
+define b = input(2,5);
+define c = csd(0.75,2);
+
+p = -(a+b);
+q = -(c*a);
+r = -(-(a - b));
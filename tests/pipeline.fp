@@ -0,0 +1,12 @@
+% Pipelining test, run with "-p 2"
+%
+% A chain of additions and constant products
+% gets a register after every two operations.
+%
+
+define a = input(1,15);
+define b = input(1,15);
+define c = input(1,15);
+define k = csd(0.8125,4);
+
+y = k*(a + b) + k*(b - c) + a*c;
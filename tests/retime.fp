@@ -0,0 +1,14 @@
+% Retiming test, run with "-p 2 -R"
+%
+% The product is followed by the wide adders of a
+% CSD multiplication, so the registers inserted by
+% "-p" are moved to shorten the critical path.
+%
+
+define a = input(3,10);
+define b = input(1,7);
+define c = input(3,11);
+define k = csd(3.91777,4);
+
+y = k*(a*b);
+z = c + c + c;